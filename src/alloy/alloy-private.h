@@ -19,6 +19,16 @@ DECLARE_bool(debug);
 DECLARE_bool(always_disasm);
 
 DECLARE_bool(validate_hir);
+DECLARE_bool(dump_pass_stats);
+DECLARE_bool(compact_hir);
+
+DECLARE_bool(ivm_superinstructions);
+
+DECLARE_bool(profile_inline_caches);
+
+DECLARE_bool(perf_map);
+
+DECLARE_bool(invalidate_modified_code);
 
 DECLARE_uint64(break_on_instruction);
 DECLARE_uint64(break_on_memory);
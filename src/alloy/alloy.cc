@@ -26,6 +26,24 @@ DEFINE_bool(always_disasm, false,
 
 DEFINE_bool(validate_hir, false,
     "Perform validation checks on the HIR during compilation.");
+DEFINE_bool(dump_pass_stats, false,
+    "Track per-pass HIR instruction deltas and dump compiler pass stats "
+    "on shutdown.");
+DEFINE_bool(compact_hir, true,
+    "Compact the HIR into dense per-block storage between pass groups.");
+
+DEFINE_bool(ivm_superinstructions, true,
+    "Fuse common IntCode sequences into superinstructions.");
+
+DEFINE_bool(profile_inline_caches, false,
+    "Count inline cache hits and misses for the debugger.");
+
+DEFINE_bool(perf_map, false,
+    "Write /tmp/perf-<pid>.map so perf can symbolize generated x64 code.");
+
+DEFINE_bool(invalidate_modified_code, false,
+    "Write-protect translated guest code and retranslate functions when the "
+    "guest modifies it.");
 
 // Breakpoints:
 DEFINE_uint64(break_on_instruction, 0,
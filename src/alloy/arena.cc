@@ -9,6 +9,8 @@
 
 #include <alloy/arena.h>
 
+#include <algorithm>
+
 using namespace alloy;
 
 
@@ -38,33 +40,63 @@ void Arena::Reset() {
 void Arena::DebugFill() {
   auto chunk = head_chunk_;
   while (chunk) {
-    memset(chunk->buffer, 0xCD, chunk->capacity);
+    if (chunk->buffer) {
+      memset(chunk->buffer, 0xCD, chunk->capacity);
+    }
     chunk = chunk->next;
   }
 }
 
-void* Arena::Alloc(size_t size) {
-  if (active_chunk_) {
-    if (active_chunk_->capacity - active_chunk_->offset < size + 4096) {
-      Chunk* next = active_chunk_->next;
-      if (!next) {
-        XEASSERT(size < chunk_size_); // need to support larger chunks
-        next = new Chunk(chunk_size_);
-        active_chunk_->next = next;
-      }
-      next->offset = 0;
-      active_chunk_ = next;
-    }
-  } else {
-    head_chunk_ = active_chunk_ = new Chunk(chunk_size_);
+void* Arena::Alloc(size_t size, size_t alignment) {
+  XEASSERT(alignment && alignment <= 16 && !(alignment & (alignment - 1)));
+  if (!active_chunk_) {
+    head_chunk_ = active_chunk_ = new Chunk(std::max(chunk_size_, size));
+  }
+  size_t offset = XEALIGN(active_chunk_->offset, alignment);
+  if (offset + size > active_chunk_->capacity) {
+    active_chunk_ = NextChunk(size);
+    offset = 0;
   }
 
-  uint8_t* p = active_chunk_->buffer + active_chunk_->offset;
-  active_chunk_->offset += size;
+  if (!active_chunk_->buffer) {
+    // Taken by DetachContents.
+    active_chunk_->buffer = (uint8_t*)xe_malloc(active_chunk_->capacity);
+  }
+  uint8_t* p = active_chunk_->buffer + offset;
+  active_chunk_->offset = offset + size;
   return p;
 }
 
-void* Arena::CloneContents() {
+Arena::Chunk* Arena::NextChunk(size_t size) {
+  // Reuse the next chunk if it fits, otherwise insert a new one in front of
+  // it so it's still around for later.
+  Chunk* next = active_chunk_->next;
+  if (!next || next->capacity < size) {
+    Chunk* chunk = new Chunk(std::max(chunk_size_, size));
+    chunk->next = next;
+    active_chunk_->next = chunk;
+    next = chunk;
+  }
+  next->offset = 0;
+  return next;
+}
+
+Arena::Mark Arena::GetMark() const {
+  Mark mark = {
+    active_chunk_, active_chunk_ ? active_chunk_->offset : 0 };
+  return mark;
+}
+
+void Arena::Rollback(const Mark& mark) {
+  if (!mark.chunk) {
+    Reset();
+    return;
+  }
+  active_chunk_ = (Chunk*)mark.chunk;
+  active_chunk_->offset = mark.offset;
+}
+
+size_t Arena::GetContentsLength() const {
   size_t total_length = 0;
   Chunk* chunk = head_chunk_;
   while (chunk) {
@@ -74,9 +106,14 @@ void* Arena::CloneContents() {
     }
     chunk = chunk->next;
   }
+  return total_length;
+}
+
+void* Arena::CloneContents() {
+  size_t total_length = GetContentsLength();
   void* result = xe_malloc(total_length);
   uint8_t* p = (uint8_t*)result;
-  chunk = head_chunk_;
+  Chunk* chunk = head_chunk_;
   while (chunk) {
     xe_copy_struct(p, chunk->buffer, chunk->offset);
     p += chunk->offset;
@@ -88,6 +125,40 @@ void* Arena::CloneContents() {
   return result;
 }
 
+void* Arena::DetachContents() {
+  // Copying is cheap for small contents and keeps the buffer warm for the
+  // next user.
+  const size_t min_detach_length = 64 * 1024;
+  size_t total_length = GetContentsLength();
+  if (total_length < min_detach_length) {
+    void* result = CloneContents();
+    Reset();
+    return result;
+  }
+
+  // Hand over the first chunk's buffer, resized to fit everything. Large
+  // blocks are usually resized in place, so only the contents of any
+  // further chunks are copied.
+  Chunk* head = head_chunk_;
+  uint8_t* result = (uint8_t*)xe_realloc(
+      head->buffer, head->capacity, total_length);
+  head->buffer = NULL;
+  uint8_t* p = result + head->offset;
+  if (head != active_chunk_) {
+    Chunk* chunk = head->next;
+    while (chunk) {
+      xe_copy_struct(p, chunk->buffer, chunk->offset);
+      p += chunk->offset;
+      if (chunk == active_chunk_) {
+        break;
+      }
+      chunk = chunk->next;
+    }
+  }
+  Reset();
+  return result;
+}
+
 Arena::Chunk::Chunk(size_t chunk_size) :
     next(NULL),
     capacity(chunk_size), buffer(0), offset(0) {
@@ -24,14 +24,34 @@ public:
   void Reset();
   void DebugFill();
 
-  void* Alloc(size_t size);
+  // Allocations larger than the chunk size get a chunk of their own.
+  // Alignment must be a power of two no larger than 16.
+  void* Alloc(size_t size, size_t alignment = 1);
   template<typename T> T* Alloc() {
-    return (T*)Alloc(sizeof(T));
+    return (T*)Alloc(sizeof(T), AlignmentOf<T>::value);
   }
 
+  // Position in the arena that can be rolled back to, freeing everything
+  // allocated since. Chunks are kept for reuse.
+  typedef struct {
+    void*   chunk;
+    size_t  offset;
+  } Mark;
+  Mark GetMark() const;
+  void Rollback(const Mark& mark);
+
+  // Everything allocated so far, copied into one xe_malloc'd block.
   void* CloneContents();
+  // Same as CloneContents, but large contents take over the first chunk's
+  // buffer instead of copying it. The arena is reset.
+  void* DetachContents();
 
 private:
+  template<typename T> struct AlignmentOf {
+    typedef struct { char c; T t; } Padded;
+    enum { value = sizeof(Padded) - sizeof(T) };
+  };
+
   class Chunk {
   public:
     Chunk(size_t chunk_size);
@@ -44,6 +64,9 @@ private:
     size_t    offset;
   };
 
+  Chunk* NextChunk(size_t size);
+  size_t GetContentsLength() const;
+
 private:
   size_t    chunk_size_;
   Chunk*    head_chunk_;
@@ -51,6 +74,18 @@ private:
 };
 
 
+// Rolls the arena back to where it was when the scope was entered.
+class ArenaScope {
+public:
+  ArenaScope(Arena* arena) : arena_(arena), mark_(arena->GetMark()) {}
+  ~ArenaScope() { arena_->Rollback(mark_); }
+
+private:
+  Arena*      arena_;
+  Arena::Mark mark_;
+};
+
+
 }  // namespace alloy
 
 
@@ -34,3 +34,18 @@ void* Backend::AllocThreadData() {
 
 void Backend::FreeThreadData(void* thread_data) {
 }
+
+uint64_t Backend::translation_cache_version() const {
+  return 0;
+}
+
+int Backend::SerializeFunction(Function* function,
+                               std::vector<uint8_t>& out_data) {
+  return 1;
+}
+
+int Backend::DeserializeFunction(FunctionInfo* symbol_info,
+                                 const uint8_t* data, size_t length,
+                                 Function** out_function) {
+  return 1;
+}
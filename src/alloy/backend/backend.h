@@ -14,7 +14,11 @@
 #include <alloy/backend/machine_info.h>
 
 
-namespace alloy { namespace runtime { class Runtime; } }
+namespace alloy { namespace runtime {
+  class Function;
+  class FunctionInfo;
+  class Runtime;
+} }
 
 namespace alloy {
 namespace backend {
@@ -37,6 +41,17 @@ public:
 
   virtual Assembler* CreateAssembler() = 0;
 
+  // Translation cache support.
+  // Identifies the code the backend generates; entries produced by a
+  // different version are ignored. 0 if the backend can't serialize
+  // functions.
+  virtual uint64_t translation_cache_version() const;
+  virtual int SerializeFunction(runtime::Function* function,
+                                std::vector<uint8_t>& out_data);
+  virtual int DeserializeFunction(runtime::FunctionInfo* symbol_info,
+                                  const uint8_t* data, size_t length,
+                                  runtime::Function** out_function);
+
 protected:
   runtime::Runtime* runtime_;
   MachineInfo machine_info_;
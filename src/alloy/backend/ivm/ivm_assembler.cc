@@ -25,8 +25,11 @@ using namespace alloy::runtime;
 
 
 IVMAssembler::IVMAssembler(Backend* backend) :
+    Assembler(backend),
     source_map_arena_(128 * 1024),
-    Assembler(backend) {
+    inline_cache_arena_(16 * 1024),
+    constant_arena_(4 * 1024),
+    reloc_arena_(4 * 1024) {
 }
 
 IVMAssembler::~IVMAssembler() {
@@ -49,6 +52,9 @@ int IVMAssembler::Initialize() {
 void IVMAssembler::Reset() {
   intcode_arena_.Reset();
   source_map_arena_.Reset();
+  inline_cache_arena_.Reset();
+  constant_arena_.Reset();
+  reloc_arena_.Reset();
   scratch_arena_.Reset();
   Assembler::Reset();
 }
@@ -67,8 +73,16 @@ int IVMAssembler::Assemble(
   ctx.intcode_arena = &intcode_arena_;
   ctx.source_map_count = 0;
   ctx.source_map_arena = &source_map_arena_;
+  ctx.inline_cache_count = 0;
+  ctx.inline_cache_arena = &inline_cache_arena_;
+  ctx.constant_count = 0;
+  ctx.constant_arena = &constant_arena_;
+  ctx.reloc_count = 0;
+  ctx.reloc_arena = &reloc_arena_;
+  ctx.is_cacheable = true;
   ctx.scratch_arena = &scratch_arena_;
   ctx.label_ref_head = NULL;
+  ctx.source_offset = 0;
 
   // Reset label tags as we use them.
   builder->ResetLabelTags();
@@ -109,7 +123,7 @@ int IVMAssembler::Assemble(
   // Fixup label references.
   LabelRef* label_ref = ctx.label_ref_head;
   while (label_ref) {
-    label_ref->instr->src1_reg = (uint32_t)label_ref->label->tag & ~0x80000000;
+    label_ref->instr->src3_reg = (uint32_t)label_ref->label->tag & ~0x80000000;
     label_ref = label_ref->next;
   }
 
@@ -37,6 +37,9 @@ public:
 private:
   Arena     intcode_arena_;
   Arena     source_map_arena_;
+  Arena     inline_cache_arena_;
+  Arena     constant_arena_;
+  Arena     reloc_arena_;
   Arena     scratch_arena_;
 };
 
@@ -10,6 +10,7 @@
 #include <alloy/backend/ivm/ivm_backend.h>
 
 #include <alloy/backend/ivm/ivm_assembler.h>
+#include <alloy/backend/ivm/ivm_function.h>
 #include <alloy/backend/ivm/ivm_stack.h>
 #include <alloy/backend/ivm/tracing.h>
 
@@ -48,6 +49,8 @@ int IVMBackend::Initialize() {
     16,
   };
 
+  InitializeIntCodeHandlers();
+
   alloy::tracing::WriteEvent(EventType::Init({
   }));
 
@@ -66,3 +69,26 @@ void IVMBackend::FreeThreadData(void* thread_data) {
 Assembler* IVMBackend::CreateAssembler() {
   return new IVMAssembler(this);
 }
+
+uint64_t IVMBackend::translation_cache_version() const {
+  return GetIntCodeVersion();
+}
+
+int IVMBackend::SerializeFunction(Function* function,
+                                  std::vector<uint8_t>& out_data) {
+  auto fn = (IVMFunction*)function;
+  return fn->Serialize(runtime_, out_data);
+}
+
+int IVMBackend::DeserializeFunction(FunctionInfo* symbol_info,
+                                    const uint8_t* data, size_t length,
+                                    Function** out_function) {
+  IVMFunction* fn = new IVMFunction(symbol_info);
+  int result = fn->Deserialize(runtime_, data, length);
+  if (result) {
+    delete fn;
+    return result;
+  }
+  *out_function = fn;
+  return 0;
+}
@@ -34,6 +34,13 @@ public:
   virtual void FreeThreadData(void* thread_data);
 
   virtual Assembler* CreateAssembler();
+
+  virtual uint64_t translation_cache_version() const;
+  virtual int SerializeFunction(runtime::Function* function,
+                                std::vector<uint8_t>& out_data);
+  virtual int DeserializeFunction(runtime::FunctionInfo* symbol_info,
+                                  const uint8_t* data, size_t length,
+                                  runtime::Function** out_function);
 };
 
 
@@ -9,6 +9,7 @@
 
 #include <alloy/backend/ivm/ivm_function.h>
 
+#include <alloy/alloy-private.h>
 #include <alloy/backend/ivm/ivm_stack.h>
 #include <alloy/backend/tracing.h>
 #include <alloy/runtime/runtime.h>
@@ -21,23 +22,299 @@ using namespace alloy::runtime;
 
 
 IVMFunction::IVMFunction(FunctionInfo* symbol_info) :
-    register_count_(0), intcode_count_(0), intcodes_(0),
+    Function(symbol_info),
+    register_count_(0), stack_size_(0), intcode_count_(0), intcodes_(0),
+    constant_count_(0), constants_(0),
     source_map_count_(0), source_map_(0),
-    Function(symbol_info) {
+    reloc_count_(0), relocs_(0), is_cacheable_(false) {
 }
 
 IVMFunction::~IVMFunction() {
   xe_free(intcodes_);
+  xe_free(constants_);
   xe_free(source_map_);
+  xe_free(relocs_);
 }
 
 void IVMFunction::Setup(TranslationContext& ctx) {
   register_count_ = ctx.register_count;
   stack_size_ = ctx.stack_size;
   intcode_count_ = ctx.intcode_count;
-  intcodes_ = (IntCode*)ctx.intcode_arena->CloneContents();
+  intcodes_ = (IntCode*)ctx.intcode_arena->DetachContents();
+  if (ctx.constant_count) {
+    constant_count_ = ctx.constant_count;
+    constants_ = (vec128_t*)ctx.constant_arena->DetachContents();
+  }
   source_map_count_ = ctx.source_map_count;
-  source_map_ = (SourceMapEntry*)ctx.source_map_arena->CloneContents();
+  source_map_ = (SourceMapEntry*)ctx.source_map_arena->DetachContents();
+  if (ctx.inline_cache_count) {
+    inline_cache_count_ = ctx.inline_cache_count;
+    inline_caches_ = (InlineCache*)ctx.inline_cache_arena->DetachContents();
+  }
+  if (ctx.reloc_count) {
+    reloc_count_ = ctx.reloc_count;
+    relocs_ = (IntCodeReloc*)ctx.reloc_arena->DetachContents();
+  }
+  is_cacheable_ = ctx.is_cacheable;
+  if (FLAGS_ivm_superinstructions) {
+    FuseIntCodes(intcodes_, intcode_count_);
+  }
+}
+
+namespace {
+
+typedef struct {
+  uint32_t register_count;
+  uint32_t stack_size;
+  uint32_t intcode_count;
+  uint32_t constant_count;
+  uint32_t reloc_count;
+  uint32_t source_map_count;
+  uint32_t inline_cache_count;
+} SerializedHeader;
+
+int FindAccessCallbacksIndex(Runtime* runtime, uint64_t ptr,
+                             uint32_t* out_index) {
+  uint32_t index = 0;
+  RegisterAccessCallbacks* cbs = runtime->access_callbacks();
+  while (cbs) {
+    if ((uint64_t)cbs == ptr) {
+      *out_index = index;
+      return 0;
+    }
+    cbs = cbs->next;
+    index++;
+  }
+  return 1;
+}
+
+RegisterAccessCallbacks* GetAccessCallbacks(Runtime* runtime,
+                                            uint32_t index) {
+  RegisterAccessCallbacks* cbs = runtime->access_callbacks();
+  while (cbs && index--) {
+    cbs = cbs->next;
+  }
+  return cbs;
+}
+
+}  // namespace
+
+int IVMFunction::Serialize(Runtime* runtime, std::vector<uint8_t>& out_data) {
+  if (!is_cacheable_) {
+    return 1;
+  }
+
+  SerializedHeader header;
+  header.register_count = (uint32_t)register_count_;
+  header.stack_size = (uint32_t)stack_size_;
+  header.intcode_count = (uint32_t)intcode_count_;
+  header.constant_count = (uint32_t)constant_count_;
+  header.reloc_count = (uint32_t)reloc_count_;
+  header.source_map_count = (uint32_t)source_map_count_;
+  header.inline_cache_count = (uint32_t)inline_cache_count_;
+
+  size_t intcodes_offset = sizeof(header);
+  size_t constants_offset =
+      intcodes_offset + intcode_count_ * sizeof(IntCode);
+  size_t relocs_offset =
+      constants_offset + constant_count_ * sizeof(vec128_t);
+  size_t source_map_offset =
+      relocs_offset + reloc_count_ * sizeof(IntCodeReloc);
+  size_t inline_caches_offset =
+      source_map_offset + source_map_count_ * sizeof(SourceMapEntry);
+  size_t total_length =
+      inline_caches_offset + inline_cache_count_ * sizeof(uint64_t);
+  out_data.resize(total_length);
+  uint8_t* p = &out_data[0];
+
+  xe_copy_struct(p, &header, sizeof(header));
+  xe_copy_struct(p + constants_offset, constants_,
+                 constant_count_ * sizeof(vec128_t));
+  xe_copy_struct(p + relocs_offset, relocs_,
+                 reloc_count_ * sizeof(IntCodeReloc));
+  xe_copy_struct(p + source_map_offset, source_map_,
+                 source_map_count_ * sizeof(SourceMapEntry));
+  for (size_t n = 0; n < inline_cache_count_; n++) {
+    uint64_t source_address = inline_caches_[n].source_address;
+    xe_copy_struct(p + inline_caches_offset + n * sizeof(uint64_t),
+                   &source_address, sizeof(source_address));
+  }
+
+  // IntCodes are written one at a time as they are patched along the way.
+  // Handlers are written as their index in the handler table.
+  size_t next_reloc = 0;
+  for (size_t n = 0; n < intcode_count_; n++) {
+    IntCode ic = intcodes_[n];
+    ic.intcode_fn_offset = GetIntCodeHandlerIndex(&ic);
+    if (ic.intcode_fn_offset == -1) {
+      return 1;
+    }
+    while (next_reloc < reloc_count_ &&
+           relocs_[next_reloc].intcode_index == n) {
+      const IntCodeReloc& reloc = relocs_[next_reloc++];
+      switch (reloc.type) {
+      case RELOC_SYMBOL_SRC2:
+        {
+          FunctionInfo* symbol_info = (FunctionInfo*)(
+              ic.src2_reg | ((uint64_t)ic.src3_reg << 32));
+          ic.src2_reg = (uint32_t)symbol_info->address();
+          ic.src3_reg = 0;
+        }
+        break;
+      case RELOC_SYMBOL_CONSTANT:
+        {
+          FunctionInfo* symbol_info = (FunctionInfo*)ic.constant.u64;
+          ic.constant.u64 = symbol_info->address();
+        }
+        break;
+      case RELOC_ACCESS_CALLBACKS_SRC2:
+        {
+          uint32_t index;
+          if (FindAccessCallbacksIndex(
+              runtime, ic.src2_reg | ((uint64_t)ic.src3_reg << 32), &index)) {
+            return 1;
+          }
+          ic.src2_reg = index;
+          ic.src3_reg = 0;
+        }
+        break;
+      case RELOC_ACCESS_CALLBACKS_SRC3:
+        {
+          uint32_t index;
+          if (FindAccessCallbacksIndex(
+              runtime, ic.src3_reg | ((uint64_t)ic.dest_reg << 32), &index)) {
+            return 1;
+          }
+          ic.src3_reg = index;
+          ic.dest_reg = 0;
+        }
+        break;
+      default:
+        XEASSERTALWAYS();
+        return 1;
+      }
+    }
+    xe_copy_struct(p + intcodes_offset + n * sizeof(IntCode),
+                   &ic, sizeof(ic));
+  }
+
+  return 0;
+}
+
+int IVMFunction::Deserialize(Runtime* runtime,
+                             const uint8_t* data, size_t length) {
+  SerializedHeader header;
+  if (length < sizeof(header)) {
+    return 1;
+  }
+  xe_copy_struct(&header, data, sizeof(header));
+
+  size_t intcodes_offset = sizeof(header);
+  size_t constants_offset =
+      intcodes_offset + header.intcode_count * sizeof(IntCode);
+  size_t relocs_offset =
+      constants_offset + header.constant_count * sizeof(vec128_t);
+  size_t source_map_offset =
+      relocs_offset + header.reloc_count * sizeof(IntCodeReloc);
+  size_t inline_caches_offset =
+      source_map_offset + header.source_map_count * sizeof(SourceMapEntry);
+  size_t total_length =
+      inline_caches_offset + header.inline_cache_count * sizeof(uint64_t);
+  if (length != total_length) {
+    return 1;
+  }
+
+  register_count_ = header.register_count;
+  stack_size_ = header.stack_size;
+  intcode_count_ = header.intcode_count;
+  intcodes_ = (IntCode*)xe_malloc(intcode_count_ * sizeof(IntCode));
+  xe_copy_struct(intcodes_, data + intcodes_offset,
+                 intcode_count_ * sizeof(IntCode));
+  for (size_t n = 0; n < intcode_count_; n++) {
+    IntCode* i = &intcodes_[n];
+    if (!SetIntCodeHandlerIndex(i, i->intcode_fn_offset)) {
+      return 1;
+    }
+  }
+  constant_count_ = header.constant_count;
+  if (constant_count_) {
+    constants_ = (vec128_t*)xe_malloc(constant_count_ * sizeof(vec128_t));
+    xe_copy_struct(constants_, data + constants_offset,
+                   constant_count_ * sizeof(vec128_t));
+  }
+  reloc_count_ = header.reloc_count;
+  if (reloc_count_) {
+    relocs_ = (IntCodeReloc*)xe_malloc(reloc_count_ * sizeof(IntCodeReloc));
+    xe_copy_struct(relocs_, data + relocs_offset,
+                   reloc_count_ * sizeof(IntCodeReloc));
+  }
+  source_map_count_ = header.source_map_count;
+  source_map_ = (SourceMapEntry*)xe_malloc(
+      source_map_count_ * sizeof(SourceMapEntry));
+  xe_copy_struct(source_map_, data + source_map_offset,
+                 source_map_count_ * sizeof(SourceMapEntry));
+  if (header.inline_cache_count) {
+    inline_cache_count_ = header.inline_cache_count;
+    inline_caches_ = (InlineCache*)xe_calloc(
+        inline_cache_count_ * sizeof(InlineCache));
+    for (size_t n = 0; n < inline_cache_count_; n++) {
+      xe_copy_struct(&inline_caches_[n].source_address,
+                     data + inline_caches_offset + n * sizeof(uint64_t),
+                     sizeof(uint64_t));
+    }
+  }
+  is_cacheable_ = true;
+
+  for (size_t n = 0; n < reloc_count_; n++) {
+    const IntCodeReloc& reloc = relocs_[n];
+    if (reloc.intcode_index >= intcode_count_) {
+      return 1;
+    }
+    IntCode* i = &intcodes_[reloc.intcode_index];
+    switch (reloc.type) {
+    case RELOC_SYMBOL_SRC2:
+    case RELOC_SYMBOL_CONSTANT:
+      {
+        uint64_t address = reloc.type == RELOC_SYMBOL_SRC2 ?
+            i->src2_reg : i->constant.u64;
+        FunctionInfo* symbol_info;
+        if (runtime->LookupFunctionInfo(address, &symbol_info)) {
+          return 1;
+        }
+        uint64_t symbol_ptr = (uint64_t)symbol_info;
+        if (reloc.type == RELOC_SYMBOL_SRC2) {
+          i->src2_reg = (uint32_t)symbol_ptr;
+          i->src3_reg = (uint32_t)(symbol_ptr >> 32);
+        } else {
+          i->constant.u64 = symbol_ptr;
+        }
+      }
+      break;
+    case RELOC_ACCESS_CALLBACKS_SRC2:
+    case RELOC_ACCESS_CALLBACKS_SRC3:
+      {
+        uint32_t index = reloc.type == RELOC_ACCESS_CALLBACKS_SRC2 ?
+            i->src2_reg : i->src3_reg;
+        RegisterAccessCallbacks* cbs = GetAccessCallbacks(runtime, index);
+        if (!cbs) {
+          return 1;
+        }
+        uint64_t cbs_ptr = (uint64_t)cbs;
+        if (reloc.type == RELOC_ACCESS_CALLBACKS_SRC2) {
+          i->src2_reg = (uint32_t)cbs_ptr;
+          i->src3_reg = (uint32_t)(cbs_ptr >> 32);
+        } else {
+          i->src3_reg = (uint32_t)cbs_ptr;
+          i->dest_reg = (uint32_t)(cbs_ptr >> 32);
+        }
+      }
+      break;
+    default:
+      return 1;
+    }
+  }
+
+  return 0;
 }
 
 IntCode* IVMFunction::GetIntCodeAtSourceOffset(uint64_t offset) {
@@ -56,8 +333,10 @@ int IVMFunction::AddBreakpointImpl(Breakpoint* breakpoint) {
     return 1;
   }
 
+  uint32_t& count = breakpoint_counts_[i - intcodes_];
+
   // TEMP breakpoints always overwrite normal ones.
-  if (!i->debug_flags ||
+  if (!count ||
       breakpoint->type() == Breakpoint::TEMP_TYPE) {
     uint64_t breakpoint_ptr = (uint64_t)breakpoint;
     i->src2_reg = (uint32_t)breakpoint_ptr;
@@ -65,7 +344,11 @@ int IVMFunction::AddBreakpointImpl(Breakpoint* breakpoint) {
   }
 
   // Increment breakpoint counter.
-  ++i->debug_flags;
+  // The dispatch loop doesn't check for breakpoints, so the handler is
+  // swapped for one that reports them.
+  if (!count++) {
+    SetBreakpointIntCode(i, true);
+  }
 
   return 0;
 }
@@ -76,31 +359,33 @@ int IVMFunction::RemoveBreakpointImpl(Breakpoint* breakpoint) {
     return 1;
   }
 
+  auto it = breakpoint_counts_.find(i - intcodes_);
+  if (it == breakpoint_counts_.end()) {
+    return 1;
+  }
+
   // Decrement breakpoint counter.
-  --i->debug_flags;
+  --it->second;
   i->src2_reg = i->src3_reg = 0;
 
   // If there were other breakpoints, see what they were.
-  if (i->debug_flags) {
+  if (it->second) {
     auto old_breakpoint = FindBreakpoint(breakpoint->address());
     if (old_breakpoint) {
       uint64_t breakpoint_ptr = (uint64_t)old_breakpoint;
       i->src2_reg = (uint32_t)breakpoint_ptr;
       i->src3_reg = (uint32_t)(breakpoint_ptr >> 32);
     }
+  } else {
+    breakpoint_counts_.erase(it);
+    SetBreakpointIntCode(i, false);
   }
 
   return 0;
 }
 
-void IVMFunction::OnBreakpointHit(ThreadState* thread_state, IntCode* i) {
-  uint64_t breakpoint_ptr = i->src2_reg | (uint64_t(i->src3_reg) << 32);
-  Breakpoint* breakpoint = (Breakpoint*)breakpoint_ptr;
-
-  // Notify debugger.
-  // The debugger may choose to wait (blocking us).
-  auto debugger = thread_state->runtime()->debugger();
-  debugger->OnBreakpointHit(thread_state, breakpoint);
+void IVMFunction::UnlinkCallSite(void* call_site) {
+  UnlinkCallIntCode((IntCode*)call_site);
 }
 
 #undef TRACE_SOURCE_OFFSET
@@ -121,11 +406,32 @@ int IVMFunction::CallImpl(ThreadState* thread_state, uint64_t return_address) {
   ics.did_carry = 0;
   ics.did_saturate = 0;
   ics.access_callbacks = thread_state->runtime()->access_callbacks();
+  ics.inline_caches = inline_caches_;
+  ics.constants = constants_;
+  ics.function = this;
   ics.thread_state = thread_state;
   ics.return_address = return_address;
   ics.call_return_address = 0;
 
+  // Suspend is only checked on entry and on back-edges, which bounds the
+  // time until a suspend request is noticed without paying for it on every
+  // IntCode.
   volatile int* suspend_flag_address = thread_state->suspend_flag_address();
+  if (*suspend_flag_address) {
+    thread_state->EnterSuspend();
+  }
+
+  // When tiering, count calls and loop iterations until the function has
+  // been queued for promotion.
+  Runtime* runtime = thread_state->runtime();
+  bool count_backedges = false;
+  if (runtime->tiering_enabled() && !promotion_requested_) {
+    if (++invocation_count_ >= runtime->tier_invocation_threshold()) {
+      runtime->RequestPromotion(this);
+    } else {
+      count_backedges = true;
+    }
+  }
 
   // TODO(benvanik): DID_CARRY -- need HIR to set a OPCODE_FLAG_SET_CARRY
   //                 or something so the fns can set an ics flag.
@@ -134,15 +440,13 @@ int IVMFunction::CallImpl(ThreadState* thread_state, uint64_t return_address) {
   size_t source_index = 0;
 #endif
 
-  uint32_t ia = 0;
+  // Breakpoints are handled by the SOURCE_OFFSET handlers they patch in, so
+  // the common path is one indirect call and one compare per IntCode.
+  IntCode* intcodes = intcodes_;
+  const IntCode* i = intcodes;
   while (true) {
-    // Check suspend. We could do this only on certain instructions, if we
-    // wanted to speed things up.
-    if (*suspend_flag_address) {
-      thread_state->EnterSuspend();
-    }
-
 #ifdef TRACE_SOURCE_OFFSET
+    uint32_t ia = (uint32_t)(i - intcodes);
     uint64_t source_offset = -1;
     if (source_index < this->source_map_count_ &&
         this->source_map_[source_index].intcode_index <= ia) {
@@ -154,23 +458,31 @@ int IVMFunction::CallImpl(ThreadState* thread_state, uint64_t return_address) {
     }
 #endif
 
-    IntCode* i = &intcodes_[ia];
-
-    if (i->debug_flags) {
-      OnBreakpointHit(thread_state, i);
+    uint32_t new_ia = GetIntCodeFn(i)(ics, i);
+    // Covers IA_NEXT and the IA_SKIP(n) returned by superinstructions.
+    uint32_t skip = new_ia - IA_NEXT;
+    if (skip <= IA_MAX_SKIP) {
+      i += skip + 1;
+      continue;
     }
-
-    uint32_t new_ia = i->intcode_fn(ics, i);
-    if (new_ia == IA_NEXT) {
-      ia++;
-    } else if (new_ia == IA_RETURN) {
+    if (new_ia == IA_RETURN) {
       break;
-    } else {
-      ia = new_ia;
+    }
+    const IntCode* target = &intcodes[new_ia];
+    if (target <= i) {
+      if (*suspend_flag_address) {
+        thread_state->EnterSuspend();
+      }
+      if (count_backedges &&
+          ++backedge_count_ >= runtime->tier_backedge_threshold()) {
+        runtime->RequestPromotion(this);
+        count_backedges = false;
+      }
+    }
+    i = target;
 #ifdef TRACE_SOURCE_OFFSET
-      source_index = 0;
+    source_index = 0;
 #endif
-    }
   }
 
   stack->Free(register_count_);
@@ -16,6 +16,8 @@
 #include <alloy/runtime/symbol_info.h>
 
 
+namespace alloy { namespace runtime { class Runtime; } }
+
 namespace alloy {
 namespace backend {
 namespace ivm {
@@ -28,23 +30,38 @@ public:
 
   void Setup(TranslationContext& ctx);
 
+  // Translation cache support. Relocatable pointers are written as guest
+  // addresses (symbols) or list indices (register access callbacks).
+  int Serialize(runtime::Runtime* runtime, std::vector<uint8_t>& out_data);
+  int Deserialize(runtime::Runtime* runtime,
+                  const uint8_t* data, size_t length);
+
 protected:
   virtual int AddBreakpointImpl(runtime::Breakpoint* breakpoint);
   virtual int RemoveBreakpointImpl(runtime::Breakpoint* breakpoint);
   virtual int CallImpl(runtime::ThreadState* thread_state,
                        uint64_t return_address);
+  virtual void UnlinkCallSite(void* call_site);
 
 private:
   IntCode* GetIntCodeAtSourceOffset(uint64_t offset);
-  void OnBreakpointHit(runtime::ThreadState* thread_state, IntCode* i);
+
+  // Breakpoints set per IntCode, kept out of the IntCodes themselves.
+  typedef std::tr1::unordered_map<size_t, uint32_t> BreakpointCountMap;
 
 private:
   size_t          register_count_;
   size_t          stack_size_;
   size_t          intcode_count_;
   IntCode*        intcodes_;
+  size_t          constant_count_;
+  vec128_t*       constants_;
   size_t          source_map_count_;
   SourceMapEntry* source_map_;
+  size_t          reloc_count_;
+  IntCodeReloc*   relocs_;
+  bool            is_cacheable_;
+  BreakpointCountMap breakpoint_counts_;
 };
 
 
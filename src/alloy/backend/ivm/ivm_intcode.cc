@@ -9,10 +9,14 @@
 
 #include <alloy/backend/ivm/ivm_intcode.h>
 
+#include <alloy/alloy-private.h>
+
 #include <alloy/hir/label.h>
+#include <alloy/runtime/debugger.h>
 #include <alloy/runtime/runtime.h>
 #include <alloy/runtime/symbol_info.h>
 #include <alloy/runtime/thread_state.h>
+#include <alloy/runtime/translation_cache.h>
 
 using namespace alloy;
 using namespace alloy::backend;
@@ -69,60 +73,104 @@ static const uint8_t __vector_s8_table[8] = {
 #define VECF4(v,n) (v.f4[(n)])
 #endif
 
-uint32_t IntCode_INT_LOAD_CONSTANT(IntCodeState& ics, const IntCode* i) {
-  // TODO(benvanik): optimize on type to avoid 16b copy per load.
-  ics.rf[i->dest_reg].v128 = i->constant.v128;
+uint32_t IntCode_LOAD_CONSTANT_I8(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].i8 = i->constant.i8;
+  return IA_NEXT;
+}
+uint32_t IntCode_LOAD_CONSTANT_I16(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].i16 = i->constant.i16;
+  return IA_NEXT;
+}
+uint32_t IntCode_LOAD_CONSTANT_I32(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].i32 = i->constant.i32;
+  return IA_NEXT;
+}
+uint32_t IntCode_LOAD_CONSTANT_I64(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].i64 = i->constant.i64;
+  return IA_NEXT;
+}
+uint32_t IntCode_LOAD_CONSTANT_F32(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].f32 = i->constant.f32;
+  return IA_NEXT;
+}
+uint32_t IntCode_LOAD_CONSTANT_F64(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].f64 = i->constant.f64;
+  return IA_NEXT;
+}
+uint32_t IntCode_LOAD_CONSTANT_V128(IntCodeState& ics, const IntCode* i) {
+  ics.rf[i->dest_reg].v128 = ics.constants[i->src1_reg];
   return IA_NEXT;
 }
 
-uint32_t AllocConstant(TranslationContext& ctx, uint64_t value,
-                       IntCode** out_ic = NULL) {
+uint32_t AllocConstant(TranslationContext& ctx, uint64_t value) {
   ctx.intcode_count++;
   IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
-  ic->intcode_fn = IntCode_INT_LOAD_CONSTANT;
+  SetIntCodeFn(ic, IntCode_LOAD_CONSTANT_I64);
   ic->flags = 0;
-  ic->debug_flags = 0;
+  ic->reserved = 0;
   ic->dest_reg = ctx.register_count++;
   ic->constant.u64 = value;
-  if (out_ic) {
-    *out_ic = ic;
-  }
+  ic->src3_reg = 0;
   return ic->dest_reg;
 }
 
 uint32_t AllocConstant(TranslationContext& ctx, Value* value) {
+  // Only the bytes of the value type are copied; readers never look past
+  // them.
+  static IntCodeFn fns[] = {
+    IntCode_LOAD_CONSTANT_I8,
+    IntCode_LOAD_CONSTANT_I16,
+    IntCode_LOAD_CONSTANT_I32,
+    IntCode_LOAD_CONSTANT_I64,
+    IntCode_LOAD_CONSTANT_F32,
+    IntCode_LOAD_CONSTANT_F64,
+    IntCode_LOAD_CONSTANT_V128,
+  };
   ctx.intcode_count++;
   IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
-  ic->intcode_fn = IntCode_INT_LOAD_CONSTANT;
+  SetIntCodeFn(ic, fns[value->type]);
   ic->flags = 0;
-  ic->debug_flags = 0;
+  ic->reserved = 0;
   ic->dest_reg = ctx.register_count++;
-  ic->constant.v128 = value->constant.v128;
+  if (value->type == VEC128_TYPE) {
+    // Too big to store inline.
+    vec128_t* pool_entry = ctx.constant_arena->Alloc<vec128_t>();
+    *pool_entry = value->constant.v128;
+    ic->src1_reg = (uint32_t)ctx.constant_count++;
+    ic->src2_reg = ic->src3_reg = 0;
+  } else {
+    ic->constant.u64 = value->constant.i64;
+    ic->src3_reg = 0;
+  }
   return ic->dest_reg;
 }
 
-uint32_t AllocLabel(TranslationContext& ctx, Label* label) {
-  // If it's a back-branch to an already tagged label avoid setting up
-  // a reference.
+void AddReloc(TranslationContext& ctx, IntCodeRelocType type) {
+  // Always applies to the last IntCode allocated.
+  IntCodeReloc* reloc = ctx.reloc_arena->Alloc<IntCodeReloc>();
+  reloc->intcode_index = (uint32_t)(ctx.intcode_count - 1);
+  reloc->type = type;
+  ctx.reloc_count++;
+}
+
+void AllocLabel(TranslationContext& ctx, Label* label, IntCode* ic) {
+  // Branch targets are stored inline in src3_reg instead of being loaded
+  // from a constant register.
+  // If it's a back-branch to an already tagged label we know the IA now.
   uint32_t value = (uint32_t)label->tag;
   if (value & 0x80000000) {
-    // Already set.
-    return AllocConstant(ctx, value & ~0x80000000);
+    ic->src3_reg = value & ~0x80000000;
+    return;
   }
 
-  // Allocate a constant - it will be updated later.
-  IntCode* ic;
-  uint32_t reg = AllocConstant(ctx, 0, &ic);
-
   // Setup a label reference. After assembly is complete this will
-  // run through and fix up the constant with the IA.
+  // run through and fix up the IntCode with the IA.
+  ic->src3_reg = 0;
   LabelRef* label_ref = ctx.scratch_arena->Alloc<LabelRef>();
   label_ref->next = ctx.label_ref_head;
   ctx.label_ref_head = label_ref;
   label_ref->label = label;
   label_ref->instr = ic;
-
-  return reg;
 }
 
 uint32_t AllocDynamicRegister(TranslationContext& ctx, Value* value) {
@@ -143,11 +191,17 @@ uint32_t AllocOpRegister(
     // Nothing.
     return 0;
   case OPCODE_SIG_TYPE_L:
-    return AllocLabel(ctx, op->label);
+    // Handled by DispatchBranchToC.
+    XEASSERTALWAYS();
+    return 0;
   case OPCODE_SIG_TYPE_O:
     return AllocConstant(ctx, (uint64_t)op->offset);
   case OPCODE_SIG_TYPE_S:
-    return AllocConstant(ctx, (uint64_t)op->symbol_info);
+    {
+      uint32_t reg = AllocConstant(ctx, (uint64_t)op->symbol_info);
+      AddReloc(ctx, RELOC_SYMBOL_CONSTANT);
+      return reg;
+    }
   case OPCODE_SIG_TYPE_V:
     Value* value = op->value;
     if (value->IsConstant()) {
@@ -185,9 +239,9 @@ int DispatchToC(TranslationContext& ctx, Instr* i, IntCodeFn fn) {
   // Allocate last (in case we had any setup instructions for args).
   ctx.intcode_count++;
   IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
-  ic->intcode_fn = fn;
+  SetIntCodeFn(ic, fn);
   ic->flags = i->flags;
-  ic->debug_flags = 0;
+  ic->reserved = 0;
   ic->dest_reg = dest_reg;
   ic->src1_reg = src1_reg;
   ic->src2_reg = src2_reg;
@@ -196,6 +250,32 @@ int DispatchToC(TranslationContext& ctx, Instr* i, IntCodeFn fn) {
   return 0;
 }
 
+int DispatchBranchToC(TranslationContext& ctx, Instr* i, IntCodeFn fn) {
+  XEASSERT(fn != IntCode_INVALID);
+  XEASSERT(fn != IntCode_INVALID_TYPE);
+
+  // Either (label) or (cond, label).
+  uint32_t src1_reg = 0;
+  Label* label;
+  if (GET_OPCODE_SIG_TYPE_SRC1(i->opcode->signature) == OPCODE_SIG_TYPE_L) {
+    label = i->src1.label;
+  } else {
+    src1_reg = AllocOpRegister(ctx, OPCODE_SIG_TYPE_V, &i->src1);
+    label = i->src2.label;
+  }
+
+  ctx.intcode_count++;
+  IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
+  SetIntCodeFn(ic, fn);
+  ic->flags = i->flags;
+  ic->reserved = 0;
+  ic->dest_reg = 0;
+  ic->src1_reg = src1_reg;
+  ic->src2_reg = 0;
+  AllocLabel(ctx, label, ic);
+  return 0;
+}
+
 uint32_t IntCode_LOAD_REGISTER_I8(IntCodeState& ics, const IntCode* i) {
   uint64_t address = ics.rf[i->src1_reg].u32;
   RegisterAccessCallbacks* cbs = (RegisterAccessCallbacks*)
@@ -241,13 +321,14 @@ int DispatchRegisterRead(
   uint32_t src1_reg = AllocOpRegister(ctx, OPCODE_SIG_TYPE_V, &i->src1);
   ctx.intcode_count++;
   IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
-  ic->intcode_fn = fn;
+  SetIntCodeFn(ic, fn);
   ic->flags = i->flags;
-  ic->debug_flags = 0;
+  ic->reserved = 0;
   ic->dest_reg = dest_reg;
   ic->src1_reg = src1_reg;
   ic->src2_reg = (uint32_t)((uint64_t)cbs);
   ic->src3_reg = (uint32_t)(((uint64_t)cbs) >> 32);
+  AddReloc(ctx, RELOC_ACCESS_CALLBACKS_SRC2);
   return 0;
 }
 uint32_t IntCode_LOAD_REGISTER_I8_DYNAMIC(IntCodeState& ics, const IntCode* i) {
@@ -344,13 +425,14 @@ int DispatchRegisterWrite(
   uint32_t src2_reg = AllocOpRegister(ctx, OPCODE_SIG_TYPE_V, &i->src2);
   ctx.intcode_count++;
   IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
-  ic->intcode_fn = fn;
+  SetIntCodeFn(ic, fn);
   ic->flags = i->flags;
-  ic->debug_flags = 0;
+  ic->reserved = 0;
   ic->dest_reg = (uint32_t)(((uint64_t)cbs) >> 32);
   ic->src1_reg = src1_reg;
   ic->src2_reg = src2_reg;
   ic->src3_reg = (uint32_t)((uint64_t)cbs);
+  AddReloc(ctx, RELOC_ACCESS_CALLBACKS_SRC3);
   return 0;
 }
 uint32_t IntCode_STORE_REGISTER_I8_DYNAMIC(IntCodeState& ics, const IntCode* i) {
@@ -424,9 +506,11 @@ uint32_t IntCode_COMMENT(IntCodeState& ics, const IntCode* i) {
 int Translate_COMMENT(TranslationContext& ctx, Instr* i) {
   ctx.intcode_count++;
   IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
-  ic->intcode_fn = IntCode_COMMENT;
+  SetIntCodeFn(ic, IntCode_COMMENT);
   ic->flags = i->flags;
-  ic->debug_flags = 0;
+  ic->reserved = 0;
+  // The string is a host pointer; don't bother persisting these.
+  ctx.is_cacheable = false;
   // HACK HACK HACK
   char* src = xestrdupa((char*)i->src1.offset);
   uint64_t src_p = (uint64_t)src;
@@ -445,6 +529,21 @@ int Translate_NOP(TranslationContext& ctx, Instr* i) {
 uint32_t IntCode_SOURCE_OFFSET(IntCodeState& ics, const IntCode* i) {
   return IA_NEXT;
 }
+uint32_t IntCode_SOURCE_OFFSET_BREAKPOINT(IntCodeState& ics,
+                                          const IntCode* i) {
+  Breakpoint* breakpoint =
+      (Breakpoint*)(i->src2_reg | ((uint64_t)i->src3_reg << 32));
+  // The debugger may choose to wait (blocking us).
+  auto debugger = ics.thread_state->runtime()->debugger();
+  debugger->OnBreakpointHit(ics.thread_state, breakpoint);
+  return IA_NEXT;
+}
+void SetBreakpointIntCode(IntCode* i, bool enabled) {
+  XEASSERT(GetIntCodeFn(i) == IntCode_SOURCE_OFFSET ||
+           GetIntCodeFn(i) == IntCode_SOURCE_OFFSET_BREAKPOINT);
+  SetIntCodeFn(
+      i, enabled ? IntCode_SOURCE_OFFSET_BREAKPOINT : IntCode_SOURCE_OFFSET);
+}
 int Translate_SOURCE_OFFSET(TranslationContext& ctx, Instr* i) {
   int result = DispatchToC(ctx, i, IntCode_SOURCE_OFFSET);
   if (result) {
@@ -454,6 +553,7 @@ int Translate_SOURCE_OFFSET(TranslationContext& ctx, Instr* i) {
   entry->intcode_index = ctx.intcode_count - 1;
   entry->source_offset = i->src1.offset;
   ctx.source_map_count++;
+  ctx.source_offset = i->src1.offset;
   return 0;
 }
 
@@ -574,12 +674,62 @@ int Translate_TRAP_TRUE(TranslationContext& ctx, Instr* i) {
   return DispatchToC(ctx, i, fns[i->src1.value->type]);
 }
 
+// The callee's current version. Invalidated versions stay set on the symbol
+// until it's redefined, so those go through the runtime like undefined ones.
+XEFORCEINLINE Function* ResolveCallee(
+    IntCodeState& ics, FunctionInfo* symbol_info) {
+  Runtime* runtime = ics.thread_state->runtime();
+  runtime->CheckCodeWrites();
+  Function* fn = symbol_info->function();
+  if (!fn || fn->is_invalidated()) {
+    runtime->ResolveFunction(symbol_info->address(), &fn);
+  }
+  return fn;
+}
 uint32_t IntCode_CALL_XX(IntCodeState& ics, const IntCode* i, uint32_t reg) {
   FunctionInfo* symbol_info = (FunctionInfo*)ics.rf[reg].u64;
-  Function* fn = symbol_info->function();
-  if (!fn) {
-    ics.thread_state->runtime()->ResolveFunction(symbol_info->address(), &fn);
+  Function* fn = ResolveCallee(ics, symbol_info);
+  XEASSERTNOTNULL(fn);
+  // TODO(benvanik): proper tail call support, somehow.
+  uint64_t return_address =
+      (i->flags & CALL_TAIL) ? ics.return_address : ics.call_return_address;
+  fn->Call(ics.thread_state, return_address);
+  if (i->flags & CALL_TAIL) {
+    return IA_RETURN;
+  }
+  return IA_NEXT;
+}
+// Linked callees are stored in dest_reg/src1_reg as one 64-bit value so a
+// relink can't be seen half written. Functions keep their IntCodes in
+// malloc'd arrays of 24-byte entries, which puts dest_reg on an 8-byte
+// boundary.
+XEFORCEINLINE Function* volatile* GetLinkedCallee(const IntCode* i) {
+  return (Function* volatile*)&i->dest_reg;
+}
+XEFORCEINLINE int32_t GetIntCodeFnOffset(IntCodeFn fn) {
+  return (int32_t)((intptr_t)fn - (intptr_t)IntCode_INVALID);
+}
+uint32_t IntCode_CALL_UNLINKED(IntCodeState& ics, const IntCode* i);
+uint32_t IntCode_CALL_LINKED(IntCodeState& ics, const IntCode* i) {
+  // Call site has been patched with the resolved callee.
+  ics.thread_state->runtime()->CheckCodeWrites();
+  Function* fn = *GetLinkedCallee(i);
+  if (fn->is_invalidated()) {
+    // The site is being unlinked; until then go through the symbol.
+    return IntCode_CALL_UNLINKED(ics, i);
   }
+  uint64_t return_address =
+      (i->flags & CALL_TAIL) ? ics.return_address : ics.call_return_address;
+  fn->CallDirect(ics.thread_state, return_address);
+  if (i->flags & CALL_TAIL) {
+    return IA_RETURN;
+  }
+  return IA_NEXT;
+}
+uint32_t IntCode_CALL_UNLINKED(IntCodeState& ics, const IntCode* i) {
+  FunctionInfo* symbol_info =
+      (FunctionInfo*)(i->src2_reg | ((uint64_t)i->src3_reg << 32));
+  Function* fn = ResolveCallee(ics, symbol_info);
   XEASSERTNOTNULL(fn);
   // TODO(benvanik): proper tail call support, somehow.
   uint64_t return_address =
@@ -591,10 +741,74 @@ uint32_t IntCode_CALL_XX(IntCodeState& ics, const IntCode* i, uint32_t reg) {
   return IA_NEXT;
 }
 uint32_t IntCode_CALL(IntCodeState& ics, const IntCode* i) {
-  return IntCode_CALL_XX(ics, i, i->src1_reg);
+  FunctionInfo* symbol_info =
+      (FunctionInfo*)(i->src2_reg | ((uint64_t)i->src3_reg << 32));
+  if (symbol_info->behavior() == FunctionInfo::BEHAVIOR_EXTERN) {
+    // Externs need the full Call() path so are never linked.
+    return IntCode_CALL_UNLINKED(ics, i);
+  }
+
+  // Claim the site so only one thread links it. While claimed it runs as
+  // unlinked; anyone who loses just makes the call.
+  IntCode* ic = (IntCode*)i;
+  if (!xe_atomic_cas_32(GetIntCodeFnOffset(IntCode_CALL),
+                        GetIntCodeFnOffset(IntCode_CALL_UNLINKED),
+                        &ic->intcode_fn_offset)) {
+    return IntCode_CALL_UNLINKED(ics, i);
+  }
+  Function* fn = ResolveCallee(ics, symbol_info);
+  XEASSERTNOTNULL(fn);
+
+  // Link the call site directly to the callee so future calls skip all of
+  // the above. Recorded with the callee before the handler is swapped so an
+  // unlink can't miss it; UnlinkCallIntCode waits out the claim.
+  XEASSERTZERO((uintptr_t)GetLinkedCallee(ic) & 0x7);
+  *GetLinkedCallee(ic) = fn;
+  fn->LinkCallSite(ics.function, ic);
+  xe_memory_barrier();
+  SetIntCodeFn(ic, IntCode_CALL_LINKED);
+  xe_memory_barrier();
+  if (fn->is_retired()) {
+    // Retired after it was resolved, and its callers may have been unlinked
+    // before this one was recorded. It's kept alive until this thread next
+    // calls anything.
+    ics.thread_state->runtime()->UnlinkCallers(fn);
+  }
+
+  // TODO(benvanik): proper tail call support, somehow.
+  uint64_t return_address =
+      (i->flags & CALL_TAIL) ? ics.return_address : ics.call_return_address;
+  fn->Call(ics.thread_state, return_address);
+  if (i->flags & CALL_TAIL) {
+    return IA_RETURN;
+  }
+  return IA_NEXT;
 }
 int Translate_CALL(TranslationContext& ctx, Instr* i) {
-  return DispatchToC(ctx, i, IntCode_CALL);
+  // The symbol is stored in the IntCode instead of a constant register so
+  // that the site can be linked once the callee is resolved.
+  ctx.intcode_count++;
+  IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
+  SetIntCodeFn(ic, IntCode_CALL);
+  ic->flags = i->flags;
+  ic->reserved = 0;
+  ic->dest_reg = 0;
+  ic->src1_reg = 0;
+  uint64_t symbol_ptr = (uint64_t)i->src1.symbol_info;
+  ic->src2_reg = (uint32_t)symbol_ptr;
+  ic->src3_reg = (uint32_t)(symbol_ptr >> 32);
+  AddReloc(ctx, RELOC_SYMBOL_SRC2);
+  return 0;
+}
+void UnlinkCallIntCode(IntCode* i) {
+  while (!xe_atomic_cas_32(GetIntCodeFnOffset(IntCode_CALL_LINKED),
+                           GetIntCodeFnOffset(IntCode_CALL),
+                           &i->intcode_fn_offset)) {
+    // Still being linked by the thread that claimed it; that's only a few
+    // stores away from finishing.
+    XEASSERT(GetIntCodeFn(i) == IntCode_CALL_UNLINKED);
+    Sleep(0);
+  }
 }
 
 uint32_t IntCode_CALL_TRUE_I8(IntCodeState& ics, const IntCode* i) {
@@ -656,9 +870,11 @@ uint32_t IntCode_CALL_INDIRECT_XX(IntCodeState& ics, const IntCode* i, uint32_t
     }
   }
 
-  // Real call.
+  // Real call. Most sites only ever see one or two targets, so check the
+  // site's inline cache before going to the runtime.
   Function* fn = NULL;
-  ics.thread_state->runtime()->ResolveFunction(target, &fn);
+  ics.thread_state->runtime()->ResolveFunction(
+      target, &ics.inline_caches[i->src3_reg], &fn);
   XEASSERTNOTNULL(fn);
   // TODO(benvanik): proper tail call support, somehow.
   uint64_t return_address =
@@ -669,11 +885,38 @@ uint32_t IntCode_CALL_INDIRECT_XX(IntCodeState& ics, const IntCode* i, uint32_t
   }
   return IA_NEXT;
 }
+int DispatchCallIndirect(TranslationContext& ctx, Instr* i, IntCodeFn fn) {
+  // Like DispatchToC, but with the index of a new inline cache for the
+  // call site in src3.
+  const OpcodeInfo* op = i->opcode;
+  uint32_t sig = op->signature;
+  OpcodeSignatureType src1_type = GET_OPCODE_SIG_TYPE_SRC1(sig);
+  OpcodeSignatureType src2_type = GET_OPCODE_SIG_TYPE_SRC2(sig);
+  XEASSERT(GET_OPCODE_SIG_TYPE_SRC3(sig) == OPCODE_SIG_TYPE_X);
+  uint32_t src1_reg = AllocOpRegister(ctx, src1_type, &i->src1);
+  uint32_t src2_reg = AllocOpRegister(ctx, src2_type, &i->src2);
+
+  InlineCache* cache = ctx.inline_cache_arena->Alloc<InlineCache>();
+  xe_zero_struct(cache, sizeof(InlineCache));
+  cache->source_address = ctx.source_offset;
+
+  ctx.intcode_count++;
+  IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
+  SetIntCodeFn(ic, fn);
+  ic->flags = i->flags;
+  ic->reserved = 0;
+  ic->dest_reg = 0;
+  ic->src1_reg = src1_reg;
+  ic->src2_reg = src2_reg;
+  ic->src3_reg = (uint32_t)ctx.inline_cache_count++;
+  return 0;
+}
+
 uint32_t IntCode_CALL_INDIRECT(IntCodeState& ics, const IntCode* i) {
   return IntCode_CALL_INDIRECT_XX(ics, i, i->src1_reg);
 }
 int Translate_CALL_INDIRECT(TranslationContext& ctx, Instr* i) {
-  return DispatchToC(ctx, i, IntCode_CALL_INDIRECT);
+  return DispatchCallIndirect(ctx, i, IntCode_CALL_INDIRECT);
 }
 
 uint32_t IntCode_CALL_INDIRECT_TRUE_I8(IntCodeState& ics, const IntCode* i) {
@@ -722,7 +965,7 @@ int Translate_CALL_INDIRECT_TRUE(TranslationContext& ctx, Instr* i) {
     IntCode_CALL_INDIRECT_TRUE_F64,
     IntCode_INVALID_TYPE,
   };
-  return DispatchToC(ctx, i, fns[i->src1.value->type]);
+  return DispatchCallIndirect(ctx, i, fns[i->src1.value->type]);
 }
 
 uint32_t IntCode_CALL_EXTERN(IntCodeState& ics, const IntCode* i) {
@@ -796,49 +1039,46 @@ int Translate_SET_RETURN_ADDRESS(TranslationContext& ctx, Instr* i) {
   return DispatchToC(ctx, i, IntCode_SET_RETURN_ADDRESS);
 }
 
-uint32_t IntCode_BRANCH_XX(IntCodeState& ics, const IntCode* i, uint32_t reg) {
-  return ics.rf[reg].u32;
-}
 uint32_t IntCode_BRANCH(IntCodeState& ics, const IntCode* i) {
-  return IntCode_BRANCH_XX(ics, i, i->src1_reg);
+  return i->src3_reg;
 }
 int Translate_BRANCH(TranslationContext& ctx, Instr* i) {
-  return DispatchToC(ctx, i, IntCode_BRANCH);
+  return DispatchBranchToC(ctx, i, IntCode_BRANCH);
 }
 
 uint32_t IntCode_BRANCH_TRUE_I8(IntCodeState& ics, const IntCode* i) {
   if (ics.rf[i->src1_reg].u8) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_TRUE_I16(IntCodeState& ics, const IntCode* i) {
   if (ics.rf[i->src1_reg].u16) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_TRUE_I32(IntCodeState& ics, const IntCode* i) {
   if (ics.rf[i->src1_reg].u32) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_TRUE_I64(IntCodeState& ics, const IntCode* i) {
   if (ics.rf[i->src1_reg].u64) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_TRUE_F32(IntCodeState& ics, const IntCode* i) {
   if (ics.rf[i->src1_reg].f32) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_TRUE_F64(IntCodeState& ics, const IntCode* i) {
   if (ics.rf[i->src1_reg].f64) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
@@ -852,42 +1092,42 @@ int Translate_BRANCH_TRUE(TranslationContext& ctx, Instr* i) {
     IntCode_BRANCH_TRUE_F64,
     IntCode_INVALID_TYPE,
   };
-  return DispatchToC(ctx, i, fns[i->src1.value->type]);
+  return DispatchBranchToC(ctx, i, fns[i->src1.value->type]);
 }
 
 uint32_t IntCode_BRANCH_FALSE_I8(IntCodeState& ics, const IntCode* i) {
   if (!ics.rf[i->src1_reg].u8) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_FALSE_I16(IntCodeState& ics, const IntCode* i) {
   if (!ics.rf[i->src1_reg].u16) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_FALSE_I32(IntCodeState& ics, const IntCode* i) {
   if (!ics.rf[i->src1_reg].u32) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_FALSE_I64(IntCodeState& ics, const IntCode* i) {
   if (!ics.rf[i->src1_reg].u64) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_FALSE_F32(IntCodeState& ics, const IntCode* i) {
   if (!ics.rf[i->src1_reg].f32) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
 uint32_t IntCode_BRANCH_FALSE_F64(IntCodeState& ics, const IntCode* i) {
   if (!ics.rf[i->src1_reg].f64) {
-    return IntCode_BRANCH_XX(ics, i, i->src2_reg);
+    return i->src3_reg;
   }
   return IA_NEXT;
 }
@@ -901,7 +1141,7 @@ int Translate_BRANCH_FALSE(TranslationContext& ctx, Instr* i) {
     IntCode_BRANCH_FALSE_F64,
     IntCode_INVALID_TYPE,
   };
-  return DispatchToC(ctx, i, fns[i->src1.value->type]);
+  return DispatchBranchToC(ctx, i, fns[i->src1.value->type]);
 }
 
 uint32_t IntCode_ASSIGN_I8(IntCodeState& ics, const IntCode* i) {
@@ -1445,38 +1685,63 @@ int Translate_STORE_LOCAL(TranslationContext& ctx, Instr* i) {
   return DispatchToC(ctx, i, fns[i->src2.value->type]);
 }
 
+// Context offsets are stored inline in src1_reg instead of being loaded
+// from a constant register, as nearly every guest instruction touches the
+// context.
+int DispatchContextToC(TranslationContext& ctx, Instr* i, IntCodeFn fn) {
+  XEASSERT(fn != IntCode_INVALID_TYPE);
+  XEASSERT(i->src1.offset <= 0xFFFFFFFF);
+  uint32_t dest_reg = 0;
+  uint32_t src2_reg = 0;
+  if (GET_OPCODE_SIG_TYPE_DEST(i->opcode->signature) == OPCODE_SIG_TYPE_V) {
+    dest_reg = AllocDynamicRegister(ctx, i->dest);
+  } else {
+    src2_reg = AllocOpRegister(ctx, OPCODE_SIG_TYPE_V, &i->src2);
+  }
+  ctx.intcode_count++;
+  IntCode* ic = ctx.intcode_arena->Alloc<IntCode>();
+  SetIntCodeFn(ic, fn);
+  ic->flags = i->flags;
+  ic->reserved = 0;
+  ic->dest_reg = dest_reg;
+  ic->src1_reg = (uint32_t)i->src1.offset;
+  ic->src2_reg = src2_reg;
+  ic->src3_reg = 0;
+  return 0;
+}
+
 uint32_t IntCode_LOAD_CONTEXT_I8(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].i8 = *((int8_t*)(ics.context + ics.rf[i->src1_reg].u64));
-  DPRINT("%d (%X) = ctx i8 +%d\n", ics.rf[i->dest_reg].i8, ics.rf[i->dest_reg].u8, ics.rf[i->src1_reg].u64);
+  ics.rf[i->dest_reg].i8 = *((int8_t*)(ics.context + i->src1_reg));
+  DPRINT("%d (%X) = ctx i8 +%d\n", ics.rf[i->dest_reg].i8, ics.rf[i->dest_reg].u8, i->src1_reg);
   return IA_NEXT;
 }
 uint32_t IntCode_LOAD_CONTEXT_I16(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].i16 = *((int16_t*)(ics.context + ics.rf[i->src1_reg].u64));
-  DPRINT("%d (%X) = ctx i16 +%d\n", ics.rf[i->dest_reg].i16, ics.rf[i->dest_reg].u16, ics.rf[i->src1_reg].u64);
+  ics.rf[i->dest_reg].i16 = *((int16_t*)(ics.context + i->src1_reg));
+  DPRINT("%d (%X) = ctx i16 +%d\n", ics.rf[i->dest_reg].i16, ics.rf[i->dest_reg].u16, i->src1_reg);
   return IA_NEXT;
 }
 uint32_t IntCode_LOAD_CONTEXT_I32(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].i32 = *((int32_t*)(ics.context + ics.rf[i->src1_reg].u64));
-  DPRINT("%d (%X) = ctx i32 +%d\n", ics.rf[i->dest_reg].i32, ics.rf[i->dest_reg].u32, ics.rf[i->src1_reg].u64);
+  ics.rf[i->dest_reg].i32 = *((int32_t*)(ics.context + i->src1_reg));
+  DPRINT("%d (%X) = ctx i32 +%d\n", ics.rf[i->dest_reg].i32, ics.rf[i->dest_reg].u32, i->src1_reg);
   return IA_NEXT;
 }
 uint32_t IntCode_LOAD_CONTEXT_I64(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].i64 = *((int64_t*)(ics.context + ics.rf[i->src1_reg].u64));
-  DPRINT("%lld (%llX) = ctx i64 +%d\n", ics.rf[i->dest_reg].i64, ics.rf[i->dest_reg].u64, ics.rf[i->src1_reg].u64);
+  ics.rf[i->dest_reg].i64 = *((int64_t*)(ics.context + i->src1_reg));
+  DPRINT("%lld (%llX) = ctx i64 +%d\n", ics.rf[i->dest_reg].i64, ics.rf[i->dest_reg].u64, i->src1_reg);
   return IA_NEXT;
 }
 uint32_t IntCode_LOAD_CONTEXT_F32(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].f32 = *((float*)(ics.context + ics.rf[i->src1_reg].u64));
-  DPRINT("%e (%X) = ctx f32 +%d\n", ics.rf[i->dest_reg].f32, ics.rf[i->dest_reg].u32, ics.rf[i->src1_reg].u64);
+  ics.rf[i->dest_reg].f32 = *((float*)(ics.context + i->src1_reg));
+  DPRINT("%e (%X) = ctx f32 +%d\n", ics.rf[i->dest_reg].f32, ics.rf[i->dest_reg].u32, i->src1_reg);
   return IA_NEXT;
 }
 uint32_t IntCode_LOAD_CONTEXT_F64(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].f64 = *((double*)(ics.context + ics.rf[i->src1_reg].u64));
-  DPRINT("%lle (%llX) = ctx f64 +%d\n", ics.rf[i->dest_reg].f64, ics.rf[i->dest_reg].u64, ics.rf[i->src1_reg].u64);
+  ics.rf[i->dest_reg].f64 = *((double*)(ics.context + i->src1_reg));
+  DPRINT("%lle (%llX) = ctx f64 +%d\n", ics.rf[i->dest_reg].f64, ics.rf[i->dest_reg].u64, i->src1_reg);
   return IA_NEXT;
 }
 uint32_t IntCode_LOAD_CONTEXT_V128(IntCodeState& ics, const IntCode* i) {
-  ics.rf[i->dest_reg].v128 = *((vec128_t*)(ics.context + ics.rf[i->src1_reg].u64));
+  ics.rf[i->dest_reg].v128 = *((vec128_t*)(ics.context + i->src1_reg));
   DPRINT("[%e, %e, %e, %e] [%.8X, %.8X, %.8X, %.8X] = ctx v128 +%d\n",
          VECF4(ics.rf[i->dest_reg].v128,0), VECF4(ics.rf[i->dest_reg].v128,1), VECF4(ics.rf[i->dest_reg].v128,2), VECF4(ics.rf[i->dest_reg].v128,3),
          VECI4(ics.rf[i->dest_reg].v128,0), VECI4(ics.rf[i->dest_reg].v128,1), VECI4(ics.rf[i->dest_reg].v128,2), VECI4(ics.rf[i->dest_reg].v128,3),
@@ -1493,42 +1758,42 @@ int Translate_LOAD_CONTEXT(TranslationContext& ctx, Instr* i) {
     IntCode_LOAD_CONTEXT_F64,
     IntCode_LOAD_CONTEXT_V128,
   };
-  return DispatchToC(ctx, i, fns[i->dest->type]);
+  return DispatchContextToC(ctx, i, fns[i->dest->type]);
 }
 
 uint32_t IntCode_STORE_CONTEXT_I8(IntCodeState& ics, const IntCode* i) {
-  *((int8_t*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].i8;
-  DPRINT("ctx i8 +%d = %d (%X)\n", ics.rf[i->src1_reg].u64, ics.rf[i->src2_reg].i8, ics.rf[i->src2_reg].u8);
+  *((int8_t*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].i8;
+  DPRINT("ctx i8 +%d = %d (%X)\n", i->src1_reg, ics.rf[i->src2_reg].i8, ics.rf[i->src2_reg].u8);
   return IA_NEXT;
 }
 uint32_t IntCode_STORE_CONTEXT_I16(IntCodeState& ics, const IntCode* i) {
-  *((int16_t*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].i16;
-  DPRINT("ctx i16 +%d = %d (%X)\n", ics.rf[i->src1_reg].u64, ics.rf[i->src2_reg].i16, ics.rf[i->src2_reg].u16);
+  *((int16_t*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].i16;
+  DPRINT("ctx i16 +%d = %d (%X)\n", i->src1_reg, ics.rf[i->src2_reg].i16, ics.rf[i->src2_reg].u16);
   return IA_NEXT;
 }
 uint32_t IntCode_STORE_CONTEXT_I32(IntCodeState& ics, const IntCode* i) {
-  *((int32_t*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].i32;
-  DPRINT("ctx i32 +%d = %d (%X)\n", ics.rf[i->src1_reg].u64, ics.rf[i->src2_reg].i32, ics.rf[i->src2_reg].u32);
+  *((int32_t*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].i32;
+  DPRINT("ctx i32 +%d = %d (%X)\n", i->src1_reg, ics.rf[i->src2_reg].i32, ics.rf[i->src2_reg].u32);
   return IA_NEXT;
 }
 uint32_t IntCode_STORE_CONTEXT_I64(IntCodeState& ics, const IntCode* i) {
-  *((int64_t*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].i64;
-  DPRINT("ctx i64 +%d = %lld (%llX)\n", ics.rf[i->src1_reg].u64, ics.rf[i->src2_reg].i64, ics.rf[i->src2_reg].u64);
+  *((int64_t*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].i64;
+  DPRINT("ctx i64 +%d = %lld (%llX)\n", i->src1_reg, ics.rf[i->src2_reg].i64, ics.rf[i->src2_reg].u64);
   return IA_NEXT;
 }
 uint32_t IntCode_STORE_CONTEXT_F32(IntCodeState& ics, const IntCode* i) {
-  *((float*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].f32;
-  DPRINT("ctx f32 +%d = %e (%X)\n", ics.rf[i->src1_reg].u64, ics.rf[i->src2_reg].f32, ics.rf[i->src2_reg].u32);
+  *((float*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].f32;
+  DPRINT("ctx f32 +%d = %e (%X)\n", i->src1_reg, ics.rf[i->src2_reg].f32, ics.rf[i->src2_reg].u32);
   return IA_NEXT;
 }
 uint32_t IntCode_STORE_CONTEXT_F64(IntCodeState& ics, const IntCode* i) {
-  *((double*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].f64;
-  DPRINT("ctx f64 +%d = %lle (%llX)\n", ics.rf[i->src1_reg].u64, ics.rf[i->src2_reg].f64, ics.rf[i->src2_reg].u64);
+  *((double*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].f64;
+  DPRINT("ctx f64 +%d = %lle (%llX)\n", i->src1_reg, ics.rf[i->src2_reg].f64, ics.rf[i->src2_reg].u64);
   return IA_NEXT;
 }
 uint32_t IntCode_STORE_CONTEXT_V128(IntCodeState& ics, const IntCode* i) {
-  *((vec128_t*)(ics.context + ics.rf[i->src1_reg].u64)) = ics.rf[i->src2_reg].v128;
-  DPRINT("ctx v128 +%d = [%e, %e, %e, %e] [%.8X, %.8X, %.8X, %.8X]\n", ics.rf[i->src1_reg].u64,
+  *((vec128_t*)(ics.context + i->src1_reg)) = ics.rf[i->src2_reg].v128;
+  DPRINT("ctx v128 +%d = [%e, %e, %e, %e] [%.8X, %.8X, %.8X, %.8X]\n", i->src1_reg,
          VECF4(ics.rf[i->src2_reg].v128,0), VECF4(ics.rf[i->src2_reg].v128,1), VECF4(ics.rf[i->src2_reg].v128,2), VECF4(ics.rf[i->src2_reg].v128,3),
          VECI4(ics.rf[i->src2_reg].v128,0), VECI4(ics.rf[i->src2_reg].v128,1), VECI4(ics.rf[i->src2_reg].v128,2), VECI4(ics.rf[i->src2_reg].v128,3));
   return IA_NEXT;
@@ -1543,7 +1808,7 @@ int Translate_STORE_CONTEXT(TranslationContext& ctx, Instr* i) {
     IntCode_STORE_CONTEXT_F64,
     IntCode_STORE_CONTEXT_V128,
   };
-  return DispatchToC(ctx, i, fns[i->src2.value->type]);
+  return DispatchContextToC(ctx, i, fns[i->src2.value->type]);
 }
 
 uint32_t IntCode_LOAD_I8(IntCodeState& ics, const IntCode* i) {
@@ -4227,6 +4492,735 @@ int TranslateIntCodes(TranslationContext& ctx, Instr* i) {
   return fn(ctx, i);
 }
 
+// Superinstructions.
+// Each runs a fixed sequence of IntCodes using their own operands, saving
+// the trip through the dispatch loop between them. They are installed over
+// the first IntCode of a matching run so the rest stay valid as branch
+// targets.
+
+// <produce i8> + BRANCH_TRUE_I8/BRANCH_FALSE_I8 on the produced value.
+#define DEFINE_FUSED_BRANCH(name, expr) \
+  uint32_t IntCode_FUSED_##name##_BRANCH_TRUE( \
+      IntCodeState& ics, const IntCode* i) { \
+    int8_t value = (expr); \
+    ics.rf[i->dest_reg].i8 = value; \
+    return value ? i[1].src3_reg : IA_SKIP(1); \
+  } \
+  uint32_t IntCode_FUSED_##name##_BRANCH_FALSE( \
+      IntCodeState& ics, const IntCode* i) { \
+    int8_t value = (expr); \
+    ics.rf[i->dest_reg].i8 = value; \
+    return !value ? i[1].src3_reg : IA_SKIP(1); \
+  }
+#define FUSED_COMPARE(type, op) \
+    ics.rf[i->src1_reg].type op ics.rf[i->src2_reg].type
+DEFINE_FUSED_BRANCH(LOAD_CONTEXT_I8,
+                    *((int8_t*)(ics.context + i->src1_reg)))
+DEFINE_FUSED_BRANCH(IS_TRUE_I32, !!ics.rf[i->src1_reg].i32)
+DEFINE_FUSED_BRANCH(IS_TRUE_I64, !!ics.rf[i->src1_reg].i64)
+DEFINE_FUSED_BRANCH(IS_FALSE_I32, !ics.rf[i->src1_reg].i32)
+DEFINE_FUSED_BRANCH(IS_FALSE_I64, !ics.rf[i->src1_reg].i64)
+DEFINE_FUSED_BRANCH(COMPARE_EQ_I32_I32, FUSED_COMPARE(i32, ==))
+DEFINE_FUSED_BRANCH(COMPARE_EQ_I64_I64, FUSED_COMPARE(i64, ==))
+DEFINE_FUSED_BRANCH(COMPARE_NE_I32_I32, FUSED_COMPARE(i32, !=))
+DEFINE_FUSED_BRANCH(COMPARE_NE_I64_I64, FUSED_COMPARE(i64, !=))
+DEFINE_FUSED_BRANCH(COMPARE_SLT_I32_I32, FUSED_COMPARE(i32, <))
+DEFINE_FUSED_BRANCH(COMPARE_SLT_I64_I64, FUSED_COMPARE(i64, <))
+DEFINE_FUSED_BRANCH(COMPARE_SLE_I32_I32, FUSED_COMPARE(i32, <=))
+DEFINE_FUSED_BRANCH(COMPARE_SLE_I64_I64, FUSED_COMPARE(i64, <=))
+DEFINE_FUSED_BRANCH(COMPARE_SGT_I32_I32, FUSED_COMPARE(i32, >))
+DEFINE_FUSED_BRANCH(COMPARE_SGT_I64_I64, FUSED_COMPARE(i64, >))
+DEFINE_FUSED_BRANCH(COMPARE_SGE_I32_I32, FUSED_COMPARE(i32, >=))
+DEFINE_FUSED_BRANCH(COMPARE_SGE_I64_I64, FUSED_COMPARE(i64, >=))
+DEFINE_FUSED_BRANCH(COMPARE_ULT_I32_I32, FUSED_COMPARE(u32, <))
+DEFINE_FUSED_BRANCH(COMPARE_ULT_I64_I64, FUSED_COMPARE(u64, <))
+DEFINE_FUSED_BRANCH(COMPARE_ULE_I32_I32, FUSED_COMPARE(u32, <=))
+DEFINE_FUSED_BRANCH(COMPARE_ULE_I64_I64, FUSED_COMPARE(u64, <=))
+DEFINE_FUSED_BRANCH(COMPARE_UGT_I32_I32, FUSED_COMPARE(u32, >))
+DEFINE_FUSED_BRANCH(COMPARE_UGT_I64_I64, FUSED_COMPARE(u64, >))
+DEFINE_FUSED_BRANCH(COMPARE_UGE_I32_I32, FUSED_COMPARE(u32, >=))
+DEFINE_FUSED_BRANCH(COMPARE_UGE_I64_I64, FUSED_COMPARE(u64, >=))
+
+// LOAD_CONTEXT_I64 + [LOAD_CONSTANT_I64] + op + STORE_CONTEXT_I64.
+// This is the shape of most guest integer instructions (rD = rA op rB/imm).
+#define DEFINE_FUSED_CONTEXT_OP(name, op) \
+  uint32_t IntCode_FUSED_LOAD_CONTEXT_##name##_STORE_CONTEXT( \
+      IntCodeState& ics, const IntCode* i) { \
+    ics.rf[i[0].dest_reg].i64 = *((int64_t*)(ics.context + i[0].src1_reg)); \
+    ics.rf[i[1].dest_reg].i64 = \
+        ics.rf[i[1].src1_reg].i64 op ics.rf[i[1].src2_reg].i64; \
+    *((int64_t*)(ics.context + i[2].src1_reg)) = ics.rf[i[2].src2_reg].i64; \
+    return IA_SKIP(2); \
+  } \
+  uint32_t IntCode_FUSED_LOAD_CONTEXT_CONSTANT_##name##_STORE_CONTEXT( \
+      IntCodeState& ics, const IntCode* i) { \
+    ics.rf[i[0].dest_reg].i64 = *((int64_t*)(ics.context + i[0].src1_reg)); \
+    ics.rf[i[1].dest_reg].i64 = i[1].constant.i64; \
+    ics.rf[i[2].dest_reg].i64 = \
+        ics.rf[i[2].src1_reg].i64 op ics.rf[i[2].src2_reg].i64; \
+    *((int64_t*)(ics.context + i[3].src1_reg)) = ics.rf[i[3].src2_reg].i64; \
+    return IA_SKIP(3); \
+  }
+DEFINE_FUSED_CONTEXT_OP(ADD_I64_I64, +)
+DEFINE_FUSED_CONTEXT_OP(SUB_I64_I64, -)
+DEFINE_FUSED_CONTEXT_OP(AND_I64_I64, &)
+DEFINE_FUSED_CONTEXT_OP(OR_I64_I64, |)
+DEFINE_FUSED_CONTEXT_OP(XOR_I64_I64, ^)
+
+typedef struct {
+  IntCodeFn pattern[IA_MAX_SKIP + 1];
+  size_t    length;
+  // The branch tests the value produced by the first IntCode.
+  bool      branch_on_dest;
+  IntCodeFn fused_fn;
+} SuperInstruction;
+
+#define FUSED_BRANCH_ENTRIES(name) \
+  { { IntCode_##name, IntCode_BRANCH_TRUE_I8 }, 2, true, \
+    IntCode_FUSED_##name##_BRANCH_TRUE }, \
+  { { IntCode_##name, IntCode_BRANCH_FALSE_I8 }, 2, true, \
+    IntCode_FUSED_##name##_BRANCH_FALSE }
+#define FUSED_CONTEXT_OP_ENTRIES(name) \
+  { { IntCode_LOAD_CONTEXT_I64, IntCode_LOAD_CONSTANT_I64, \
+      IntCode_##name, IntCode_STORE_CONTEXT_I64 }, 4, false, \
+    IntCode_FUSED_LOAD_CONTEXT_CONSTANT_##name##_STORE_CONTEXT }, \
+  { { IntCode_LOAD_CONTEXT_I64, IntCode_##name, \
+      IntCode_STORE_CONTEXT_I64 }, 3, false, \
+    IntCode_FUSED_LOAD_CONTEXT_##name##_STORE_CONTEXT }
+
+// Longer patterns first, as the first match wins.
+static const SuperInstruction super_instructions[] = {
+  FUSED_CONTEXT_OP_ENTRIES(ADD_I64_I64),
+  FUSED_CONTEXT_OP_ENTRIES(SUB_I64_I64),
+  FUSED_CONTEXT_OP_ENTRIES(AND_I64_I64),
+  FUSED_CONTEXT_OP_ENTRIES(OR_I64_I64),
+  FUSED_CONTEXT_OP_ENTRIES(XOR_I64_I64),
+  FUSED_BRANCH_ENTRIES(LOAD_CONTEXT_I8),
+  FUSED_BRANCH_ENTRIES(IS_TRUE_I32),
+  FUSED_BRANCH_ENTRIES(IS_TRUE_I64),
+  FUSED_BRANCH_ENTRIES(IS_FALSE_I32),
+  FUSED_BRANCH_ENTRIES(IS_FALSE_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_EQ_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_EQ_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_NE_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_NE_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_SLT_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_SLT_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_SLE_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_SLE_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_SGT_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_SGT_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_SGE_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_SGE_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_ULT_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_ULT_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_ULE_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_ULE_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_UGT_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_UGT_I64_I64),
+  FUSED_BRANCH_ENTRIES(COMPARE_UGE_I32_I32),
+  FUSED_BRANCH_ENTRIES(COMPARE_UGE_I64_I64),
+};
+
+bool MatchSuperInstruction(const SuperInstruction& si,
+                           const IntCode* i, size_t remaining) {
+  if (si.length > remaining) {
+    return false;
+  }
+  for (size_t n = 0; n < si.length; n++) {
+    // Flags change the behavior of some handlers (carry/etc).
+    if (GetIntCodeFn(&i[n]) != si.pattern[n] || i[n].flags) {
+      return false;
+    }
+  }
+  if (si.branch_on_dest && i[1].src1_reg != i[0].dest_reg) {
+    return false;
+  }
+  return true;
+}
+
+size_t FuseIntCodes(IntCode* intcodes, size_t intcode_count) {
+  size_t fused_count = 0;
+  for (size_t n = 0; n < intcode_count; n++) {
+    for (size_t m = 0; m < XECOUNT(super_instructions); m++) {
+      const SuperInstruction& si = super_instructions[m];
+      if (MatchSuperInstruction(si, &intcodes[n], intcode_count - n)) {
+        SetIntCodeFn(&intcodes[n], si.fused_fn);
+        fused_count++;
+        break;
+      }
+    }
+  }
+  return fused_count;
+}
+
+// Every handler, so serialized IntCodes can name them by index rather than
+// by address, which differs between builds. Adding handlers anywhere is
+// fine, as the table size is part of the version.
+static const IntCodeFn intcode_handlers[] = {
+  IntCode_LOAD_CONSTANT_I8,
+  IntCode_LOAD_CONSTANT_I16,
+  IntCode_LOAD_CONSTANT_I32,
+  IntCode_LOAD_CONSTANT_I64,
+  IntCode_LOAD_CONSTANT_F32,
+  IntCode_LOAD_CONSTANT_F64,
+  IntCode_LOAD_CONSTANT_V128,
+  IntCode_LOAD_REGISTER_I8,
+  IntCode_LOAD_REGISTER_I16,
+  IntCode_LOAD_REGISTER_I32,
+  IntCode_LOAD_REGISTER_I64,
+  IntCode_LOAD_REGISTER_I8_DYNAMIC,
+  IntCode_LOAD_REGISTER_I16_DYNAMIC,
+  IntCode_LOAD_REGISTER_I32_DYNAMIC,
+  IntCode_LOAD_REGISTER_I64_DYNAMIC,
+  IntCode_STORE_REGISTER_I8,
+  IntCode_STORE_REGISTER_I16,
+  IntCode_STORE_REGISTER_I32,
+  IntCode_STORE_REGISTER_I64,
+  IntCode_STORE_REGISTER_I8_DYNAMIC,
+  IntCode_STORE_REGISTER_I16_DYNAMIC,
+  IntCode_STORE_REGISTER_I32_DYNAMIC,
+  IntCode_STORE_REGISTER_I64_DYNAMIC,
+  IntCode_INVALID,
+  IntCode_INVALID_TYPE,
+  IntCode_COMMENT,
+  IntCode_NOP,
+  IntCode_SOURCE_OFFSET,
+  IntCode_SOURCE_OFFSET_BREAKPOINT,
+  IntCode_DEBUG_BREAK,
+  IntCode_DEBUG_BREAK_TRUE_I8,
+  IntCode_DEBUG_BREAK_TRUE_I16,
+  IntCode_DEBUG_BREAK_TRUE_I32,
+  IntCode_DEBUG_BREAK_TRUE_I64,
+  IntCode_DEBUG_BREAK_TRUE_F32,
+  IntCode_DEBUG_BREAK_TRUE_F64,
+  IntCode_TRAP,
+  IntCode_TRAP_TRUE_I8,
+  IntCode_TRAP_TRUE_I16,
+  IntCode_TRAP_TRUE_I32,
+  IntCode_TRAP_TRUE_I64,
+  IntCode_TRAP_TRUE_F32,
+  IntCode_TRAP_TRUE_F64,
+  IntCode_CALL_LINKED,
+  IntCode_CALL_UNLINKED,
+  IntCode_CALL,
+  IntCode_CALL_TRUE_I8,
+  IntCode_CALL_TRUE_I16,
+  IntCode_CALL_TRUE_I32,
+  IntCode_CALL_TRUE_I64,
+  IntCode_CALL_TRUE_F32,
+  IntCode_CALL_TRUE_F64,
+  IntCode_CALL_INDIRECT,
+  IntCode_CALL_INDIRECT_TRUE_I8,
+  IntCode_CALL_INDIRECT_TRUE_I16,
+  IntCode_CALL_INDIRECT_TRUE_I32,
+  IntCode_CALL_INDIRECT_TRUE_I64,
+  IntCode_CALL_INDIRECT_TRUE_F32,
+  IntCode_CALL_INDIRECT_TRUE_F64,
+  IntCode_CALL_EXTERN,
+  IntCode_RETURN,
+  IntCode_RETURN_TRUE_I8,
+  IntCode_RETURN_TRUE_I16,
+  IntCode_RETURN_TRUE_I32,
+  IntCode_RETURN_TRUE_I64,
+  IntCode_RETURN_TRUE_F32,
+  IntCode_RETURN_TRUE_F64,
+  IntCode_SET_RETURN_ADDRESS,
+  IntCode_BRANCH,
+  IntCode_BRANCH_TRUE_I8,
+  IntCode_BRANCH_TRUE_I16,
+  IntCode_BRANCH_TRUE_I32,
+  IntCode_BRANCH_TRUE_I64,
+  IntCode_BRANCH_TRUE_F32,
+  IntCode_BRANCH_TRUE_F64,
+  IntCode_BRANCH_FALSE_I8,
+  IntCode_BRANCH_FALSE_I16,
+  IntCode_BRANCH_FALSE_I32,
+  IntCode_BRANCH_FALSE_I64,
+  IntCode_BRANCH_FALSE_F32,
+  IntCode_BRANCH_FALSE_F64,
+  IntCode_ASSIGN_I8,
+  IntCode_ASSIGN_I16,
+  IntCode_ASSIGN_I32,
+  IntCode_ASSIGN_I64,
+  IntCode_ASSIGN_F32,
+  IntCode_ASSIGN_F64,
+  IntCode_ASSIGN_V128,
+  IntCode_CAST,
+  IntCode_ZERO_EXTEND_I8_TO_I16,
+  IntCode_ZERO_EXTEND_I8_TO_I32,
+  IntCode_ZERO_EXTEND_I8_TO_I64,
+  IntCode_ZERO_EXTEND_I16_TO_I32,
+  IntCode_ZERO_EXTEND_I16_TO_I64,
+  IntCode_ZERO_EXTEND_I32_TO_I64,
+  IntCode_SIGN_EXTEND_I8_TO_I16,
+  IntCode_SIGN_EXTEND_I8_TO_I32,
+  IntCode_SIGN_EXTEND_I8_TO_I64,
+  IntCode_SIGN_EXTEND_I16_TO_I32,
+  IntCode_SIGN_EXTEND_I16_TO_I64,
+  IntCode_SIGN_EXTEND_I32_TO_I64,
+  IntCode_TRUNCATE_I16_TO_I8,
+  IntCode_TRUNCATE_I32_TO_I8,
+  IntCode_TRUNCATE_I32_TO_I16,
+  IntCode_TRUNCATE_I64_TO_I8,
+  IntCode_TRUNCATE_I64_TO_I16,
+  IntCode_TRUNCATE_I64_TO_I32,
+  IntCode_CONVERT_I32_TO_F32,
+  IntCode_CONVERT_I64_TO_F64,
+  IntCode_CONVERT_F32_TO_I32,
+  IntCode_CONVERT_F32_TO_F64,
+  IntCode_CONVERT_F64_TO_I32,
+  IntCode_CONVERT_F64_TO_I64,
+  IntCode_CONVERT_F64_TO_F32,
+  IntCode_ROUND_F32,
+  IntCode_ROUND_F64,
+  IntCode_ROUND_V128_ZERO,
+  IntCode_ROUND_V128_NEAREST,
+  IntCode_ROUND_V128_MINUS_INFINITY,
+  IntCode_ROUND_V128_POSITIVE_INFINTIY,
+  IntCode_VECTOR_CONVERT_I2F_S,
+  IntCode_VECTOR_CONVERT_I2F_U,
+  IntCode_VECTOR_CONVERT_F2I,
+  IntCode_VECTOR_CONVERT_F2I_SAT,
+  IntCode_LOAD_VECTOR_SHL,
+  IntCode_LOAD_VECTOR_SHR,
+  IntCode_LOAD_CLOCK,
+  IntCode_LOAD_LOCAL_I8,
+  IntCode_LOAD_LOCAL_I16,
+  IntCode_LOAD_LOCAL_I32,
+  IntCode_LOAD_LOCAL_I64,
+  IntCode_LOAD_LOCAL_F32,
+  IntCode_LOAD_LOCAL_F64,
+  IntCode_LOAD_LOCAL_V128,
+  IntCode_STORE_LOCAL_I8,
+  IntCode_STORE_LOCAL_I16,
+  IntCode_STORE_LOCAL_I32,
+  IntCode_STORE_LOCAL_I64,
+  IntCode_STORE_LOCAL_F32,
+  IntCode_STORE_LOCAL_F64,
+  IntCode_STORE_LOCAL_V128,
+  IntCode_LOAD_CONTEXT_I8,
+  IntCode_LOAD_CONTEXT_I16,
+  IntCode_LOAD_CONTEXT_I32,
+  IntCode_LOAD_CONTEXT_I64,
+  IntCode_LOAD_CONTEXT_F32,
+  IntCode_LOAD_CONTEXT_F64,
+  IntCode_LOAD_CONTEXT_V128,
+  IntCode_STORE_CONTEXT_I8,
+  IntCode_STORE_CONTEXT_I16,
+  IntCode_STORE_CONTEXT_I32,
+  IntCode_STORE_CONTEXT_I64,
+  IntCode_STORE_CONTEXT_F32,
+  IntCode_STORE_CONTEXT_F64,
+  IntCode_STORE_CONTEXT_V128,
+  IntCode_LOAD_I8,
+  IntCode_LOAD_I16,
+  IntCode_LOAD_I32,
+  IntCode_LOAD_I64,
+  IntCode_LOAD_F32,
+  IntCode_LOAD_F64,
+  IntCode_LOAD_V128,
+  IntCode_STORE_I8,
+  IntCode_STORE_I16,
+  IntCode_STORE_I32,
+  IntCode_STORE_I64,
+  IntCode_STORE_F32,
+  IntCode_STORE_F64,
+  IntCode_STORE_V128,
+  IntCode_PREFETCH,
+  IntCode_MAX_I8_I8,
+  IntCode_MAX_I16_I16,
+  IntCode_MAX_I32_I32,
+  IntCode_MAX_I64_I64,
+  IntCode_MAX_F32_F32,
+  IntCode_MAX_F64_F64,
+  IntCode_MAX_V128_V128,
+  IntCode_MIN_I8_I8,
+  IntCode_MIN_I16_I16,
+  IntCode_MIN_I32_I32,
+  IntCode_MIN_I64_I64,
+  IntCode_MIN_F32_F32,
+  IntCode_MIN_F64_F64,
+  IntCode_MIN_V128_V128,
+  IntCode_SELECT_I8,
+  IntCode_SELECT_I16,
+  IntCode_SELECT_I32,
+  IntCode_SELECT_I64,
+  IntCode_SELECT_F32,
+  IntCode_SELECT_F64,
+  IntCode_SELECT_V128,
+  IntCode_IS_TRUE_I8,
+  IntCode_IS_TRUE_I16,
+  IntCode_IS_TRUE_I32,
+  IntCode_IS_TRUE_I64,
+  IntCode_IS_TRUE_F32,
+  IntCode_IS_TRUE_F64,
+  IntCode_IS_TRUE_V128,
+  IntCode_IS_FALSE_I8,
+  IntCode_IS_FALSE_I16,
+  IntCode_IS_FALSE_I32,
+  IntCode_IS_FALSE_I64,
+  IntCode_IS_FALSE_F32,
+  IntCode_IS_FALSE_F64,
+  IntCode_IS_FALSE_V128,
+  IntCode_COMPARE_EQ_I8_I8,
+  IntCode_COMPARE_EQ_I16_I16,
+  IntCode_COMPARE_EQ_I32_I32,
+  IntCode_COMPARE_EQ_I64_I64,
+  IntCode_COMPARE_EQ_F32_F32,
+  IntCode_COMPARE_EQ_F64_F64,
+  IntCode_COMPARE_NE_I8_I8,
+  IntCode_COMPARE_NE_I16_I16,
+  IntCode_COMPARE_NE_I32_I32,
+  IntCode_COMPARE_NE_I64_I64,
+  IntCode_COMPARE_NE_F32_F32,
+  IntCode_COMPARE_NE_F64_F64,
+  IntCode_COMPARE_SLT_I8_I8,
+  IntCode_COMPARE_SLT_I16_I16,
+  IntCode_COMPARE_SLT_I32_I32,
+  IntCode_COMPARE_SLT_I64_I64,
+  IntCode_COMPARE_SLT_F32_F32,
+  IntCode_COMPARE_SLT_F64_F64,
+  IntCode_COMPARE_SLE_I8_I8,
+  IntCode_COMPARE_SLE_I16_I16,
+  IntCode_COMPARE_SLE_I32_I32,
+  IntCode_COMPARE_SLE_I64_I64,
+  IntCode_COMPARE_SLE_F32_F32,
+  IntCode_COMPARE_SLE_F64_F64,
+  IntCode_COMPARE_SGT_I8_I8,
+  IntCode_COMPARE_SGT_I16_I16,
+  IntCode_COMPARE_SGT_I32_I32,
+  IntCode_COMPARE_SGT_I64_I64,
+  IntCode_COMPARE_SGT_F32_F32,
+  IntCode_COMPARE_SGT_F64_F64,
+  IntCode_COMPARE_SGE_I8_I8,
+  IntCode_COMPARE_SGE_I16_I16,
+  IntCode_COMPARE_SGE_I32_I32,
+  IntCode_COMPARE_SGE_I64_I64,
+  IntCode_COMPARE_SGE_F32_F32,
+  IntCode_COMPARE_SGE_F64_F64,
+  IntCode_COMPARE_ULT_I8_I8,
+  IntCode_COMPARE_ULT_I16_I16,
+  IntCode_COMPARE_ULT_I32_I32,
+  IntCode_COMPARE_ULT_I64_I64,
+  IntCode_COMPARE_ULT_F32_F32,
+  IntCode_COMPARE_ULT_F64_F64,
+  IntCode_COMPARE_ULE_I8_I8,
+  IntCode_COMPARE_ULE_I16_I16,
+  IntCode_COMPARE_ULE_I32_I32,
+  IntCode_COMPARE_ULE_I64_I64,
+  IntCode_COMPARE_ULE_F32_F32,
+  IntCode_COMPARE_ULE_F64_F64,
+  IntCode_COMPARE_UGT_I8_I8,
+  IntCode_COMPARE_UGT_I16_I16,
+  IntCode_COMPARE_UGT_I32_I32,
+  IntCode_COMPARE_UGT_I64_I64,
+  IntCode_COMPARE_UGT_F32_F32,
+  IntCode_COMPARE_UGT_F64_F64,
+  IntCode_COMPARE_UGE_I8_I8,
+  IntCode_COMPARE_UGE_I16_I16,
+  IntCode_COMPARE_UGE_I32_I32,
+  IntCode_COMPARE_UGE_I64_I64,
+  IntCode_COMPARE_UGE_F32_F32,
+  IntCode_COMPARE_UGE_F64_F64,
+  IntCode_DID_CARRY,
+  IntCode_DID_SATURATE,
+  IntCode_VECTOR_COMPARE_EQ_I8,
+  IntCode_VECTOR_COMPARE_EQ_I16,
+  IntCode_VECTOR_COMPARE_EQ_I32,
+  IntCode_VECTOR_COMPARE_EQ_F32,
+  IntCode_VECTOR_COMPARE_SGT_I8,
+  IntCode_VECTOR_COMPARE_SGT_I16,
+  IntCode_VECTOR_COMPARE_SGT_I32,
+  IntCode_VECTOR_COMPARE_SGT_F32,
+  IntCode_VECTOR_COMPARE_SGE_I8,
+  IntCode_VECTOR_COMPARE_SGE_I16,
+  IntCode_VECTOR_COMPARE_SGE_I32,
+  IntCode_VECTOR_COMPARE_SGE_F32,
+  IntCode_VECTOR_COMPARE_UGT_I8,
+  IntCode_VECTOR_COMPARE_UGT_I16,
+  IntCode_VECTOR_COMPARE_UGT_I32,
+  IntCode_VECTOR_COMPARE_UGT_F32,
+  IntCode_VECTOR_COMPARE_UGE_I8,
+  IntCode_VECTOR_COMPARE_UGE_I16,
+  IntCode_VECTOR_COMPARE_UGE_I32,
+  IntCode_VECTOR_COMPARE_UGE_F32,
+  IntCode_ADD_I8_I8,
+  IntCode_ADD_I16_I16,
+  IntCode_ADD_I32_I32,
+  IntCode_ADD_I64_I64,
+  IntCode_ADD_F32_F32,
+  IntCode_ADD_F64_F64,
+  IntCode_ADD_V128_V128,
+  IntCode_ADD_CARRY_I8_I8,
+  IntCode_ADD_CARRY_I16_I16,
+  IntCode_ADD_CARRY_I32_I32,
+  IntCode_ADD_CARRY_I64_I64,
+  IntCode_ADD_CARRY_F32_F32,
+  IntCode_ADD_CARRY_F64_F64,
+  IntCode_SUB_I8_I8,
+  IntCode_SUB_I16_I16,
+  IntCode_SUB_I32_I32,
+  IntCode_SUB_I64_I64,
+  IntCode_SUB_F32_F32,
+  IntCode_SUB_F64_F64,
+  IntCode_SUB_V128_V128,
+  IntCode_MUL_I8_I8,
+  IntCode_MUL_I16_I16,
+  IntCode_MUL_I32_I32,
+  IntCode_MUL_I64_I64,
+  IntCode_MUL_F32_F32,
+  IntCode_MUL_F64_F64,
+  IntCode_MUL_V128_V128,
+  IntCode_MUL_I8_I8_U,
+  IntCode_MUL_I16_I16_U,
+  IntCode_MUL_I32_I32_U,
+  IntCode_MUL_I64_I64_U,
+  IntCode_MUL_HI_I8_I8,
+  IntCode_MUL_HI_I16_I16,
+  IntCode_MUL_HI_I32_I32,
+  IntCode_MUL_HI_I64_I64,
+  IntCode_MUL_HI_I8_I8_U,
+  IntCode_MUL_HI_I16_I16_U,
+  IntCode_MUL_HI_I32_I32_U,
+  IntCode_MUL_HI_I64_I64_U,
+  IntCode_DIV_I8_I8,
+  IntCode_DIV_I16_I16,
+  IntCode_DIV_I32_I32,
+  IntCode_DIV_I64_I64,
+  IntCode_DIV_F32_F32,
+  IntCode_DIV_F64_F64,
+  IntCode_DIV_V128_V128,
+  IntCode_DIV_I8_I8_U,
+  IntCode_DIV_I16_I16_U,
+  IntCode_DIV_I32_I32_U,
+  IntCode_DIV_I64_I64_U,
+  IntCode_MUL_ADD_I8,
+  IntCode_MUL_ADD_I16,
+  IntCode_MUL_ADD_I32,
+  IntCode_MUL_ADD_I64,
+  IntCode_MUL_ADD_F32,
+  IntCode_MUL_ADD_F64,
+  IntCode_MUL_ADD_V128,
+  IntCode_MUL_SUB_I8,
+  IntCode_MUL_SUB_I16,
+  IntCode_MUL_SUB_I32,
+  IntCode_MUL_SUB_I64,
+  IntCode_MUL_SUB_F32,
+  IntCode_MUL_SUB_F64,
+  IntCode_MUL_SUB_V128,
+  IntCode_NEG_I8,
+  IntCode_NEG_I16,
+  IntCode_NEG_I32,
+  IntCode_NEG_I64,
+  IntCode_NEG_F32,
+  IntCode_NEG_F64,
+  IntCode_NEG_V128,
+  IntCode_ABS_I8,
+  IntCode_ABS_I16,
+  IntCode_ABS_I32,
+  IntCode_ABS_I64,
+  IntCode_ABS_F32,
+  IntCode_ABS_F64,
+  IntCode_ABS_V128,
+  IntCode_DOT_PRODUCT_3_V128,
+  IntCode_DOT_PRODUCT_4_V128,
+  IntCode_SQRT_F32,
+  IntCode_SQRT_F64,
+  IntCode_SQRT_V128,
+  IntCode_RSQRT_V128,
+  IntCode_POW2_F32,
+  IntCode_POW2_F64,
+  IntCode_POW2_V128,
+  IntCode_LOG2_F32,
+  IntCode_LOG2_F64,
+  IntCode_LOG2_V128,
+  IntCode_AND_I8_I8,
+  IntCode_AND_I16_I16,
+  IntCode_AND_I32_I32,
+  IntCode_AND_I64_I64,
+  IntCode_AND_V128_V128,
+  IntCode_OR_I8_I8,
+  IntCode_OR_I16_I16,
+  IntCode_OR_I32_I32,
+  IntCode_OR_I64_I64,
+  IntCode_OR_V128_V128,
+  IntCode_XOR_I8_I8,
+  IntCode_XOR_I16_I16,
+  IntCode_XOR_I32_I32,
+  IntCode_XOR_I64_I64,
+  IntCode_XOR_V128_V128,
+  IntCode_NOT_I8,
+  IntCode_NOT_I16,
+  IntCode_NOT_I32,
+  IntCode_NOT_I64,
+  IntCode_NOT_V128,
+  IntCode_SHL_I8,
+  IntCode_SHL_I16,
+  IntCode_SHL_I32,
+  IntCode_SHL_I64,
+  IntCode_VECTOR_SHL_I8,
+  IntCode_VECTOR_SHL_I16,
+  IntCode_VECTOR_SHL_I32,
+  IntCode_SHR_I8,
+  IntCode_SHR_I16,
+  IntCode_SHR_I32,
+  IntCode_SHR_I64,
+  IntCode_VECTOR_SHR_I8,
+  IntCode_VECTOR_SHR_I16,
+  IntCode_VECTOR_SHR_I32,
+  IntCode_SHA_I8,
+  IntCode_SHA_I16,
+  IntCode_SHA_I32,
+  IntCode_SHA_I64,
+  IntCode_VECTOR_SHA_I8,
+  IntCode_VECTOR_SHA_I16,
+  IntCode_VECTOR_SHA_I32,
+  IntCode_ROTATE_LEFT_I8,
+  IntCode_ROTATE_LEFT_I16,
+  IntCode_ROTATE_LEFT_I32,
+  IntCode_ROTATE_LEFT_I64,
+  IntCode_BYTE_SWAP_I16,
+  IntCode_BYTE_SWAP_I32,
+  IntCode_BYTE_SWAP_I64,
+  IntCode_BYTE_SWAP_V128,
+  IntCode_CNTLZ_I8,
+  IntCode_CNTLZ_I16,
+  IntCode_CNTLZ_I32,
+  IntCode_CNTLZ_I64,
+  IntCode_EXTRACT_INT8_V128,
+  IntCode_EXTRACT_INT16_V128,
+  IntCode_EXTRACT_INT32_V128,
+  IntCode_INSERT_INT8_V128,
+  IntCode_INSERT_INT16_V128,
+  IntCode_INSERT_INT32_V128,
+  IntCode_SPLAT_V128_INT8,
+  IntCode_SPLAT_V128_INT16,
+  IntCode_SPLAT_V128_INT32,
+  IntCode_SPLAT_V128_FLOAT32,
+  IntCode_PERMUTE_V128_BY_INT32,
+  IntCode_PERMUTE_V128_BY_V128,
+  IntCode_SWIZZLE_V128,
+  IntCode_PACK_D3DCOLOR,
+  IntCode_PACK_FLOAT16_2,
+  IntCode_PACK_FLOAT16_4,
+  IntCode_PACK_SHORT_2,
+  IntCode_UNPACK_D3DCOLOR,
+  IntCode_UNPACK_FLOAT16_2,
+  IntCode_UNPACK_FLOAT16_4,
+  IntCode_UNPACK_SHORT_2,
+  IntCode_UNPACK_S8_IN_16_LO,
+  IntCode_UNPACK_S8_IN_16_HI,
+  IntCode_UNPACK_S16_IN_32_LO,
+  IntCode_UNPACK_S16_IN_32_HI,
+  IntCode_ATOMIC_EXCHANGE_I32,
+  IntCode_ATOMIC_EXCHANGE_I64,
+
+  // Superinstructions.
+  IntCode_FUSED_LOAD_CONTEXT_ADD_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_CONSTANT_ADD_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_SUB_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_CONSTANT_SUB_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_AND_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_CONSTANT_AND_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_OR_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_CONSTANT_OR_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_XOR_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_CONSTANT_XOR_I64_I64_STORE_CONTEXT,
+  IntCode_FUSED_LOAD_CONTEXT_I8_BRANCH_TRUE,
+  IntCode_FUSED_LOAD_CONTEXT_I8_BRANCH_FALSE,
+  IntCode_FUSED_IS_TRUE_I32_BRANCH_TRUE,
+  IntCode_FUSED_IS_TRUE_I32_BRANCH_FALSE,
+  IntCode_FUSED_IS_TRUE_I64_BRANCH_TRUE,
+  IntCode_FUSED_IS_TRUE_I64_BRANCH_FALSE,
+  IntCode_FUSED_IS_FALSE_I32_BRANCH_TRUE,
+  IntCode_FUSED_IS_FALSE_I32_BRANCH_FALSE,
+  IntCode_FUSED_IS_FALSE_I64_BRANCH_TRUE,
+  IntCode_FUSED_IS_FALSE_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_EQ_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_EQ_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_EQ_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_EQ_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_NE_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_NE_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_NE_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_NE_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SLT_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SLT_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SLT_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SLT_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SLE_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SLE_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SLE_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SLE_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SGT_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SGT_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SGT_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SGT_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SGE_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SGE_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_SGE_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_SGE_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_ULT_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_ULT_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_ULT_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_ULT_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_ULE_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_ULE_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_ULE_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_ULE_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_UGT_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_UGT_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_UGT_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_UGT_I64_I64_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_UGE_I32_I32_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_UGE_I32_I32_BRANCH_FALSE,
+  IntCode_FUSED_COMPARE_UGE_I64_I64_BRANCH_TRUE,
+  IntCode_FUSED_COMPARE_UGE_I64_I64_BRANCH_FALSE,
+};
+
+// Handler offset (as stored in IntCodes) to index in intcode_handlers.
+static std::unordered_map<int32_t, int32_t> intcode_handler_indices;
+
+void InitializeIntCodeHandlers() {
+  if (!intcode_handler_indices.empty()) {
+    return;
+  }
+  for (size_t n = 0; n < XECOUNT(intcode_handlers); n++) {
+    intcode_handler_indices[GetIntCodeFnOffset(intcode_handlers[n])] =
+        (int32_t)n;
+  }
+}
+
+int32_t GetIntCodeHandlerIndex(const IntCode* i) {
+  auto it = intcode_handler_indices.find(i->intcode_fn_offset);
+  return it != intcode_handler_indices.end() ? it->second : -1;
+}
+
+bool SetIntCodeHandlerIndex(IntCode* i, int32_t index) {
+  if (index < 0 || index >= (int32_t)XECOUNT(intcode_handlers)) {
+    return false;
+  }
+  SetIntCodeFn(i, intcode_handlers[index]);
+  return true;
+}
+
+// Bump when handler behavior or the IntCode encoding changes. Generated
+// code as a whole is covered by TranslationCache::kCompilerVersion.
+const uint64_t kIntCodeVersion = 2;
+
+uint64_t GetIntCodeVersion() {
+  uint64_t hash = TranslationCache::Hash(
+      &kIntCodeVersion, sizeof(kIntCodeVersion),
+      TranslationCache::kFormatVersion ^ sizeof(IntCode));
+  uint32_t handler_count = (uint32_t)XECOUNT(intcode_handlers);
+  hash = TranslationCache::Hash(&handler_count, sizeof(handler_count), hash);
+
+  // Fusion changes which handlers end up in the output.
+  uint8_t fused = FLAGS_ivm_superinstructions ? 1 : 0;
+  return TranslationCache::Hash(&fused, sizeof(fused), hash);
+}
+
 
 }  // namespace ivm
 }  // namespace backend
@@ -14,9 +14,13 @@
 
 #include <alloy/hir/instr.h>
 #include <alloy/hir/opcodes.h>
+#include <alloy/runtime/inline_cache.h>
 #include <alloy/runtime/register_access.h>
 
-namespace alloy { namespace runtime { class ThreadState; } }
+namespace alloy { namespace runtime {
+  class Function;
+  class ThreadState;
+} }
 
 
 namespace alloy {
@@ -47,6 +51,9 @@ typedef struct {
   int8_t        did_carry;
   int8_t        did_saturate;
   runtime::RegisterAccessCallbacks* access_callbacks;
+  runtime::InlineCache* inline_caches;
+  const vec128_t* constants;
+  runtime::Function* function;
   runtime::ThreadState* thread_state;
   uint64_t      return_address;
   uint64_t      call_return_address;
@@ -59,12 +66,37 @@ typedef uint32_t (*IntCodeFn)(
 
 #define IA_RETURN 0xA0000000
 #define IA_NEXT   0xB0000000
+// Superinstructions execute the IntCodes following them as well and return
+// IA_SKIP(n) to step over the n they absorbed.
+#define IA_SKIP(n)    (IA_NEXT + (n))
+#define IA_MAX_SKIP   3
 
 
+// Constants small enough to be stored inline. Vectors live in the
+// function's constant pool instead.
+typedef union {
+  int8_t    i8;
+  uint8_t   u8;
+  int16_t   i16;
+  uint16_t  u16;
+  int32_t   i32;
+  uint32_t  u32;
+  int64_t   i64;
+  uint64_t  u64;
+  float     f32;
+  double    f64;
+} IntCodeConstant;
+
+
+// Every IntCode is fetched on every execution, so this is kept to 24 bytes.
+// Packed to 4 so the 8-byte constant doesn't pad the union out.
+#pragma pack(push, 4)
 typedef struct IntCode_s {
-  IntCodeFn intcode_fn;
+  // Handler as an offset from IntCode_INVALID, which is half the size of a
+  // pointer. Use GetIntCodeFn/SetIntCodeFn.
+  int32_t   intcode_fn_offset;
   uint16_t  flags;
-  uint16_t  debug_flags;
+  uint16_t  reserved;
 
   uint32_t  dest_reg;
   union {
@@ -72,19 +104,29 @@ typedef struct IntCode_s {
       uint32_t  src1_reg;
       uint32_t  src2_reg;
       uint32_t  src3_reg;
-      // <4 bytes available>
-    };
-    struct {
-      Register  constant;
     };
+    IntCodeConstant constant;
   };
-
-  // debugging info/etc
 } IntCode;
+#pragma pack(pop)
+XESTATICASSERT(sizeof(IntCode) == 24, "IntCode should be 24 bytes");
+
+
+uint32_t IntCode_INVALID(IntCodeState& ics, const IntCode* i);
+
+XEFORCEINLINE IntCodeFn GetIntCodeFn(const IntCode* i) {
+  return (IntCodeFn)((intptr_t)IntCode_INVALID + i->intcode_fn_offset);
+}
+XEFORCEINLINE void SetIntCodeFn(IntCode* i, IntCodeFn fn) {
+  intptr_t offset = (intptr_t)fn - (intptr_t)IntCode_INVALID;
+  XEASSERT(offset == (int32_t)offset);
+  i->intcode_fn_offset = (int32_t)offset;
+}
 
 
 typedef struct LabelRef_s {
   hir::Label* label;
+  // Branch whose src3_reg is patched with the IA of the label.
   IntCode*    instr;
   LabelRef_s* next;
 } LabelRef;
@@ -96,6 +138,24 @@ typedef struct SourceMapEntry_s {
 } SourceMapEntry;
 
 
+// Host pointers baked into IntCodes that must be rewritten when a function
+// is stored to or loaded from the translation cache.
+enum IntCodeRelocType {
+  // FunctionInfo* split across src2_reg (low) and src3_reg (high).
+  RELOC_SYMBOL_SRC2           = 1,
+  // FunctionInfo* in constant.u64.
+  RELOC_SYMBOL_CONSTANT       = 2,
+  // RegisterAccessCallbacks* in src2_reg (low) and src3_reg (high).
+  RELOC_ACCESS_CALLBACKS_SRC2 = 3,
+  // RegisterAccessCallbacks* in src3_reg (low) and dest_reg (high).
+  RELOC_ACCESS_CALLBACKS_SRC3 = 4,
+};
+typedef struct IntCodeReloc_s {
+  uint32_t    intcode_index;
+  uint32_t    type;
+} IntCodeReloc;
+
+
 typedef struct {
   runtime::RegisterAccessCallbacks* access_callbacks;
 
@@ -104,7 +164,15 @@ typedef struct {
   Arena*    intcode_arena;
   size_t    source_map_count;
   Arena*    source_map_arena;
+  size_t    inline_cache_count;
+  Arena*    inline_cache_arena;
+  size_t    constant_count;
+  Arena*    constant_arena;
+  size_t    reloc_count;
+  Arena*    reloc_arena;
+  bool      is_cacheable;
   Arena*    scratch_arena;
+  uint64_t  source_offset;
   LabelRef* label_ref_head;
   size_t    stack_size;
 } TranslationContext;
@@ -112,6 +180,29 @@ typedef struct {
 
 int TranslateIntCodes(TranslationContext& ctx, hir::Instr* i);
 
+// Reverts a CALL that was linked directly to its callee.
+void UnlinkCallIntCode(IntCode* i);
+
+// Swaps the handler of a SOURCE_OFFSET IntCode for one that reports the
+// breakpoint stored in src2_reg/src3_reg, or back again.
+void SetBreakpointIntCode(IntCode* i, bool enabled);
+
+// Replaces common runs of IntCodes with superinstructions in place.
+// The absorbed IntCodes are left as-is so branches into the middle of a run
+// still work. Returns the number of superinstructions formed.
+size_t FuseIntCodes(IntCode* intcodes, size_t intcode_count);
+
+// Handlers are serialized as indices into a table of all of them, as their
+// addresses differ between builds. Must be called before the other two.
+void InitializeIntCodeHandlers();
+// Returns -1 if the handler isn't in the table.
+int32_t GetIntCodeHandlerIndex(const IntCode* i);
+// Returns false if the index is out of range.
+bool SetIntCodeHandlerIndex(IntCode* i, int32_t index);
+
+// Changes whenever the handlers or their encoding may have.
+uint64_t GetIntCodeVersion();
+
 
 }  // namespace ivm
 }  // namespace backend
@@ -29,6 +29,13 @@ struct MachineInfo {
     uint32_t types;
     uint32_t count;
   } register_sets[8];
+
+  // Binary ops overwrite their first source (dest = dest op src), as on
+  // x86, so operands should be ordered to let it be reused.
+  bool two_address_ops;
+  // Cycles before a loaded value can be used, for scheduling. 0 disables
+  // scheduling (interpreters, or hardware that does it all itself).
+  uint32_t load_latency;
 };
 
 
@@ -9,6 +9,7 @@
 
 #include <alloy/backend/x64/lowering/lowering_sequences.h>
 
+#include <alloy/alloy-private.h>
 #include <alloy/backend/x64/x64_backend.h>
 #include <alloy/backend/x64/x64_emitter.h>
 #include <alloy/backend/x64/x64_function.h>
@@ -236,7 +237,9 @@ void IssueCall(X64Emitter& e, FunctionInfo* symbol_info, uint32_t flags) {
   auto fn = (X64Function*)symbol_info->function();
   // Resolve address to the function to call and store in rax.
   // TODO(benvanik): caching/etc. For now this makes debugging easier.
-  if (fn) {
+  // If guest code can be modified the callee may be replaced later, so
+  // it's always resolved then.
+  if (fn && !FLAGS_invalidate_modified_code) {
     e.mov(e.rax, (uint64_t)fn->machine_code());
   } else {
     e.mov(e.rdx, (uint64_t)symbol_info);
@@ -11,6 +11,7 @@
 
 #include <alloy/backend/x64/tracing.h>
 #include <alloy/backend/x64/x64_backend.h>
+#include <alloy/backend/x64/x64_code_cache.h>
 #include <alloy/backend/x64/x64_emitter.h>
 #include <alloy/backend/x64/x64_function.h>
 #include <alloy/hir/hir_builder.h>
@@ -83,6 +84,18 @@ int X64Assembler::Assemble(
     string_buffer_.Reset();
   }
 
+  // Let profilers see guest functions by name.
+  if (symbol_info->name()) {
+    x64_backend_->code_cache()->AddSymbol(
+        machine_code, code_size, symbol_info->name());
+  } else {
+    char name_buffer[32];
+    xesnprintfa(name_buffer, XECOUNT(name_buffer), "sub_%.8X",
+                (uint32_t)symbol_info->address());
+    x64_backend_->code_cache()->AddSymbol(
+        machine_code, code_size, name_buffer);
+  }
+
   X64Function* fn = new X64Function(symbol_info);
   fn->set_debug_info(debug_info);
   fn->Setup(machine_code, code_size);
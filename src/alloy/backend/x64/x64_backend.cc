@@ -50,6 +50,8 @@ int X64Backend::Initialize() {
     MachineInfo::RegisterSet::VEC_TYPES,
     X64Emitter::XMM_COUNT,
   };
+  machine_info_.two_address_ops = true;
+  machine_info_.load_latency = 4;
 
   code_cache_ = new X64CodeCache();
   result = code_cache_->Initialize();
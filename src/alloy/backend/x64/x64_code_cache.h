@@ -30,14 +30,36 @@ public:
   // TODO(benvanik): keep track of code blocks
   // TODO(benvanik): padding/guards/etc
 
+  // Copies fully relocated machine code into the cache and returns the
+  // address it should be executed from. The code must be position
+  // independent, as it may be written through a different mapping than the
+  // one it runs from.
   void* PlaceCode(void* machine_code, size_t code_size, size_t stack_size);
 
+  // Names a range of placed code for external profilers (--perf_map).
+  void AddSymbol(void* code_address, size_t code_size, const char* name);
+
 private:
   const static size_t DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024;
   Mutex*        lock_;
   size_t        chunk_size_;
+#if XE_LIKE_WIN32
   X64CodeChunk* head_chunk_;
   X64CodeChunk* active_chunk_;
+#else
+  // All code lives in a single reserved region so that any two functions
+  // are within rel32 range of each other. The region is backed by a shared
+  // memory file that is mapped twice: once RW for PlaceCode to write
+  // through and once RX to execute from. The file is grown a chunk at a
+  // time as code is placed.
+  const static size_t REGION_SIZE = 1024 * 1024 * 1024;
+  int           region_fd_;
+  uint8_t*      write_base_;
+  uint8_t*      execute_base_;
+  size_t        region_offset_;
+  size_t        committed_size_;
+  FILE*         perf_map_file_;
+#endif  // XE_LIKE_WIN32
 };
 
 
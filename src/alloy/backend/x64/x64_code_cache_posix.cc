@@ -0,0 +1,186 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/backend/x64/x64_code_cache.h>
+
+#include <alloy/alloy-private.h>
+#include <alloy/backend/x64/tracing.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+using namespace alloy;
+using namespace alloy::backend;
+using namespace alloy::backend::x64;
+
+
+namespace {
+
+// Creates an anonymous shared memory file to back the code region.
+// memfd_create never touches the filesystem, but needs Linux 3.17+; other
+// systems get an immediately unlinked POSIX shm object.
+int CreateRegionFile() {
+#if defined(__NR_memfd_create)
+  // 1 == MFD_CLOEXEC, which older headers don't define.
+  int fd = (int)syscall(__NR_memfd_create, "xenia-code-cache", 1);
+  if (fd != -1) {
+    return fd;
+  }
+#endif  // __NR_memfd_create
+  char name[64];
+  xesnprintfa(name, XECOUNT(name), "/xenia-code-cache-%d", (int)getpid());
+  int shm_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (shm_fd == -1) {
+    return -1;
+  }
+  shm_unlink(name);
+  return shm_fd;
+}
+
+}  // namespace
+
+
+X64CodeCache::X64CodeCache(size_t chunk_size) :
+    chunk_size_(chunk_size),
+    region_fd_(-1), write_base_(NULL), execute_base_(NULL),
+    region_offset_(0), committed_size_(0),
+    perf_map_file_(NULL) {
+  lock_ = AllocMutex();
+}
+
+X64CodeCache::~X64CodeCache() {
+  LockMutex(lock_);
+  if (write_base_ && write_base_ != execute_base_) {
+    munmap(write_base_, REGION_SIZE);
+  }
+  if (execute_base_) {
+    munmap(execute_base_, REGION_SIZE);
+  }
+  write_base_ = execute_base_ = NULL;
+  if (region_fd_ != -1) {
+    close(region_fd_);
+    region_fd_ = -1;
+  }
+  if (perf_map_file_) {
+    fclose(perf_map_file_);
+    perf_map_file_ = NULL;
+  }
+  UnlockMutex(lock_);
+  FreeMutex(lock_);
+}
+
+int X64CodeCache::Initialize() {
+  // Map the whole region up front. Nothing is committed until the file is
+  // grown, and both views stay at fixed addresses for the cache lifetime.
+  region_fd_ = CreateRegionFile();
+  if (region_fd_ != -1) {
+    void* execute_base = mmap(
+        NULL, REGION_SIZE, PROT_READ | PROT_EXEC,
+        MAP_SHARED | MAP_NORESERVE, region_fd_, 0);
+    void* write_base = mmap(
+        NULL, REGION_SIZE, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_NORESERVE, region_fd_, 0);
+    if (execute_base != MAP_FAILED && write_base != MAP_FAILED) {
+      execute_base_ = (uint8_t*)execute_base;
+      write_base_ = (uint8_t*)write_base;
+    } else {
+      if (execute_base != MAP_FAILED) {
+        munmap(execute_base, REGION_SIZE);
+      }
+      if (write_base != MAP_FAILED) {
+        munmap(write_base, REGION_SIZE);
+      }
+      close(region_fd_);
+      region_fd_ = -1;
+    }
+  }
+
+  if (!execute_base_) {
+    // Some systems forbid executable shared mappings (noexec /dev/shm,
+    // hardened kernels). Fall back to a single RWX view.
+    XELOGW("X64CodeCache unable to double map code, falling back to RWX");
+    void* base = mmap(
+        NULL, REGION_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+      XELOGE("X64CodeCache unable to reserve %u MB of code space",
+             (uint32_t)(REGION_SIZE / (1024 * 1024)));
+      return 1;
+    }
+    execute_base_ = write_base_ = (uint8_t*)base;
+  }
+
+  if (FLAGS_perf_map) {
+    char path[64];
+    xesnprintfa(path, XECOUNT(path), "/tmp/perf-%d.map", (int)getpid());
+    perf_map_file_ = fopen(path, "w");
+    if (!perf_map_file_) {
+      XELOGW("X64CodeCache unable to open perf map %s", path);
+    }
+  }
+
+  return 0;
+}
+
+void* X64CodeCache::PlaceCode(void* machine_code, size_t code_size,
+                              size_t stack_size) {
+  // No unwind info is registered on POSIX, so stack_size is unused.
+
+  // Always move the code to land on 16b alignment.
+  size_t alloc_size = XEROUNDUP(code_size, 16);
+
+  LockMutex(lock_);
+
+  size_t offset = region_offset_;
+  if (offset + alloc_size > committed_size_) {
+    // Grow the backing file to cover the new code. Pages beyond the end of
+    // the file would fault (SIGBUS) if touched.
+    size_t new_size = XEROUNDUP(offset + alloc_size, chunk_size_);
+    if (new_size > REGION_SIZE ||
+        (region_fd_ != -1 && ftruncate(region_fd_, new_size))) {
+      UnlockMutex(lock_);
+      XELOGE("X64CodeCache exhausted at %u bytes", (uint32_t)offset);
+      XEASSERTALWAYS();
+      return NULL;
+    }
+    committed_size_ = new_size;
+  }
+  region_offset_ += alloc_size;
+
+  UnlockMutex(lock_);
+
+  // Copy code through the writable view.
+  xe_copy_struct(write_base_ + offset, machine_code, code_size);
+
+  // x64 keeps the instruction cache coherent across views, but this is
+  // convention (and a compiler barrier for the copy).
+  uint8_t* final_address = execute_base_ + offset;
+  __builtin___clear_cache((char*)final_address,
+                          (char*)final_address + code_size);
+  return final_address;
+}
+
+void X64CodeCache::AddSymbol(void* code_address, size_t code_size,
+                             const char* name) {
+  if (!perf_map_file_) {
+    return;
+  }
+
+  // http://lxr.linux.no/linux+v3.13/tools/perf/Documentation/jit-interface.txt
+  LockMutex(lock_);
+  fprintf(perf_map_file_, "%llx %llx %s\n",
+          (unsigned long long)(uintptr_t)code_address,
+          (unsigned long long)code_size,
+          name);
+  // perf reads the map after we exit, possibly abnormally.
+  fflush(perf_map_file_);
+  UnlockMutex(lock_);
+}
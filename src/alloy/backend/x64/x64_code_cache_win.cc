@@ -114,6 +114,11 @@ void* X64CodeCache::PlaceCode(void* machine_code, size_t code_size,
   return final_address;
 }
 
+void X64CodeCache::AddSymbol(void* code_address, size_t code_size,
+                             const char* name) {
+  // Only perf maps are supported, and those are POSIX only.
+}
+
 X64CodeChunk::X64CodeChunk(size_t chunk_size) :
     next(NULL),
     capacity(chunk_size), buffer(0), offset(0) {
@@ -156,15 +156,14 @@ int X64Emitter::Emit(
 }
 
 void* X64Emitter::Emplace(size_t stack_size) {
-  // To avoid changing xbyak, we do a switcharoo here.
   // top_ points to the Xbyak buffer, and since we are in AutoGrow mode
-  // it has pending relocations. We copy the top_ to our buffer, swap the
-  // pointer, relocate, then return the original scratch pointer for use.
-  uint8_t* old_address = top_;
-  void* new_address = code_cache_->PlaceCode(top_, size_, stack_size);
-  top_ = (uint8_t*)new_address;
+  // it has pending relocations. Resolve them in place and copy the final
+  // bytes out: the code cache may execute the code from a mapping that we
+  // can't write to. This relies on everything we emit being position
+  // independent - labels are local rel32 jumps and all calls go through a
+  // register - so the bytes don't depend on where they land.
   ready();
-  top_ = old_address;
+  void* new_address = code_cache_->PlaceCode(top_, size_, stack_size);
   reset();
   return new_address;
 }
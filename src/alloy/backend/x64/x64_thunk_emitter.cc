@@ -9,6 +9,9 @@
 
 #include <alloy/backend/x64/x64_thunk_emitter.h>
 
+#include <alloy/backend/x64/x64_backend.h>
+#include <alloy/backend/x64/x64_code_cache.h>
+
 #include <third_party/xbyak/xbyak/xbyak.h>
 
 
@@ -92,7 +95,9 @@ HostToGuestThunk X64ThunkEmitter::EmitHostToGuestThunk() {
   mov(r8, qword[rsp + 8 * 3]);
   ret();
 
+  size_t code_size = getSize();
   void* fn = Emplace(stack_size);
+  backend()->code_cache()->AddSymbol(fn, code_size, "HostToGuestThunk");
   return (HostToGuestThunk)fn;
 }
 
@@ -140,6 +145,8 @@ GuestToHostThunk X64ThunkEmitter::EmitGuestToHostThunk() {
   mov(rdx, qword[rsp + 8 * 2]);
   ret();
 
+  size_t code_size = getSize();
   void* fn = Emplace(stack_size);
+  backend()->code_cache()->AddSymbol(fn, code_size, "GuestToHostThunk");
   return (HostToGuestThunk)fn;
 }
@@ -9,8 +9,12 @@
 
 #include <alloy/compiler/compiler.h>
 
+#include <alloy/alloy-private.h>
 #include <alloy/compiler/compiler_pass.h>
 #include <alloy/compiler/tracing.h>
+#include <alloy/runtime/translation_cache.h>
+
+#include <chrono>
 
 using namespace alloy;
 using namespace alloy::compiler;
@@ -18,8 +22,27 @@ using namespace alloy::hir;
 using namespace alloy::runtime;
 
 
+namespace {
+
+size_t CountInstrs(HIRBuilder* builder) {
+  size_t count = 0;
+  Block* block = builder->first_block();
+  while (block) {
+    Instr* i = block->instr_head;
+    while (i) {
+      count++;
+      i = i->next;
+    }
+    block = block->next;
+  }
+  return count;
+}
+
+}  // namespace
+
+
 Compiler::Compiler(Runtime* runtime) :
-    runtime_(runtime) {
+    runtime_(runtime), in_group_(false) {
   scratch_arena_ = new Arena();
 
   alloy::tracing::WriteEvent(EventType::Init({
@@ -42,22 +65,129 @@ Compiler::~Compiler() {
 
 void Compiler::AddPass(CompilerPass* pass) {
   pass->Initialize(this);
+  if (in_group_) {
+    groups_.back().pass_count++;
+  } else {
+    PassGroup group = { passes_.size(), 1, 1 };
+    groups_.push_back(group);
+  }
   passes_.push_back(pass);
+  PassTiming timing = { pass->name(), 0, 0, 0, 0 };
+  pass_timings_.push_back(timing);
+}
+
+void Compiler::BeginPassGroup(uint32_t max_iterations) {
+  XEASSERT(!in_group_);
+  XEASSERT(max_iterations > 0);
+  PassGroup group = { passes_.size(), 0, max_iterations };
+  groups_.push_back(group);
+  in_group_ = true;
+}
+
+void Compiler::EndPassGroup() {
+  XEASSERT(in_group_);
+  in_group_ = false;
 }
 
 void Compiler::Reset() {
 }
 
+uint64_t Compiler::GetPipelineHash() const {
+  uint64_t hash = 0;
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    const PassGroup& group = *it;
+    hash = runtime::TranslationCache::Hash(
+        &group.max_iterations, sizeof(group.max_iterations), hash);
+    for (size_t n = 0; n < group.pass_count; n++) {
+      const char* name = passes_[group.first_pass + n]->name();
+      hash = runtime::TranslationCache::Hash(name, xestrlena(name), hash);
+    }
+  }
+  return hash;
+}
+
 int Compiler::Compile(HIRBuilder* builder) {
-  // TODO(benvanik): sophisticated stuff. Run passes in parallel, run until they
-  //                 stop changing things, etc.
-  for (auto it = passes_.begin(); it != passes_.end(); ++it) {
-    CompilerPass* pass = *it;
-    scratch_arena_->Reset();
-    if (pass->Run(builder)) {
-      return 1;
+  XEASSERT(!in_group_);
+
+  // TODO(benvanik): run independent passes in parallel.
+  for (auto it = groups_.begin(); it != groups_.end(); ++it) {
+    const PassGroup& group = *it;
+    for (uint32_t iteration = 0; iteration < group.max_iterations;
+         iteration++) {
+      bool changed = false;
+      for (size_t n = 0; n < group.pass_count; n++) {
+        if (RunPass(group.first_pass + n, builder, changed)) {
+          return 1;
+        }
+      }
+      if (!changed) {
+        break;
+      }
     }
   }
 
   return 0;
 }
+
+int Compiler::RunPass(size_t n, HIRBuilder* builder, bool& out_changed) {
+  CompilerPass* pass = passes_[n];
+  PassTiming& timing = pass_timings_[n];
+  scratch_arena_->Reset();
+
+  bool track_instrs = FLAGS_dump_pass_stats;
+  size_t instr_count = track_instrs ? CountInstrs(builder) : 0;
+
+  bool changed = false;
+  auto start = std::chrono::high_resolution_clock::now();
+  int result = pass->Run(builder, changed);
+  auto end = std::chrono::high_resolution_clock::now();
+
+  timing.run_count++;
+  timing.total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      end - start).count();
+  if (changed) {
+    timing.changed_count++;
+    out_changed = true;
+  }
+  if (track_instrs) {
+    timing.instr_delta +=
+        (int64_t)CountInstrs(builder) - (int64_t)instr_count;
+  }
+  return result;
+}
+
+void Compiler::GetPassTimings(PassTimingList& timings) const {
+  for (auto it = pass_timings_.begin(); it != pass_timings_.end(); ++it) {
+    AddTiming(timings, *it);
+  }
+}
+
+void Compiler::AddTiming(PassTimingList& timings, const PassTiming& timing) {
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    if (!xestrcmpa(it->name, timing.name)) {
+      it->run_count += timing.run_count;
+      it->total_ns += timing.total_ns;
+      it->changed_count += timing.changed_count;
+      it->instr_delta += timing.instr_delta;
+      return;
+    }
+  }
+  timings.push_back(timing);
+}
+
+void Compiler::DumpTimings(const PassTimingList& timings) {
+  uint64_t total_ns = 0;
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    total_ns += it->total_ns;
+  }
+  XELOGI("Compiler pass stats:");
+  XELOGI("  %-24s %10s %10s %12s %10s %7s",
+         "pass", "runs", "changed", "instr delta", "total ms", "%");
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    XELOGI("  %-24s %10u %10u %12lld %10.2f %6.2f%%",
+           it->name, it->run_count, it->changed_count,
+           (long long)it->instr_delta,
+           it->total_ns / 1000000.0,
+           total_ns ? 100.0 * it->total_ns / total_ns : 0.0);
+  }
+}
@@ -23,6 +23,19 @@ class CompilerPass;
 
 
 class Compiler {
+public:
+  typedef struct {
+    const char* name;
+    uint32_t    run_count;
+    uint64_t    total_ns;
+    // Runs that reported modifying the HIR.
+    uint32_t    changed_count;
+    // Net change in HIR instruction count. Only tracked with
+    // --dump_pass_stats, as it requires walking the HIR around each run.
+    int64_t     instr_delta;
+  } PassTiming;
+  typedef std::vector<PassTiming> PassTimingList;
+
 public:
   Compiler(runtime::Runtime* runtime);
   ~Compiler();
@@ -30,18 +43,51 @@ public:
   runtime::Runtime* runtime() const { return runtime_; }
   Arena* scratch_arena() const { return scratch_arena_; }
 
+  // Passes are run in the order they are added.
   void AddPass(CompilerPass* pass);
 
+  // Passes added between Begin/EndPassGroup are run in order, repeatedly,
+  // until none of them change the HIR or max_iterations is reached.
+  void BeginPassGroup(uint32_t max_iterations);
+  void EndPassGroup();
+
   void Reset();
 
   int Compile(hir::HIRBuilder* builder);
 
+  // Identifies the passes (by name) and pass groups, for keying cached
+  // output. Passes whose options change their output must reflect them in
+  // their name. Changes to what a pass does are covered by
+  // TranslationCache::kCompilerVersion instead.
+  uint64_t GetPipelineHash() const;
+
+  // Adds the stats for each pass over all Compile() calls to timings,
+  // merging with any existing entries of the same name.
+  void GetPassTimings(PassTimingList& timings) const;
+  static void AddTiming(PassTimingList& timings, const PassTiming& timing);
+  static void DumpTimings(const PassTimingList& timings);
+
+private:
+  int RunPass(size_t n, hir::HIRBuilder* builder, bool& out_changed);
+
 private:
   runtime::Runtime* runtime_;
   Arena* scratch_arena_;
 
   typedef std::vector<CompilerPass*> PassList;
   PassList passes_;
+  // Parallel to passes_.
+  PassTimingList pass_timings_;
+
+  // Every pass belongs to exactly one group; passes added outside of
+  // Begin/EndPassGroup get a group of their own that runs once.
+  typedef struct {
+    size_t    first_pass;
+    size_t    pass_count;
+    uint32_t  max_iterations;
+  } PassGroup;
+  std::vector<PassGroup> groups_;
+  bool in_group_;
 };
 
 
@@ -30,7 +30,12 @@ public:
 
   virtual int Initialize(Compiler* compiler);
 
-  virtual int Run(hir::HIRBuilder* builder) = 0;
+  // Short name used in timing reports.
+  virtual const char* name() const = 0;
+
+  // Sets out_changed if the HIR was modified. Pass groups rerun until no
+  // pass reports a change, so this must not be set spuriously.
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed) = 0;
 
 protected:
   Arena* scratch_arena() const;
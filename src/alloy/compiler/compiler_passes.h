@@ -10,17 +10,24 @@
 #ifndef ALLOY_COMPILER_COMPILER_PASSES_H_
 #define ALLOY_COMPILER_COMPILER_PASSES_H_
 
+#include <alloy/compiler/passes/byte_swap_elimination_pass.h>
+#include <alloy/compiler/passes/compaction_pass.h>
 #include <alloy/compiler/passes/constant_propagation_pass.h>
 #include <alloy/compiler/passes/control_flow_analysis_pass.h>
 #include <alloy/compiler/passes/context_promotion_pass.h>
 #include <alloy/compiler/passes/data_flow_analysis_pass.h>
 #include <alloy/compiler/passes/dead_code_elimination_pass.h>
- //#include <alloy/compiler/passes/dead_store_elimination_pass.h>
+#include <alloy/compiler/passes/dead_store_elimination_pass.h>
 #include <alloy/compiler/passes/finalization_pass.h>
+#include <alloy/compiler/passes/global_value_numbering_pass.h>
+#include <alloy/compiler/passes/instruction_scheduling_pass.h>
+#include <alloy/compiler/passes/loop_invariant_code_motion_pass.h>
 #include <alloy/compiler/passes/register_allocation_pass.h>
 #include <alloy/compiler/passes/simplification_pass.h>
+#include <alloy/compiler/passes/type_propagation_pass.h>
 #include <alloy/compiler/passes/validation_pass.h>
 #include <alloy/compiler/passes/value_reduction_pass.h>
+#include <alloy/compiler/passes/x86_canonicalization_pass.h>
 
 // TODO:
 //   - mark_use/mark_set
@@ -58,87 +65,37 @@
 //   ConstantPropagation
 //   TypePropagation
 //   ByteSwapElimination
+//   GlobalValueNumbering
+//   LoopInvariantCodeMotion
 //   Simplification
 //   DeadStoreElimination
 //   DeadCodeElimination
 //
-// - TypePropagation
-//    There are many extensions/truncations in generated code right now due to
-//    various load/stores of varying widths. Being able to find and short-
-//    circuit the conversions early on would make following passes cleaner
-//    and faster as they'd have to trace through fewer value definitions.
-//    Example (after ContextPromotion):
-//      v81.i64 = load_context +88
-//      v82.i32 = truncate v81.i64
-//      v84.i32 = and v82.i32, 3F
-//      v85.i64 = zero_extend v84.i32
-//      v87.i64 = load_context +248
-//      v88.i64 = v85.i64
-//      v89.i32 = truncate v88.i64      <-- zero_extend/truncate => v84.i32
-//      v90.i32 = byte_swap v89.i32
-//      store v87.i64, v90.i32
-//    after type propagation / simplification / DCE:
-//      v81.i64 = load_context +88
-//      v82.i32 = truncate v81.i64
-//      v84.i32 = and v82.i32, 3F
-//      v87.i64 = load_context +248
-//      v90.i32 = byte_swap v84.i32
-//      store v87.i64, v90.i32
+// - TypePropagation (type_propagation_pass.cc)
+//    Short-circuits chains of extensions/truncations.
 //
-// - ByteSwapElimination
-//   Find chained byte swaps and replace with assignments. This is often found
-//   in memcpy paths.
-//   Example:
-//     v0 = load ...
-//     v1 = byte_swap v0
-//     v2 = byte_swap v1
-//     store ..., v2       <-- this could be v0
+// - ByteSwapElimination (byte_swap_elimination_pass.cc)
+//    Replaces byte swaps of byte swaps with assignments, after
+//    TypePropagation has removed any conversions in between.
 //
-//   It may be tricky to detect, though, as often times there are intervening
-//   instructions:
-//     v21.i32 = load v20.i64
-//     v22.i32 = byte_swap v21.i32
-//     v23.i64 = zero_extend v22.i32
-//     v88.i64 = v23.i64 (from ContextPromotion)
-//     v89.i32 = truncate v88.i64
-//     v90.i32 = byte_swap v89.i32
-//     store v87.i64, v90.i32
-//   After type propagation:
-//     v21.i32 = load v20.i64
-//     v22.i32 = byte_swap v21.i32
-//     v89.i32 = v22.i32
-//     v90.i32 = byte_swap v89.i32
-//     store v87.i64, v90.i32
-//   This could ideally become:
-//     v21.i32 = load v20.i64
-//     ... (DCE takes care of this) ...
-//     store v87.i64, v21.i32
+// - GlobalValueNumbering (global_value_numbering_pass.cc)
+//    Replaces pure instructions recomputing a value available from a
+//    dominating instruction with an assign of the earlier result.
 //
-// - DeadStoreElimination
-//   Generic DSE pass, removing all redundant stores. ContextPromotion may be
-//   able to take care of most of these, as the input assembly is generally
-//   pretty optimized already. This pass would mainly be looking for introduced
-//   stores, such as those from comparisons.
+// - LoopInvariantCodeMotion (loop_invariant_code_motion_pass.cc)
+//    Hoists pure instructions and unclobbered context loads out of loops
+//    into the preheaders ControlFlowAnalysis inserts.
 //
-//   Example:
-//   <block0>:
-//     v0 = compare_ult ...     (later removed by DCE)
-//     v1 = compare_ugt ...     (later removed by DCE)
-//     v2 = compare_eq ...
-//     store_context +300, v0   <-- removed
-//     store_context +301, v1   <-- removed
-//     store_context +302, v2   <-- removed
-//     branch_true v1, ...
-//   <block1>:
-//     v3 = compare_ult ...
-//     v4 = compare_ugt ...
-//     v5 = compare_eq ...
-//     store_context +300, v3   <-- these may be required if at end of function
-//     store_context +301, v4       or before a call
-//     store_context +302, v5
-//     branch_true v5, ...
+// - DeadStoreElimination (dead_store_elimination_pass.cc)
+//    Removes context stores that are overwritten before anything can read
+//    them, mostly cr0/XER bits from compares and carrying ops.
 //
-// - X86Canonicalization
+// - Compaction (compaction_pass.cc)
+//    Copies instructions, values and uses into dense per-block storage so
+//    the passes after it iterate linearly through memory.
+//
+// - X86Canonicalization (x86_canonicalization_pass.cc)
+//   Only run for backends with two_address_ops set in their MachineInfo.
 //   For various opcodes add copies/commute the arguments to match x86
 //   operand semantics. This makes code generation easier and if done
 //   before register allocation can prevent a lot of extra shuffling in
@@ -155,6 +112,10 @@
 //     v1 = add v1, v0          <-- src1 = dest/src, so reuse for both
 //                                  by commuting and setting dest = src1
 //
+// - InstructionScheduling (instruction_scheduling_pass.cc)
+//    Reorders independent instructions within blocks so loads issue ahead
+//    of unrelated ALU work, using the backend's load_latency.
+//
 // - RegisterAllocation
 //   Given a machine description (register classes, counts) run over values
 //   and assign them to registers, adding spills as needed. It should be
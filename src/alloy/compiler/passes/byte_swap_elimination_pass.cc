@@ -0,0 +1,82 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/byte_swap_elimination_pass.h>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+ByteSwapEliminationPass::ByteSwapEliminationPass() :
+    CompilerPass() {
+}
+
+ByteSwapEliminationPass::~ByteSwapEliminationPass() {
+}
+
+int ByteSwapEliminationPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Find chained byte swaps and replace them with assignments. Every guest
+  // load is swapped into host order and every store swapped back, so any
+  // value that is only moved around (memcpy, serialization loops) ends up
+  // swapped twice:
+  //   v21.i32 = load v20.i64
+  //   v22.i32 = byte_swap v21.i32
+  //   v23.i64 = zero_extend v22.i32
+  //   v88.i64 = v23.i64 (from ContextPromotion)
+  //   v89.i32 = truncate v88.i64
+  //   v90.i32 = byte_swap v89.i32
+  //   store v87.i64, v90.i32
+  // TypePropagation turns the zero_extend/truncate pair into an assign:
+  //   v89.i32 = v22.i32
+  //   v90.i32 = byte_swap v89.i32
+  // and then we can replace the second swap:
+  //   v90.i32 = v21.i32
+  //   store v87.i64, v90.i32
+  // Simplification/DCE then forward the assign and remove the first swap
+  // if nothing else uses it.
+
+  bool changed = false;
+  auto block = builder->first_block();
+  while (block) {
+    auto i = block->instr_head;
+    while (i) {
+      if (i->opcode == &OPCODE_BYTE_SWAP_info) {
+        changed |= EliminateByteSwap(i);
+      }
+      i = i->next;
+    }
+    block = block->next;
+  }
+
+  out_changed = changed;
+  return 0;
+}
+
+bool ByteSwapEliminationPass::EliminateByteSwap(Instr* i) {
+  // Walk backward up src's chain looking for a byte swap. We may have
+  // assigns, so skip those.
+  Instr* def = i->src1.value->def;
+  while (def && def->opcode == &OPCODE_ASSIGN_info) {
+    def = def->src1.value->def;
+  }
+  if (!def || def->opcode != &OPCODE_BYTE_SWAP_info) {
+    return false;
+  }
+
+  // Value comes from a byte swap of the same width.
+  Value* src = def->src1.value;
+  if (src->type != i->dest->type) {
+    return false;
+  }
+  i->Replace(&OPCODE_ASSIGN_info, 0);
+  i->set_src1(src);
+  return true;
+}
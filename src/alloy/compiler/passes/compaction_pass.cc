@@ -0,0 +1,35 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/compaction_pass.h>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+CompactionPass::CompactionPass() :
+    CompilerPass() {
+}
+
+CompactionPass::~CompactionPass() {
+}
+
+int CompactionPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Lays the HIR out again in memory so the passes after this walk blocks and
+  // use lists linearly instead of chasing pointers around the arena.
+  // Nothing about the HIR itself changes, so this should be placed before
+  // groups of passes that do a lot of walking (and after ones that add or
+  // move a lot of instructions).
+  builder->Compact();
+
+  out_changed = false;
+  return 0;
+}
@@ -22,7 +22,7 @@ ConstantPropagationPass::ConstantPropagationPass() :
 ConstantPropagationPass::~ConstantPropagationPass() {
 }
 
-int ConstantPropagationPass::Run(HIRBuilder* builder) {
+int ConstantPropagationPass::Run(HIRBuilder* builder, bool& out_changed) {
   // Once ContextPromotion has run there will likely be a whole slew of
   // constants that can be pushed through the function.
   // Example:
@@ -42,11 +42,15 @@ int ConstantPropagationPass::Run(HIRBuilder* builder) {
   //   store_context +200, 2000
   // A DCE run after this should clean up any of the values no longer needed.
 
+  // Every folding below ends in a Replace or Remove (which replaces with a
+  // NOP), so a changed opcode means we changed something.
+  bool changed = false;
   Block* block = builder->first_block();
   while (block) {
     Instr* i = block->instr_head;
     while (i) {
       Value* v = i->dest;
+      const OpcodeInfo* opcode = i->opcode;
       switch (i->opcode->num) {
       case OPCODE_DEBUG_BREAK_TRUE:
         if (i->src1.value->IsConstant()) {
@@ -376,11 +380,15 @@ int ConstantPropagationPass::Run(HIRBuilder* builder) {
         }
         break;
       }
+      if (i->opcode != opcode) {
+        changed = true;
+      }
       i = i->next;
     }
 
     block = block->next;
   }
 
+  out_changed = changed;
   return 0;
 }
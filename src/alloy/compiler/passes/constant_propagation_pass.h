@@ -23,7 +23,9 @@ public:
   ConstantPropagationPass();
   virtual ~ConstantPropagationPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "ConstantPropagation"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
 };
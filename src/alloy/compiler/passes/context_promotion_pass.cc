@@ -12,6 +12,8 @@
 #include <alloy/compiler/compiler.h>
 #include <alloy/runtime/runtime.h>
 
+#include <algorithm>
+
 using namespace alloy;
 using namespace alloy::compiler;
 using namespace alloy::compiler::passes;
@@ -21,7 +23,7 @@ using namespace alloy::runtime;
 
 
 ContextPromotionPass::ContextPromotionPass() :
-    context_values_size_(0), context_values_(0),
+    context_size_(0), context_values_(0),
     CompilerPass() {
 }
 
@@ -36,15 +38,14 @@ int ContextPromotionPass::Initialize(Compiler* compiler) {
     return 1;
   }
 
-  // This is a terrible implementation.
   ContextInfo* context_info = runtime_->frontend()->context_info();
-  context_values_size_ = context_info->size() * sizeof(Value*);
-  context_values_ = (Value**)xe_calloc(context_values_size_);
+  context_size_ = context_info->size();
+  context_values_ = (Value**)xe_calloc(context_size_ * sizeof(Value*));
 
   return 0;
 }
 
-int ContextPromotionPass::Run(HIRBuilder* builder) {
+int ContextPromotionPass::Run(HIRBuilder* builder, bool& out_changed) {
   // Like mem2reg, but because context memory is unaliasable it's easier to
   // check and convert LoadContext/StoreContext into value operations.
   // Example of load->value promotion:
@@ -53,81 +54,173 @@ int ContextPromotionPass::Run(HIRBuilder* builder) {
   //   v1 = load_context +100  <-- replace with v1 = v0
   //   store_context +200, v1
   //
-  // It'd be possible in this stage to also remove redundant context stores:
-  // Example of dead store elimination:
-  //   store_context +100, v0  <-- removed due to following store
-  //   store_context +100, v1
-  // This is more generally done by DSE, however if it could be done here
-  // instead as it may be faster (at least on the block-level).
-
-  // Promote loads to values.
-  // Process each block independently, for now.
+  // Values are carried across blocks along the CFG built by
+  // ControlFlowAnalysis, so guest registers stay in HIR values until the
+  // function calls out, returns or traps; anything known before one of
+  // those is forgotten at it, wherever it is in the block. There are no
+  // phis, so a block only inherits values that all of its predecessors
+  // agree on, and blocks with a back edge into them (loop headers) start
+  // empty.
+  //
+  // Stores made redundant by this are removed by DeadStoreElimination.
+
+  LinearizeBlocks(builder);
+
+  out_changed = PromoteValues();
+  return 0;
+}
+
+void ContextPromotionPass::LinearizeBlocks(HIRBuilder* builder) {
+  blocks_.clear();
   Block* block = builder->first_block();
   while (block) {
-    PromoteBlock(block);
+    block->ordinal = (uint16_t)blocks_.size();
+    blocks_.push_back(block);
     block = block->next;
   }
+}
 
-  // Remove all dead stores.
-  block = builder->first_block();
-  while (block) {
-    RemoveDeadStoresBlock(block);
-    block = block->next;
+bool ContextPromotionPass::PromoteValues() {
+  block_values_.resize(blocks_.size());
+
+  // Blocks are visited in order, so predecessors (other than back edges)
+  // have already saved their values by the time we get to a block.
+  bool changed = false;
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    Block* block = *it;
+    MergePredecessorValues(block);
+    changed |= PromoteBlock(block);
+    SaveBlockValues(block);
+    ClearContextValues();
   }
-
-  return 0;
+  return changed;
 }
 
-void ContextPromotionPass::PromoteBlock(Block* block) {
-  // Clear the context values list.
-  // TODO(benvanik): new data structure that isn't so stupid.
-  //     Bitvector of validity, perhaps?
-  xe_zero_struct(context_values_, context_values_size_);
+void ContextPromotionPass::MergePredecessorValues(Block* block) {
+  // Gather predecessors, bailing if any haven't been visited yet (or there
+  // are too many to be worth intersecting).
+  Block* preds[8];
+  size_t pred_count = 0;
+  Block* prev = block->prev;
+  if (prev && HIRBuilder::FallsThrough(prev)) {
+    preds[pred_count++] = prev;
+  }
+  Edge* edge = block->incoming_edge_head;
+  while (edge) {
+    if (edge->src->ordinal >= block->ordinal ||
+        pred_count == XECOUNT(preds)) {
+      return;
+    }
+    preds[pred_count++] = edge->src;
+    edge = edge->incoming_next;
+  }
+  if (!pred_count) {
+    // Entry block (or unreachable).
+    return;
+  }
+
+  // Keep values that every predecessor ended with.
+  auto compare = [](const ContextValue& a, const ContextValue& b) {
+    return a.offset < b.offset;
+  };
+  const BlockValues& first = block_values_[preds[0]->ordinal];
+  for (size_t n = 0; n < first.count; n++) {
+    const ContextValue& value = first.values[n];
+    bool all_match = true;
+    for (size_t m = 1; m < pred_count && all_match; m++) {
+      const BlockValues& other = block_values_[preds[m]->ordinal];
+      const ContextValue* begin = other.values;
+      const ContextValue* end = other.values + other.count;
+      const ContextValue* match =
+          std::lower_bound(begin, end, value, compare);
+      all_match = match != end &&
+                  match->offset == value.offset &&
+                  match->value == value.value;
+    }
+    if (all_match) {
+      SetContextValue(value.offset, value.value);
+    }
+  }
+}
 
+bool ContextPromotionPass::PromoteBlock(Block* block) {
+  bool changed = false;
   Instr* i = block->instr_head;
   while (i) {
-    if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
-      size_t offset = i->src1.offset;
+    if (HIRBuilder::IsContextEscape(i)) {
+      // The callee (or whatever handles the trap) may change anything.
+      ClearContextValues();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      uint32_t offset = (uint32_t)i->src1.offset;
       Value* previous_value = context_values_[offset];
-      if (previous_value) {
+      if (previous_value && previous_value->type == i->dest->type) {
         // Legit previous value, reuse.
         i->opcode = &hir::OPCODE_ASSIGN_info;
         i->set_src1(previous_value);
+        changed = true;
       } else {
         // Store the loaded value into the table.
-        context_values_[offset] = i->dest;
+        SetContextValue(offset, i->dest);
       }
     } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
-      size_t offset = i->src1.offset;
-      Value* value = i->src2.value;
       // Store value into the table for later.
-      context_values_[offset] = value;
+      SetContextValue((uint32_t)i->src1.offset, i->src2.value);
     }
 
     i = i->next;
   }
+  return changed;
 }
 
-void ContextPromotionPass::RemoveDeadStoresBlock(Block* block) {
-  // TODO(benvanik): use a bitvector.
-  // To avoid clearing the structure, we use a token.
-  Value* token = (Value*)block;
+void ContextPromotionPass::SaveBlockValues(Block* block) {
+  BlockValues& block_values = block_values_[block->ordinal];
+  block_values.values = NULL;
+  block_values.count = 0;
+  if (dirty_offsets_.empty()) {
+    // Successors must reload everything.
+    return;
+  }
 
-  // Walk backwards and mark offsets that are written to.
-  // If the offset was written to earlier, ignore the store.
-  Instr* i = block->instr_tail;
-  while (i) {
-    Instr* prev = i->prev;
-    if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
-      size_t offset = i->src1.offset;
-      if (context_values_[offset] != token) {
-        // Mark offset as written to.
-        context_values_[offset] = token;
-      } else {
-        // Already written to. Remove this store.
-        i->Remove();
-      }
+  std::sort(dirty_offsets_.begin(), dirty_offsets_.end());
+  block_values.values = (ContextValue*)scratch_arena()->Alloc(
+      sizeof(ContextValue) * dirty_offsets_.size());
+  uint32_t last_offset = 0xFFFFFFFF;
+  for (auto it = dirty_offsets_.begin(); it != dirty_offsets_.end(); ++it) {
+    uint32_t offset = *it;
+    if (offset == last_offset || !context_values_[offset]) {
+      continue;
     }
-    i = prev;
+    ContextValue& value = block_values.values[block_values.count++];
+    value.offset = offset;
+    value.value = context_values_[offset];
+    last_offset = offset;
+  }
+}
+
+void ContextPromotionPass::SetContextValue(uint32_t offset, Value* value) {
+  size_t size = GetTypeSize(value->type);
+  XEASSERT(offset + size <= context_size_);
+
+  // Forget anything this partially overlaps. Guest registers are always
+  // accessed with the same offset and size, so this rarely finds anything.
+  uint32_t start = offset > 15 ? offset - 15 : 0;
+  for (uint32_t n = start; n < offset + size; n++) {
+    Value* existing = context_values_[n];
+    if (existing && n != offset &&
+        n + GetTypeSize(existing->type) > offset) {
+      context_values_[n] = NULL;
+    }
+  }
+
+  if (!context_values_[offset]) {
+    dirty_offsets_.push_back(offset);
+  }
+  context_values_[offset] = value;
+}
+
+void ContextPromotionPass::ClearContextValues() {
+  for (auto it = dirty_offsets_.begin(); it != dirty_offsets_.end(); ++it) {
+    context_values_[*it] = NULL;
   }
+  dirty_offsets_.clear();
 }
@@ -23,17 +23,43 @@ public:
   ContextPromotionPass();
   virtual ~ContextPromotionPass();
 
+  virtual const char* name() const { return "ContextPromotion"; }
+
   virtual int Initialize(Compiler* compiler);
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
-  void PromoteBlock(hir::Block* block);
-  void RemoveDeadStoresBlock(hir::Block* block);
+  // A context value known at the end of a block, sorted by offset.
+  typedef struct {
+    uint32_t    offset;
+    hir::Value* value;
+  } ContextValue;
+  typedef struct {
+    ContextValue* values;
+    size_t        count;
+  } BlockValues;
+
+  void LinearizeBlocks(hir::HIRBuilder* builder);
+
+  bool PromoteValues();
+  void MergePredecessorValues(hir::Block* block);
+  bool PromoteBlock(hir::Block* block);
+  void SaveBlockValues(hir::Block* block);
+  void SetContextValue(uint32_t offset, hir::Value* value);
+  void ClearContextValues();
 
 private:
-  size_t context_values_size_;
+  size_t context_size_;
+  // Value last loaded from/stored to each context offset in the current
+  // block. Only offsets in dirty_offsets_ may be set, so resetting between
+  // blocks doesn't touch the whole context.
   hir::Value** context_values_;
+  std::vector<uint32_t> dirty_offsets_;
+
+  // Indexed by block ordinal.
+  std::vector<hir::Block*> blocks_;
+  std::vector<BlockValues> block_values_;
 };
 
 
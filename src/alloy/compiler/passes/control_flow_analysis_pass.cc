@@ -35,10 +35,37 @@ ControlFlowAnalysisPass::ControlFlowAnalysisPass() :
 ControlFlowAnalysisPass::~ControlFlowAnalysisPass() {
 }
 
-int ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
+int ControlFlowAnalysisPass::Run(HIRBuilder* builder, bool& out_changed) {
   // TODO(benvanik): reset edges for all blocks? Needed to be re-runnable.
 
-  // Add edges.
+  AddEdges(builder);
+
+  // Find natural loops, giving each a preheader for LICM to hoist into.
+  // Inserting preheaders retargets branches, so the edges are rebuilt
+  // afterwards and the loops marked again.
+  ComputeDominators(builder);
+  if (MarkLoops(builder, true)) {
+    ResetEdges(builder);
+    AddEdges(builder);
+    ComputeDominators(builder);
+    MarkLoops(builder, false);
+    out_changed = true;
+  }
+
+  // Mark dominators.
+  auto block = builder->first_block();
+  while (block) {
+    if (block->incoming_edge_head &&
+        !block->incoming_edge_head->incoming_next) {
+      block->incoming_edge_head->flags |= Edge::DOMINATES;
+    }
+    block = block->next;
+  }
+
+  return 0;
+}
+
+void ControlFlowAnalysisPass::AddEdges(HIRBuilder* builder) {
   auto block = builder->first_block();
   while (block) {
     auto instr = block->instr_tail;
@@ -59,16 +86,156 @@ int ControlFlowAnalysisPass::Run(HIRBuilder* builder) {
     }
     block = block->next;
   }
+}
 
-  // Mark dominators.
-  block = builder->first_block();
+void ControlFlowAnalysisPass::ResetEdges(HIRBuilder* builder) {
+  // Edges are arena allocated, so just drop them.
+  auto block = builder->first_block();
   while (block) {
-    if (block->incoming_edge_head &&
-        !block->incoming_edge_head->incoming_next) {
-      block->incoming_edge_head->flags |= Edge::DOMINATES;
+    block->incoming_edge_head = block->outgoing_edge_head = NULL;
+    block = block->next;
+  }
+}
+
+void ControlFlowAnalysisPass::ComputeDominators(HIRBuilder* builder) {
+  // Iterative dataflow over the block order, which is close to reverse
+  // postorder for guest code, so this settles in a couple of passes:
+  //   dom(entry) = { entry }
+  //   dom(b) = { b } + intersection of dom(p) over predecessors p
+  // Fall-through counts as an edge here, even though we don't add one.
+  // Unreachable blocks end up dominated by everything.
+  uint32_t block_count = 0;
+  auto block = builder->first_block();
+  while (block) {
+    block->ordinal = (uint16_t)block_count++;
+    block = block->next;
+  }
+  dominators_.resize(block_count);
+  for (uint32_t n = 0; n < block_count; n++) {
+    dominators_[n].clear();
+    dominators_[n].resize(block_count, n != 0);
+  }
+  dominators_[0].set(0);
+
+  llvm::BitVector dom(block_count);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    block = builder->first_block()->next;
+    while (block) {
+      dom.set();
+      if (block->prev && HIRBuilder::FallsThrough(block->prev)) {
+        dom &= dominators_[block->prev->ordinal];
+      }
+      auto edge = block->incoming_edge_head;
+      while (edge) {
+        dom &= dominators_[edge->src->ordinal];
+        edge = edge->incoming_next;
+      }
+      dom.set(block->ordinal);
+      if (dom != dominators_[block->ordinal]) {
+        dominators_[block->ordinal] = dom;
+        changed = true;
+      }
+      block = block->next;
     }
+  }
+}
+
+bool ControlFlowAnalysisPass::Dominates(Block* a, Block* b) {
+  return dominators_[b->ordinal].test(a->ordinal);
+}
+
+bool ControlFlowAnalysisPass::MarkLoops(HIRBuilder* builder,
+                                        bool insert_preheaders) {
+  // A header is a block with incoming edges from blocks it dominates. For
+  // hoisting we want it to have exactly one way in from outside the loop:
+  // a preheader laid out just before it that does nothing but fall through.
+  //   <preheader>:
+  //     ...                    <-- falls through
+  //   <header>:
+  //     ...
+  //   <latch>:
+  //     branch_true v0, header <-- BACK_EDGE
+  bool inserted = false;
+  auto block = builder->first_block();
+  while (block) {
+    Block* header = block;
     block = block->next;
+
+    bool has_back_edge = false;
+    uint32_t entry_count = 0;
+    auto edge = header->incoming_edge_head;
+    while (edge) {
+      if (Dominates(header, edge->src)) {
+        has_back_edge = true;
+      } else {
+        entry_count++;
+      }
+      edge = edge->incoming_next;
+    }
+    if (!has_back_edge) {
+      continue;
+    }
+
+    Block* prev = header->prev;
+    if (prev && HIRBuilder::FallsThrough(prev)) {
+      if (Dominates(header, prev)) {
+        // Latch laid out before the header. Rare enough to not bother.
+        continue;
+      }
+      entry_count++;
+    }
+    bool has_preheader =
+        prev && entry_count == 1 && HIRBuilder::FallsThrough(prev) &&
+        !prev->outgoing_edge_head &&
+        (!prev->instr_tail ||
+         !(prev->instr_tail->opcode->flags &
+           (OPCODE_FLAG_BRANCH | OPCODE_FLAG_VOLATILE)));
+    if (!has_preheader) {
+      if (insert_preheaders) {
+        InsertPreheader(builder, header);
+        inserted = true;
+      }
+      continue;
+    }
+
+    edge = header->incoming_edge_head;
+    while (edge) {
+      if (Dominates(header, edge->src)) {
+        edge->flags |= Edge::BACK_EDGE;
+      }
+      edge = edge->incoming_next;
+    }
   }
+  return inserted;
+}
 
-  return 0;
+void ControlFlowAnalysisPass::InsertPreheader(HIRBuilder* builder,
+                                              Block* header) {
+  // The block before the header (if any) now falls through into the
+  // preheader. Branches from outside the loop get pointed at it, leaving
+  // the back edges going to the header.
+  Block* preheader = builder->InsertBlock(header);
+  Label* label = builder->NewLabel();
+  builder->MarkLabel(label, preheader);
+
+  auto edge = header->incoming_edge_head;
+  while (edge) {
+    if (!Dominates(header, edge->src)) {
+      // Same search as AddEdges.
+      Instr* instr = edge->src->instr_tail;
+      while (instr->opcode != &OPCODE_BRANCH_info &&
+             instr->opcode != &OPCODE_BRANCH_TRUE_info &&
+             instr->opcode != &OPCODE_BRANCH_FALSE_info) {
+        instr = instr->prev;
+      }
+      if (instr->opcode == &OPCODE_BRANCH_info) {
+        instr->src1.label = label;
+      } else {
+        instr->src2.label = label;
+      }
+    }
+    edge = edge->incoming_next;
+  }
 }
@@ -12,6 +12,8 @@
 
 #include <alloy/compiler/compiler_pass.h>
 
+#include <llvm/ADT/BitVector.h>
+
 
 namespace alloy {
 namespace compiler {
@@ -23,9 +25,21 @@ public:
   ControlFlowAnalysisPass();
   virtual ~ControlFlowAnalysisPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "ControlFlowAnalysis"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  void AddEdges(hir::HIRBuilder* builder);
+  void ResetEdges(hir::HIRBuilder* builder);
+  void ComputeDominators(hir::HIRBuilder* builder);
+  bool Dominates(hir::Block* a, hir::Block* b);
+  bool MarkLoops(hir::HIRBuilder* builder, bool insert_preheaders);
+  void InsertPreheader(hir::HIRBuilder* builder, hir::Block* header);
 
 private:
+  // Indexed by block ordinal: the set of blocks dominating each block.
+  std::vector<llvm::BitVector> dominators_;
 };
 
 
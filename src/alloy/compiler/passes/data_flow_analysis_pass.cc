@@ -35,14 +35,17 @@ DataFlowAnalysisPass::DataFlowAnalysisPass() :
 DataFlowAnalysisPass::~DataFlowAnalysisPass() {
 }
 
-int DataFlowAnalysisPass::Run(HIRBuilder* builder) {
+int DataFlowAnalysisPass::Run(HIRBuilder* builder, bool& out_changed) {
   auto arena = builder->arena();
 
   // Linearize blocks so that we can detect cycles and propagate dependencies.
   uint32_t block_count = LinearizeBlocks(builder);
 
-  // Analyze value flow and add locals as needed.
+  // Analyze value flow and add locals as needed. Loads/stores are only
+  // inserted for values that get a local.
+  size_t local_count = builder->locals().size();
   AnalyzeFlow(builder, block_count);
+  out_changed = builder->locals().size() != local_count;
 
   return 0;
 }
@@ -23,7 +23,9 @@ public:
   DataFlowAnalysisPass();
   virtual ~DataFlowAnalysisPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "DataFlowAnalysis"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
   uint32_t LinearizeBlocks(hir::HIRBuilder* builder);
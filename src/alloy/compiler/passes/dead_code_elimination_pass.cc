@@ -22,7 +22,7 @@ DeadCodeEliminationPass::DeadCodeEliminationPass() :
 DeadCodeEliminationPass::~DeadCodeEliminationPass() {
 }
 
-int DeadCodeEliminationPass::Run(HIRBuilder* builder) {
+int DeadCodeEliminationPass::Run(HIRBuilder* builder, bool& out_changed) {
   // ContextPromotion/DSE will likely leave around a lot of dead statements.
   // Code generated for comparison/testing produces many unused statements and
   // with proper use analysis it should be possible to remove most of them:
@@ -60,6 +60,7 @@ int DeadCodeEliminationPass::Run(HIRBuilder* builder) {
   // all.
 
   bool any_instr_removed = false;
+  bool any_assigns_removed = false;
   bool any_locals_removed = false;
   Block* block = builder->first_block();
   while (block) {
@@ -78,6 +79,7 @@ int DeadCodeEliminationPass::Run(HIRBuilder* builder) {
         // Assignment. These are useless, so just try to remove by completely
         // replacing the value.
         ReplaceAssignment(i);
+        any_assigns_removed = true;
       }
 
       i = prev;
@@ -138,6 +140,8 @@ int DeadCodeEliminationPass::Run(HIRBuilder* builder) {
     }
   }
 
+  out_changed =
+      any_instr_removed || any_assigns_removed || any_locals_removed;
   return 0;
 }
 
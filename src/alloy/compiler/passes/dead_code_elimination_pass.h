@@ -23,7 +23,9 @@ public:
   DeadCodeEliminationPass();
   virtual ~DeadCodeEliminationPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "DeadCodeElimination"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
   void MakeNopRecursive(hir::Instr* i);
@@ -0,0 +1,159 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/dead_store_elimination_pass.h>
+
+#include <alloy/compiler/compiler.h>
+#include <alloy/runtime/runtime.h>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::frontend;
+using namespace alloy::hir;
+using namespace alloy::runtime;
+
+
+DeadStoreEliminationPass::DeadStoreEliminationPass() :
+    CompilerPass(),
+    context_size_(0) {
+}
+
+DeadStoreEliminationPass::~DeadStoreEliminationPass() {
+}
+
+int DeadStoreEliminationPass::Initialize(Compiler* compiler) {
+  if (CompilerPass::Initialize(compiler)) {
+    return 1;
+  }
+
+  ContextInfo* context_info = runtime_->frontend()->context_info();
+  context_size_ = context_info->size();
+  live_.resize((unsigned)context_size_);
+
+  return 0;
+}
+
+int DeadStoreEliminationPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Removes context stores that nothing can read before they are
+  // overwritten. Every guest compare writes all of cr0 (and XER for
+  // carrying/overflowing ops), but usually only one of the bits is read,
+  // and only before the next compare:
+  //   <block0>:
+  //     store_context +300, v0   <-- removed
+  //     store_context +301, v1   <-- removed
+  //     store_context +302, v2   <-- removed
+  //     branch_true v1, ...
+  //   <block1>:
+  //     store_context +300, v3   <-- these may be required if at end of
+  //     store_context +301, v4       function or before a call
+  //     store_context +302, v5
+  //     branch_true v5, ...
+  // ContextPromotion has already turned any reads of the branch condition
+  // into uses of the stored value, so nothing loads +301 in block0.
+  //
+  // This is a byte-granular liveness analysis of the context over the
+  // whole function, along the edges from ControlFlowAnalysis plus
+  // fall-through. Calls/returns/traps read everything, wherever they are
+  // in the block and whether or not they are conditional.
+
+  blocks_.clear();
+  Block* block = builder->first_block();
+  while (block) {
+    block->ordinal = (uint16_t)blocks_.size();
+    blocks_.push_back(block);
+    block = block->next;
+  }
+
+  size_t block_count = blocks_.size();
+  if (live_in_.size() < block_count) {
+    live_in_.resize(block_count);
+  }
+  for (size_t n = 0; n < block_count; n++) {
+    live_in_[n].resize((unsigned)context_size_);
+    live_in_[n].reset();
+  }
+
+  // Iterate liveness to a fixed point. Walking backwards means acyclic
+  // code settles in a single iteration; each loop adds about one more.
+  bool live_changed = true;
+  while (live_changed) {
+    live_changed = false;
+    for (auto it = blocks_.rbegin(); it != blocks_.rend(); ++it) {
+      Block* block = *it;
+      RemoveDeadStoresBlock(block, false);
+      llvm::BitVector& live_in = live_in_[block->ordinal];
+      if (live_ != live_in) {
+        live_in = live_;
+        live_changed = true;
+      }
+    }
+  }
+
+  bool changed = false;
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    changed |= RemoveDeadStoresBlock(*it, true);
+  }
+
+  out_changed = changed;
+  return 0;
+}
+
+void DeadStoreEliminationPass::ComputeLiveOut(Block* block,
+                                              llvm::BitVector& live) {
+  live.reset();
+  Edge* edge = block->outgoing_edge_head;
+  while (edge) {
+    live |= live_in_[edge->dest->ordinal];
+    edge = edge->outgoing_next;
+  }
+  if (HIRBuilder::FallsThrough(block)) {
+    if (block->next) {
+      live |= live_in_[block->next->ordinal];
+    } else {
+      // Falls off the end of the function.
+      live.set();
+    }
+  }
+}
+
+bool DeadStoreEliminationPass::RemoveDeadStoresBlock(Block* block,
+                                                     bool remove_stores) {
+  // Walk backwards from the live out set. Leaves live_ as the live in set.
+  ComputeLiveOut(block, live_);
+
+  bool changed = false;
+  Instr* i = block->instr_tail;
+  while (i) {
+    Instr* prev = i->prev;
+    if (HIRBuilder::IsContextEscape(i)) {
+      live_.set();
+    } else if (i->opcode == &OPCODE_LOAD_CONTEXT_info) {
+      unsigned offset = (unsigned)i->src1.offset;
+      unsigned size = (unsigned)GetTypeSize(i->dest->type);
+      live_.set(offset, offset + size);
+    } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+      unsigned offset = (unsigned)i->src1.offset;
+      unsigned size = (unsigned)GetTypeSize(i->src2.value->type);
+      bool is_live = false;
+      for (unsigned n = offset; n < offset + size && !is_live; n++) {
+        is_live = live_.test(n);
+      }
+      if (is_live) {
+        live_.reset(offset, offset + size);
+      } else if (remove_stores) {
+        // Overwritten (or never read) on every path. Remove this store.
+        i->Remove();
+        changed = true;
+      }
+    }
+    i = prev;
+  }
+  return changed;
+}
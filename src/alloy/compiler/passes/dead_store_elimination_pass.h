@@ -0,0 +1,54 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+#define ALLOY_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
+
+#include <alloy/compiler/compiler_pass.h>
+
+#include <llvm/ADT/BitVector.h>
+
+
+namespace alloy {
+namespace compiler {
+namespace passes {
+
+
+class DeadStoreEliminationPass : public CompilerPass {
+public:
+  DeadStoreEliminationPass();
+  virtual ~DeadStoreEliminationPass();
+
+  virtual const char* name() const { return "DeadStoreElimination"; }
+
+  virtual int Initialize(Compiler* compiler);
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  void ComputeLiveOut(hir::Block* block, llvm::BitVector& live);
+  bool RemoveDeadStoresBlock(hir::Block* block, bool remove_stores);
+
+private:
+  size_t context_size_;
+
+  // Indexed by block ordinal.
+  std::vector<hir::Block*> blocks_;
+  // Context bytes that may be read before being written, at block entry.
+  std::vector<llvm::BitVector> live_in_;
+  llvm::BitVector live_;
+};
+
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace alloy
+
+
+#endif  // ALLOY_COMPILER_PASSES_DEAD_STORE_ELIMINATION_PASS_H_
@@ -29,7 +29,7 @@ FinalizationPass::FinalizationPass() :
 FinalizationPass::~FinalizationPass() {
 }
 
-int FinalizationPass::Run(HIRBuilder* builder) {
+int FinalizationPass::Run(HIRBuilder* builder, bool& out_changed) {
   // Process the HIR and prepare it for lowering.
   // After this is done the HIR should be ready for emitting.
 
@@ -60,6 +60,7 @@ int FinalizationPass::Run(HIRBuilder* builder) {
       if (target->block == block->next) {
         // Jumping to subsequent block. Remove.
         tail->Remove();
+        out_changed = true;
       }
     }
 
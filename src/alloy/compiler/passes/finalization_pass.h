@@ -23,7 +23,9 @@ public:
   FinalizationPass();
   virtual ~FinalizationPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "Finalization"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
 };
@@ -0,0 +1,430 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/global_value_numbering_pass.h>
+
+#include <algorithm>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+namespace {
+
+// Looks through assigns, including the ones we've just inserted, so that
+// users of a replaced value match users of the value it was replaced with.
+Value* GetRealValue(Value* value) {
+  while (value->def && value->def->opcode == &OPCODE_ASSIGN_info) {
+    value = value->def->src1.value;
+  }
+  return value;
+}
+
+// Constant bits, masked to the width of the type. Smaller set_constant
+// overloads leave the rest of the union untouched.
+uint64_t GetConstantBits(const Value* value) {
+  switch (value->type) {
+  case INT8_TYPE:
+    return (uint8_t)value->constant.i8;
+  case INT16_TYPE:
+    return (uint16_t)value->constant.i16;
+  case INT32_TYPE:
+  case FLOAT32_TYPE:
+    return (uint32_t)value->constant.i32;
+  case VEC128_TYPE:
+    return value->constant.v128.low ^
+           (value->constant.v128.high * 0x9E3779B97F4A7C15ull);
+  default:
+    return (uint64_t)value->constant.i64;
+  }
+}
+
+bool ValuesEqual(Value* a, Value* b) {
+  a = GetRealValue(a);
+  b = GetRealValue(b);
+  if (a == b) {
+    return true;
+  }
+  // Constants aren't shared, so compare them by content. Floats are
+  // compared bitwise, which keeps -0/+0 and NaNs apart.
+  if (!a->IsConstant() || !b->IsConstant() || a->type != b->type) {
+    return false;
+  }
+  if (a->type == VEC128_TYPE) {
+    return a->constant.v128.low == b->constant.v128.low &&
+           a->constant.v128.high == b->constant.v128.high;
+  }
+  return GetConstantBits(a) == GetConstantBits(b);
+}
+
+uint32_t HashValue(Value* value) {
+  value = GetRealValue(value);
+  uint64_t hash;
+  if (value->IsConstant()) {
+    hash = GetConstantBits(value) * 31 + value->type;
+  } else {
+    hash = (uint64_t)value->ordinal * 0x9E3779B97F4A7C15ull;
+  }
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+bool OperandsEqual(uint32_t sig_type, const Instr::Op& a, const Instr::Op& b) {
+  switch (sig_type) {
+  case OPCODE_SIG_TYPE_X:
+    return true;
+  case OPCODE_SIG_TYPE_V:
+    return ValuesEqual(a.value, b.value);
+  default:
+    // Offsets, labels and symbols are all compared by identity.
+    return a.offset == b.offset;
+  }
+}
+
+uint32_t HashOperand(uint32_t sig_type, const Instr::Op& op) {
+  switch (sig_type) {
+  case OPCODE_SIG_TYPE_X:
+    return 0;
+  case OPCODE_SIG_TYPE_V:
+    return HashValue(op.value);
+  default:
+    return (uint32_t)(op.offset ^ (op.offset >> 32));
+  }
+}
+
+uint32_t Mix(uint32_t hash, uint32_t value) {
+  return (hash ^ value) * 0x01000193;
+}
+
+}  // namespace
+
+
+GlobalValueNumberingPass::GlobalValueNumberingPass(bool cross_block) :
+    CompilerPass(),
+    cross_block_(cross_block) {
+}
+
+GlobalValueNumberingPass::~GlobalValueNumberingPass() {
+}
+
+int GlobalValueNumberingPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Dominator-based value numbering. Blocks are visited in dominator tree
+  // order with a scoped table of the expressions computed so far; an
+  // instruction computing the same thing as one in a dominating position is
+  // replaced with an assign of the earlier result:
+  //   <block0>:
+  //     v1.i64 = add v0.i64, 16
+  //     branch_true v9.i8, label1
+  //   <block1>:
+  //     v2.i64 = add 16, v0.i64   <-- v2.i64 = v1.i64
+  // Simplification/DCE then forward the assign and remove it.
+  //
+  // Only pure instructions are considered. Anything volatile, touching
+  // memory, the context, locals or host flags is left alone.
+
+  out_changed = false;
+  if (!builder->first_block()) {
+    return 0;
+  }
+
+  BuildGraph(builder);
+  ComputeDominators();
+
+  bool changed = false;
+  struct Frame {
+    uint16_t  ordinal;
+    size_t    next_child;
+    size_t    entry_count;
+  };
+  std::vector<Frame> stack;
+  Frame entry = { 0, child_start_[0], entries_.size() };
+  changed |= NumberBlock(blocks_[0]);
+  stack.push_back(entry);
+  while (stack.size()) {
+    Frame& frame = stack.back();
+    if (frame.next_child < child_start_[frame.ordinal + 1]) {
+      uint16_t child = children_[frame.next_child++];
+      Frame child_frame = { child, child_start_[child], entries_.size() };
+      changed |= NumberBlock(blocks_[child]);
+      stack.push_back(child_frame);
+    } else {
+      PopScope(frame.entry_count);
+      stack.pop_back();
+    }
+  }
+  XEASSERT(entries_.empty());
+
+  out_changed = changed;
+  return 0;
+}
+
+void GlobalValueNumberingPass::BuildGraph(HIRBuilder* builder) {
+  blocks_.clear();
+  size_t instr_count = 0;
+  Block* block = builder->first_block();
+  while (block) {
+    block->ordinal = (uint16_t)blocks_.size();
+    blocks_.push_back(block);
+    Instr* i = block->instr_head;
+    while (i) {
+      instr_count++;
+      i = i->next;
+    }
+    block = block->next;
+  }
+  size_t block_count = blocks_.size();
+
+  succs_.clear();
+  succ_start_.clear();
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    block = *it;
+    succ_start_.push_back(succs_.size());
+    if (block->next && HIRBuilder::FallsThrough(block)) {
+      succs_.push_back(block->next->ordinal);
+    }
+    Edge* edge = block->outgoing_edge_head;
+    while (edge) {
+      succs_.push_back(edge->dest->ordinal);
+      edge = edge->outgoing_next;
+    }
+  }
+  succ_start_.push_back(succs_.size());
+
+  // Invert into predecessor lists.
+  pred_start_.assign(block_count + 1, 0);
+  for (auto it = succs_.begin(); it != succs_.end(); ++it) {
+    pred_start_[*it + 1]++;
+  }
+  for (size_t n = 0; n < block_count; n++) {
+    pred_start_[n + 1] += pred_start_[n];
+  }
+  preds_.resize(succs_.size());
+  std::vector<size_t> cursor(pred_start_.begin(), pred_start_.end() - 1);
+  for (size_t n = 0; n < block_count; n++) {
+    for (size_t m = succ_start_[n]; m < succ_start_[n + 1]; m++) {
+      preds_[cursor[succs_[m]]++] = (uint16_t)n;
+    }
+  }
+
+  // Sized so chains stay short even if every instruction is a candidate.
+  size_t bucket_count = 64;
+  while (bucket_count < instr_count) {
+    bucket_count <<= 1;
+  }
+  buckets_.assign(bucket_count, -1);
+  entries_.clear();
+}
+
+void GlobalValueNumberingPass::ComputeDominators() {
+  // Cooper, Harvey, Kennedy - "A Simple, Fast Dominance Algorithm".
+  size_t block_count = blocks_.size();
+  postorder_.assign(block_count, -1);
+  idom_.assign(block_count, -1);
+  rpo_.clear();
+
+  // Iterative DFS from the entry. -2 marks blocks on the stack.
+  std::vector<std::pair<uint16_t, size_t>> stack;
+  int32_t postorder_count = 0;
+  postorder_[0] = -2;
+  stack.push_back(std::make_pair((uint16_t)0, succ_start_[0]));
+  while (stack.size()) {
+    auto& top = stack.back();
+    if (top.second < succ_start_[top.first + 1]) {
+      uint16_t succ = succs_[top.second++];
+      if (postorder_[succ] == -1) {
+        postorder_[succ] = -2;
+        stack.push_back(std::make_pair(succ, succ_start_[succ]));
+      }
+    } else {
+      postorder_[top.first] = postorder_count++;
+      rpo_.push_back(top.first);
+      stack.pop_back();
+    }
+  }
+  std::reverse(rpo_.begin(), rpo_.end());
+
+  idom_[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t n = 1; n < rpo_.size(); n++) {
+      uint16_t block = rpo_[n];
+      int32_t new_idom = -1;
+      for (size_t m = pred_start_[block]; m < pred_start_[block + 1]; m++) {
+        uint16_t pred = preds_[m];
+        if (idom_[pred] == -1) {
+          // Unreachable, or not processed yet.
+          continue;
+        }
+        new_idom = new_idom == -1 ? pred : IntersectDominators(pred, new_idom);
+      }
+      if (idom_[block] != new_idom) {
+        idom_[block] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  // Build the tree. Unreachable blocks aren't in it, and are never visited.
+  child_start_.assign(block_count + 1, 0);
+  for (size_t n = 1; n < rpo_.size(); n++) {
+    child_start_[idom_[rpo_[n]] + 1]++;
+  }
+  for (size_t n = 0; n < block_count; n++) {
+    child_start_[n + 1] += child_start_[n];
+  }
+  children_.resize(rpo_.size() - 1);
+  std::vector<size_t> cursor(child_start_.begin(), child_start_.end() - 1);
+  for (size_t n = 1; n < rpo_.size(); n++) {
+    children_[cursor[idom_[rpo_[n]]]++] = rpo_[n];
+  }
+}
+
+int32_t GlobalValueNumberingPass::IntersectDominators(int32_t a, int32_t b) {
+  while (a != b) {
+    while (postorder_[a] < postorder_[b]) {
+      a = idom_[a];
+    }
+    while (postorder_[b] < postorder_[a]) {
+      b = idom_[b];
+    }
+  }
+  return a;
+}
+
+bool GlobalValueNumberingPass::NumberBlock(Block* block) {
+  bool changed = false;
+  Instr* i = block->instr_head;
+  while (i) {
+    if (!IsCandidate(i)) {
+      i = i->next;
+      continue;
+    }
+    uint32_t hash = HashInstr(i);
+    Instr* leader = Lookup(i, hash);
+    if (!leader || leader->block->ordinal > block->ordinal ||
+        (!cross_block_ && leader->block != block)) {
+      // A dominator laid out after us would have its value used before
+      // it's defined in block order, which the register allocator can't
+      // handle. Start a new leader instead. Without cross-block reuse only
+      // leaders in this block are used.
+      Insert(i, hash);
+    } else if (i->next &&
+               (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+      // did_carry/etc read the host flags the instruction sets, so it has
+      // to stay. The leader remains available.
+    } else {
+      i->Replace(&OPCODE_ASSIGN_info, 0);
+      i->set_src1(leader->dest);
+      changed = true;
+    }
+    i = i->next;
+  }
+  return changed;
+}
+
+bool GlobalValueNumberingPass::IsCandidate(Instr* i) {
+  if (!i->dest) {
+    return false;
+  }
+  if (i->opcode->flags & (OPCODE_FLAG_BRANCH |
+                          OPCODE_FLAG_MEMORY |
+                          OPCODE_FLAG_VOLATILE |
+                          OPCODE_FLAG_IGNORE |
+                          OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  switch (i->opcode->num) {
+  case OPCODE_ASSIGN:
+    // Forwarded by Simplification.
+  case OPCODE_LOAD_CLOCK:
+  case OPCODE_LOAD_LOCAL:
+  case OPCODE_LOAD_CONTEXT:
+    // Context loads are handled by ContextPromotion, which knows about
+    // intervening stores.
+  case OPCODE_ATOMIC_ADD:
+  case OPCODE_ATOMIC_SUB:
+    return false;
+  default:
+    return true;
+  }
+}
+
+uint32_t GlobalValueNumberingPass::HashInstr(Instr* i) {
+  uint32_t signature = i->opcode->signature;
+  uint32_t hash = Mix(0x811C9DC5, i->opcode->num);
+  hash = Mix(hash, i->flags);
+  hash = Mix(hash, i->dest->type);
+  if (i->opcode->flags & OPCODE_FLAG_COMMUNATIVE) {
+    // Order independent, so add v0, v1 and add v1, v0 collide.
+    hash = Mix(hash, HashValue(i->src1.value) + HashValue(i->src2.value));
+  } else {
+    hash = Mix(hash, HashOperand(GET_OPCODE_SIG_TYPE_SRC1(signature),
+                                 i->src1));
+    hash = Mix(hash, HashOperand(GET_OPCODE_SIG_TYPE_SRC2(signature),
+                                 i->src2));
+  }
+  hash = Mix(hash, HashOperand(GET_OPCODE_SIG_TYPE_SRC3(signature), i->src3));
+  return hash;
+}
+
+bool GlobalValueNumberingPass::InstrsEqual(Instr* a, Instr* b) {
+  if (a->opcode != b->opcode ||
+      a->flags != b->flags ||
+      a->dest->type != b->dest->type) {
+    return false;
+  }
+  uint32_t signature = a->opcode->signature;
+  if (a->opcode->flags & OPCODE_FLAG_COMMUNATIVE) {
+    if (!(ValuesEqual(a->src1.value, b->src1.value) &&
+          ValuesEqual(a->src2.value, b->src2.value)) &&
+        !(ValuesEqual(a->src1.value, b->src2.value) &&
+          ValuesEqual(a->src2.value, b->src1.value))) {
+      return false;
+    }
+  } else {
+    if (!OperandsEqual(GET_OPCODE_SIG_TYPE_SRC1(signature),
+                       a->src1, b->src1) ||
+        !OperandsEqual(GET_OPCODE_SIG_TYPE_SRC2(signature),
+                       a->src2, b->src2)) {
+      return false;
+    }
+  }
+  return OperandsEqual(GET_OPCODE_SIG_TYPE_SRC3(signature), a->src3, b->src3);
+}
+
+Instr* GlobalValueNumberingPass::Lookup(Instr* i, uint32_t hash) {
+  int32_t index = buckets_[hash & (buckets_.size() - 1)];
+  while (index != -1) {
+    const Entry& entry = entries_[index];
+    if (entry.hash == hash && InstrsEqual(entry.instr, i)) {
+      return entry.instr;
+    }
+    index = entry.next;
+  }
+  return NULL;
+}
+
+void GlobalValueNumberingPass::Insert(Instr* i, uint32_t hash) {
+  int32_t& bucket = buckets_[hash & (buckets_.size() - 1)];
+  Entry entry = { hash, bucket, i };
+  bucket = (int32_t)entries_.size();
+  entries_.push_back(entry);
+}
+
+void GlobalValueNumberingPass::PopScope(size_t entry_count) {
+  // Entries are always at the head of their chain when popped, as anything
+  // inserted after them is popped first.
+  while (entries_.size() > entry_count) {
+    const Entry& entry = entries_.back();
+    buckets_[entry.hash & (buckets_.size() - 1)] = entry.next;
+    entries_.pop_back();
+  }
+}
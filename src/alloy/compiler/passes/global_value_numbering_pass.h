@@ -0,0 +1,83 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_COMPILER_PASSES_GLOBAL_VALUE_NUMBERING_PASS_H_
+#define ALLOY_COMPILER_PASSES_GLOBAL_VALUE_NUMBERING_PASS_H_
+
+#include <alloy/compiler/compiler_pass.h>
+
+
+namespace alloy {
+namespace compiler {
+namespace passes {
+
+
+class GlobalValueNumberingPass : public CompilerPass {
+public:
+  // Values are only reused across blocks when cross_block is set. That
+  // extends their live ranges past the block that defines them, so the
+  // register allocator in the pipeline has to support it.
+  GlobalValueNumberingPass(bool cross_block);
+  virtual ~GlobalValueNumberingPass();
+
+  virtual const char* name() const { return "GlobalValueNumbering"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  void BuildGraph(hir::HIRBuilder* builder);
+  void ComputeDominators();
+  int32_t IntersectDominators(int32_t a, int32_t b);
+
+  bool NumberBlock(hir::Block* block);
+  bool IsCandidate(hir::Instr* i);
+  uint32_t HashInstr(hir::Instr* i);
+  bool InstrsEqual(hir::Instr* a, hir::Instr* b);
+  hir::Instr* Lookup(hir::Instr* i, uint32_t hash);
+  void Insert(hir::Instr* i, uint32_t hash);
+  void PopScope(size_t entry_count);
+
+private:
+  bool cross_block_;
+
+  // All indexed by block ordinal. Successors/predecessors include
+  // fall-through, which ControlFlowAnalysisPass doesn't add edges for.
+  std::vector<hir::Block*> blocks_;
+  std::vector<uint16_t> succs_;
+  std::vector<size_t> succ_start_;
+  std::vector<uint16_t> preds_;
+  std::vector<size_t> pred_start_;
+  // -1 for blocks unreachable from the entry.
+  std::vector<int32_t> postorder_;
+  std::vector<int32_t> idom_;
+  // Reachable block ordinals in reverse postorder.
+  std::vector<uint16_t> rpo_;
+  // Dominator tree, children in reverse postorder.
+  std::vector<uint16_t> children_;
+  std::vector<size_t> child_start_;
+
+  // Scoped hash table of available expressions. Entries are pushed as they
+  // are seen and popped when leaving the dominator subtree that defined
+  // them, so lookups only ever find dominating instructions.
+  typedef struct {
+    uint32_t    hash;
+    int32_t     next;
+    hir::Instr* instr;
+  } Entry;
+  std::vector<Entry> entries_;
+  std::vector<int32_t> buckets_;
+};
+
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace alloy
+
+
+#endif  // ALLOY_COMPILER_PASSES_GLOBAL_VALUE_NUMBERING_PASS_H_
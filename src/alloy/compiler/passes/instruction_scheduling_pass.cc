@@ -0,0 +1,387 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/instruction_scheduling_pass.h>
+
+#include <algorithm>
+
+using namespace alloy;
+using namespace alloy::backend;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+namespace {
+
+// Large regions cost O(n^2) to build and mostly just raise register
+// pressure, so they are cut into pieces this big.
+const size_t kMaxRegionSize = 32;
+
+// How many loaded values may be waiting for their first user before loads
+// stop being preferred, so hoisting doesn't cause spills.
+const uint32_t kMaxLoadsInFlight = 2;
+
+}  // namespace
+
+
+InstructionSchedulingPass::InstructionSchedulingPass(
+    const MachineInfo* machine_info) :
+    CompilerPass(),
+    load_latency_(machine_info->load_latency) {
+}
+
+InstructionSchedulingPass::~InstructionSchedulingPass() {
+}
+
+int InstructionSchedulingPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Reorders instructions within a block so loads start as early as
+  // possible and the ALU work that doesn't depend on them fills the gap:
+  //   v0 = load v10                v0 = load v10
+  //   v1 = add v0, 1               v3 = load v11
+  //   v2 = xor v20, v21      =>    v2 = xor v20, v21
+  //   v3 = load v11                v1 = add v0, 1
+  //   v4 = add v3, v2              v4 = add v3, v2
+  // Only the order of data-independent instructions changes: guest memory
+  // accesses keep their order if either is a store, context accesses keep
+  // theirs if they overlap and either is a store, and anything with side
+  // effects or host flag pairing ends the region being scheduled.
+  //
+  // Instructions are picked by their latency-weighted distance to the end
+  // of the region (the critical path), then by original order.
+
+  bool changed = false;
+  auto block = builder->first_block();
+  while (block) {
+    changed |= ScheduleBlock(block);
+    block = block->next;
+  }
+
+  out_changed = changed;
+  return 0;
+}
+
+bool InstructionSchedulingPass::IsSchedulable(Instr* i) {
+  if (i->opcode->flags & (OPCODE_FLAG_BRANCH |
+                          OPCODE_FLAG_VOLATILE |
+                          OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    // did_carry/etc need the host flags this sets.
+    return false;
+  }
+  switch (i->opcode->num) {
+  case OPCODE_LOAD:
+  case OPCODE_STORE:
+  case OPCODE_LOAD_CONTEXT:
+  case OPCODE_STORE_CONTEXT:
+  case OPCODE_LOAD_LOCAL:
+  case OPCODE_STORE_LOCAL:
+    return true;
+  case OPCODE_LOAD_CLOCK:
+  case OPCODE_ATOMIC_ADD:
+  case OPCODE_ATOMIC_SUB:
+    return false;
+  default:
+    // Anything else not producing a value is there for a side effect.
+    return i->dest && !(i->opcode->flags & OPCODE_FLAG_MEMORY);
+  }
+}
+
+InstructionSchedulingPass::AccessClass
+InstructionSchedulingPass::GetAccessClass(Instr* i, bool* out_is_store) {
+  *out_is_store = false;
+  switch (i->opcode->num) {
+  case OPCODE_STORE:
+    *out_is_store = true;
+  case OPCODE_LOAD:
+    return ACCESS_MEMORY;
+  case OPCODE_STORE_CONTEXT:
+    *out_is_store = true;
+  case OPCODE_LOAD_CONTEXT:
+    return ACCESS_CONTEXT;
+  case OPCODE_STORE_LOCAL:
+    *out_is_store = true;
+  case OPCODE_LOAD_LOCAL:
+    return ACCESS_LOCAL;
+  default:
+    return ACCESS_NONE;
+  }
+}
+
+uint32_t InstructionSchedulingPass::GetLatency(Instr* i) {
+  switch (i->opcode->num) {
+  case OPCODE_LOAD:
+  case OPCODE_LOAD_CONTEXT:
+  case OPCODE_LOAD_LOCAL:
+    return load_latency_;
+  case OPCODE_MUL:
+  case OPCODE_MUL_HI:
+    return 3;
+  case OPCODE_DIV:
+    return 20;
+  default:
+    return 1;
+  }
+}
+
+bool InstructionSchedulingPass::ScheduleBlock(Block* block) {
+  // Regions run between barriers, and include the comments/source offsets
+  // in front of their instructions.
+  bool changed = false;
+  Instr* region_start = NULL;
+  size_t region_size = 0;
+  auto i = block->instr_head;
+  while (i) {
+    auto next = i->next;
+    if (i->opcode->flags & OPCODE_FLAG_IGNORE) {
+      if (!region_start) {
+        region_start = i;
+      }
+    } else if (!IsSchedulable(i)) {
+      if (region_size) {
+        changed |= ScheduleRegion(block, region_start, i);
+      }
+      region_start = NULL;
+      region_size = 0;
+    } else {
+      if (!region_start) {
+        region_start = i;
+      }
+      if (++region_size == kMaxRegionSize) {
+        changed |= ScheduleRegion(block, region_start, next);
+        region_start = NULL;
+        region_size = 0;
+      }
+    }
+    i = next;
+  }
+  if (region_size) {
+    changed |= ScheduleRegion(block, region_start, NULL);
+  }
+  return changed;
+}
+
+bool InstructionSchedulingPass::ScheduleRegion(
+    Block* block, Instr* start, Instr* end) {
+  // Build nodes. Instruction ordinals are set to their node index so
+  // dependencies on values defined earlier in the region can be found from
+  // the def.
+  nodes_.clear();
+  succs_.clear();
+  Instr* attached_head = NULL;
+  for (Instr* i = start; i != end; i = i->next) {
+    if (i->opcode->flags & OPCODE_FLAG_IGNORE) {
+      if (!attached_head) {
+        attached_head = i;
+      }
+      i->ordinal = (uint32_t)-1;
+      continue;
+    }
+    Node node;
+    node.instr = i;
+    node.attached_head = attached_head;
+    node.latency = GetLatency(i);
+    node.height = 0;
+    node.pred_count = 0;
+    node.succ_head = -1;
+    node.is_load = i->opcode == &OPCODE_LOAD_info ||
+                   i->opcode == &OPCODE_LOAD_CONTEXT_info;
+    node.consumed = false;
+    attached_head = NULL;
+    i->ordinal = (uint32_t)nodes_.size();
+    nodes_.push_back(node);
+  }
+  if (nodes_.size() < 3) {
+    return false;
+  }
+  if (attached_head) {
+    // Trailing comments stay where they are, at the end.
+    end = attached_head;
+  }
+
+  Value* srcs[3];
+  for (uint32_t n = 0; n < nodes_.size(); n++) {
+    uint32_t src_count = GetSources(nodes_[n].instr, srcs);
+    for (uint32_t m = 0; m < src_count; m++) {
+      int32_t def_index = GetRegionIndex(block, srcs[m]);
+      if (def_index != -1 && (uint32_t)def_index < n) {
+        AddDependency(def_index, n);
+      }
+    }
+    AddAccessDependencies(n);
+  }
+
+  // Heights, bottom up. Dependencies always point forward.
+  for (size_t n = nodes_.size(); n-- > 0;) {
+    Node& node = nodes_[n];
+    uint32_t max_height = 0;
+    for (int32_t s = node.succ_head; s != -1; s = succs_[s].next) {
+      max_height = std::max(max_height, nodes_[succs_[s].node].height);
+    }
+    node.height = node.latency + max_height;
+  }
+
+  // List schedule. Once enough loaded values are waiting on their users,
+  // further loads are held back so hoisting doesn't just cause spills.
+  ready_.clear();
+  order_.clear();
+  for (uint32_t n = 0; n < nodes_.size(); n++) {
+    if (!nodes_[n].pred_count) {
+      ready_.push_back(n);
+    }
+  }
+  uint32_t loads_in_flight = 0;
+  while (ready_.size()) {
+    bool hold_loads = loads_in_flight >= kMaxLoadsInFlight;
+    size_t best = 0;
+    for (size_t r = 1; r < ready_.size(); r++) {
+      const Node& node = nodes_[ready_[r]];
+      const Node& best_node = nodes_[ready_[best]];
+      bool held = hold_loads && node.is_load;
+      bool best_held = hold_loads && best_node.is_load;
+      if (held != best_held) {
+        if (best_held) {
+          best = r;
+        }
+      } else if (node.height > best_node.height ||
+                 (node.height == best_node.height &&
+                  ready_[r] < ready_[best])) {
+        best = r;
+      }
+    }
+    uint32_t n = ready_[best];
+    ready_.erase(ready_.begin() + best);
+    order_.push_back(n);
+
+    Node& node = nodes_[n];
+    if (node.is_load) {
+      loads_in_flight++;
+    }
+    uint32_t src_count = GetSources(node.instr, srcs);
+    for (uint32_t m = 0; m < src_count; m++) {
+      int32_t def_index = GetRegionIndex(block, srcs[m]);
+      if (def_index != -1 &&
+          nodes_[def_index].is_load && !nodes_[def_index].consumed) {
+        nodes_[def_index].consumed = true;
+        loads_in_flight--;
+      }
+    }
+
+    for (int32_t s = node.succ_head; s != -1; s = succs_[s].next) {
+      if (!--nodes_[succs_[s].node].pred_count) {
+        ready_.push_back(succs_[s].node);
+      }
+    }
+  }
+  XEASSERT(order_.size() == nodes_.size());
+
+  bool changed = false;
+  for (uint32_t n = 0; n < order_.size(); n++) {
+    if (order_[n] != n) {
+      changed = true;
+      break;
+    }
+  }
+  if (!changed) {
+    return false;
+  }
+
+  // Relink in the new order in front of whatever follows the region.
+  for (auto it = order_.begin(); it != order_.end(); ++it) {
+    const Node& node = nodes_[*it];
+    Instr* i = node.attached_head ? node.attached_head : node.instr;
+    while (true) {
+      Instr* next = i->next;
+      if (end) {
+        i->MoveBefore(end);
+      } else {
+        i->MoveToEnd(block);
+      }
+      if (i == node.instr) {
+        break;
+      }
+      i = next;
+    }
+  }
+  return true;
+}
+
+uint32_t InstructionSchedulingPass::GetSources(Instr* i, Value** out_srcs) {
+  uint32_t signature = i->opcode->signature;
+  uint32_t count = 0;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+    out_srcs[count++] = i->src1.value;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+    out_srcs[count++] = i->src2.value;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+    out_srcs[count++] = i->src3.value;
+  }
+  return count;
+}
+
+int32_t InstructionSchedulingPass::GetRegionIndex(Block* block, Value* value) {
+  // Ordinals of instructions outside of the region are stale, so check the
+  // node actually refers back to the def.
+  Instr* def = value->def;
+  if (!def || def->block != block || def->ordinal >= nodes_.size() ||
+      nodes_[def->ordinal].instr != def) {
+    return -1;
+  }
+  return (int32_t)def->ordinal;
+}
+
+void InstructionSchedulingPass::AddDependency(uint32_t from, uint32_t to) {
+  for (int32_t s = nodes_[from].succ_head; s != -1; s = succs_[s].next) {
+    if (succs_[s].node == to) {
+      return;
+    }
+  }
+  Succ succ = { to, nodes_[from].succ_head };
+  nodes_[from].succ_head = (int32_t)succs_.size();
+  succs_.push_back(succ);
+  nodes_[to].pred_count++;
+}
+
+void InstructionSchedulingPass::AddAccessDependencies(uint32_t index) {
+  bool is_store;
+  Instr* i = nodes_[index].instr;
+  AccessClass access_class = GetAccessClass(i, &is_store);
+  if (access_class == ACCESS_NONE) {
+    return;
+  }
+  for (uint32_t n = 0; n < index; n++) {
+    bool other_is_store;
+    Instr* other = nodes_[n].instr;
+    if (GetAccessClass(other, &other_is_store) != access_class ||
+        (!is_store && !other_is_store)) {
+      continue;
+    }
+    if (access_class == ACCESS_CONTEXT) {
+      // Context offsets are exact, so disjoint ranges can't interfere.
+      uint64_t offset = i->src1.offset;
+      uint64_t other_offset = other->src1.offset;
+      size_t size = GetTypeSize(is_store ? i->src2.value->type
+                                         : i->dest->type);
+      size_t other_size = GetTypeSize(other_is_store ? other->src2.value->type
+                                                     : other->dest->type);
+      if (offset + size <= other_offset ||
+          other_offset + other_size <= offset) {
+        continue;
+      }
+    } else if (access_class == ACCESS_LOCAL &&
+               i->src1.value != other->src1.value) {
+      continue;
+    }
+    AddDependency(n, index);
+  }
+}
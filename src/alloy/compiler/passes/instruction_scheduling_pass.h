@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_COMPILER_PASSES_INSTRUCTION_SCHEDULING_PASS_H_
+#define ALLOY_COMPILER_PASSES_INSTRUCTION_SCHEDULING_PASS_H_
+
+#include <alloy/backend/machine_info.h>
+#include <alloy/compiler/compiler_pass.h>
+
+
+namespace alloy {
+namespace compiler {
+namespace passes {
+
+
+class InstructionSchedulingPass : public CompilerPass {
+public:
+  InstructionSchedulingPass(const backend::MachineInfo* machine_info);
+  virtual ~InstructionSchedulingPass();
+
+  virtual const char* name() const { return "InstructionScheduling"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  enum AccessClass {
+    ACCESS_NONE,
+    ACCESS_MEMORY,
+    ACCESS_CONTEXT,
+    ACCESS_LOCAL,
+  };
+  typedef struct {
+    hir::Instr* instr;
+    // Comments/source offsets that move along with the instruction.
+    hir::Instr* attached_head;
+    uint32_t    latency;
+    uint32_t    height;
+    uint32_t    pred_count;
+    int32_t     succ_head;
+    bool        is_load;
+    // Set once a scheduled instruction has used the loaded value.
+    bool        consumed;
+  } Node;
+  typedef struct {
+    uint32_t    node;
+    int32_t     next;
+  } Succ;
+
+  bool IsSchedulable(hir::Instr* i);
+  AccessClass GetAccessClass(hir::Instr* i, bool* out_is_store);
+  uint32_t GetLatency(hir::Instr* i);
+  bool ScheduleBlock(hir::Block* block);
+  bool ScheduleRegion(hir::Block* block, hir::Instr* start, hir::Instr* end);
+  uint32_t GetSources(hir::Instr* i, hir::Value** out_srcs);
+  int32_t GetRegionIndex(hir::Block* block, hir::Value* value);
+  void AddDependency(uint32_t from, uint32_t to);
+  void AddAccessDependencies(uint32_t index);
+
+private:
+  uint32_t load_latency_;
+  std::vector<Node> nodes_;
+  std::vector<Succ> succs_;
+  std::vector<uint32_t> ready_;
+  std::vector<uint32_t> order_;
+};
+
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace alloy
+
+
+#endif  // ALLOY_COMPILER_PASSES_INSTRUCTION_SCHEDULING_PASS_H_
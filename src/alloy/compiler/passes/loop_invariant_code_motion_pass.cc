@@ -0,0 +1,274 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/loop_invariant_code_motion_pass.h>
+
+#include <algorithm>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+LoopInvariantCodeMotionPass::LoopInvariantCodeMotionPass() :
+    CompilerPass(),
+    context_escapes_(false) {
+}
+
+LoopInvariantCodeMotionPass::~LoopInvariantCodeMotionPass() {
+}
+
+int LoopInvariantCodeMotionPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Moves instructions whose inputs don't change within a loop into the
+  // loop preheader, so they run once instead of every iteration.
+  // ControlFlowAnalysisPass finds the loops (marking their back edges) and
+  // makes sure each has a preheader:
+  //   <block0>:                   <-- preheader
+  //     v0.i64 = load_context +40
+  //   <block1>:                   <-- header
+  //     v1.i64 = load_context +56
+  //     v2.i64 = add v0.i64, 4
+  //     v3.i64 = add v1.i64, 1
+  //     store_context +40, v3.i64
+  //     branch_true v4.i8, block1
+  // Becomes:
+  //   <block0>:
+  //     v0.i64 = load_context +40
+  //     v1.i64 = load_context +56   <-- nothing in the loop stores +56
+  //     v2.i64 = add v0.i64, 4
+  //   <block1>:
+  //     v3.i64 = add v1.i64, 1
+  //     store_context +40, v3.i64
+  //     branch_true v4.i8, block1
+  //
+  // Hoisted instructions run even if the loop body wouldn't have reached
+  // them, so only pure instructions that can't fault are moved. Context
+  // loads are only moved if nothing in the loop writes to the context
+  // they read.
+
+  FindLoops(builder);
+
+  bool changed = false;
+  for (auto it = loops_.begin(); it != loops_.end(); ++it) {
+    changed |= HoistInvariants(*it);
+  }
+
+  out_changed = changed;
+  return 0;
+}
+
+void LoopInvariantCodeMotionPass::FindLoops(HIRBuilder* builder) {
+  blocks_.clear();
+  Block* block = builder->first_block();
+  while (block) {
+    block->ordinal = (uint16_t)blocks_.size();
+    blocks_.push_back(block);
+    block = block->next;
+  }
+
+  loops_.clear();
+  for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+    Block* header = *it;
+    Block* preheader = GetPreheader(header);
+    if (!preheader) {
+      continue;
+    }
+    loops_.resize(loops_.size() + 1);
+    Loop& loop = loops_.back();
+    loop.header = header;
+    loop.preheader = preheader;
+    FindLoopBody(builder, loop);
+    if (loop.body.find_first() < (int)header->ordinal) {
+      // Part of the body is laid out before the header; hoisting into the
+      // preheader would put definitions after their uses in block order,
+      // which the register allocator can't handle.
+      loops_.pop_back();
+    }
+  }
+
+  // Inner loops first, so anything they hoist into their preheader (part
+  // of the outer loop) can then be hoisted further.
+  std::sort(loops_.begin(), loops_.end(),
+            [](const Loop& a, const Loop& b) {
+              return a.block_count < b.block_count;
+            });
+}
+
+Block* LoopInvariantCodeMotionPass::GetPreheader(Block* header) {
+  // Back edges are only marked on loops that had a preheader when
+  // ControlFlowAnalysis ran. Make sure nothing has changed that since.
+  bool has_back_edge = false;
+  Edge* edge = header->incoming_edge_head;
+  while (edge) {
+    if (!(edge->flags & Edge::BACK_EDGE)) {
+      return NULL;
+    }
+    has_back_edge = true;
+    edge = edge->incoming_next;
+  }
+  Block* preheader = header->prev;
+  if (!has_back_edge || !preheader || preheader->outgoing_edge_head) {
+    return NULL;
+  }
+  Instr* tail = preheader->instr_tail;
+  if (tail && (tail->opcode->flags &
+               (OPCODE_FLAG_BRANCH | OPCODE_FLAG_VOLATILE))) {
+    return NULL;
+  }
+  return preheader;
+}
+
+void LoopInvariantCodeMotionPass::FindLoopBody(HIRBuilder* builder,
+                                               Loop& loop) {
+  // Everything that can reach a back edge without going through the
+  // header.
+  loop.body.clear();
+  loop.body.resize((unsigned)blocks_.size());
+  loop.body.set(loop.header->ordinal);
+  loop.block_count = 1;
+
+  std::vector<Block*> worklist;
+  Edge* edge = loop.header->incoming_edge_head;
+  while (edge) {
+    worklist.push_back(edge->src);
+    edge = edge->incoming_next;
+  }
+  while (worklist.size()) {
+    Block* block = worklist.back();
+    worklist.pop_back();
+    if (loop.body.test(block->ordinal)) {
+      continue;
+    }
+    loop.body.set(block->ordinal);
+    loop.block_count++;
+    if (block->prev && HIRBuilder::FallsThrough(block->prev)) {
+      worklist.push_back(block->prev);
+    }
+    edge = block->incoming_edge_head;
+    while (edge) {
+      worklist.push_back(edge->src);
+      edge = edge->incoming_next;
+    }
+  }
+}
+
+bool LoopInvariantCodeMotionPass::HoistInvariants(Loop& loop) {
+  ScanContextWrites(loop);
+
+  // Visit in block order so chains of invariants get hoisted together;
+  // repeat in case a definition is laid out after one of its users.
+  bool changed = false;
+  bool hoisted = true;
+  while (hoisted) {
+    hoisted = false;
+    for (int n = loop.body.find_first(); n != -1;
+         n = loop.body.find_next(n)) {
+      Instr* i = blocks_[n]->instr_head;
+      while (i) {
+        Instr* next = i->next;
+        if (IsInvariant(loop, i)) {
+          i->MoveToEnd(loop.preheader);
+          hoisted = true;
+        }
+        i = next;
+      }
+    }
+    changed |= hoisted;
+  }
+  return changed;
+}
+
+void LoopInvariantCodeMotionPass::ScanContextWrites(Loop& loop) {
+  context_escapes_ = false;
+  context_stores_.clear();
+  for (int n = loop.body.find_first(); n != -1; n = loop.body.find_next(n)) {
+    Instr* i = blocks_[n]->instr_head;
+    while (i) {
+      if (HIRBuilder::IsContextEscape(i)) {
+        // Anything in the context may change on each iteration.
+        context_escapes_ = true;
+        return;
+      } else if (i->opcode == &OPCODE_STORE_CONTEXT_info) {
+        ContextRange range = {
+          i->src1.offset, GetTypeSize(i->src2.value->type) };
+        context_stores_.push_back(range);
+      }
+      i = i->next;
+    }
+  }
+}
+
+bool LoopInvariantCodeMotionPass::IsInvariant(Loop& loop, Instr* i) {
+  if (!i->dest) {
+    return false;
+  }
+  if (i->opcode->flags & (OPCODE_FLAG_BRANCH |
+                          OPCODE_FLAG_MEMORY |
+                          OPCODE_FLAG_VOLATILE |
+                          OPCODE_FLAG_IGNORE |
+                          OPCODE_FLAG_PAIRED_PREV)) {
+    return false;
+  }
+  if (i->next && (i->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    // did_carry/etc need the host flags this sets.
+    return false;
+  }
+  switch (i->opcode->num) {
+  case OPCODE_LOAD_CLOCK:
+  case OPCODE_LOAD_LOCAL:
+  case OPCODE_ATOMIC_ADD:
+  case OPCODE_ATOMIC_SUB:
+    return false;
+  case OPCODE_DIV:
+    // Integer division faults on zero, which the loop may be guarding.
+    if (IsIntType(i->dest->type)) {
+      return false;
+    }
+    break;
+  case OPCODE_LOAD_CONTEXT:
+    {
+      if (context_escapes_) {
+        return false;
+      }
+      uint64_t offset = i->src1.offset;
+      size_t size = GetTypeSize(i->dest->type);
+      for (auto it = context_stores_.begin();
+           it != context_stores_.end(); ++it) {
+        if (offset < it->offset + it->size && it->offset < offset + size) {
+          return false;
+        }
+      }
+      return true;
+    }
+  default:
+    break;
+  }
+
+  uint32_t signature = i->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+      !IsInvariantValue(loop, i->src1.value)) {
+    return false;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+      !IsInvariantValue(loop, i->src2.value)) {
+    return false;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+      !IsInvariantValue(loop, i->src3.value)) {
+    return false;
+  }
+  return true;
+}
+
+bool LoopInvariantCodeMotionPass::IsInvariantValue(Loop& loop, Value* value) {
+  return value->IsConstant() ||
+         !value->def ||
+         !loop.body.test(value->def->block->ordinal);
+}
@@ -0,0 +1,69 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+#define ALLOY_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
+
+#include <alloy/compiler/compiler_pass.h>
+
+#include <llvm/ADT/BitVector.h>
+
+
+namespace alloy {
+namespace compiler {
+namespace passes {
+
+
+class LoopInvariantCodeMotionPass : public CompilerPass {
+public:
+  LoopInvariantCodeMotionPass();
+  virtual ~LoopInvariantCodeMotionPass();
+
+  virtual const char* name() const { return "LoopInvariantCodeMotion"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  typedef struct {
+    hir::Block*     header;
+    hir::Block*     preheader;
+    // Indexed by block ordinal.
+    llvm::BitVector body;
+    size_t          block_count;
+  } Loop;
+
+  void FindLoops(hir::HIRBuilder* builder);
+  hir::Block* GetPreheader(hir::Block* header);
+  void FindLoopBody(hir::HIRBuilder* builder, Loop& loop);
+
+  bool HoistInvariants(Loop& loop);
+  void ScanContextWrites(Loop& loop);
+  bool IsInvariant(Loop& loop, hir::Instr* i);
+  bool IsInvariantValue(Loop& loop, hir::Value* value);
+
+private:
+  std::vector<hir::Block*> blocks_;
+  std::vector<Loop> loops_;
+
+  // Context writes within the loop being processed.
+  bool context_escapes_;
+  typedef struct {
+    uint64_t offset;
+    size_t   size;
+  } ContextRange;
+  std::vector<ContextRange> context_stores_;
+};
+
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace alloy
+
+
+#endif  // ALLOY_COMPILER_PASSES_LOOP_INVARIANT_CODE_MOTION_PASS_H_
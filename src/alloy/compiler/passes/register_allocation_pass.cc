@@ -9,6 +9,8 @@
 
 #include <alloy/compiler/passes/register_allocation_pass.h>
 
+#include <algorithm>
+
 using namespace alloy;
 using namespace alloy::backend;
 using namespace alloy::compiler;
@@ -16,456 +18,522 @@ using namespace alloy::compiler::passes;
 using namespace alloy::hir;
 
 
-struct RegisterAllocationPass::Interval {
-  uint32_t start_ordinal;
-  uint32_t end_ordinal;
-  Value* value;
-  RegisterFreeUntilSet* free_until_set;
-  // TODO(benvanik): reduce to offsets in arena?
-  struct Interval* next;
-  struct Interval* prev;
-
-  void AddToList(Interval** list_head) {
-    auto list_next = *list_head;
-    this->next = list_next;
-    if (list_next) {
-      list_next->prev = this;
-    }
-    *list_head = this;
-  }
+namespace {
 
-  void InsertIntoList(Interval** list_head) {
-    auto it = *list_head;
-    while (it) {
-      if (it->start_ordinal > this->start_ordinal) {
-        // Went too far. Insert before this interval.
-        this->prev = it->prev;
-        this->next = it;
-        if (it->prev) {
-          it->prev->next = this;
-        } else {
-          *list_head = this;
-        }
-        it->prev = this;
-        return;
-      }
-      if (!it->next) {
-        // None found, add at tail.
-        it->next = this;
-        this->prev = it;
-        return;
-      }
-      it = it->next;
-    }
+// Gathers the distinct values an instruction reads.
+size_t GetSourceValues(Instr* i, Value* values[3]) {
+  size_t count = 0;
+  uint32_t signature = i->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+      i->src1.value) {
+    values[count++] = i->src1.value;
   }
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+      i->src2.value && (!count || values[0] != i->src2.value)) {
+    values[count++] = i->src2.value;
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+      i->src3.value &&
+      (!count || values[0] != i->src3.value) &&
+      (count < 2 || values[1] != i->src3.value)) {
+    values[count++] = i->src3.value;
+  }
+  return count;
+}
 
-  void RemoveFromList(Interval** list_head) {
-    if (this->next) {
-      this->next->prev = this->prev;
-    }
-    if (this->prev) {
-      this->prev->next = this->next;
-    } else {
-      *list_head = this->next;
-    }
-    this->next = this->prev = NULL;
+void ReplaceSourceValue(Instr* i, Value* old_value, Value* new_value) {
+  uint32_t signature = i->opcode->signature;
+  if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+      i->src1.value == old_value) {
+    i->set_src1(new_value);
   }
-};
+  if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+      i->src2.value == old_value) {
+    i->set_src2(new_value);
+  }
+  if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+      i->src3.value == old_value) {
+    i->set_src3(new_value);
+  }
+}
+
+}  // namespace
 
-struct RegisterAllocationPass::Intervals {
-  Interval* unhandled;
-  Interval* active;
-  Interval* handled;
-};
 
 RegisterAllocationPass::RegisterAllocationPass(
     const MachineInfo* machine_info) :
+    CompilerPass(),
     machine_info_(machine_info),
-    CompilerPass() {
-  // Initialize register sets. The values of these will be
-  // cleared before use, so just the structure is required.
+    register_set_count_(0),
+    int_set_index_(0), float_set_index_(0), vec_set_index_(0),
+    changed_(false) {
+  // Initialize register sets. Occupancy is cleared before each run, so
+  // just the structure is required.
   auto mi_sets = machine_info->register_sets;
-  xe_zero_struct(&free_until_sets_, sizeof(free_until_sets_));
-  uint32_t n = 0;
-  while (mi_sets[n].count) {
+  xe_zero_struct(register_sets_, sizeof(register_sets_));
+  while (register_set_count_ < XECOUNT(register_sets_) &&
+         mi_sets[register_set_count_].count) {
+    uint32_t n = register_set_count_++;
     auto& mi_set = mi_sets[n];
-    auto free_until_set = new RegisterFreeUntilSet();
-    free_until_sets_.all_sets[n] = free_until_set;
-    free_until_set->count = mi_set.count;
-    free_until_set->set = &mi_set;
+    auto& state = register_sets_[n];
+    XEASSERT(mi_set.count <= XECOUNT(state.active));
+    state.set = &mi_set;
+    state.count = mi_set.count;
     if (mi_set.types & MachineInfo::RegisterSet::INT_TYPES) {
-      free_until_sets_.int_set = free_until_set;
+      int_set_index_ = n;
     }
     if (mi_set.types & MachineInfo::RegisterSet::FLOAT_TYPES) {
-      free_until_sets_.float_set = free_until_set;
+      float_set_index_ = n;
     }
     if (mi_set.types & MachineInfo::RegisterSet::VEC_TYPES) {
-      free_until_sets_.vec_set = free_until_set;
+      vec_set_index_ = n;
     }
-    n++;
   }
 }
 
 RegisterAllocationPass::~RegisterAllocationPass() {
-  for (size_t n = 0; n < XECOUNT(free_until_sets_.all_sets); n++) {
-    if (!free_until_sets_.all_sets[n]) {
-      break;
-    }
-    delete free_until_sets_.all_sets[n];
-  }
 }
 
-int RegisterAllocationPass::Run(HIRBuilder* builder) {
-  // A (probably broken) implementation of a linear scan register allocator
-  // that operates directly on SSA form:
+int RegisterAllocationPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // A linear scan register allocator that operates directly on SSA form:
   // http://www.christianwimmer.at/Publications/Wimmer10a/Wimmer10a.pdf
   //
+  // Each value gets a single interval from its definition to its last use
+  // (kept live through any loop it's used in). Intervals are visited in
+  // order of their start; when no register is free the active interval
+  // whose next use is furthest away is split there: its value is stored to
+  // a local slot once after its definition, and every block that uses it
+  // later reloads it into a new value with its own short interval:
+  //   v0 = ...                  v0 = ...
+  //   <block0>:                 store_local s0, v0
+  //     v5 = add v4, 1          <block0>:
+  //   <block1>:            =>     v5 = add v4, 1
+  //     v6 = mul v0, 3          <block1>:
+  //     v7 = sub v6, v0           v8 = load_local s0
+  //                               v6 = mul v8, 3
+  //                               v7 = sub v6, v8
+  // Values only ever live in one register, so the split part can't just
+  // move to another register without the block-local renaming.
+  //
   // Requirements:
   // - SSA form (single definition for variables)
-  // - block should be in linear order:
-  //   - dominators *should* come before (a->b->c)
-  //   - loop block sequences *should not* have intervening non-loop blocks
+  // - definitions come before their uses in block order
+
+  NumberInstructions(builder);
+  BuildIntervals(builder);
+  FindLoopRanges(builder);
+  ExtendLoopIntervals();
+
+  for (uint32_t n = 0; n < register_set_count_; n++) {
+    auto& state = register_sets_[n];
+    for (uint32_t m = 0; m < state.count; m++) {
+      state.active[m] = -1;
+    }
+  }
+
+  // Initial intervals were created in order. Reloads created by splitting
+  // always start after the current position and are merged in from the
+  // heap.
+  XEASSERT(pending_.empty());
+  changed_ = false;
+  size_t next_interval = 0;
+  size_t initial_count = intervals_.size();
+  while (next_interval < initial_count || !pending_.empty()) {
+    uint32_t index;
+    if (next_interval < initial_count &&
+        (pending_.empty() ||
+         intervals_[next_interval].start_ordinal < pending_.top().first)) {
+      index = (uint32_t)next_interval++;
+    } else {
+      index = pending_.top().second;
+      pending_.pop();
+    }
+    Allocate(builder, index);
+  }
 
-  auto arena = scratch_arena();
+  // Registers are assigned in place, so a rerun over allocated code only
+  // changes anything if it spills or picks different registers.
+  out_changed = changed_;
+  return 0;
+}
 
-  // Renumber everything.
+void RegisterAllocationPass::NumberInstructions(HIRBuilder* builder) {
+  // Instructions are numbered in steps of two so that spill stores and
+  // reloads inserted later can be given the odd ordinal right after or
+  // before the instruction they're attached to.
   uint32_t block_ordinal = 0;
-  uint32_t instr_ordinal = 0;
+  uint32_t instr_ordinal = 2;
+  block_start_ordinals_.clear();
+  block_end_ordinals_.clear();
   auto block = builder->first_block();
   while (block) {
     // Sequential block ordinals.
     block->ordinal = block_ordinal++;
+    block_start_ordinals_.push_back(instr_ordinal);
     auto instr = block->instr_head;
     while (instr) {
-      // Sequential global instruction ordinals.
-      instr->ordinal = instr_ordinal++;
+      instr->ordinal = instr_ordinal;
+      instr_ordinal += 2;
       instr = instr->next;
     }
+    // One past the last instruction, so empty blocks have an empty range.
+    block_end_ordinals_.push_back(instr_ordinal);
     block = block->next;
   }
+}
 
-  // Compute all liveness ranges by walking forward through all
-  // blocks/instructions and checking the last use of each value. This lets
-  // us know the exact order in (block#,instr#) form, which is then used to
-  // setup the range.
-  // TODO(benvanik): ideally we would have a list of all values and not have
-  //     to keep walking instructions over and over.
-  Interval* prev_interval = NULL;
-  Interval* head_interval = NULL;
-  block = builder->first_block();
+void RegisterAllocationPass::BuildIntervals(HIRBuilder* builder) {
+  // One interval per defined value, and a flattened list of the
+  // instructions using each one in order. Two walks: the first counts uses
+  // so the second can fill them in place.
+  intervals_.clear();
+  uses_.clear();
+  value_intervals_.assign(builder->max_value_ordinal(), -1);
+
+  Value* values[3];
+  uint32_t use_count = 0;
+  auto block = builder->first_block();
   while (block) {
     auto instr = block->instr_head;
     while (instr) {
-      // Compute last-use for the dest value.
+      size_t count = GetSourceValues(instr, values);
+      for (size_t n = 0; n < count; n++) {
+        int32_t index = GetIntervalIndex(values[n]);
+        if (index != -1) {
+          intervals_[index].use_end++;
+          use_count++;
+        }
+      }
       // Since we know all values of importance must be defined, we can avoid
       // having to check every value and just look at dest.
       const OpcodeInfo* info = instr->opcode;
       if (GET_OPCODE_SIG_TYPE_DEST(info->signature) == OPCODE_SIG_TYPE_V) {
         auto v = instr->dest;
-        if (!v->last_use) {
-          ComputeLastUse(v);
-        }
-
-        // Add interval.
-        auto interval = arena->Alloc<Interval>();
-        interval->start_ordinal = instr->ordinal;
-        interval->end_ordinal = v->last_use ?
-            v->last_use->ordinal : v->def->ordinal;
-        interval->value = v;
-        interval->next = NULL;
-        interval->prev = prev_interval;
-        if (prev_interval) {
-          prev_interval->next = interval;
-        } else {
-          head_interval = interval;
-        }
-        prev_interval = interval;
-
-        // Grab register set to use.
-        // We do this now so it's only once per interval, and it makes it easy
-        // to only compare intervals that overlap their sets.
-        if (v->type <= INT64_TYPE) {
-          interval->free_until_set = free_until_sets_.int_set;
-        } else if (v->type <= FLOAT64_TYPE) {
-          interval->free_until_set = free_until_sets_.float_set;
-        } else {
-          interval->free_until_set = free_until_sets_.vec_set;
-        }
+        XEASSERT(v->ordinal < value_intervals_.size());
+        value_intervals_[v->ordinal] = (int32_t)intervals_.size();
+        Interval interval = {
+          instr->ordinal, instr->ordinal, v, GetSetIndex(v->type), 0, 0 };
+        intervals_.push_back(interval);
       }
-
       instr = instr->next;
     }
     block = block->next;
   }
 
-  // Now have a sorted list of intervals, minus their ending ordinals.
-  Intervals intervals;
-  intervals.unhandled = head_interval;
-  intervals.active = intervals.handled = NULL;
-  while (intervals.unhandled) {
-    // Get next unhandled interval.
-    auto current = intervals.unhandled;
-    intervals.unhandled = intervals.unhandled->next;
-    current->RemoveFromList(&intervals.unhandled);
-
-    // Check for intervals in active that are handled or inactive.
-    auto it = intervals.active;
-    while (it) {
-      auto next = it->next;
-      if (it->end_ordinal <= current->start_ordinal) {
-        // Move from active to handled.
-        it->RemoveFromList(&intervals.active);
-        it->AddToList(&intervals.handled);
+  uint32_t use_offset = 0;
+  for (auto it = intervals_.begin(); it != intervals_.end(); ++it) {
+    uint32_t count = it->use_end;
+    it->use_begin = it->use_end = use_offset;
+    use_offset += count;
+  }
+  uses_.resize(use_count);
+
+  block = builder->first_block();
+  while (block) {
+    auto instr = block->instr_head;
+    while (instr) {
+      size_t count = GetSourceValues(instr, values);
+      for (size_t n = 0; n < count; n++) {
+        int32_t index = GetIntervalIndex(values[n]);
+        if (index != -1 &&
+            intervals_[index].start_ordinal < instr->ordinal) {
+          // Uses before the definition in block order weren't counted
+          // above; the requirements rule them out.
+          Interval& interval = intervals_[index];
+          uses_[interval.use_end++] = instr;
+          interval.end_ordinal = std::max(interval.end_ordinal,
+                                          instr->ordinal);
+        }
       }
-      it = next;
+      instr = instr->next;
     }
+    block = block->next;
+  }
+}
 
-    // Find a register for current.
-    if (!TryAllocateFreeReg(current, intervals)) {
-      // Failed, spill.
-      AllocateBlockedReg(builder, current, intervals);
+void RegisterAllocationPass::FindLoopRanges(HIRBuilder* builder) {
+  // Any edge going backwards in block order closes a loop; that covers
+  // everything ControlFlowAnalysis marks as a back edge, and anything
+  // irreducible too.
+  loop_ranges_.clear();
+  auto block = builder->first_block();
+  while (block) {
+    auto edge = block->outgoing_edge_head;
+    while (edge) {
+      if (edge->dest->ordinal <= block->ordinal) {
+        LoopRange range = {
+          block_start_ordinals_[edge->dest->ordinal],
+          block_end_ordinals_[block->ordinal] - 2 };
+        if (range.end_ordinal > range.start_ordinal) {
+          loop_ranges_.push_back(range);
+        }
+      }
+      edge = edge->outgoing_next;
     }
+    block = block->next;
+  }
+}
 
-    if (current->value->reg.index!= -1) {
-      // Add current to active.
-      current->AddToList(&intervals.active);
+void RegisterAllocationPass::ExtendLoopIntervals() {
+  // Values defined before a loop and used inside it are read again on the
+  // next iteration, so they must stay live until the end of the loop and
+  // not just until their last use:
+  //   v0 = ...
+  //   <loop>:
+  //     v1 = add v0, 1   <-- last use of v0
+  //     v2 = ...         <-- must not reuse v0's register
+  //     branch_true v2, loop
+  if (loop_ranges_.empty()) {
+    return;
+  }
+  for (auto it = intervals_.begin(); it != intervals_.end(); ++it) {
+    // Extending into one loop may extend into an enclosing one.
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (auto range = loop_ranges_.begin(); range != loop_ranges_.end();
+           ++range) {
+        if (it->start_ordinal < range->start_ordinal &&
+            it->end_ordinal >= range->start_ordinal &&
+            it->end_ordinal < range->end_ordinal) {
+          it->end_ordinal = range->end_ordinal;
+          changed = true;
+        }
+      }
     }
   }
+}
 
-  return 0;
+uint32_t RegisterAllocationPass::GetSetIndex(TypeName type) const {
+  if (type <= INT64_TYPE) {
+    return int_set_index_;
+  } else if (type <= FLOAT64_TYPE) {
+    return float_set_index_;
+  } else {
+    return vec_set_index_;
+  }
 }
 
-void RegisterAllocationPass::ComputeLastUse(Value* value) {
-  // TODO(benvanik): compute during construction?
-  // Note that this list isn't sorted (unfortunately), so we have to scan
-  // them all.
-  uint32_t max_ordinal = 0;
-  Value::Use* last_use = NULL;
-  auto use = value->use_head;
-  while (use) {
-    if (!last_use || use->instr->ordinal >= max_ordinal) {
-      last_use = use;
-      max_ordinal = use->instr->ordinal;
-    }
-    use = use->next;
+int32_t RegisterAllocationPass::GetIntervalIndex(Value* value) const {
+  // Constants and local slots have no definition and no interval.
+  if (value->IsConstant() || !value->def ||
+      value->ordinal >= value_intervals_.size()) {
+    return -1;
   }
-  value->last_use = last_use ? last_use->instr : NULL;
+  return value_intervals_[value->ordinal];
+}
+
+bool RegisterAllocationPass::IsUsedAt(const Interval& interval,
+                                      uint32_t ordinal) const {
+  auto begin = uses_.begin() + interval.use_begin;
+  auto end = uses_.begin() + interval.use_end;
+  auto it = std::lower_bound(begin, end, ordinal,
+                             [](Instr* use, uint32_t ordinal) {
+                               return use->ordinal < ordinal;
+                             });
+  return it != end && (*it)->ordinal == ordinal;
 }
 
-bool RegisterAllocationPass::TryAllocateFreeReg(
-    Interval* current, Intervals& intervals) {
-  // Reset all registers in the set to unused.
-  auto free_until_set = current->free_until_set;
-  for (uint32_t n = 0; n < free_until_set->count; n++) {
-    free_until_set->pos[n] = -1;
+uint32_t RegisterAllocationPass::GetNextUse(const Interval& interval,
+                                            uint32_t ordinal) const {
+  auto begin = uses_.begin() + interval.use_begin;
+  auto end = uses_.begin() + interval.use_end;
+  auto it = std::upper_bound(begin, end, ordinal,
+                             [](uint32_t ordinal, Instr* use) {
+                               return ordinal < use->ordinal;
+                             });
+  // Live but unused for the rest of the interval means it's only kept
+  // around for the next iteration of a loop.
+  return it != end ? (*it)->ordinal : interval.end_ordinal;
+}
+
+void RegisterAllocationPass::Allocate(HIRBuilder* builder,
+                                      uint32_t interval_index) {
+  // Splitting may add intervals, so no references are held across it.
+  Interval current = intervals_[interval_index];
+  int32_t reg = FindFreeReg(current);
+  if (reg == -1) {
+    reg = SpillBlockedReg(builder, current);
+  }
+  auto& state = register_sets_[current.set_index];
+  if (current.value->reg.set != state.set ||
+      current.value->reg.index != reg) {
+    current.value->reg.set = state.set;
+    current.value->reg.index = reg;
+    changed_ = true;
   }
+  state.active[reg] = (int32_t)interval_index;
+}
 
-  // Mark all active registers as used.
-  // TODO(benvanik): keep some kind of bitvector so that this is instant?
-  auto it = intervals.active;
-  while (it) {
-    if (it->free_until_set == free_until_set) {
-      free_until_set->pos[it->value->reg.index] = 0;
+int32_t RegisterAllocationPass::FindFreeReg(const Interval& current) {
+  auto& state = register_sets_[current.set_index];
+  uint32_t position = current.start_ordinal;
+  auto is_free = [&](int32_t reg) {
+    int32_t active = state.active[reg];
+    return active == -1 || intervals_[active].end_ordinal <= position;
+  };
+
+  // Prefer the register of the first source if it ends here, so two-operand
+  // forms (x86) don't need a move.
+  Instr* def = current.value->def;
+  if (GET_OPCODE_SIG_TYPE_SRC1(def->opcode->signature) == OPCODE_SIG_TYPE_V) {
+    Value* src1 = def->src1.value;
+    if (src1 && src1->reg.set == state.set && src1->reg.index != -1 &&
+        is_free(src1->reg.index)) {
+      return src1->reg.index;
     }
-    it = it->next;
   }
 
-  uint32_t max_pos = 0;
-  for (uint32_t n = 0; n < free_until_set->count; n++) {
-    if (max_pos == -1) {
-      max_pos = n;
-    } else {
-      if (free_until_set->pos[n] > free_until_set->pos[max_pos]) {
-        max_pos = n;
-      }
+  for (uint32_t n = 0; n < state.count; n++) {
+    if (is_free(n)) {
+      return n;
     }
   }
-  if (!free_until_set->pos[max_pos]) {
-    // No register available without spilling.
-    return false;
-  }
-  if (current->end_ordinal < free_until_set->pos[max_pos]) {
-    // Register available for the whole interval.
-    current->value->reg.set = free_until_set->set;
-    current->value->reg.index = max_pos;
-  } else {
-    // Register available for the first part of the interval.
-    // Split the interval at where it hits the next one.
-    //current->value->reg = max_pos;
-    //SplitRange(current, free_until_set->pos[max_pos]);
-    // TODO(benvanik): actually split -- for now we just spill.
-    return false;
-  }
-
-  return true;
+  return -1;
 }
 
-void RegisterAllocationPass::AllocateBlockedReg(
-    HIRBuilder* builder, Interval* current, Intervals& intervals) {
-  auto free_until_set = current->free_until_set;
-
-  // TODO(benvanik): smart heuristics.
-  //     wimmer AllocateBlockedReg has some stuff for deciding whether to
-  //     spill current or some other active interval - which we ignore.
-
-  // Pick a random interval. Maybe the first. Sure.
-  auto spill_interval = intervals.active;
-  Value* spill_value = NULL;
-  Instr* prev_use = NULL;
-  Instr* next_use = NULL;
-  while (spill_interval) {
-    if (spill_interval->free_until_set != free_until_set ||
-        spill_interval->start_ordinal == current->start_ordinal) {
-      // Only interested in ones of the same register set.
-      // We also ensure that ones at the same ordinal as us are ignored,
-      // which can happen with multiple local inserts/etc.
-      spill_interval = spill_interval->next;
+int32_t RegisterAllocationPass::SpillBlockedReg(HIRBuilder* builder,
+                                                const Interval& current) {
+  // Evict whatever isn't needed for the longest time (Belady). Anything
+  // read by the instruction we're allocating for must stay; for reloads
+  // that's the instruction they were inserted for.
+  auto& state = register_sets_[current.set_index];
+  uint32_t position = current.start_ordinal;
+  uint32_t use_ordinal = (position & 1) ? position + 1 : position;
+  int32_t best_reg = -1;
+  uint32_t best_next_use = 0;
+  for (uint32_t n = 0; n < state.count; n++) {
+    const Interval& interval = intervals_[state.active[n]];
+    if (interval.start_ordinal == position ||
+        IsUsedAt(interval, use_ordinal)) {
       continue;
     }
-    spill_value = spill_interval->value;
-
-    // Find the uses right before/after current.
-    auto use = spill_value->use_head;
-    while (use) {
-      if (use->instr->ordinal != -1) {
-        if (use->instr->ordinal < current->start_ordinal) {
-          if (!prev_use || prev_use->ordinal < use->instr->ordinal) {
-            prev_use = use->instr;
-          }
-        } else if (use->instr->ordinal > current->start_ordinal) {
-          if (!next_use || next_use->ordinal > use->instr->ordinal) {
-            next_use = use->instr;
-          }
-        }
-      }
-      use = use->next;
-    }
-    if (!prev_use) {
-      prev_use = spill_value->def;
+    uint32_t next_use = GetNextUse(interval, position);
+    if (best_reg == -1 || next_use > best_next_use) {
+      best_reg = n;
+      best_next_use = next_use;
     }
-    if (prev_use->next == next_use) {
-      // Uh, this interval is way too short.
-      spill_interval = spill_interval->next;
-      continue;
+  }
+  XEASSERT(best_reg != -1);
+  SplitAndSpill(builder, state.active[best_reg], position);
+  state.active[best_reg] = -1;
+  return best_reg;
+}
+
+void RegisterAllocationPass::SplitAndSpill(HIRBuilder* builder,
+                                           uint32_t interval_index,
+                                           uint32_t position) {
+  Interval interval = intervals_[interval_index];
+  Value* value = interval.value;
+
+  // If this is inside a loop the value was live into, uses earlier in the
+  // loop will also run again after this point: split at the loop header
+  // so they reload too.
+  uint32_t split_ordinal = position;
+  for (auto it = loop_ranges_.begin(); it != loop_ranges_.end(); ++it) {
+    if (it->start_ordinal <= position && position <= it->end_ordinal &&
+        interval.start_ordinal < it->start_ordinal &&
+        it->start_ordinal < split_ordinal) {
+      split_ordinal = it->start_ordinal;
     }
-    XEASSERT(prev_use->ordinal != -1);
-    XEASSERTNOTNULL(next_use);
-    break;
   }
-  XEASSERT(spill_interval->free_until_set == free_until_set);
-
-  // Find the real last use -- paired ops may require sequences to stay
-  // intact. This is a bad design.
-  auto prev_def_tail = prev_use;
-  while (prev_def_tail &&
-          prev_def_tail->opcode->flags & OPCODE_FLAG_PAIRED_PREV) {
-    prev_def_tail = prev_def_tail->prev;
+
+  auto begin = uses_.begin() + interval.use_begin;
+  auto end = uses_.begin() + interval.use_end;
+  uint32_t use_index = (uint32_t)(std::lower_bound(
+      begin, end, split_ordinal,
+      [](Instr* use, uint32_t ordinal) {
+        return use->ordinal < ordinal;
+      }) - uses_.begin());
+
+  // The register is given up here either way.
+  intervals_[interval_index].end_ordinal = position;
+  intervals_[interval_index].use_end = use_index;
+  if (use_index == interval.use_end) {
+    return;
   }
 
-  Value* new_value;
-  uint32_t end_ordinal;
-  if (spill_value->local_slot) {
-    // Value is already assigned a slot, so load from that.
-    // We can then split the interval right after the previous use to
-    // before the next use.
-
-    // Update the last use of the spilled interval/value.
-    end_ordinal = spill_interval->end_ordinal;
-    spill_interval->end_ordinal = current->start_ordinal;//prev_def_tail->ordinal;
-    XEASSERT(end_ordinal != -1);
-    XEASSERT(spill_interval->end_ordinal != -1);
-
-    // Insert a load right before the next use.
-    new_value = builder->LoadLocal(spill_value->local_slot);
-    builder->last_instr()->MoveBefore(next_use);
-
-    // Update last use info.
-    new_value->last_use = spill_value->last_use;
-    spill_value->last_use = prev_use;
-  } else {
-    // Allocate a local slot.
-    spill_value->local_slot = builder->AllocLocal(spill_value->type);
-
-    // Insert a spill right after the def.
-    builder->StoreLocal(spill_value->local_slot, spill_value);
-    auto spill_store = builder->last_instr();
-    spill_store->MoveBefore(prev_def_tail->next);
-
-    // Update last use of spilled interval/value.
-    end_ordinal = spill_interval->end_ordinal;
-    spill_interval->end_ordinal = current->start_ordinal;//prev_def_tail->ordinal;
-    XEASSERT(end_ordinal != -1);
-    XEASSERT(spill_interval->end_ordinal != -1);
-
-    // Insert a load right before the next use.
-    new_value = builder->LoadLocal(spill_value->local_slot);
-    builder->last_instr()->MoveBefore(next_use);
-
-    // Update last use info.
-    new_value->last_use = spill_value->last_use;
-    spill_value->last_use = spill_store;
+  if (!value->local_slot) {
+    InsertStore(builder, value);
   }
 
-  // Reuse the same local slot. Hooray SSA.
-  new_value->local_slot = spill_value->local_slot;
-
-  // Rename all future uses to that loaded value.
-  auto use = spill_value->use_head;
-  while (use) {
-    // TODO(benvanik): keep use list sorted so we don't have to do this.
-    if (use->instr->ordinal <= spill_interval->end_ordinal ||
-        use->instr->ordinal == -1) {
-      use = use->next;
-      continue;
-    }
-    auto next = use->next;
-    auto instr = use->instr;
-    uint32_t signature = instr->opcode->signature;
-    if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src1.value == spill_value) {
-        instr->set_src1(new_value);
-      }
-    }
-    if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src2.value == spill_value) {
-        instr->set_src2(new_value);
-      }
+  // Reload once per block, and once more if the block has uses on both
+  // sides of the current position.
+  uint32_t group_begin = use_index;
+  while (group_begin < interval.use_end) {
+    Instr* first = uses_[group_begin];
+    uint32_t group_end = group_begin + 1;
+    while (group_end < interval.use_end &&
+           uses_[group_end]->block == first->block &&
+           (first->ordinal > position ||
+            uses_[group_end]->ordinal < position)) {
+      group_end++;
     }
-    if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-      if (instr->src3.value == spill_value) {
-        instr->set_src3(new_value);
-      }
+    uint32_t reload_index = AddReload(
+        builder, value, interval.set_index, group_begin, group_end);
+    const Interval& reload = intervals_[reload_index];
+    if (reload.start_ordinal < position) {
+      // Between the split and the current position the register still
+      // belonged to the spilled interval, so the reload can have it.
+      reload.value->reg = value->reg;
+    } else {
+      pending_.push(PendingInterval(reload.start_ordinal, reload_index));
     }
-    use = next;
+    group_begin = group_end;
   }
+}
 
-  // Create new interval.
-  auto arena = scratch_arena();
-  auto new_interval = arena->Alloc<Interval>();
-  new_interval->start_ordinal = new_value->def->ordinal;
-  new_interval->end_ordinal = end_ordinal;
-  new_interval->value = new_value;
-  new_interval->next = NULL;
-  new_interval->prev = NULL;
-  if (new_value->type <= INT64_TYPE) {
-    new_interval->free_until_set = free_until_sets_.int_set;
-  } else if (new_value->type <= FLOAT64_TYPE) {
-    new_interval->free_until_set = free_until_sets_.float_set;
+Instr* RegisterAllocationPass::InsertStore(HIRBuilder* builder,
+                                           Value* value) {
+  // Paired ops may require sequences to stay intact, so the store goes
+  // after any instruction reading the host flags of the definition.
+  Instr* def_tail = value->def;
+  while (def_tail->next &&
+         (def_tail->next->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    def_tail = def_tail->next;
+  }
+
+  value->local_slot = builder->AllocLocal(value->type);
+  builder->StoreLocal(value->local_slot, value);
+  Instr* store = builder->last_instr();
+  changed_ = true;
+  if (def_tail->next) {
+    store->MoveBefore(def_tail->next);
   } else {
-    new_interval->free_until_set = free_until_sets_.vec_set;
+    store->MoveToEnd(def_tail->block);
+  }
+  store->ordinal = def_tail->ordinal + 1;
+  return store;
+}
+
+uint32_t RegisterAllocationPass::AddReload(HIRBuilder* builder, Value* value,
+                                           uint32_t set_index,
+                                           uint32_t use_begin,
+                                           uint32_t use_end) {
+  // Load right before the first use, or before the instruction setting the
+  // host flags it reads.
+  Instr* insert_point = uses_[use_begin];
+  while (insert_point->prev &&
+         (insert_point->opcode->flags & OPCODE_FLAG_PAIRED_PREV)) {
+    insert_point = insert_point->prev;
   }
+  Value* new_value = builder->LoadLocal(value->local_slot);
+  Instr* load = builder->last_instr();
+  load->MoveBefore(insert_point);
+  changed_ = true;
+  load->ordinal = insert_point->ordinal - 1;
 
-  // Remove the old interval from the active list, as it's been spilled.
-  spill_interval->RemoveFromList(&intervals.active);
-  spill_interval->AddToList(&intervals.handled);
+  // Reuse the same local slot. Hooray SSA.
+  new_value->local_slot = value->local_slot;
 
-  // Insert interval into the right place in the list.
-  // We know it's ahead of us.
-  new_interval->InsertIntoList(&intervals.unhandled);
+  // Rename the uses; the new interval shares their entries in uses_.
+  for (uint32_t n = use_begin; n < use_end; n++) {
+    ReplaceSourceValue(uses_[n], value, new_value);
+  }
 
-  // TODO(benvanik): use the register we just freed?
-  //current->value->reg.set = free_until_set->set;
-  //current->value->reg.index = spill_interval->value->reg.index;
-  bool allocated = TryAllocateFreeReg(current, intervals);
-  XEASSERTTRUE(allocated);
+  Interval interval = {
+    load->ordinal, uses_[use_end - 1]->ordinal,
+    new_value, set_index, use_begin, use_end };
+  intervals_.push_back(interval);
+  return (uint32_t)intervals_.size() - 1;
 }
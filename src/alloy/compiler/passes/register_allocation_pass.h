@@ -13,6 +13,9 @@
 #include <alloy/backend/machine_info.h>
 #include <alloy/compiler/compiler_pass.h>
 
+#include <functional>
+#include <queue>
+
 
 namespace alloy {
 namespace compiler {
@@ -24,31 +27,79 @@ public:
   RegisterAllocationPass(const backend::MachineInfo* machine_info);
   virtual ~RegisterAllocationPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "RegisterAllocation"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
-  struct Interval;
-  struct Intervals;
-  void ComputeLastUse(hir::Value* value);
-  bool TryAllocateFreeReg(Interval* current, Intervals& intervals);
-  void AllocateBlockedReg(hir::HIRBuilder* builder,
-                          Interval* current, Intervals& intervals);
+  typedef struct {
+    uint32_t    start_ordinal;
+    uint32_t    end_ordinal;
+    hir::Value* value;
+    uint32_t    set_index;
+    // Range of uses_, sorted by instruction ordinal.
+    uint32_t    use_begin;
+    uint32_t    use_end;
+  } Interval;
+
+  void NumberInstructions(hir::HIRBuilder* builder);
+  void BuildIntervals(hir::HIRBuilder* builder);
+  void FindLoopRanges(hir::HIRBuilder* builder);
+  void ExtendLoopIntervals();
+  uint32_t GetSetIndex(hir::TypeName type) const;
+  int32_t GetIntervalIndex(hir::Value* value) const;
+  bool IsUsedAt(const Interval& interval, uint32_t ordinal) const;
+  uint32_t GetNextUse(const Interval& interval, uint32_t ordinal) const;
+
+  void Allocate(hir::HIRBuilder* builder, uint32_t interval_index);
+  int32_t FindFreeReg(const Interval& current);
+  int32_t SpillBlockedReg(hir::HIRBuilder* builder, const Interval& current);
+  void SplitAndSpill(hir::HIRBuilder* builder, uint32_t interval_index,
+                     uint32_t position);
+  hir::Instr* InsertStore(hir::HIRBuilder* builder, hir::Value* value);
+  uint32_t AddReload(hir::HIRBuilder* builder, hir::Value* value,
+                     uint32_t set_index, uint32_t use_begin, uint32_t use_end);
 
 private:
   const backend::MachineInfo* machine_info_;
 
-  struct RegisterFreeUntilSet {
-    uint32_t count;
-    uint32_t pos[32];
+  // Occupancy of each register in each machine register set, as indices
+  // into intervals_ (or -1 if free). An occupant whose interval has ended
+  // before the current position is also free, so nothing has to expire
+  // intervals as the scan moves forward.
+  typedef struct {
     const backend::MachineInfo::RegisterSet* set;
-  };
-  struct RegisterFreeUntilSets {
-    RegisterFreeUntilSet* int_set;
-    RegisterFreeUntilSet* float_set;
-    RegisterFreeUntilSet* vec_set;
-    RegisterFreeUntilSet* all_sets[3];
-  };
-  RegisterFreeUntilSets free_until_sets_;
+    uint32_t count;
+    int32_t  active[32];
+  } RegisterSetState;
+  // Matches MachineInfo::register_sets.
+  RegisterSetState register_sets_[8];
+  uint32_t register_set_count_;
+  uint32_t int_set_index_;
+  uint32_t float_set_index_;
+  uint32_t vec_set_index_;
+  // Whether the current run spilled or assigned any register differently.
+  bool changed_;
+
+  std::vector<Interval> intervals_;
+  // Instructions using each interval's value, see Interval::use_begin.
+  std::vector<hir::Instr*> uses_;
+  // Indexed by value ordinal.
+  std::vector<int32_t> value_intervals_;
+  // Reload intervals waiting to be allocated, ordered by start.
+  typedef std::pair<uint32_t, uint32_t> PendingInterval;
+  std::priority_queue<PendingInterval,
+                      std::vector<PendingInterval>,
+                      std::greater<PendingInterval> > pending_;
+
+  // Indexed by block ordinal.
+  std::vector<uint32_t> block_start_ordinals_;
+  std::vector<uint32_t> block_end_ordinals_;
+  typedef struct {
+    uint32_t start_ordinal;
+    uint32_t end_ordinal;
+  } LoopRange;
+  std::vector<LoopRange> loop_ranges_;
 };
 
 
@@ -22,91 +22,14 @@ SimplificationPass::SimplificationPass() :
 SimplificationPass::~SimplificationPass() {
 }
 
-int SimplificationPass::Run(HIRBuilder* builder) {
-  EliminateConversions(builder);
-  SimplifyAssignments(builder);
+int SimplificationPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // Conversion chains and byte swap pairs are handled by TypePropagation
+  // and ByteSwapElimination, which produce assigns for this to clean up.
+  out_changed = SimplifyAssignments(builder);
   return 0;
 }
 
-void SimplificationPass::EliminateConversions(HIRBuilder* builder) {
-  // First, we check for truncates/extensions that can be skipped.
-  // This generates some assignments which then the second step will clean up.
-  // Both zero/sign extends can be skipped:
-  //   v1.i64 = zero/sign_extend v0.i32
-  //   v2.i32 = truncate v1.i64
-  // becomes:
-  //   v1.i64 = zero/sign_extend v0.i32 (may be dead code removed later)
-  //   v2.i32 = v0.i32
-
-  auto block = builder->first_block();
-  while (block) {
-    auto i = block->instr_head;
-    while (i) {
-      // To make things easier we check in reverse (source of truncate/extend
-      // back to definition).
-      if (i->opcode == &OPCODE_TRUNCATE_info) {
-        // Matches zero/sign_extend + truncate.
-        CheckTruncate(i);
-      } else if (i->opcode == &OPCODE_BYTE_SWAP_info) {
-        // Matches byte swap + byte swap.
-        // This is pretty rare within the same basic block, but is in the
-        // memcpy hot path and (probably) worth it. Maybe.
-        CheckByteSwap(i);
-      }
-      i = i->next;
-    }
-    block = block->next;
-  }
-}
-
-void SimplificationPass::CheckTruncate(Instr* i) {
-  // Walk backward up src's chain looking for an extend. We may have
-  // assigns, so skip those.
-  auto src = i->src1.value;
-  Instr* def = src->def;
-  while (def && def->opcode == &OPCODE_ASSIGN_info) {
-    // Skip asignments.
-    def = def->src1.value->def;
-  }
-  if (def) {
-    if (def->opcode == &OPCODE_SIGN_EXTEND_info) {
-      // Value comes from a sign extend.
-      if (def->src1.value->type == i->dest->type) {
-        // Types match, use original by turning this into an assign.
-        i->Replace(&OPCODE_ASSIGN_info, 0);
-        i->set_src1(def->src1.value);
-      }
-    } else if (def->opcode == &OPCODE_ZERO_EXTEND_info) {
-      // Value comes from a zero extend.
-      if (def->src1.value->type == i->dest->type) {
-        // Types match, use original by turning this into an assign.
-        i->Replace(&OPCODE_ASSIGN_info, 0);
-        i->set_src1(def->src1.value);
-      }
-    }
-  }
-}
-
-void SimplificationPass::CheckByteSwap(Instr* i) {
-  // Walk backward up src's chain looking for a byte swap. We may have
-  // assigns, so skip those.
-  auto src = i->src1.value;
-  Instr* def = src->def;
-  while (def && def->opcode == &OPCODE_ASSIGN_info) {
-    // Skip asignments.
-    def = def->src1.value->def;
-  }
-  if (def && def->opcode == &OPCODE_BYTE_SWAP_info) {
-    // Value comes from a byte swap.
-    if (def->src1.value->type == i->dest->type) {
-      // Types match, use original by turning this into an assign.
-      i->Replace(&OPCODE_ASSIGN_info, 0);
-      i->set_src1(def->src1.value);
-    }
-  }
-}
-
-void SimplificationPass::SimplifyAssignments(HIRBuilder* builder) {
+bool SimplificationPass::SimplifyAssignments(HIRBuilder* builder) {
   // Run over the instructions and rename assigned variables:
   //   v1 = v0
   //   v2 = v1
@@ -124,24 +47,38 @@ void SimplificationPass::SimplifyAssignments(HIRBuilder* builder) {
   // of that instr. Because we may have chains, we do this recursively until
   // we find a non-assign def.
 
+  bool changed = false;
   auto block = builder->first_block();
   while (block) {
     auto i = block->instr_head;
     while (i) {
       uint32_t signature = i->opcode->signature;
       if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
-        i->set_src1(CheckValue(i->src1.value));
+        Value* value = CheckValue(i->src1.value);
+        if (value != i->src1.value) {
+          i->set_src1(value);
+          changed = true;
+        }
       }
       if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
-        i->set_src2(CheckValue(i->src2.value));
+        Value* value = CheckValue(i->src2.value);
+        if (value != i->src2.value) {
+          i->set_src2(value);
+          changed = true;
+        }
       }
       if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
-        i->set_src3(CheckValue(i->src3.value));
+        Value* value = CheckValue(i->src3.value);
+        if (value != i->src3.value) {
+          i->set_src3(value);
+          changed = true;
+        }
       }
       i = i->next;
     }
     block = block->next;
   }
+  return changed;
 }
 
 Value* SimplificationPass::CheckValue(Value* value) {
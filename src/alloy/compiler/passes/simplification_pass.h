@@ -23,14 +23,12 @@ public:
   SimplificationPass();
   virtual ~SimplificationPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "Simplification"; }
 
-private:
-  void EliminateConversions(hir::HIRBuilder* builder);
-  void CheckTruncate(hir::Instr* i);
-  void CheckByteSwap(hir::Instr* i);
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
-  void SimplifyAssignments(hir::HIRBuilder* builder);
+private:
+  bool SimplifyAssignments(hir::HIRBuilder* builder);
   hir::Value* CheckValue(hir::Value* value);
 };
 
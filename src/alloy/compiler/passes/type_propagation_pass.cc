@@ -0,0 +1,136 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/type_propagation_pass.h>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+namespace {
+
+// Finds the instruction that really defines value, skipping assignments.
+Instr* GetRealDef(Value* value) {
+  Instr* def = value->def;
+  while (def && def->opcode == &OPCODE_ASSIGN_info) {
+    def = def->src1.value->def;
+  }
+  return def;
+}
+
+}  // namespace
+
+
+TypePropagationPass::TypePropagationPass() :
+    CompilerPass() {
+}
+
+TypePropagationPass::~TypePropagationPass() {
+}
+
+int TypePropagationPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // There are many extensions/truncations in generated code due to the
+  // various load/stores of varying widths - everything in a GPR is 64-bit.
+  // Short-circuiting chains of conversions makes following passes cleaner
+  // and faster as they have to trace through fewer value definitions.
+  // Example (after ContextPromotion):
+  //   v82.i32 = truncate v81.i64
+  //   v84.i32 = and v82.i32, 3F
+  //   v85.i64 = zero_extend v84.i32
+  //   v88.i64 = v85.i64
+  //   v89.i32 = truncate v88.i64      <-- zero_extend/truncate => v84.i32
+  //   v90.i32 = byte_swap v89.i32
+  // becomes:
+  //   ...
+  //   v89.i32 = v84.i32
+  //   v90.i32 = byte_swap v89.i32
+  // The handled chains are:
+  //   truncate(extend(x))     -> x, truncate(x) or extend(x) by size
+  //   truncate(truncate(x))   -> truncate(x)
+  //   zero_extend(zero_extend(x)) -> zero_extend(x)
+  //   sign_extend(sign_extend(x)) -> sign_extend(x)
+  //   sign_extend(zero_extend(x)) -> zero_extend(x) (top bit is clear)
+  // Intermediates are left for DCE.
+
+  bool changed = false;
+  auto block = builder->first_block();
+  while (block) {
+    auto i = block->instr_head;
+    while (i) {
+      if (i->opcode == &OPCODE_TRUNCATE_info) {
+        changed |= PropagateTruncate(i);
+      } else if (i->opcode == &OPCODE_ZERO_EXTEND_info ||
+                 i->opcode == &OPCODE_SIGN_EXTEND_info) {
+        changed |= PropagateExtend(i);
+      }
+      i = i->next;
+    }
+    block = block->next;
+  }
+
+  out_changed = changed;
+  return 0;
+}
+
+bool TypePropagationPass::PropagateTruncate(Instr* i) {
+  Instr* def = GetRealDef(i->src1.value);
+  if (!def) {
+    return false;
+  }
+  TypeName dest_type = i->dest->type;
+
+  if (def->opcode == &OPCODE_ZERO_EXTEND_info ||
+      def->opcode == &OPCODE_SIGN_EXTEND_info) {
+    Value* src = def->src1.value;
+    if (!IsIntType(src->type)) {
+      return false;
+    }
+    if (src->type == dest_type) {
+      // Types match, use original by turning this into an assign.
+      i->Replace(&OPCODE_ASSIGN_info, 0);
+      i->set_src1(src);
+    } else if (GetTypeSize(src->type) > GetTypeSize(dest_type)) {
+      // Extended and then truncated below the original width.
+      i->set_src1(src);
+    } else {
+      // Extended and then truncated part of the way back, so just extend
+      // the original less.
+      i->Replace(def->opcode, 0);
+      i->set_src1(src);
+    }
+    return true;
+  } else if (def->opcode == &OPCODE_TRUNCATE_info) {
+    // Truncate straight from the wider value.
+    i->set_src1(def->src1.value);
+    return true;
+  }
+  return false;
+}
+
+bool TypePropagationPass::PropagateExtend(Instr* i) {
+  Instr* def = GetRealDef(i->src1.value);
+  if (!def) {
+    return false;
+  }
+
+  if (def->opcode == i->opcode) {
+    // Extending an extension of the same kind.
+    i->set_src1(def->src1.value);
+    return true;
+  } else if (i->opcode == &OPCODE_SIGN_EXTEND_info &&
+             def->opcode == &OPCODE_ZERO_EXTEND_info) {
+    // The zero extension guarantees the sign bit is clear.
+    i->Replace(&OPCODE_ZERO_EXTEND_info, 0);
+    i->set_src1(def->src1.value);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,41 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_COMPILER_PASSES_TYPE_PROPAGATION_PASS_H_
+#define ALLOY_COMPILER_PASSES_TYPE_PROPAGATION_PASS_H_
+
+#include <alloy/compiler/compiler_pass.h>
+
+
+namespace alloy {
+namespace compiler {
+namespace passes {
+
+
+class TypePropagationPass : public CompilerPass {
+public:
+  TypePropagationPass();
+  virtual ~TypePropagationPass();
+
+  virtual const char* name() const { return "TypePropagation"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  bool PropagateTruncate(hir::Instr* i);
+  bool PropagateExtend(hir::Instr* i);
+};
+
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace alloy
+
+
+#endif  // ALLOY_COMPILER_PASSES_TYPE_PROPAGATION_PASS_H_
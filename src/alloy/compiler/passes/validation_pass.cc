@@ -29,7 +29,7 @@ ValidationPass::ValidationPass() :
 ValidationPass::~ValidationPass() {
 }
 
-int ValidationPass::Run(HIRBuilder* builder) {
+int ValidationPass::Run(HIRBuilder* builder, bool& out_changed) {
   StringBuffer str;
   builder->Dump(&str);
   printf(str.GetString());
@@ -84,9 +84,40 @@ int ValidationPass::ValidateInstruction(Block* block, Instr* instr) {
     }
   }
 
+  if (ValidateTypes(instr)) {
+    return 1;
+  }
+
   return 0;
 }
 
+int ValidationPass::ValidateTypes(Instr* instr) {
+  // Passes that rewrite conversions/swaps (TypePropagation,
+  // ByteSwapElimination, ContextPromotion) must keep types consistent.
+  bool valid = true;
+  switch (instr->opcode->num) {
+  case OPCODE_ASSIGN:
+  case OPCODE_BYTE_SWAP:
+    valid = instr->dest->type == instr->src1.value->type;
+    break;
+  case OPCODE_ZERO_EXTEND:
+  case OPCODE_SIGN_EXTEND:
+    valid = GetTypeSize(instr->dest->type) >
+            GetTypeSize(instr->src1.value->type);
+    break;
+  case OPCODE_TRUNCATE:
+    valid = IsIntType(instr->dest->type) &&
+            IsIntType(instr->src1.value->type) &&
+            GetTypeSize(instr->dest->type) <
+            GetTypeSize(instr->src1.value->type);
+    break;
+  default:
+    break;
+  }
+  XEASSERT(valid);
+  return valid ? 0 : 1;
+}
+
 int ValidationPass::ValidateValue(Block* block, Instr* instr, Value* value) {
   if (value->def) {
     /*auto def = value->def;
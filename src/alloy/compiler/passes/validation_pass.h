@@ -23,10 +23,13 @@ public:
   ValidationPass();
   virtual ~ValidationPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "Validation"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
   int ValidateInstruction(hir::Block* block, hir::Instr* instr);
+  int ValidateTypes(hir::Instr* instr);
   int ValidateValue(hir::Block* block, hir::Instr* instr, hir::Value* value);
 };
 
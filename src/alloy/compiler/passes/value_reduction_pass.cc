@@ -52,7 +52,7 @@ void ValueReductionPass::ComputeLastUse(Value* value) {
   value->last_use = last_use->instr;
 }
 
-int ValueReductionPass::Run(HIRBuilder* builder) {
+int ValueReductionPass::Run(HIRBuilder* builder, bool& out_changed) {
   // Walk each block and reuse variable ordinals as much as possible.
 
   llvm::BitVector ordinals(builder->max_value_ordinal());
@@ -23,7 +23,9 @@ public:
   ValueReductionPass();
   virtual ~ValueReductionPass();
 
-  virtual int Run(hir::HIRBuilder* builder);
+  virtual const char* name() const { return "ValueReduction"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
 
 private:
   void ComputeLastUse(hir::Value* value);
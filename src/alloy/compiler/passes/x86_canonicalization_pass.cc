@@ -0,0 +1,131 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/compiler/passes/x86_canonicalization_pass.h>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::compiler::passes;
+using namespace alloy::hir;
+
+
+namespace {
+
+// The compare giving the same result with its operands swapped, or NULL.
+const OpcodeInfo* GetMirroredCompare(const OpcodeInfo* opcode) {
+  switch (opcode->num) {
+  case OPCODE_COMPARE_SLT: return &OPCODE_COMPARE_SGT_info;
+  case OPCODE_COMPARE_SLE: return &OPCODE_COMPARE_SGE_info;
+  case OPCODE_COMPARE_SGT: return &OPCODE_COMPARE_SLT_info;
+  case OPCODE_COMPARE_SGE: return &OPCODE_COMPARE_SLE_info;
+  case OPCODE_COMPARE_ULT: return &OPCODE_COMPARE_UGT_info;
+  case OPCODE_COMPARE_ULE: return &OPCODE_COMPARE_UGE_info;
+  case OPCODE_COMPARE_UGT: return &OPCODE_COMPARE_ULT_info;
+  case OPCODE_COMPARE_UGE: return &OPCODE_COMPARE_ULE_info;
+  default: return NULL;
+  }
+}
+
+}  // namespace
+
+
+X86CanonicalizationPass::X86CanonicalizationPass() :
+    CompilerPass() {
+}
+
+X86CanonicalizationPass::~X86CanonicalizationPass() {
+}
+
+int X86CanonicalizationPass::Run(HIRBuilder* builder, bool& out_changed) {
+  // x86 ALU ops overwrite their first operand, so the lowering has to copy
+  // src1 into dest first unless they share a register. The register
+  // allocator gives dest the register of src1 when src1 dies there, so
+  // commutative ops are flipped to put the operand that dies first:
+  //   v0 = ...
+  //   v1 = ...
+  //   v2 = add v0, v1          <-- v1 now unused
+  //   v3 = sub v0, 4
+  // Becomes:
+  //   v2 = add v1, v0          <-- v2 can reuse v1's register
+  //
+  // Constants are also moved to src2, where x86 has immediate forms,
+  // mirroring compares that aren't commutative:
+  //   v2 = compare_slt 4, v1
+  // Becomes:
+  //   v2 = compare_sgt v1, 4
+
+  bool changed = false;
+  auto block = builder->first_block();
+  while (block) {
+    // Positions within the block for DiesAt.
+    uint32_t ordinal = 0;
+    auto i = block->instr_head;
+    while (i) {
+      i->ordinal = ordinal++;
+      i = i->next;
+    }
+
+    i = block->instr_head;
+    while (i) {
+      uint32_t signature = i->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) != OPCODE_SIG_TYPE_V ||
+          GET_OPCODE_SIG_TYPE_SRC2(signature) != OPCODE_SIG_TYPE_V ||
+          GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V ||
+          i->src1.value == i->src2.value) {
+        i = i->next;
+        continue;
+      }
+      bool commutative = (i->opcode->flags & OPCODE_FLAG_COMMUNATIVE) != 0;
+      const OpcodeInfo* mirrored = GetMirroredCompare(i->opcode);
+      if (!commutative && !mirrored) {
+        i = i->next;
+        continue;
+      }
+
+      Value* src1 = i->src1.value;
+      Value* src2 = i->src2.value;
+      bool swap = false;
+      if (src1->IsConstant()) {
+        swap = !src2->IsConstant();
+      } else if (commutative && !src2->IsConstant()) {
+        swap = !DiesAt(src1, i) && DiesAt(src2, i);
+      }
+      if (swap) {
+        if (!commutative) {
+          i->opcode = mirrored;
+        }
+        i->set_src1(src2);
+        i->set_src2(src1);
+        changed = true;
+      }
+      i = i->next;
+    }
+
+    block = block->next;
+  }
+
+  out_changed = changed;
+  return 0;
+}
+
+bool X86CanonicalizationPass::DiesAt(Value* value, Instr* i) {
+  // Values from other blocks may be live out, so only ones defined and
+  // entirely used in this block count.
+  if (!value->def || value->def->block != i->block) {
+    return false;
+  }
+  auto use = value->use_head;
+  while (use) {
+    if (use->instr->block != i->block || use->instr->ordinal > i->ordinal) {
+      return false;
+    }
+    use = use->next;
+  }
+  return true;
+}
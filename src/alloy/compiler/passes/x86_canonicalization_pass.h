@@ -0,0 +1,40 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_COMPILER_PASSES_X86_CANONICALIZATION_PASS_H_
+#define ALLOY_COMPILER_PASSES_X86_CANONICALIZATION_PASS_H_
+
+#include <alloy/compiler/compiler_pass.h>
+
+
+namespace alloy {
+namespace compiler {
+namespace passes {
+
+
+class X86CanonicalizationPass : public CompilerPass {
+public:
+  X86CanonicalizationPass();
+  virtual ~X86CanonicalizationPass();
+
+  virtual const char* name() const { return "X86Canonicalization"; }
+
+  virtual int Run(hir::HIRBuilder* builder, bool& out_changed);
+
+private:
+  bool DiesAt(hir::Value* value, hir::Instr* i);
+};
+
+
+}  // namespace passes
+}  // namespace compiler
+}  // namespace alloy
+
+
+#endif  // ALLOY_COMPILER_PASSES_X86_CANONICALIZATION_PASS_H_
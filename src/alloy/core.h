@@ -16,6 +16,7 @@
 #include <alloy/arena.h>
 #include <alloy/delegate.h>
 #include <alloy/mutex.h>
+#include <alloy/semaphore.h>
 #include <alloy/string_buffer.h>
 
 
@@ -12,11 +12,15 @@
 
 #include <alloy/core.h>
 #include <alloy/memory.h>
+#include <alloy/compiler/compiler.h>
 #include <alloy/frontend/context_info.h>
 #include <alloy/runtime/function.h>
 #include <alloy/runtime/symbol_info.h>
 
 
+namespace alloy { namespace backend {
+  class Backend;
+} }
 namespace alloy { namespace runtime {
   class Runtime;
 } }
@@ -41,6 +45,14 @@ public:
   virtual int DefineFunction(
       runtime::FunctionInfo* symbol_info, uint32_t debug_info_flags,
       runtime::Function** out_function) = 0;
+  // Defines the function with a backend other than the runtime default.
+  virtual int DefineFunction(
+      runtime::FunctionInfo* symbol_info, uint32_t debug_info_flags,
+      backend::Backend* backend, runtime::Function** out_function) = 0;
+
+  // Adds time spent in each translation stage and compiler pass so far.
+  // Only idle translators are included, so call when nothing is compiling.
+  virtual void GetTimings(compiler::Compiler::PassTimingList& timings) {}
 
 protected:
   runtime::Runtime* runtime_;
@@ -96,3 +96,19 @@ int PPCFrontend::DefineFunction(
   translator_pool_.Release(translator);
   return result;
 }
+
+int PPCFrontend::DefineFunction(
+    FunctionInfo* symbol_info, uint32_t debug_info_flags,
+    backend::Backend* backend, Function** out_function) {
+  PPCTranslator* translator = translator_pool_.Allocate(this);
+  int result = translator->Translate(
+      symbol_info, debug_info_flags, backend, out_function);
+  translator_pool_.Release(translator);
+  return result;
+}
+
+void PPCFrontend::GetTimings(compiler::Compiler::PassTimingList& timings) {
+  translator_pool_.ForEach([&timings](PPCTranslator* translator) {
+    translator->GetTimings(timings);
+  });
+}
@@ -34,6 +34,11 @@ public:
   virtual int DefineFunction(
       runtime::FunctionInfo* symbol_info, uint32_t debug_info_flags,
       runtime::Function** out_function);
+  virtual int DefineFunction(
+      runtime::FunctionInfo* symbol_info, uint32_t debug_info_flags,
+      backend::Backend* backend, runtime::Function** out_function);
+
+  virtual void GetTimings(compiler::Compiler::PassTimingList& timings);
 
 private:
   TypePool<PPCTranslator, PPCFrontend*> translator_pool_;
@@ -67,8 +67,8 @@ int PPCHIRBuilder::Emit(FunctionInfo* symbol_info, bool with_debug_info) {
   // instruction may have a label assigned to it if it hasn't been hit
   // yet.
   size_t list_size = instr_count_ * sizeof(void*);
-  instr_offset_list_ = (Instr**)arena_->Alloc(list_size);
-  label_list_ = (Label**)arena_->Alloc(list_size);
+  instr_offset_list_ = (Instr**)arena_->Alloc(list_size, sizeof(void*));
+  label_list_ = (Label**)arena_->Alloc(list_size, sizeof(void*));
   xe_zero_struct(instr_offset_list_, list_size);
   xe_zero_struct(label_list_, list_size);
 
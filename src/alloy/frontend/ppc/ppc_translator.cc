@@ -19,6 +19,8 @@
 #include <alloy/frontend/ppc/ppc_scanner.h>
 #include <alloy/runtime/runtime.h>
 
+#include <chrono>
+
 using namespace alloy;
 using namespace alloy::backend;
 using namespace alloy::compiler;
@@ -28,71 +30,197 @@ using namespace alloy::hir;
 using namespace alloy::runtime;
 
 
+namespace {
+
+uint64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+void AddStageTime(Compiler::PassTiming& timing, uint64_t start_ns) {
+  timing.run_count++;
+  timing.total_ns += NowNs() - start_ns;
+}
+
+}  // namespace
+
+
 PPCTranslator::PPCTranslator(PPCFrontend* frontend) :
     frontend_(frontend) {
-  Backend* backend = frontend->runtime()->backend();
+  Compiler::PassTiming scan_timing = { "Scan", 0, 0, 0, 0 };
+  scan_timing_ = scan_timing;
+  Compiler::PassTiming emit_timing = { "EmitHIR", 0, 0, 0, 0 };
+  emit_timing_ = emit_timing;
+  Compiler::PassTiming assemble_timing = { "Assemble", 0, 0, 0, 0 };
+  assemble_timing_ = assemble_timing;
+  Compiler::PassTiming cache_timing = { "CacheLoad", 0, 0, 0, 0 };
+  cache_timing_ = cache_timing;
 
   scanner_ = new PPCScanner(frontend);
   builder_ = new PPCHIRBuilder(frontend);
-  compiler_ = new Compiler(frontend->runtime());
-  assembler_ = backend->CreateAssembler();
-  assembler_->Initialize();
+
+  // Setup the default backend now, others are created as needed.
+  GetTarget(frontend->runtime()->backend());
+}
+
+PPCTranslator::~PPCTranslator() {
+  for (auto it = targets_.begin(); it != targets_.end(); ++it) {
+    delete it->assembler;
+    delete it->compiler;
+  }
+  delete builder_;
+  delete scanner_;
+}
+
+PPCTranslator::Target* PPCTranslator::GetTarget(Backend* backend) {
+  for (auto it = targets_.begin(); it != targets_.end(); ++it) {
+    if (it->backend == backend) {
+      return &(*it);
+    }
+  }
+
+  Target target;
+  target.backend = backend;
+  target.compiler = new Compiler(frontend_->runtime());
+  target.assembler = backend->CreateAssembler();
+  target.assembler->Initialize();
+  Compiler* compiler = target.compiler;
 
   bool validate = FLAGS_validate_hir;
 
+  // When tiering, the first tier only has to be cheap to generate. Hot
+  // functions are translated again for the next tier with everything below.
+  Runtime* runtime = frontend_->runtime();
+  if (runtime->tiering_enabled() && backend == runtime->backend()) {
+    if (validate) compiler->AddPass(new passes::ValidationPass());
+    compiler->AddPass(new passes::FinalizationPass());
+    target.pipeline_hash = compiler->GetPipelineHash();
+    targets_.push_back(target);
+    return &targets_.back();
+  }
+
   // Build the CFG first.
-  compiler_->AddPass(new passes::ControlFlowAnalysisPass());
+  compiler->AddPass(new passes::ControlFlowAnalysisPass());
 
   // Passes are executed in the order they are added. Multiple of the same
   // pass type may be used.
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
-  compiler_->AddPass(new passes::ContextPromotionPass());
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
-  compiler_->AddPass(new passes::SimplificationPass());
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
-  compiler_->AddPass(new passes::ConstantPropagationPass());
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
-  compiler_->AddPass(new passes::SimplificationPass());
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
-  //compiler_->AddPass(new passes::DeadStoreEliminationPass());
-  //if (validate) compiler_->AddPass(new passes::ValidationPass());
-  compiler_->AddPass(new passes::DeadCodeEliminationPass());
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::ContextPromotionPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+
+  // Emission and promotion leave instructions scattered around the arena;
+  // lay them out densely for the iterated passes below.
+  if (FLAGS_compact_hir) {
+    compiler->AddPass(new passes::CompactionPass());
+    if (validate) compiler->AddPass(new passes::ValidationPass());
+  }
+
+  // Cleanup passes feed each other (folded constants expose conversions to
+  // simplify, simplified assigns leave dead code, etc) so run them until
+  // they stop changing things. Most functions settle in two iterations.
+  compiler->BeginPassGroup(4);
+  compiler->AddPass(new passes::SimplificationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::ConstantPropagationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::TypePropagationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::ByteSwapEliminationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  // RegisterAllocationPass keeps values live across blocks and loops and
+  // splits them through locals, so GVN may reuse values across blocks.
+  compiler->AddPass(new passes::GlobalValueNumberingPass(true));
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::LoopInvariantCodeMotionPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::DeadStoreEliminationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::DeadCodeEliminationPass());
+  if (validate) compiler->AddPass(new passes::ValidationPass());
+  compiler->EndPassGroup();
 
   //// Removes all unneeded variables. Try not to add new ones after this.
-  //compiler_->AddPass(new passes::ValueReductionPass());
-  //if (validate) compiler_->AddPass(new passes::ValidationPass());
+  //compiler->AddPass(new passes::ValueReductionPass());
+  //if (validate) compiler->AddPass(new passes::ValidationPass());
+
+  // Backend-specific shaping of the HIR before it's lowered. Both only
+  // reorder operands/instructions, so they go ahead of allocation.
+  const backend::MachineInfo* machine_info = backend->machine_info();
+  if (machine_info->two_address_ops) {
+    compiler->AddPass(new passes::X86CanonicalizationPass());
+    if (validate) compiler->AddPass(new passes::ValidationPass());
+  }
+  if (machine_info->load_latency) {
+    compiler->AddPass(new passes::InstructionSchedulingPass(machine_info));
+    if (validate) compiler->AddPass(new passes::ValidationPass());
+  }
+
+  if (FLAGS_compact_hir) {
+    compiler->AddPass(new passes::CompactionPass());
+    if (validate) compiler->AddPass(new passes::ValidationPass());
+  }
 
   // Register allocation for the target backend.
   // Will modify the HIR to add loads/stores.
   // This should be the last pass before finalization, as after this all
   // registers are assigned and ready to be emitted.
-  compiler_->AddPass(new passes::RegisterAllocationPass(
-      backend->machine_info()));
-  if (validate) compiler_->AddPass(new passes::ValidationPass());
+  compiler->AddPass(new passes::RegisterAllocationPass(machine_info));
+  if (validate) compiler->AddPass(new passes::ValidationPass());
 
   // Must come last. The HIR is not really HIR after this.
-  compiler_->AddPass(new passes::FinalizationPass());
+  compiler->AddPass(new passes::FinalizationPass());
+
+  target.pipeline_hash = compiler->GetPipelineHash();
+  targets_.push_back(target);
+  return &targets_.back();
 }
 
-PPCTranslator::~PPCTranslator() {
-  delete assembler_;
-  delete compiler_;
-  delete builder_;
-  delete scanner_;
+int PPCTranslator::Translate(
+    FunctionInfo* symbol_info,
+    uint32_t debug_info_flags,
+    Function** out_function) {
+  return Translate(symbol_info, debug_info_flags,
+                   frontend_->runtime()->backend(), out_function);
 }
 
 int PPCTranslator::Translate(
     FunctionInfo* symbol_info,
     uint32_t debug_info_flags,
+    Backend* backend,
     Function** out_function) {
+  Target* target = GetTarget(backend);
+  Compiler* compiler = target->compiler;
+  Assembler* assembler = target->assembler;
+
+  // Try the translation cache first. Only source maps are cheap enough to
+  // rebuild, so anything asking for disassembly goes the long way.
+  TranslationCache* cache = frontend_->runtime()->translation_cache();
+  TranslationCache::Key cache_key;
+  if (cache &&
+      (FLAGS_always_disasm ||
+       (debug_info_flags & ~DEBUG_INFO_SOURCE_MAP) ||
+       !GetCacheKey(symbol_info, target, &cache_key))) {
+    cache = NULL;
+  }
+  if (cache) {
+    uint64_t start = NowNs();
+    int result = LoadCachedFunction(cache, cache_key, symbol_info,
+                                    debug_info_flags, backend, out_function);
+    AddStageTime(cache_timing_, start);
+    if (!result) {
+      return 0;
+    }
+  }
+
   // Scan the function to find its extents. We only need to do this if we
   // haven't already been provided with them from some other source.
   if (!symbol_info->has_end_address()) {
     // TODO(benvanik): find a way to remove the need for the scan. A fixup
     //     scheme acting on branches could go back and modify calls to branches
     //     if they are within the extents.
+    uint64_t start = NowNs();
     int result = scanner_->FindExtents(symbol_info);
+    AddStageTime(scan_timing_, start);
     if (result) {
       return result;
     }
@@ -114,8 +242,15 @@ int PPCTranslator::Translate(
     string_buffer_.Reset();
   }
 
+  // Hashed before emitting, so if the code changes under us the hash won't
+  // match memory once the runtime is watching it.
+  uint64_t source_hash = HashSource(symbol_info->address(),
+                                    symbol_info->end_address());
+
   // Emit function.
+  uint64_t stage_start = NowNs();
   int result = builder_->Emit(symbol_info, debug_info != NULL);
+  AddStageTime(emit_timing_, stage_start);
   XEEXPECTZERO(result);
 
   // Stash raw HIR.
@@ -126,7 +261,7 @@ int PPCTranslator::Translate(
   }
 
   // Compile/optimize/etc.
-  result = compiler_->Compile(builder_);
+  result = compiler->Compile(builder_);
   XEEXPECTZERO(result);
 
   // Stash optimized HIR.
@@ -137,11 +272,19 @@ int PPCTranslator::Translate(
   }
 
   // Assemble to backend machine code.
-  result = assembler_->Assemble(
+  stage_start = NowNs();
+  result = assembler->Assemble(
       symbol_info, builder_,
       debug_info_flags, debug_info,
       out_function);
+  AddStageTime(assemble_timing_, stage_start);
   XEEXPECTZERO(result);
+  (*out_function)->set_source_hash(source_hash);
+
+  if (cache) {
+    StoreCachedFunction(cache, cache_key, symbol_info, backend,
+                        *out_function);
+  }
 
   result = 0;
 
@@ -150,12 +293,99 @@ XECLEANUP:
     delete debug_info;
   }
   builder_->Reset();
-  compiler_->Reset();
-  assembler_->Reset();
+  compiler->Reset();
+  assembler->Reset();
   string_buffer_.Reset();
   return result;
 };
 
+void PPCTranslator::GetTimings(Compiler::PassTimingList& timings) const {
+  Compiler::AddTiming(timings, cache_timing_);
+  Compiler::AddTiming(timings, scan_timing_);
+  Compiler::AddTiming(timings, emit_timing_);
+  for (auto it = targets_.begin(); it != targets_.end(); ++it) {
+    it->compiler->GetPassTimings(timings);
+  }
+  Compiler::AddTiming(timings, assemble_timing_);
+}
+
+bool PPCTranslator::GetCacheKey(
+    FunctionInfo* symbol_info, const Target* target,
+    TranslationCache::Key* out_key) {
+  out_key->module_hash = symbol_info->module()->content_hash();
+  // Output depends on the compiler and the passes that ran as much as on
+  // the backend.
+  out_key->backend_version = target->backend->translation_cache_version();
+  if (out_key->backend_version) {
+    uint64_t compiler_version = TranslationCache::kCompilerVersion;
+    out_key->backend_version = TranslationCache::Hash(
+        &compiler_version, sizeof(compiler_version),
+        out_key->backend_version);
+    out_key->backend_version = TranslationCache::Hash(
+        &target->pipeline_hash, sizeof(target->pipeline_hash),
+        out_key->backend_version);
+  }
+  out_key->address = symbol_info->address();
+  return out_key->module_hash && out_key->backend_version;
+}
+
+uint64_t PPCTranslator::HashSource(
+    uint64_t start_address, uint64_t end_address) {
+  return frontend_->runtime()->HashGuestCode(start_address, end_address);
+}
+
+int PPCTranslator::LoadCachedFunction(
+    TranslationCache* cache, const TranslationCache::Key& key,
+    FunctionInfo* symbol_info, uint32_t debug_info_flags,
+    Backend* backend, Function** out_function) {
+  TranslationCache::Entry entry;
+  if (!cache->Lookup(key, &entry)) {
+    return 1;
+  }
+
+  // Validate against the guest code as it is now. If it has changed (or the
+  // extents disagree with what we already know) this is just a miss and the
+  // entry will be replaced once translated.
+  if (entry.end_address < key.address ||
+      (symbol_info->has_end_address() &&
+       symbol_info->end_address() != entry.end_address)) {
+    return 1;
+  }
+  if (HashSource(key.address, entry.end_address) != entry.source_hash) {
+    return 1;
+  }
+
+  Function* fn = NULL;
+  if (backend->DeserializeFunction(
+      symbol_info, entry.data, entry.length, &fn)) {
+    return 1;
+  }
+  if (!symbol_info->has_end_address()) {
+    symbol_info->set_end_address(entry.end_address);
+  }
+  if (debug_info_flags) {
+    fn->set_debug_info(new DebugInfo());
+  }
+  fn->set_source_hash(entry.source_hash);
+  *out_function = fn;
+  return 0;
+}
+
+void PPCTranslator::StoreCachedFunction(
+    TranslationCache* cache, const TranslationCache::Key& key,
+    FunctionInfo* symbol_info, Backend* backend, Function* function) {
+  if (backend->SerializeFunction(function, cache_buffer_)) {
+    // Not everything can be cached (host pointers, etc).
+    return;
+  }
+  TranslationCache::Entry entry;
+  entry.end_address = symbol_info->end_address();
+  entry.source_hash = function->source_hash();
+  entry.data = &cache_buffer_[0];
+  entry.length = cache_buffer_.size();
+  cache->Store(key, entry);
+}
+
 void PPCTranslator::DumpSource(
     runtime::FunctionInfo* symbol_info, StringBuffer* string_buffer) {
   Memory* memory = frontend_->memory();
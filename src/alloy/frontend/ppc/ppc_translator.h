@@ -14,6 +14,7 @@
 #include <alloy/backend/assembler.h>
 #include <alloy/compiler/compiler.h>
 #include <alloy/runtime/symbol_info.h>
+#include <alloy/runtime/translation_cache.h>
 
 
 namespace alloy {
@@ -33,8 +34,45 @@ public:
   int Translate(runtime::FunctionInfo* symbol_info,
                 uint32_t debug_info_flags,
                 runtime::Function** out_function);
+  int Translate(runtime::FunctionInfo* symbol_info,
+                uint32_t debug_info_flags,
+                backend::Backend* backend,
+                runtime::Function** out_function);
+
+  // Adds the time spent in each stage and pass by this translator.
+  void GetTimings(compiler::Compiler::PassTimingList& timings) const;
 
 private:
+  // Compiler pipeline + assembler for a particular backend. The pass
+  // pipeline depends on the backend (register allocation), so each backend
+  // a translator is used with gets its own.
+  typedef struct {
+    backend::Backend*   backend;
+    compiler::Compiler* compiler;
+    backend::Assembler* assembler;
+    // Compiler::GetPipelineHash(), part of every cache key.
+    uint64_t            pipeline_hash;
+  } Target;
+  Target* GetTarget(backend::Backend* backend);
+
+  // Translation cache helpers. GetCacheKey returns false if the function
+  // can't be cached.
+  bool GetCacheKey(runtime::FunctionInfo* symbol_info,
+                   const Target* target,
+                   runtime::TranslationCache::Key* out_key);
+  uint64_t HashSource(uint64_t start_address, uint64_t end_address);
+  int LoadCachedFunction(runtime::TranslationCache* cache,
+                         const runtime::TranslationCache::Key& key,
+                         runtime::FunctionInfo* symbol_info,
+                         uint32_t debug_info_flags,
+                         backend::Backend* backend,
+                         runtime::Function** out_function);
+  void StoreCachedFunction(runtime::TranslationCache* cache,
+                           const runtime::TranslationCache::Key& key,
+                           runtime::FunctionInfo* symbol_info,
+                           backend::Backend* backend,
+                           runtime::Function* function);
+
   void DumpSource(runtime::FunctionInfo* symbol_info,
                   StringBuffer* string_buffer);
 
@@ -42,10 +80,16 @@ private:
   PPCFrontend*          frontend_;
   PPCScanner*           scanner_;
   PPCHIRBuilder*        builder_;
-  compiler::Compiler*   compiler_;
-  backend::Assembler*   assembler_;
+  std::vector<Target>   targets_;
 
   StringBuffer          string_buffer_;
+  std::vector<uint8_t>  cache_buffer_;
+
+  // Stages outside of the compiler passes.
+  compiler::Compiler::PassTiming  scan_timing_;
+  compiler::Compiler::PassTiming  emit_timing_;
+  compiler::Compiler::PassTiming  assemble_timing_;
+  compiler::Compiler::PassTiming  cache_timing_;
 };
 
 
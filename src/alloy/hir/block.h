@@ -29,6 +29,9 @@ public:
   enum EdgeFlags {
     UNCONDITIONAL = (1 << 0),
     DOMINATES = (1 << 1),
+    // Edge from inside a natural loop to its header. Only set for loops
+    // that have a preheader (see ControlFlowAnalysisPass).
+    BACK_EDGE = (1 << 2),
   };
 public:
   Edge* outgoing_next;
@@ -399,6 +399,23 @@ void HIRBuilder::AddEdge(Block* src, Block* dest, uint32_t flags) {
   dest->incoming_edge_head = edge;
 }
 
+Block* HIRBuilder::InsertBlock(Block* next_block) {
+  Block* block = arena_->Alloc<Block>();
+  block->arena = arena_;
+  block->prev = next_block->prev;
+  block->next = next_block;
+  if (block->prev) {
+    block->prev->next = block;
+  } else {
+    block_head_ = block;
+  }
+  next_block->prev = block;
+  block->label_head = block->label_tail = NULL;
+  block->incoming_edge_head = block->outgoing_edge_head = NULL;
+  block->instr_head = block->instr_tail = NULL;
+  return block;
+}
+
 Block* HIRBuilder::AppendBlock() {
   Block* block = arena_->Alloc<Block>();
   block->arena = arena_;
@@ -439,6 +456,192 @@ bool HIRBuilder::IsUnconditionalJump(Instr* instr) {
   return false;
 }
 
+bool HIRBuilder::FallsThrough(Block* block) {
+  return !block->instr_tail || !IsUnconditionalJump(block->instr_tail);
+}
+
+bool HIRBuilder::IsContextEscape(Instr* instr) {
+  switch (instr->opcode->num) {
+  case OPCODE_DEBUG_BREAK:
+  case OPCODE_DEBUG_BREAK_TRUE:
+  case OPCODE_TRAP:
+  case OPCODE_TRAP_TRUE:
+  case OPCODE_CALL:
+  case OPCODE_CALL_TRUE:
+  case OPCODE_CALL_INDIRECT:
+  case OPCODE_CALL_INDIRECT_TRUE:
+  case OPCODE_CALL_EXTERN:
+  case OPCODE_RETURN:
+  case OPCODE_RETURN_TRUE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void HIRBuilder::Compact() {
+  // Instructions, values and uses are allocated from the arena as they are
+  // created, so after a few passes have moved things around walking a block
+  // or a use list hops all over memory. This copies everything into one
+  // dense run per block, in program order: the block's instructions, then
+  // the values first referenced in it, then their uses. instr->next and
+  // use->next are then (almost always) the next element in memory.
+  // The old nodes are abandoned in the arena until Reset.
+  typedef struct {
+    Block*      block;
+    size_t      instr_count;
+    size_t      value_count;
+    size_t      use_count;
+    Instr*      instrs;
+    Value*      values;
+    Value::Use* uses;
+  } Run;
+  std::vector<Run> runs;
+  std::vector<Value*> values;
+  std::vector<Value*> value_map(next_value_ordinal_, NULL);
+
+  // Assign each value to the run of the block it's first referenced in.
+  // value_map just marks them as seen until the copies are made.
+  Run current = { 0 };
+  auto add_value = [&](Value* value) {
+    if (!value || value_map[value->ordinal]) {
+      return;
+    }
+    value_map[value->ordinal] = value;
+    values.push_back(value);
+    current.value_count++;
+    for (auto use = value->use_head; use; use = use->next) {
+      current.use_count++;
+    }
+  };
+  for (auto block = block_head_; block; block = block->next) {
+    current.block = block;
+    current.instr_count = current.value_count = current.use_count = 0;
+    for (auto i = block->instr_head; i; i = i->next) {
+      current.instr_count++;
+      uint32_t signature = i->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V) {
+        add_value(i->dest);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        add_value(i->src1.value);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        add_value(i->src2.value);
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        add_value(i->src3.value);
+      }
+    }
+    runs.push_back(current);
+  }
+  // Locals nothing references anymore.
+  current.block = NULL;
+  current.instr_count = current.value_count = current.use_count = 0;
+  for (auto it = locals_.begin(); it != locals_.end(); ++it) {
+    add_value(*it);
+  }
+  runs.push_back(current);
+
+  // Copy values. Definitions are filled in as the instructions are copied.
+  auto value_it = values.begin();
+  for (auto it = runs.begin(); it != runs.end(); ++it) {
+    Run& run = *it;
+    run.values = (Value*)arena_->Alloc(
+        run.value_count * sizeof(Value) +
+        run.instr_count * sizeof(Instr) +
+        run.use_count * sizeof(Value::Use), 16);
+    run.instrs = (Instr*)(run.values + run.value_count);
+    run.uses = (Value::Use*)(run.instrs + run.instr_count);
+    for (size_t n = 0; n < run.value_count; n++, ++value_it) {
+      Value* value = &run.values[n];
+      *value = **value_it;
+      value->def = NULL;
+      value->last_use = NULL;
+      value_map[value->ordinal] = value;
+    }
+  }
+
+  // Copy instructions. Each old instruction's next is left pointing at its
+  // copy so the uses below can be forwarded.
+  for (auto it = runs.begin(); it != runs.end(); ++it) {
+    Run& run = *it;
+    if (!run.block) {
+      continue;
+    }
+    Instr* i = run.block->instr_head;
+    for (size_t n = 0; n < run.instr_count; n++) {
+      Instr* copy = &run.instrs[n];
+      *copy = *i;
+      copy->prev = n ? copy - 1 : NULL;
+      copy->next = n + 1 < run.instr_count ? copy + 1 : NULL;
+      uint32_t signature = copy->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_DEST(signature) == OPCODE_SIG_TYPE_V &&
+          copy->dest) {
+        copy->dest = value_map[copy->dest->ordinal];
+        copy->dest->def = copy;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+          copy->src1.value) {
+        copy->src1.value = value_map[copy->src1.value->ordinal];
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V &&
+          copy->src2.value) {
+        copy->src2.value = value_map[copy->src2.value->ordinal];
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V &&
+          copy->src3.value) {
+        copy->src3.value = value_map[copy->src3.value->ordinal];
+      }
+      Instr* next = i->next;
+      i->next = copy;
+      i = next;
+    }
+    run.block->instr_head = run.instr_count ? run.instrs : NULL;
+    run.block->instr_tail =
+        run.instr_count ? &run.instrs[run.instr_count - 1] : NULL;
+  }
+
+  // Copy use lists, keeping their order.
+  for (auto it = runs.begin(); it != runs.end(); ++it) {
+    Run& run = *it;
+    Value::Use* use_copy = run.uses;
+    for (size_t n = 0; n < run.value_count; n++) {
+      Value* value = &run.values[n];
+      Value::Use* prev = NULL;
+      Value::Use* use = value->use_head;
+      value->use_head = NULL;
+      while (use) {
+        Instr* instr = use->instr->next;
+        use_copy->instr = instr;
+        use_copy->prev = prev;
+        use_copy->next = NULL;
+        if (prev) {
+          prev->next = use_copy;
+        } else {
+          value->use_head = use_copy;
+        }
+        if (instr->src1_use == use) {
+          instr->src1_use = use_copy;
+        } else if (instr->src2_use == use) {
+          instr->src2_use = use_copy;
+        } else if (instr->src3_use == use) {
+          instr->src3_use = use_copy;
+        }
+        prev = use_copy++;
+        use = use->next;
+      }
+      if (value->local_slot && value_map[value->local_slot->ordinal]) {
+        value->local_slot = value_map[value->local_slot->ordinal];
+      }
+    }
+  }
+
+  for (auto it = locals_.begin(); it != locals_.end(); ++it) {
+    *it = value_map[(*it)->ordinal];
+  }
+}
+
 Instr* HIRBuilder::AppendInstr(
     const OpcodeInfo& opcode_info, uint16_t flags, Value* dest) {
   if (!current_block_) {
@@ -56,6 +56,23 @@ public:
   void ResetLabelTags();
 
   void AddEdge(Block* src, Block* dest, uint32_t flags);
+  // Inserts an empty block before next_block, which the previous block
+  // will now fall through into.
+  Block* InsertBlock(Block* next_block);
+  // Whether control never continues past instr into the next block.
+  static bool IsUnconditionalJump(Instr* instr);
+  // Whether control can continue from the end of block into block->next.
+  static bool FallsThrough(Block* block);
+  // Whether instr hands the context to something outside of the function
+  // that may read or write any of it: calls, returns, traps and debug
+  // breaks, including the conditional forms. These can appear anywhere in
+  // a block; Finalize adds a fall-through branch after any that end one.
+  static bool IsContextEscape(Instr* instr);
+
+  // Moves all instructions, values and uses into dense per-block storage in
+  // program order. Any Instr*, Value* or Value::Use* held from before is
+  // invalidated.
+  void Compact();
 
   // static allocations:
   // Value* AllocStatic(size_t length);
@@ -224,7 +241,6 @@ protected:
 private:
   Block* AppendBlock();
   void EndBlock();
-  bool IsUnconditionalJump(Instr* instr);
   Instr* AppendInstr(const OpcodeInfo& opcode, uint16_t flags,
                      Value* dest = 0);
   Value* CompareXX(const OpcodeInfo& opcode, Value* value1, Value* value2);
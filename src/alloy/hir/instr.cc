@@ -54,16 +54,7 @@ void Instr::MoveBefore(Instr* other) {
   }
 
   // Remove from current location.
-  if (prev) {
-    prev->next = next;
-  } else {
-    block->instr_head = next;
-  }
-  if (next) {
-    next->prev = prev;
-  } else {
-    block->instr_tail = prev;
-  }
+  Unlink();
 
   // Insert into new location.
   block = other->block;
@@ -78,6 +69,33 @@ void Instr::MoveBefore(Instr* other) {
   }
 }
 
+void Instr::MoveToEnd(Block* other_block) {
+  Unlink();
+
+  block = other_block;
+  next = NULL;
+  prev = block->instr_tail;
+  if (prev) {
+    prev->next = this;
+  } else {
+    block->instr_head = this;
+  }
+  block->instr_tail = this;
+}
+
+void Instr::Unlink() {
+  if (prev) {
+    prev->next = next;
+  } else {
+    block->instr_head = next;
+  }
+  if (next) {
+    next->prev = prev;
+  } else {
+    block->instr_tail = prev;
+  }
+}
+
 void Instr::Replace(const OpcodeInfo* opcode, uint16_t flags) {
   this->opcode = opcode;
   this->flags = flags;
@@ -103,14 +121,5 @@ void Instr::Remove() {
   // Remove all srcs/dest.
   Replace(&OPCODE_NOP_info, 0);
 
-  if (prev) {
-    prev->next = next;
-  } else {
-    block->instr_head = next;
-  }
-  if (next) {
-    next->prev = prev;
-  } else {
-    block->instr_tail = prev;
-  }
+  Unlink();
 }
@@ -55,8 +55,12 @@ public:
   void set_src3(Value* value);
 
   void MoveBefore(Instr* other);
+  void MoveToEnd(Block* other_block);
   void Replace(const OpcodeInfo* opcode, uint16_t flags);
   void Remove();
+
+private:
+  void Unlink();
 };
 
 
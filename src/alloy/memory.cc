@@ -12,14 +12,61 @@
 using namespace alloy;
 
 
+namespace {
+
+// Instances with write watches, scanned by the fault handler. Slots are
+// claimed/released with CAS so the handler never needs a lock to find them.
+Memory* volatile watched_memories[8] = { 0 };
+volatile uint32_t fault_handler_installed = 0;
+
+// Guest addresses are 32-bit.
+const uint64_t kGuestAddressSpaceSize = 0x100000000ull;
+
+// PageWatch::state. The low bits count the watches covering the page.
+const uint32_t kPageWatchCountMask  = 0xFFFF;
+// Write-protected until next written.
+const uint32_t kPageProtected       = 1 << 16;
+// The guest can write the page, so a fault while it's unprotected is a race
+// with the thread that unprotected it.
+const uint32_t kPageWritable        = 1 << 17;
+// The guest can execute the page, which has to be kept when unprotecting.
+const uint32_t kPageExecutable      = 1 << 18;
+// Written, and queued for DispatchWriteWatches.
+const uint32_t kPagePending         = 1 << 19;
+
+// Sets and clears bits of a page state, returning the old state.
+uint32_t UpdatePageState(volatile uint32_t* state,
+                         uint32_t set_bits, uint32_t clear_bits) {
+  uint32_t old_state;
+  do {
+    old_state = *state;
+  } while (!xe_atomic_cas_32(
+      old_state, (old_state & ~clear_bits) | set_bits, state));
+  return old_state;
+}
+
+}  // namespace
+
+
 Memory::Memory() :
-    membase_(0), reserve_address_(0) {
-  SYSTEM_INFO si;
-  GetSystemInfo(&si);
-  system_page_size_ = si.dwPageSize;
+    membase_(0), reserve_address_(0),
+    next_watch_id_(1), page_watches_(0), pending_page_head_(0) {
+  system_page_size_ = QueryHostPageSize();
+  watch_lock_ = AllocMutex(10000);
 }
 
 Memory::~Memory() {
+  // Unprotect everything before the fault handler stops looking at us.
+  while (!watches_.empty()) {
+    RemoveWriteWatch(watches_.begin()->first);
+  }
+  for (size_t n = 0; n < XECOUNT(watched_memories); n++) {
+    if (watched_memories[n] == this) {
+      watched_memories[n] = NULL;
+    }
+  }
+  xe_free(page_watches_);
+  FreeMutex(watch_lock_);
 }
 
 int Memory::Initialize() {
@@ -66,3 +113,332 @@ uint64_t Memory::SearchAligned(
   }
   return 0;
 }
+
+uint32_t Memory::AddWriteWatch(
+    uint64_t address, size_t size,
+    WriteWatchCallback callback, void* callback_context) {
+  if (!size || address + size > kGuestAddressSpaceSize) {
+    return 0;
+  }
+
+  LockMutex(watch_lock_);
+  if (!page_watches_) {
+    // Untouched entries are never paged in, so this costs little.
+    page_watches_ = (PageWatch*)xe_calloc(
+        (size_t)(kGuestAddressSpaceSize / system_page_size_) *
+        sizeof(PageWatch));
+    if (!page_watches_) {
+      UnlockMutex(watch_lock_);
+      return 0;
+    }
+  }
+
+  // Register with the fault handler before anything is protected.
+  bool registered = false;
+  for (size_t n = 0; n < XECOUNT(watched_memories) && !registered; n++) {
+    registered = watched_memories[n] == this ||
+                 xe_atomic_cas_ptr(NULL, this, &watched_memories[n]);
+  }
+  if (!registered) {
+    UnlockMutex(watch_lock_);
+    XELOGE("Too many memory instances with write watches.");
+    return 0;
+  }
+  if (xe_atomic_cas_32(0, 1, &fault_handler_installed)) {
+    InstallWriteFaultHandler();
+  }
+
+  uint64_t start = address & ~(uint64_t)(system_page_size_ - 1);
+  uint64_t end = XEROUNDUP(address + size, system_page_size_);
+  WriteWatch* watch = new WriteWatch();
+  watch->id = next_watch_id_++;
+  watch->address = start;
+  watch->size = (size_t)(end - start);
+  watch->page_count = watch->size / system_page_size_;
+  watch->callback = callback;
+  watch->callback_context = callback_context;
+  watch->dirty_bits = (uint32_t*)xe_calloc(
+      XEROUNDUP(watch->page_count, 32) / 32 * sizeof(uint32_t));
+  watch->dirty_count = 0;
+  watches_[watch->id] = watch;
+
+  uint32_t first_page = (uint32_t)(start / system_page_size_);
+  for (uint32_t n = 0; n < watch->page_count; n++) {
+    page_watch_index_.insert(std::make_pair(first_page + n, watch));
+    xe_atomic_inc_32(&page_watches_[first_page + n].state);
+  }
+  ProtectPages(first_page, (uint32_t)watch->page_count);
+  UnlockMutex(watch_lock_);
+  return watch->id;
+}
+
+void Memory::RemoveWriteWatch(uint32_t watch_id) {
+  LockMutex(watch_lock_);
+  auto it = watches_.find(watch_id);
+  if (it == watches_.end()) {
+    UnlockMutex(watch_lock_);
+    return;
+  }
+  WriteWatch* watch = it->second;
+  watches_.erase(it);
+  uint32_t first_page = (uint32_t)(watch->address / system_page_size_);
+  for (uint32_t page = first_page;
+       page < first_page + watch->page_count; page++) {
+    auto range = page_watch_index_.equal_range(page);
+    for (auto index_it = range.first; index_it != range.second; ++index_it) {
+      if (index_it->second == watch) {
+        page_watch_index_.erase(index_it);
+        break;
+      }
+    }
+    UnwatchPage(page);
+  }
+  UnlockMutex(watch_lock_);
+
+  xe_free(watch->dirty_bits);
+  delete watch;
+}
+
+size_t Memory::GetWriteWatch(uint32_t watch_id, uint32_t* out_bitmap,
+                             size_t bitmap_word_count, bool reset) {
+  // Pick up anything written since the last dispatch.
+  DispatchWriteWatches();
+
+  LockMutex(watch_lock_);
+  auto it = watches_.find(watch_id);
+  if (it == watches_.end()) {
+    UnlockMutex(watch_lock_);
+    return 0;
+  }
+  WriteWatch* watch = it->second;
+  size_t word_count = XEROUNDUP(watch->page_count, 32) / 32;
+  if (out_bitmap) {
+    size_t copy_count = MIN(word_count, bitmap_word_count);
+    xe_copy_struct(out_bitmap, watch->dirty_bits,
+                   copy_count * sizeof(uint32_t));
+  }
+  size_t dirty_count = watch->dirty_count;
+  if (reset && dirty_count) {
+    xe_zero_struct(watch->dirty_bits, word_count * sizeof(uint32_t));
+    watch->dirty_count = 0;
+    ProtectPages((uint32_t)(watch->address / system_page_size_),
+                 (uint32_t)watch->page_count);
+  }
+  UnlockMutex(watch_lock_);
+  return dirty_count;
+}
+
+void Memory::ResetWriteWatch(uint32_t watch_id) {
+  GetWriteWatch(watch_id, NULL, 0, true);
+}
+
+void Memory::DispatchWriteWatches() {
+  if (!pending_page_head_) {
+    return;
+  }
+  typedef struct {
+    WriteWatchCallback callback;
+    void*     context;
+    uint32_t  id;
+    uint64_t  address;
+  } PendingCallback;
+  std::vector<PendingCallback> callbacks;
+
+  LockMutex(watch_lock_);
+  uint32_t head;
+  do {
+    head = pending_page_head_;
+  } while (!xe_atomic_cas_32(head, 0, &pending_page_head_));
+  while (head) {
+    uint32_t page = head - 1;
+    PageWatch* page_watch = &page_watches_[page];
+    // Read before clearing pending, after which the page can be queued
+    // again (once reprotected, which needs the lock).
+    head = page_watch->next_pending;
+    uint64_t fault_address = page_watch->fault_address;
+    UpdatePageState(&page_watch->state, 0, kPagePending);
+
+    uint64_t page_address = (uint64_t)page * system_page_size_;
+    auto range = page_watch_index_.equal_range(page);
+    for (auto it = range.first; it != range.second; ++it) {
+      WriteWatch* watch = it->second;
+      size_t n = (size_t)((page_address - watch->address) /
+                          system_page_size_);
+      uint32_t bit = 1 << (n % 32);
+      if (watch->dirty_bits[n / 32] & bit) {
+        continue;
+      }
+      watch->dirty_bits[n / 32] |= bit;
+      watch->dirty_count++;
+      if (watch->callback) {
+        PendingCallback pending = {
+          watch->callback, watch->callback_context, watch->id, fault_address,
+        };
+        callbacks.push_back(pending);
+      }
+    }
+  }
+  UnlockMutex(watch_lock_);
+
+  // Outside the lock, so callbacks can query/reset watches.
+  for (auto it = callbacks.begin(); it != callbacks.end(); ++it) {
+    it->callback(it->context, it->id, it->address);
+  }
+}
+
+void Memory::DirtyWriteWatches(uint64_t address, size_t size) {
+  if (!page_watches_ || !size) {
+    return;
+  }
+  LockMutex(watch_lock_);
+  uint32_t first_page = (uint32_t)(address / system_page_size_);
+  uint32_t last_page = (uint32_t)((address + size - 1) / system_page_size_);
+  for (uint32_t page = first_page; page <= last_page; page++) {
+    PageWatch* page_watch = &page_watches_[page];
+    if (!(page_watch->state & kPageWatchCountMask)) {
+      continue;
+    }
+    // Protection may change, so it's looked up again on reset.
+    uint32_t old_state = UpdatePageState(
+        &page_watch->state, kPagePending, kPageProtected | kPageWritable);
+    if (old_state & kPageProtected) {
+      ProtectHostPages(membase_ + (uint64_t)page * system_page_size_,
+                       system_page_size_,
+                       true, (old_state & kPageExecutable) != 0);
+    }
+    if (!(old_state & kPagePending)) {
+      page_watch->fault_address = (uint32_t)MAX(
+          address, (uint64_t)page * system_page_size_);
+      uint32_t head;
+      do {
+        head = pending_page_head_;
+        page_watch->next_pending = head;
+      } while (!xe_atomic_cas_32(head, page + 1, &pending_page_head_));
+    }
+  }
+  UnlockMutex(watch_lock_);
+}
+
+bool Memory::IsWatchablePage(uint64_t address, bool* out_executable) {
+  *out_executable = false;
+  return true;
+}
+
+void Memory::ProtectPages(uint32_t first_page, uint32_t page_count) {
+  // Requires watch_lock_. Pages already protected are skipped, as are
+  // written pages still queued; they'll be dirty once dispatched.
+  uint32_t end_page = first_page + page_count;
+  uint32_t page = first_page;
+  while (page < end_page) {
+    // Find the next run of pages to protect the same way.
+    uint32_t run_start = page;
+    bool run_executable = false;
+    for (; page < end_page; page++) {
+      PageWatch* page_watch = &page_watches_[page];
+      bool executable = false;
+      bool protect = false;
+      if (!(page_watch->state & (kPageProtected | kPagePending))) {
+        protect = IsWatchablePage(
+            (uint64_t)page * system_page_size_, &executable);
+        if (!protect) {
+          // Writes here are real faults.
+          UpdatePageState(&page_watch->state,
+                          0, kPageWritable | kPageExecutable);
+        }
+      }
+      if (!protect) {
+        if (page == run_start) {
+          run_start++;
+          continue;
+        }
+        break;
+      }
+      if (page == run_start) {
+        run_executable = executable;
+      } else if (executable != run_executable) {
+        break;
+      }
+      UpdatePageState(&page_watch->state,
+                      kPageWritable | (executable ? kPageExecutable : 0),
+                      kPageExecutable);
+    }
+    if (page == run_start) {
+      continue;
+    }
+    if (!ProtectHostPages(
+        membase_ + (uint64_t)run_start * system_page_size_,
+        (size_t)(page - run_start) * system_page_size_,
+        false, run_executable)) {
+      continue;
+    }
+    // Only now, so stores faulting between the protect and here are retried
+    // rather than missed.
+    for (uint32_t n = run_start; n < page; n++) {
+      UpdatePageState(&page_watches_[n].state, kPageProtected, 0);
+    }
+  }
+}
+
+void Memory::UnwatchPage(uint32_t page) {
+  // Requires watch_lock_. The last watch out restores the protection, before
+  // dropping the count so racing faults are still retried.
+  PageWatch* page_watch = &page_watches_[page];
+  if ((page_watch->state & kPageWatchCountMask) == 1) {
+    uint32_t old_state =
+        UpdatePageState(&page_watch->state, 0, kPageProtected);
+    if (old_state & kPageProtected) {
+      ProtectHostPages(membase_ + (uint64_t)page * system_page_size_,
+                       system_page_size_,
+                       true, (old_state & kPageExecutable) != 0);
+    }
+  }
+  xe_atomic_dec_32(&page_watch->state);
+}
+
+bool Memory::OnWriteFault(uint64_t address) {
+  // Runs in the fault handler, so only atomics and the protection change:
+  // no locks, allocation or callbacks.
+  if (!page_watches_) {
+    return false;
+  }
+  uint32_t page = (uint32_t)(address / system_page_size_);
+  PageWatch* page_watch = &page_watches_[page];
+  uint32_t state;
+  do {
+    state = page_watch->state;
+    if (!(state & kPageWatchCountMask)) {
+      return false;
+    }
+    if (!(state & kPageProtected)) {
+      // Another thread is (un)protecting it, so retry the store. Otherwise
+      // the guest can't write here and it's a real fault.
+      return (state & (kPagePending | kPageWritable)) != 0;
+    }
+  } while (!xe_atomic_cas_32(
+      state, (state & ~kPageProtected) | kPagePending, &page_watch->state));
+
+  ProtectHostPages(membase_ + (uint64_t)page * system_page_size_,
+                   system_page_size_,
+                   true, (state & kPageExecutable) != 0);
+  page_watch->fault_address = (uint32_t)address;
+  uint32_t head;
+  do {
+    head = pending_page_head_;
+    page_watch->next_pending = head;
+  } while (!xe_atomic_cas_32(head, page + 1, &pending_page_head_));
+  return true;
+}
+
+bool Memory::HandleWriteFault(void* host_address) {
+  for (size_t n = 0; n < XECOUNT(watched_memories); n++) {
+    Memory* memory = watched_memories[n];
+    if (!memory || (uint8_t*)host_address < memory->membase_) {
+      continue;
+    }
+    uint64_t address = (uint64_t)((uint8_t*)host_address - memory->membase_);
+    if (address < kGuestAddressSpaceSize) {
+      return memory->OnWriteFault(address);
+    }
+  }
+  return false;
+}
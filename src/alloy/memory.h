@@ -12,6 +12,8 @@
 
 #include <alloy/core.h>
 
+#include <unordered_map>
+
 
 namespace alloy {
 
@@ -23,6 +25,13 @@ enum {
 };
 
 
+// Called from DispatchWriteWatches the first time a page in a watched range
+// is seen written after being added or reset. address is the first guest
+// address seen written on the page.
+typedef void (*WriteWatchCallback)(
+    void* context, uint32_t watch, uint64_t address);
+
+
 class Memory {
 public:
   Memory();
@@ -33,6 +42,7 @@ public:
     return membase_ + guest_address;
   };
   inline uint32_t* reserve_address() { return &reserve_address_; }
+  inline size_t page_size() const { return system_page_size_; }
 
   virtual int Initialize();
 
@@ -53,10 +63,91 @@ public:
   virtual int Protect(uint64_t address, size_t size, uint32_t access) = 0;
   virtual uint32_t QueryProtect(uint64_t address) = 0;
 
+  // Tracks writes to a committed, read/write range with host page
+  // granularity. Pages are write-protected until first written, so only the
+  // first write to a page after a reset costs a fault. Pages that aren't
+  // writable when added are left alone. Writes through other views aliasing
+  // the same memory aren't seen.
+  // Returns a watch handle, or 0 on failure.
+  uint32_t AddWriteWatch(uint64_t address, size_t size,
+                         WriteWatchCallback callback = NULL,
+                         void* callback_context = NULL);
+  void RemoveWriteWatch(uint32_t watch);
+  // Fills out_bitmap (bit n for page n of the range, as 32-bit words) with
+  // the pages written since the last reset, optionally resetting them.
+  // Returns the number of dirty pages.
+  size_t GetWriteWatch(uint32_t watch, uint32_t* out_bitmap,
+                       size_t bitmap_word_count, bool reset);
+  // Marks all pages of the range clean and protects them again.
+  void ResetWriteWatch(uint32_t watch);
+
+  // Faults only queue the written pages, as the handler can't take locks or
+  // call out. This marks them dirty and runs the callbacks, on the calling
+  // thread. Cheap to poll with has_pending_writes.
+  inline bool has_pending_writes() const { return pending_page_head_ != 0; }
+  void DispatchWriteWatches();
+  // Must be called before the host writes into, decommits or changes the
+  // protection of guest memory, which would otherwise fail or drop the
+  // write protection. Watched pages in the range are unprotected and
+  // queued as written.
+  void DirtyWriteWatches(uint64_t address, size_t size);
+
+  // Called by the platform fault handler with the host address of a faulting
+  // write. Returns true if it was a watched page, and the store can now be
+  // retried. Safe in signal context.
+  static bool HandleWriteFault(void* host_address);
+
+  // Whether the host page at address is committed and guest writable, so
+  // write watches can protect it, and if it must be kept executable.
+  // Subclasses tracking protection should override this.
+  virtual bool IsWatchablePage(uint64_t address, bool* out_executable);
+
 protected:
   size_t    system_page_size_;
   uint8_t*  membase_;
   uint32_t  reserve_address_;
+
+private:
+  typedef struct {
+    uint32_t  id;
+    uint64_t  address;
+    size_t    size;
+    size_t    page_count;
+    WriteWatchCallback callback;
+    void*     callback_context;
+    uint32_t* dirty_bits;
+    size_t    dirty_count;
+  } WriteWatch;
+
+  // Per host page, indexed by guest page number. Only changed atomically,
+  // as the fault handler can't take locks.
+  typedef struct {
+    volatile uint32_t state;
+    // Next page (+1) on the pending list.
+    volatile uint32_t next_pending;
+    volatile uint32_t fault_address;
+  } PageWatch;
+
+  void ProtectPages(uint32_t first_page, uint32_t page_count);
+  void UnwatchPage(uint32_t page);
+  bool OnWriteFault(uint64_t address);
+
+  // Implemented per platform.
+  static size_t QueryHostPageSize();
+  static bool ProtectHostPages(void* p, size_t size,
+                               bool writable, bool executable);
+  static void InstallWriteFaultHandler();
+
+private:
+  Mutex*    watch_lock_;
+  uint32_t  next_watch_id_;
+  std::unordered_map<uint32_t, WriteWatch*> watches_;
+  // Watches covering each page, so dispatching doesn't scan them all.
+  std::unordered_multimap<uint32_t, WriteWatch*> page_watch_index_;
+  PageWatch* page_watches_;
+  // Written pages (+1) waiting for DispatchWriteWatches, as a lock-free
+  // stack through PageWatch::next_pending.
+  volatile uint32_t pending_page_head_;
 };
 
 
@@ -0,0 +1,85 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/memory.h>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+using namespace alloy;
+
+
+namespace {
+
+// Actions that were installed before ours, for faults that aren't watches.
+struct sigaction previous_segv_action;
+struct sigaction previous_bus_action;
+
+// Reads of inaccessible pages fault too, and must not unprotect them. The
+// x86 page fault error code has the write bit.
+bool IsWriteFault(void* context) {
+#if XE_LIKE_OSX && defined(__x86_64__)
+  return (((ucontext_t*)context)->uc_mcontext->__es.__err & 2) != 0;
+#elif defined(__linux__) && defined(__x86_64__)
+  return (((ucontext_t*)context)->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+#else
+  // Can't tell, so only watched pages that are writable are handled.
+  return true;
+#endif  // XE_LIKE_OSX
+}
+
+void WriteFaultHandler(int signo, siginfo_t* info, void* context) {
+  if (IsWriteFault(context) && Memory::HandleWriteFault(info->si_addr)) {
+    // Page is writable again; the faulting store will be retried.
+    return;
+  }
+  struct sigaction* previous =
+      signo == SIGBUS ? &previous_bus_action : &previous_segv_action;
+  if (previous->sa_flags & SA_SIGINFO) {
+    previous->sa_sigaction(signo, info, context);
+  } else if (previous->sa_handler == SIG_DFL ||
+             previous->sa_handler == SIG_IGN) {
+    // Restore and return so the fault happens again and is fatal as usual.
+    sigaction(signo, previous, NULL);
+  } else {
+    previous->sa_handler(signo);
+  }
+}
+
+}  // namespace
+
+
+size_t Memory::QueryHostPageSize() {
+  return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+bool Memory::ProtectHostPages(void* p, size_t size,
+                              bool writable, bool executable) {
+  int prot = PROT_READ;
+  if (writable) {
+    prot |= PROT_WRITE;
+  }
+  if (executable) {
+    prot |= PROT_EXEC;
+  }
+  return mprotect(p, size, prot) == 0;
+}
+
+void Memory::InstallWriteFaultHandler() {
+  struct sigaction action;
+  xe_zero_struct(&action, sizeof(action));
+  action.sa_sigaction = WriteFaultHandler;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGSEGV, &action, &previous_segv_action);
+  // OS X reports writes to read-only pages as SIGBUS.
+  sigaction(SIGBUS, &action, &previous_bus_action);
+}
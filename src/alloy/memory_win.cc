@@ -0,0 +1,53 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/memory.h>
+
+using namespace alloy;
+
+
+namespace {
+
+LONG CALLBACK WriteFaultHandler(PEXCEPTION_POINTERS ex_info) {
+  PEXCEPTION_RECORD record = ex_info->ExceptionRecord;
+  if (record->ExceptionCode == EXCEPTION_ACCESS_VIOLATION &&
+      record->NumberParameters >= 2 &&
+      record->ExceptionInformation[0] == 1 &&
+      Memory::HandleWriteFault((void*)record->ExceptionInformation[1])) {
+    // Page is writable again; retry the store.
+    return EXCEPTION_CONTINUE_EXECUTION;
+  }
+  return EXCEPTION_CONTINUE_SEARCH;
+}
+
+}  // namespace
+
+
+size_t Memory::QueryHostPageSize() {
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return si.dwPageSize;
+}
+
+bool Memory::ProtectHostPages(void* p, size_t size,
+                              bool writable, bool executable) {
+  DWORD protect;
+  if (executable) {
+    protect = writable ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ;
+  } else {
+    protect = writable ? PAGE_READWRITE : PAGE_READONLY;
+  }
+  DWORD old_protect;
+  return VirtualProtect(p, size, protect, &old_protect) == TRUE;
+}
+
+void Memory::InstallWriteFaultHandler() {
+  // First in line, so watches are handled before any debugger-ish handlers.
+  AddVectoredExceptionHandler(1, WriteFaultHandler);
+}
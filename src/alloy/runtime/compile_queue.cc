@@ -0,0 +1,172 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/runtime/compile_queue.h>
+
+#include <alloy/runtime/runtime.h>
+#include <alloy/runtime/symbol_info.h>
+
+using namespace alloy;
+using namespace alloy::runtime;
+
+
+CompileQueue::CompileQueue(Runtime* runtime) :
+    runtime_(runtime),
+    next_sequence_(0), busy_count_(0), idle_waiter_count_(0),
+    shutting_down_(false),
+    compiled_count_(0), skipped_count_(0), failed_count_(0),
+    promoted_count_(0) {
+  lock_ = AllocMutex(10000);
+  work_semaphore_ = AllocSemaphore();
+  idle_semaphore_ = AllocSemaphore();
+  exit_semaphore_ = AllocSemaphore();
+}
+
+CompileQueue::~CompileQueue() {
+  Shutdown();
+  FreeSemaphore(exit_semaphore_);
+  FreeSemaphore(idle_semaphore_);
+  FreeSemaphore(work_semaphore_);
+  FreeMutex(lock_);
+}
+
+int CompileQueue::Initialize(uint32_t thread_count) {
+  for (uint32_t n = 0; n < thread_count; n++) {
+    xe_thread_ref thread = xe_thread_create(
+        "Alloy Compile Worker", WorkerThunk, this);
+    if (xe_thread_start(thread)) {
+      xe_thread_release(thread);
+      return 1;
+    }
+    workers_.push_back(thread);
+  }
+  return 0;
+}
+
+void CompileQueue::Shutdown() {
+  LockMutex(lock_);
+  shutting_down_ = true;
+  while (queue_.size()) {
+    queue_.pop();
+  }
+  if (idle_waiter_count_) {
+    PostSemaphore(idle_semaphore_, idle_waiter_count_);
+    idle_waiter_count_ = 0;
+  }
+  UnlockMutex(lock_);
+
+  // Workers are started detached, so wait on their exit signal rather than
+  // joining them.
+  if (workers_.size()) {
+    PostSemaphore(work_semaphore_, (uint32_t)workers_.size());
+    for (size_t n = 0; n < workers_.size(); n++) {
+      WaitSemaphore(exit_semaphore_);
+    }
+  }
+  for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+    xe_thread_release(*it);
+  }
+  workers_.clear();
+}
+
+void CompileQueue::Push(
+    FunctionInfo* symbol_info, Priority priority, bool promote) {
+  LockMutex(lock_);
+  if (shutting_down_) {
+    UnlockMutex(lock_);
+    return;
+  }
+  WorkItem item;
+  item.priority = priority;
+  item.sequence = next_sequence_++;
+  item.symbol_info = symbol_info;
+  item.promote = promote;
+  queue_.push(item);
+  UnlockMutex(lock_);
+  PostSemaphore(work_semaphore_);
+}
+
+void CompileQueue::Enqueue(FunctionInfo* symbol_info, Priority priority) {
+  if (symbol_info->behavior() == FunctionInfo::BEHAVIOR_EXTERN) {
+    // Nothing to compile.
+    return;
+  }
+  Push(symbol_info, priority, false);
+}
+
+void CompileQueue::EnqueuePromotion(FunctionInfo* symbol_info) {
+  Push(symbol_info, PRIORITY_PROMOTION, true);
+}
+
+void CompileQueue::WaitForIdle() {
+  LockMutex(lock_);
+  if (shutting_down_ || (!queue_.size() && !busy_count_)) {
+    UnlockMutex(lock_);
+    return;
+  }
+  idle_waiter_count_++;
+  UnlockMutex(lock_);
+  WaitSemaphore(idle_semaphore_);
+}
+
+void CompileQueue::WorkerThunk(void* param) {
+  CompileQueue* queue = (CompileQueue*)param;
+  queue->WorkerMain();
+  PostSemaphore(queue->exit_semaphore_);
+}
+
+void CompileQueue::WorkerMain() {
+  while (true) {
+    WaitSemaphore(work_semaphore_);
+    LockMutex(lock_);
+    if (shutting_down_) {
+      UnlockMutex(lock_);
+      break;
+    }
+    if (!queue_.size()) {
+      // Cleared by a shutdown that hasn't woken us yet.
+      UnlockMutex(lock_);
+      continue;
+    }
+    FunctionInfo* symbol_info = queue_.top().symbol_info;
+    bool promote = queue_.top().promote;
+    queue_.pop();
+    busy_count_++;
+    UnlockMutex(lock_);
+
+    // The same function may be queued more than once (or demanded by a guest
+    // thread in the meantime) - only declared, undefined ones need work.
+    // If a guest thread is defining it right now DemandFunction would just
+    // wait on it, which is a waste of a worker.
+    if (promote) {
+      if (runtime_->PromoteFunction(symbol_info)) {
+        xe_atomic_inc_32(&failed_count_);
+      } else {
+        xe_atomic_inc_32(&promoted_count_);
+      }
+    } else if (symbol_info->status() == SymbolInfo::STATUS_DECLARED) {
+      Function* fn = NULL;
+      if (runtime_->DemandFunction(symbol_info, &fn)) {
+        xe_atomic_inc_32(&failed_count_);
+      } else {
+        xe_atomic_inc_32(&compiled_count_);
+      }
+    } else {
+      xe_atomic_inc_32(&skipped_count_);
+    }
+
+    LockMutex(lock_);
+    busy_count_--;
+    if (!queue_.size() && !busy_count_ && idle_waiter_count_) {
+      PostSemaphore(idle_semaphore_, idle_waiter_count_);
+      idle_waiter_count_ = 0;
+    }
+    UnlockMutex(lock_);
+  }
+}
@@ -0,0 +1,113 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_RUNTIME_COMPILE_QUEUE_H_
+#define ALLOY_RUNTIME_COMPILE_QUEUE_H_
+
+#include <alloy/core.h>
+
+#include <queue>
+
+#include <xenia/core/thread.h>
+
+
+namespace alloy {
+namespace runtime {
+
+class FunctionInfo;
+class Runtime;
+
+
+// Background compilation service.
+// Worker threads pull FunctionInfos off a priority queue and define them
+// through the runtime, so that by the time guest code calls them they are
+// (hopefully) already translated. Threads that demand a function that isn't
+// ready still define it themselves, or wait on it if a worker beat them.
+class CompileQueue {
+public:
+  // Functions demanded by guest threads are defined on those threads and
+  // never go through the queue.
+  enum Priority {
+    // Referenced by a function that has been translated (likely a callee).
+    PRIORITY_PREDICTED    = 0,
+    // Hot function running in a lower tier.
+    PRIORITY_PROMOTION    = 1,
+    // Declared somewhere in a module, may never be called.
+    PRIORITY_SPECULATIVE  = 2,
+  };
+
+public:
+  CompileQueue(Runtime* runtime);
+  ~CompileQueue();
+
+  int Initialize(uint32_t thread_count);
+  void Shutdown();
+
+  void Enqueue(FunctionInfo* symbol_info, Priority priority);
+  // Recompiles an already defined function with the runtime's tier 1
+  // backend and swaps it in.
+  void EnqueuePromotion(FunctionInfo* symbol_info);
+  // Blocks until the queue is empty and all workers are idle.
+  void WaitForIdle();
+
+  uint32_t compiled_count() const { return compiled_count_; }
+  uint32_t skipped_count() const { return skipped_count_; }
+  uint32_t failed_count() const { return failed_count_; }
+  uint32_t promoted_count() const { return promoted_count_; }
+
+private:
+  static void WorkerThunk(void* param);
+  void WorkerMain();
+  void Push(FunctionInfo* symbol_info, Priority priority, bool promote);
+
+private:
+  typedef struct {
+    Priority      priority;
+    uint64_t      sequence;
+    FunctionInfo* symbol_info;
+    bool          promote;
+  } WorkItem;
+  struct WorkItemCompare {
+    bool operator()(const WorkItem& a, const WorkItem& b) const {
+      // Lowest priority value first, FIFO within a priority.
+      if (a.priority != b.priority) {
+        return a.priority > b.priority;
+      }
+      return a.sequence > b.sequence;
+    }
+  };
+
+  Runtime*  runtime_;
+
+  Mutex*    lock_;
+  // Posted once per queued item (and once per worker on shutdown).
+  Semaphore* work_semaphore_;
+  // Posted for each WaitForIdle caller once the queue drains.
+  Semaphore* idle_semaphore_;
+  // Posted by each worker as it exits.
+  Semaphore* exit_semaphore_;
+  std::priority_queue<WorkItem, std::vector<WorkItem>, WorkItemCompare> queue_;
+  uint64_t  next_sequence_;
+  uint32_t  busy_count_;
+  uint32_t  idle_waiter_count_;
+  bool      shutting_down_;
+  std::vector<xe_thread_ref> workers_;
+
+  volatile uint32_t compiled_count_;
+  volatile uint32_t skipped_count_;
+  volatile uint32_t failed_count_;
+  volatile uint32_t promoted_count_;
+};
+
+
+}  // namespace runtime
+}  // namespace alloy
+
+
+#endif  // ALLOY_RUNTIME_COMPILE_QUEUE_H_
@@ -9,79 +9,176 @@
 
 #include <alloy/runtime/entry_table.h>
 
+#include <algorithm>
+
 using namespace alloy;
 using namespace alloy::runtime;
 
 
 EntryTable::EntryTable() {
   lock_ = AllocMutex(10000);
+  pages_ = (Page* volatile*)xe_calloc(kPageCount * sizeof(Page*));
 }
 
 EntryTable::~EntryTable() {
   LockMutex(lock_);
-  EntryMap::iterator it = map_.begin();
-  for (; it != map_.end(); ++it) {
-    Entry* entry = it->second;
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    Entry* entry = *it;
     delete entry;
   }
+  entries_.clear();
+  overflow_map_.clear();
+  range_map_.clear();
+  for (uint32_t n = 0; n < kPageCount; n++) {
+    if (pages_[n]) {
+      xe_free((void*)pages_[n]);
+    }
+  }
+  xe_free((void*)pages_);
   UnlockMutex(lock_);
   FreeMutex(lock_);
 }
 
-Entry* EntryTable::Get(uint64_t address) {
+Entry* volatile* EntryTable::LookupSlot(uint64_t address) {
+  if ((address & 0x3) || (address >> 32)) {
+    return NULL;
+  }
+  Page* page = pages_[address >> kPageShift];
+  if (!page) {
+    return NULL;
+  }
+  return &(*page)[(address & ((1 << kPageShift) - 1)) >> 2];
+}
+
+Entry* EntryTable::LookupEntry(uint64_t address) {
+  Entry* volatile* slot = LookupSlot(address);
+  if (slot) {
+    return *slot;
+  }
+  if (!(address & 0x3) && !(address >> 32)) {
+    // Page not yet allocated, so nothing is there.
+    return NULL;
+  }
   LockMutex(lock_);
-  EntryMap::const_iterator it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : NULL;
+  EntryMap::const_iterator it = overflow_map_.find(address);
+  Entry* entry = it != overflow_map_.end() ? it->second : NULL;
+  UnlockMutex(lock_);
+  return entry;
+}
+
+Entry* volatile* EntryTable::EnsureSlot(uint64_t address) {
+  // Must be called with lock_ held.
+  if ((address & 0x3) || (address >> 32)) {
+    return NULL;
+  }
+  uint32_t page_index = (uint32_t)(address >> kPageShift);
+  Page* page = pages_[page_index];
+  if (!page) {
+    page = (Page*)xe_calloc(sizeof(Page));
+    // Make sure the zeroed page is visible before the pointer to it.
+    xe_memory_barrier();
+    pages_[page_index] = page;
+  }
+  return &(*page)[(address & ((1 << kPageShift) - 1)) >> 2];
+}
+
+Entry* EntryTable::Get(uint64_t address) {
+  Entry* entry = LookupEntry(address);
   if (entry) {
     // TODO(benvanik): wait if needed?
     if (entry->status != Entry::STATUS_READY) {
       entry = NULL;
     }
   }
-  UnlockMutex(lock_);
   return entry;
 }
 
 Entry::Status EntryTable::GetOrCreate(uint64_t address, Entry** out_entry) {
-  LockMutex(lock_);
-  EntryMap::const_iterator it = map_.find(address);
-  Entry* entry = it != map_.end() ? it->second : NULL;
-  Entry::Status status;
-  if (entry) {
-    // If we aren't ready yet spin and wait.
-    if (entry->status == Entry::STATUS_COMPILING) {
-      // Still compiling, so spin.
-      do {
-        UnlockMutex(lock_);
-        // TODO(benvanik): sleep for less time?
-        Sleep(0);
-        LockMutex(lock_);
-      } while (entry->status == Entry::STATUS_COMPILING);
+  // Fast path: already created, no lock required.
+  Entry* entry = LookupEntry(address);
+  if (!entry) {
+    LockMutex(lock_);
+    // Someone may have beaten us to it while we were waiting.
+    Entry* volatile* slot = EnsureSlot(address);
+    if (slot) {
+      entry = *slot;
+    } else {
+      EntryMap::const_iterator it = overflow_map_.find(address);
+      entry = it != overflow_map_.end() ? it->second : NULL;
     }
-    status = entry->status;
-  } else {
-    // Create and return for initialization.
-    entry = new Entry();
-    entry->address = address;
-    entry->end_address = 0;
-    entry->status = Entry::STATUS_COMPILING;
-    entry->function = 0;
-    map_[address] = entry;
-    status = Entry::STATUS_NEW;
+    if (!entry) {
+      // Create and return for initialization.
+      entry = new Entry();
+      entry->address = address;
+      entry->end_address = 0;
+      entry->status = Entry::STATUS_COMPILING;
+      entry->function = 0;
+      entries_.push_back(entry);
+      // Entry must be fully initialized before it can be seen by lookups.
+      xe_memory_barrier();
+      if (slot) {
+        *slot = entry;
+      } else {
+        overflow_map_[address] = entry;
+      }
+      UnlockMutex(lock_);
+      *out_entry = entry;
+      return Entry::STATUS_NEW;
+    }
+    UnlockMutex(lock_);
+  }
+
+  // If we aren't ready yet spin and wait.
+  while (entry->status == Entry::STATUS_COMPILING) {
+    // Still compiling, so spin.
+    // TODO(benvanik): sleep for less time?
+    Sleep(0);
   }
-  UnlockMutex(lock_);
   *out_entry = entry;
-  return status;
+  return entry->status;
+}
+
+void EntryTable::Index(Entry* entry) {
+  // Functions without a known end only cover their first bucket.
+  uint64_t end_address = MAX(entry->address, entry->end_address);
+  LockMutex(lock_);
+  for (uint64_t n = entry->address >> kRangeShift;
+       n <= end_address >> kRangeShift; n++) {
+    range_map_[n].push_back(entry);
+  }
+  UnlockMutex(lock_);
+}
+
+void EntryTable::RemoveFromIndex(Entry* entry) {
+  // Must be called with lock_ held.
+  uint64_t end_address = MAX(entry->address, entry->end_address);
+  for (uint64_t n = entry->address >> kRangeShift;
+       n <= end_address >> kRangeShift; n++) {
+    RangeMap::iterator it = range_map_.find(n);
+    if (it == range_map_.end()) {
+      continue;
+    }
+    std::vector<Entry*>& bucket = it->second;
+    bucket.erase(std::remove(bucket.begin(), bucket.end(), entry),
+                 bucket.end());
+    if (bucket.empty()) {
+      range_map_.erase(it);
+    }
+  }
 }
 
 std::vector<Function*> EntryTable::FindWithAddress(uint64_t address) {
   std::vector<Function*> fns;
   LockMutex(lock_);
-  for (auto it = map_.begin(); it != map_.end(); ++it) {
-    Entry* entry = it->second;
-    if (address >= entry->address &&
-        address <= entry->end_address) {
-      if (entry->status == Entry::STATUS_READY) {
+  RangeMap::const_iterator it = range_map_.find(address >> kRangeShift);
+  if (it != range_map_.end()) {
+    const std::vector<Entry*>& bucket = it->second;
+    for (auto entry_it = bucket.begin(); entry_it != bucket.end();
+         ++entry_it) {
+      Entry* entry = *entry_it;
+      if (address >= entry->address &&
+          address <= entry->end_address &&
+          entry->status == Entry::STATUS_READY) {
         fns.push_back(entry->function);
       }
     }
@@ -89,3 +186,54 @@ std::vector<Function*> EntryTable::FindWithAddress(uint64_t address) {
   UnlockMutex(lock_);
   return fns;
 }
+
+std::vector<Entry*> EntryTable::Invalidate(
+    uint64_t address, uint64_t end_address) {
+  std::vector<Entry*> removed;
+  LockMutex(lock_);
+  for (uint64_t n = address >> kRangeShift;
+       n <= end_address >> kRangeShift; n++) {
+    RangeMap::const_iterator it = range_map_.find(n);
+    if (it == range_map_.end()) {
+      continue;
+    }
+    const std::vector<Entry*>& bucket = it->second;
+    for (auto entry_it = bucket.begin(); entry_it != bucket.end();
+         ++entry_it) {
+      Entry* entry = *entry_it;
+      if (entry->address <= end_address &&
+          MAX(entry->address, entry->end_address) >= address &&
+          std::find(removed.begin(), removed.end(), entry) == removed.end()) {
+        removed.push_back(entry);
+      }
+    }
+  }
+  for (auto it = removed.begin(); it != removed.end(); ++it) {
+    RemoveEntry(*it);
+  }
+  UnlockMutex(lock_);
+  return removed;
+}
+
+void EntryTable::Remove(Entry* entry) {
+  LockMutex(lock_);
+  RemoveEntry(entry);
+  UnlockMutex(lock_);
+}
+
+void EntryTable::RemoveEntry(Entry* entry) {
+  // Must be called with lock_ held.
+  RemoveFromIndex(entry);
+  // New lookups miss and create a fresh entry. Another may already have.
+  Entry* volatile* slot = LookupSlot(entry->address);
+  if (slot) {
+    if (*slot == entry) {
+      *slot = NULL;
+    }
+  } else {
+    EntryMap::iterator it = overflow_map_.find(entry->address);
+    if (it != overflow_map_.end() && it->second == entry) {
+      overflow_map_.erase(it);
+    }
+  }
+}
@@ -29,7 +29,7 @@ typedef struct Entry_t {
 
   uint64_t  address;
   uint64_t  end_address;
-  Status    status;
+  volatile Status status;
   Function* function;
 } Entry;
 
@@ -42,13 +42,45 @@ public:
   Entry* Get(uint64_t address);
   Entry::Status GetOrCreate(uint64_t address, Entry** out_entry);
 
+  // Adds an entry to the address range index. Must be called once
+  // end_address is known and before the entry is made ready, so an
+  // Invalidate racing with that can't miss it.
+  void Index(Entry* entry);
   std::vector<Function*> FindWithAddress(uint64_t address);
+  // Removes all indexed entries overlapping [address, end_address] so the next
+  // GetOrCreate of their address starts over. The removed entries remain
+  // valid (other threads may be using them) until the table is destroyed.
+  std::vector<Entry*> Invalidate(uint64_t address, uint64_t end_address);
+  // Removes a single entry, as Invalidate does, if it's still in the table.
+  void Remove(Entry* entry);
+
+private:
+  // Guest code lives in the low 4GB and is 4b aligned, so entries are found
+  // through a two level table of (address >> 16) pages each holding a slot
+  // per instruction. Slots are only ever written under lock_ and are
+  // published with a barrier, so lookups of existing entries never lock.
+  static const uint32_t kPageShift = 16;
+  static const uint32_t kPageCount = 1 << (32 - kPageShift);
+  static const uint32_t kSlotCount = 1 << (kPageShift - 2);
+  typedef Entry* volatile Page[kSlotCount];
+
+  Entry* volatile* LookupSlot(uint64_t address);
+  Entry* LookupEntry(uint64_t address);
+  Entry* volatile* EnsureSlot(uint64_t address);
+  void RemoveFromIndex(Entry* entry);
+  void RemoveEntry(Entry* entry);
 
 private:
-  // TODO(benvanik): replace with a better data structure.
   Mutex* lock_;
+  Page* volatile* pages_;
+  // Addresses that don't fit in the page table (unaligned/out of range).
   typedef std::tr1::unordered_map<uint64_t, Entry*> EntryMap;
-  EntryMap map_;
+  EntryMap overflow_map_;
+  // Ready entries by each (address >> kRangeShift) bucket they overlap.
+  static const uint32_t kRangeShift = 12;
+  typedef std::tr1::unordered_map<uint64_t, std::vector<Entry*> > RangeMap;
+  RangeMap range_map_;
+  std::vector<Entry*> entries_;
 };
 
 
@@ -9,7 +9,10 @@
 
 #include <alloy/runtime/function.h>
 
+#include <algorithm>
+
 #include <alloy/runtime/debugger.h>
+#include <alloy/runtime/runtime.h>
 #include <alloy/runtime/symbol_info.h>
 #include <alloy/runtime/thread_state.h>
 
@@ -19,15 +22,88 @@ using namespace alloy::runtime;
 
 Function::Function(FunctionInfo* symbol_info) :
     address_(symbol_info->address()),
-    symbol_info_(symbol_info), debug_info_(0) {
+    symbol_info_(symbol_info), debug_info_(0), source_hash_(0),
+    inline_cache_count_(0), inline_caches_(0),
+    invocation_count_(0), backedge_count_(0), promotion_requested_(0),
+    invalidated_(0), retired_(0), active_count_(0) {
   // TODO(benvanik): create on demand?
   lock_ = AllocMutex();
 }
 
 Function::~Function() {
+  // Revert anyone calling us directly and stop callees from trying to
+  // revert our (soon to be gone) call sites.
+  UnlinkCallers();
+  LockMutex(lock_);
+  std::vector<Function*> callees;
+  callees.swap(linked_callees_);
+  UnlockMutex(lock_);
+  for (auto it = callees.begin(); it != callees.end(); ++it) {
+    if (*it != this) {
+      (*it)->RemoveLinkedCallSites(this);
+    }
+  }
+
+  xe_free(inline_caches_);
   FreeMutex(lock_);
 }
 
+int Function::LinkCallSite(Function* caller, void* call_site) {
+  LinkedCallSite entry;
+  entry.caller = caller;
+  entry.call_site = call_site;
+  LockMutex(lock_);
+  linked_call_sites_.push_back(entry);
+  UnlockMutex(lock_);
+
+  LockMutex(caller->lock_);
+  bool found = false;
+  for (auto it = caller->linked_callees_.begin();
+       it != caller->linked_callees_.end(); ++it) {
+    if (*it == this) {
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    caller->linked_callees_.push_back(this);
+  }
+  UnlockMutex(caller->lock_);
+  return 0;
+}
+
+void Function::UnlinkCallers() {
+  LockMutex(lock_);
+  std::vector<LinkedCallSite> call_sites;
+  call_sites.swap(linked_call_sites_);
+  UnlockMutex(lock_);
+  for (auto it = call_sites.begin(); it != call_sites.end(); ++it) {
+    Function* caller = it->caller;
+    caller->UnlinkCallSite(it->call_site);
+    // So the caller doesn't reach back in here once we're freed.
+    LockMutex(caller->lock_);
+    auto callee = std::find(caller->linked_callees_.begin(),
+                            caller->linked_callees_.end(), this);
+    if (callee != caller->linked_callees_.end()) {
+      caller->linked_callees_.erase(callee);
+    }
+    UnlockMutex(caller->lock_);
+  }
+}
+
+void Function::RemoveLinkedCallSites(Function* caller) {
+  LockMutex(lock_);
+  for (auto it = linked_call_sites_.begin();
+       it != linked_call_sites_.end();) {
+    if (it->caller == caller) {
+      it = linked_call_sites_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  UnlockMutex(lock_);
+}
+
 int Function::AddBreakpoint(Breakpoint* breakpoint) {
   LockMutex(lock_);
   bool found = false;
@@ -59,6 +135,20 @@ int Function::RemoveBreakpoint(Breakpoint* breakpoint) {
   return found ? 0 : 1;
 }
 
+void Function::EvictFromInlineCaches(
+    const std::vector<Function*>& functions) {
+  for (size_t n = 0; n < inline_cache_count_; n++) {
+    InlineCache& cache = inline_caches_[n];
+    for (size_t m = 0; m < InlineCache::kEntryCount; m++) {
+      Function* function = cache.entries[m].function;
+      if (function && std::find(functions.begin(), functions.end(),
+                                function) != functions.end()) {
+        cache.entries[m].function = NULL;
+      }
+    }
+  }
+}
+
 Breakpoint* Function::FindBreakpoint(uint64_t address) {
   LockMutex(lock_);
   Breakpoint* result = NULL;
@@ -84,9 +174,16 @@ int Function::Call(ThreadState* thread_state, uint64_t return_address) {
   if (symbol_info_->behavior() == FunctionInfo::BEHAVIOR_EXTERN) {
     auto handler = symbol_info_->extern_handler();
     if (handler) {
+      // Host code only gets at functions by resolving them, which marks
+      // the thread as holding on to them again, so while it runs nothing
+      // needs to wait on this thread to reclaim retired ones. That includes
+      // this function, so it mustn't be touched after the handler.
+      Runtime* runtime = thread_state->runtime();
+      thread_state->set_retire_epoch(0);
       handler(thread_state->raw_context(),
               symbol_info_->extern_arg0(),
               symbol_info_->extern_arg1());
+      runtime->PublishRetireEpoch(thread_state);
     } else {
       XELOGW("undefined extern call to %.8X %s",
              symbol_info_->address(),
@@ -94,7 +191,7 @@ int Function::Call(ThreadState* thread_state, uint64_t return_address) {
       result = 1;
     }
   } else {
-    CallImpl(thread_state, return_address);
+    CallDirect(thread_state, return_address);
   }
 
   if (original_thread_state != thread_state) {
@@ -102,3 +199,15 @@ int Function::Call(ThreadState* thread_state, uint64_t return_address) {
   }
   return result;
 }
+
+int Function::CallDirect(ThreadState* thread_state, uint64_t return_address) {
+  // Counted before the thread says it's done with anything it resolved, so
+  // the function is never without one or the other while it's entered.
+  Runtime* runtime = thread_state->runtime();
+  Acquire();
+  runtime->PublishRetireEpoch(thread_state);
+  int result = CallImpl(thread_state, return_address);
+  Release();
+  runtime->PublishRetireEpoch(thread_state);
+  return result;
+}
@@ -12,6 +12,7 @@
 
 #include <alloy/core.h>
 #include <alloy/runtime/debug_info.h>
+#include <alloy/runtime/inline_cache.h>
 
 
 namespace alloy {
@@ -33,12 +34,66 @@ public:
   DebugInfo* debug_info() const { return debug_info_; }
   void set_debug_info(DebugInfo* debug_info) { debug_info_ = debug_info; }
 
+  // Execution counters maintained by lower tier backends for promotion.
+  uint32_t invocation_count() const { return invocation_count_; }
+  uint32_t backedge_count() const { return backedge_count_; }
+  // Returns true the first time it's called.
+  bool MarkPromotionRequested() {
+    return xe_atomic_cas_32(0, 1, &promotion_requested_);
+  }
+
+  // Hash of the guest code as it was translated, to tell if it has since
+  // changed. 0 if unknown.
+  uint64_t source_hash() const { return source_hash_; }
+  void set_source_hash(uint64_t source_hash) { source_hash_ = source_hash; }
+
+  // Set once the guest code the function was translated from has changed.
+  // Invalidated functions are never called through the runtime again.
+  // Returns true for the caller that invalidated it.
+  bool is_invalidated() const { return invalidated_ != 0; }
+  bool MarkInvalidated() { return xe_atomic_cas_32(0, 1, &invalidated_); }
+  // Set once another version (promoted or retranslated) has replaced this
+  // one, so cached pointers to it should be refreshed. Returns true for the
+  // caller that retired it, which then owns keeping it alive.
+  bool is_retired() const { return retired_ != 0; }
+  bool MarkRetired() { return xe_atomic_cas_32(0, 1, &retired_); }
+
+  // Calls into the function in progress on any thread, plus anyone else
+  // holding on to it. Retired functions are only freed once this is 0.
+  uint32_t active_count() const { return active_count_; }
+  void Acquire() { xe_atomic_inc_32(&active_count_); }
+  void Release() { xe_atomic_dec_32(&active_count_); }
+
+  // Indirect call site caches, if the backend uses them.
+  size_t inline_cache_count() const { return inline_cache_count_; }
+  const InlineCache* inline_cache(size_t n) const {
+    return &inline_caches_[n];
+  }
+  // Drops any of the given functions from all of the inline caches.
+  void EvictFromInlineCaches(const std::vector<Function*>& functions);
+
   int AddBreakpoint(Breakpoint* breakpoint);
   int RemoveBreakpoint(Breakpoint* breakpoint);
 
   int Call(ThreadState* thread_state, uint64_t return_address);
+  // Calls into the function without rebinding the thread state or checking
+  // for externs. Only for use by linked call sites in guest code that is
+  // already running on thread_state.
+  int CallDirect(ThreadState* thread_state, uint64_t return_address);
+
+  // Records that call_site in caller has been patched to call this function
+  // directly. The site is reverted with UnlinkCallSite if this function is
+  // unlinked or destroyed.
+  int LinkCallSite(Function* caller, void* call_site);
+  // Reverts all call sites that were linked to this function. Callers
+  // must not be freed meanwhile, so the runtime serializes this with
+  // reclaiming retired functions.
+  void UnlinkCallers();
 
 protected:
+  void RemoveLinkedCallSites(Function* caller);
+  virtual void UnlinkCallSite(void* call_site) {}
+
   Breakpoint* FindBreakpoint(uint64_t address);
   virtual int AddBreakpointImpl(Breakpoint* breakpoint) { return 0; }
   virtual int RemoveBreakpointImpl(Breakpoint* breakpoint) { return 0; }
@@ -49,10 +104,29 @@ protected:
   uint64_t    address_;
   FunctionInfo* symbol_info_;
   DebugInfo*  debug_info_;
+  uint64_t    source_hash_;
+
+  size_t      inline_cache_count_;
+  InlineCache* inline_caches_;
+
+  // Not atomic; only approximate counts are needed.
+  volatile uint32_t invocation_count_;
+  volatile uint32_t backedge_count_;
+  volatile uint32_t promotion_requested_;
+  volatile uint32_t invalidated_;
+  volatile uint32_t retired_;
+  volatile uint32_t active_count_;
 
   // TODO(benvanik): move elsewhere? DebugData?
   Mutex*      lock_;
   std::vector<Breakpoint*> breakpoints_;
+
+  typedef struct {
+    Function* caller;
+    void*     call_site;
+  } LinkedCallSite;
+  std::vector<LinkedCallSite> linked_call_sites_;
+  std::vector<Function*> linked_callees_;
 };
 
 
@@ -0,0 +1,88 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_RUNTIME_INLINE_CACHE_H_
+#define ALLOY_RUNTIME_INLINE_CACHE_H_
+
+#include <alloy/core.h>
+
+
+namespace alloy {
+namespace runtime {
+
+class Function;
+
+
+// Per-call-site cache of the last few targets of an indirect call.
+// Slots are claimed once (address 0 -> target) and their address is never
+// overwritten, so a reader that sees a matching address and a non-NULL
+// function can use it without locking. The function may be swapped by
+// Replace when the cached one is retired, or cleared by the runtime before
+// the retired one is freed. Once all slots are taken the site
+// is megamorphic and every miss goes to the runtime.
+// Hit/miss counts are only maintained with --profile_inline_caches, so the
+// shared cache line isn't written on every hit otherwise.
+typedef struct InlineCache_s {
+  static const size_t kEntryCount = 4;
+
+  struct {
+    volatile uint32_t address;
+    Function* volatile function;
+  } entries[kEntryCount];
+
+  uint64_t source_address;
+  volatile uint32_t hit_count;
+  volatile uint32_t miss_count;
+
+  Function* Lookup(uint64_t address) {
+    for (size_t n = 0; n < kEntryCount; n++) {
+      uint32_t entry_address = entries[n].address;
+      if (entry_address == address) {
+        return entries[n].function;
+      } else if (!entry_address) {
+        break;
+      }
+    }
+    return NULL;
+  }
+
+  void Update(uint64_t address, Function* function) {
+    for (size_t n = 0; n < kEntryCount; n++) {
+      if (entries[n].address == address) {
+        // Another thread already claimed it (and will fill it).
+        return;
+      }
+      if (xe_atomic_cas_32(0, (uint32_t)address, &entries[n].address)) {
+        entries[n].function = function;
+        return;
+      }
+    }
+  }
+
+  bool Replace(uint64_t address, Function* function) {
+    for (size_t n = 0; n < kEntryCount; n++) {
+      if (entries[n].address == address) {
+        entries[n].function = function;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool is_megamorphic() const {
+    return entries[kEntryCount - 1].address != 0;
+  }
+} InlineCache;
+
+
+}  // namespace runtime
+}  // namespace alloy
+
+
+#endif  // ALLOY_RUNTIME_INLINE_CACHE_H_
@@ -160,6 +160,14 @@ SymbolInfo::Status Module::DefineVariable(VariableInfo* symbol_info) {
   return DefineSymbol((SymbolInfo*)symbol_info);
 }
 
+void Module::UndefineFunction(FunctionInfo* symbol_info) {
+  LockMutex(lock_);
+  if (symbol_info->status() == SymbolInfo::STATUS_DEFINED) {
+    symbol_info->set_status(SymbolInfo::STATUS_DECLARED);
+  }
+  UnlockMutex(lock_);
+}
+
 void Module::ForEachFunction(std::function<void (FunctionInfo*)> callback) {
   LockMutex(lock_);
   for (auto it = list_.begin(); it != list_.end(); ++it) {
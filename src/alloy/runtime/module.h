@@ -32,6 +32,9 @@ public:
   Memory* memory() const { return memory_; }
 
   virtual const char* name() const = 0;
+  // Identifies the module contents across runs for the translation cache.
+  // 0 if the module can't be cached.
+  virtual uint64_t content_hash() const { return 0; }
 
   virtual bool ContainsAddress(uint64_t address);
 
@@ -43,6 +46,9 @@ public:
 
   SymbolInfo::Status DefineFunction(FunctionInfo* symbol_info);
   SymbolInfo::Status DefineVariable(VariableInfo* symbol_info);
+  // Returns a defined function to declared, so the next DefineFunction
+  // defines it again. Does nothing if it isn't defined.
+  void UndefineFunction(FunctionInfo* symbol_info);
 
   void ForEachFunction(std::function<void (FunctionInfo*)> callback);
   void ForEachFunction(size_t since, size_t& version,
@@ -56,6 +56,21 @@ int RawModule::LoadFile(uint64_t base_address, const char* path) {
   return 0;
 }
 
+int RawModule::LoadData(uint64_t base_address,
+                        const uint8_t* data, size_t length,
+                        const char* name) {
+  base_address_ = memory_->HeapAlloc(base_address, length, MEMORY_FLAG_ZERO);
+  if (!base_address_) {
+    return 1;
+  }
+  xe_copy_struct(memory_->Translate(base_address_), data, length);
+
+  name_ = xestrdupa(name);
+  low_address_ = base_address;
+  high_address_ = base_address + length;
+  return 0;
+}
+
 bool RawModule::ContainsAddress(uint64_t address) {
   return address >= low_address_ && address < high_address_;
 }
@@ -23,6 +23,9 @@ public:
   virtual ~RawModule();
 
   int LoadFile(uint64_t base_address, const char* path);
+  // Copies already big-endian code into memory, as if read from a file.
+  int LoadData(uint64_t base_address, const uint8_t* data, size_t length,
+               const char* name);
 
   virtual const char* name() const { return name_; }
 
@@ -9,8 +9,11 @@
 
 #include <alloy/runtime/runtime.h>
 
+#include <algorithm>
+
 #include <gflags/gflags.h>
 
+#include <alloy/alloy-private.h>
 #include <alloy/runtime/module.h>
 #include <alloy/runtime/tracing.h>
 
@@ -21,17 +24,67 @@ using namespace alloy::runtime;
 
 
 DEFINE_string(runtime_backend, "any",
-              "Runtime backend [any, ivm, x64].");
+              "Runtime backend [any, ivm, x64, tiered].");
+DEFINE_int32(runtime_compile_threads, 0,
+             "Number of background compilation threads, 0 to only compile "
+             "functions when first called.");
+DEFINE_int32(tier_invocation_threshold, 1000,
+             "Calls before a function is promoted to the next tier.");
+DEFINE_int32(tier_backedge_threshold, 100000,
+             "Loop back-edges before a function is promoted to the next tier.");
+DEFINE_bool(dump_tier_counters, false,
+            "Dumps per-function tiering counters on shutdown.");
 
 
 Runtime::Runtime(Memory* memory) :
     memory_(memory), debugger_(0), backend_(0), frontend_(0),
+    compile_queue_(0), translation_cache_(0), tier1_backend_(0),
+    tier_invocation_threshold_(0), tier_backedge_threshold_(0),
+    retire_epoch_(1),
+    code_write_count_(0), invalidated_function_count_(0),
     access_callbacks_(0) {
   tracing::Initialize();
   modules_lock_ = AllocMutex(10000);
+  tier_lock_ = AllocMutex(10000);
+  thread_states_lock_ = AllocMutex(10000);
+  code_watch_lock_ = AllocMutex(10000);
 }
 
 Runtime::~Runtime() {
+  // Stop compiling before anything it uses goes away.
+  delete compile_queue_;
+  compile_queue_ = NULL;
+
+  LockMutex(code_watch_lock_);
+  for (auto it = code_watches_.begin(); it != code_watches_.end(); ++it) {
+    memory_->RemoveWriteWatch(it->second);
+  }
+  code_watches_.clear();
+  code_watch_infos_.clear();
+  UnlockMutex(code_watch_lock_);
+  FreeMutex(code_watch_lock_);
+  if (invalidated_function_count_) {
+    XELOGI("Code invalidation: %u writes to translated code, "
+           "%u functions invalidated",
+           code_write_count_, invalidated_function_count_);
+  }
+
+  if (FLAGS_dump_tier_counters && tiering_enabled()) {
+    DumpTierCounters();
+  }
+  if (FLAGS_dump_pass_stats && frontend_) {
+    compiler::Compiler::PassTimingList timings;
+    frontend_->GetTimings(timings);
+    compiler::Compiler::DumpTimings(timings);
+  }
+  for (auto it = retired_functions_.begin();
+       it != retired_functions_.end(); ++it) {
+    delete it->function;
+  }
+  retired_functions_.clear();
+  FreeMutex(tier_lock_);
+  FreeMutex(thread_states_lock_);
+
   LockMutex(modules_lock_);
   for (ModuleList::iterator it = modules_.begin();
        it != modules_.end(); ++it) {
@@ -50,6 +103,7 @@ Runtime::~Runtime() {
   access_callbacks_ = NULL;
 
   delete frontend_;
+  delete tier1_backend_;
   delete backend_;
   delete debugger_;
 
@@ -79,8 +133,15 @@ int Runtime::Initialize(Frontend* frontend, Backend* backend) {
   if (!backend) {
 #if defined(ALLOY_HAS_X64_BACKEND) && ALLOY_HAS_X64_BACKEND
     if (FLAGS_runtime_backend == "x64") {
+#if XE_LIKE_WIN32
       backend = new alloy::backend::x64::X64Backend(
           this);
+#else
+      // Generated code and its thunks follow the Win64 calling convention
+      // (arguments in rcx/rdx/r8, home space) and would corrupt SysV
+      // callers.
+      XELOGE("The x64 backend only supports the Win64 ABI");
+#endif  // XE_LIKE_WIN32
     }
 #endif  // ALLOY_HAS_X64_BACKEND
 #if defined(ALLOY_HAS_IVM_BACKEND) && ALLOY_HAS_IVM_BACKEND
@@ -88,14 +149,26 @@ int Runtime::Initialize(Frontend* frontend, Backend* backend) {
       backend = new alloy::backend::ivm::IVMBackend(
           this);
     }
+#endif  // ALLOY_HAS_IVM_BACKEND
+#if defined(ALLOY_HAS_IVM_BACKEND) && ALLOY_HAS_IVM_BACKEND
+    if (FLAGS_runtime_backend == "tiered") {
+      // Start everything in the interpreter with only the passes needed to
+      // run (fast to generate) and retranslate hot functions with the full
+      // pipeline. x64 doesn't lower most opcodes yet, so both tiers are
+      // IVM; they share the thread stack, so promoted code runs on it as is.
+      backend = new alloy::backend::ivm::IVMBackend(
+          this);
+      tier1_backend_ = new alloy::backend::ivm::IVMBackend(
+          this);
+    }
 #endif  // ALLOY_HAS_IVM_BACKEND
     if (FLAGS_runtime_backend == "any") {
-#if defined(ALLOY_HAS_X64_BACKEND) && ALLOY_HAS_X64_BACKEND
+#if defined(ALLOY_HAS_X64_BACKEND) && ALLOY_HAS_X64_BACKEND && XE_LIKE_WIN32
       if (!backend) {
         backend = new alloy::backend::x64::X64Backend(
             this);
       }
-#endif  // ALLOY_HAS_X64_BACKEND
+#endif  // ALLOY_HAS_X64_BACKEND && XE_LIKE_WIN32
 #if defined(ALLOY_HAS_IVM_BACKEND) && ALLOY_HAS_IVM_BACKEND
       if (!backend) {
         backend = new alloy::backend::ivm::IVMBackend(
@@ -115,12 +188,34 @@ int Runtime::Initialize(Frontend* frontend, Backend* backend) {
   if (result) {
     return result;
   }
+  if (tier1_backend_) {
+    result = tier1_backend_->Initialize();
+    if (result) {
+      return result;
+    }
+    tier_invocation_threshold_ = FLAGS_tier_invocation_threshold;
+    tier_backedge_threshold_ = FLAGS_tier_backedge_threshold;
+  }
 
   result = frontend_->Initialize();
   if (result) {
     return result;
   }
 
+  // Promotion always happens in the background, so tiering needs at least
+  // one compile thread.
+  uint32_t compile_thread_count = FLAGS_runtime_compile_threads;
+  if (tier1_backend_ && !compile_thread_count) {
+    compile_thread_count = 1;
+  }
+  if (compile_thread_count) {
+    compile_queue_ = new CompileQueue(this);
+    result = compile_queue_->Initialize(compile_thread_count);
+    if (result) {
+      return result;
+    }
+  }
+
   return 0;
 }
 
@@ -128,6 +223,16 @@ int Runtime::AddModule(Module* module) {
   LockMutex(modules_lock_);
   modules_.push_back(module);
   UnlockMutex(modules_lock_);
+
+  if (compile_queue_) {
+    // Anything the module declared up front may be needed at some point.
+    module->ForEachFunction([&](FunctionInfo* symbol_info) {
+      if (symbol_info->status() == SymbolInfo::STATUS_DECLARED) {
+        compile_queue_->Enqueue(
+            symbol_info, CompileQueue::PRIORITY_SPECULATIVE);
+      }
+    });
+  }
   return 0;
 }
 
@@ -158,36 +263,103 @@ std::vector<Function*> Runtime::FindFunctionsWithAddress(uint64_t address) {
   return entry_table_.FindWithAddress(address);
 }
 
+void Runtime::AddThreadState(ThreadState* thread_state) {
+  LockMutex(thread_states_lock_);
+  thread_states_.push_back(thread_state);
+  UnlockMutex(thread_states_lock_);
+}
+
+void Runtime::RemoveThreadState(ThreadState* thread_state) {
+  LockMutex(thread_states_lock_);
+  auto it = std::find(thread_states_.begin(), thread_states_.end(),
+                      thread_state);
+  if (it != thread_states_.end()) {
+    thread_states_.erase(it);
+  }
+  UnlockMutex(thread_states_lock_);
+}
+
 int Runtime::ResolveFunction(uint64_t address, Function** out_function) {
   *out_function = NULL;
-  Entry* entry;
-  Entry::Status status = entry_table_.GetOrCreate(address, &entry);
-  if (status == Entry::STATUS_NEW) {
-    // Needs to be generated. We have the 'lock' on it and must do so now.
-  
-    // Grab symbol declaration.
-    FunctionInfo* symbol_info;
-    int result = LookupFunctionInfo(address, &symbol_info);
-    if (result) {
-      return result;
-    }
+  // Host code called from guest code holds on to nothing until now. A
+  // thread that may already hold something keeps its older epoch.
+  ThreadState* thread_state = ThreadState::Get();
+  if (thread_state && !thread_state->retire_epoch()) {
+    PublishRetireEpoch(thread_state);
+  }
+  // Writes to code since the last call may invalidate what's found here.
+  CheckCodeWrites();
+  while (true) {
+    Entry* entry;
+    Entry::Status status = entry_table_.GetOrCreate(address, &entry);
+    if (status == Entry::STATUS_NEW) {
+      // Needs to be generated. We have the 'lock' on it and must do so now.
+
+      // Grab symbol declaration.
+      FunctionInfo* symbol_info;
+      int result = LookupFunctionInfo(address, &symbol_info);
+      if (result) {
+        return result;
+      }
 
-    result = DemandFunction(symbol_info, &entry->function);
-    if (result) {
-      entry->status = Entry::STATUS_FAILED;
-      return result;
+      result = DemandFunction(symbol_info, &entry->function);
+      if (result) {
+        entry->status = Entry::STATUS_FAILED;
+        return result;
+      }
+      entry->end_address = symbol_info->end_address();
+      // Indexed before it's ready so invalidations can't miss it. Lookups
+      // don't lock, so the function must be visible before the status.
+      entry_table_.Index(entry);
+      xe_memory_barrier();
+      status = entry->status = Entry::STATUS_READY;
+    }
+    if (status != Entry::STATUS_READY) {
+      // Failed or bad state.
+      return 1;
     }
-    entry->end_address = symbol_info->end_address();
-    status = entry->status = Entry::STATUS_READY;
+    Function* function = entry->function;
+    if (function && !function->is_invalidated() && !function->is_retired()) {
+      // Ready to use.
+      *out_function = function;
+      return 0;
+    }
+    // The code changed since it was translated (or while it was being
+    // defined by someone else) or it was promoted, and the entry may not
+    // have been dropped or updated yet if that raced with it being made
+    // ready.
+    entry_table_.Remove(entry);
   }
-  if (status == Entry::STATUS_READY) {
-    // Ready to use.
-    *out_function = entry->function;
+}
+
+int Runtime::ResolveFunction(uint64_t address, InlineCache* cache,
+                             Function** out_function) {
+  CheckCodeWrites();
+  // Fast path: seen from this call site before.
+  Function* fn = cache->Lookup(address);
+  if (fn && !fn->is_retired()) {
+    if (FLAGS_profile_inline_caches) {
+      xe_atomic_inc_32(&cache->hit_count);
+    }
+    *out_function = fn;
     return 0;
-  } else {
-    // Failed or bad state.
-    return 1;
   }
+  if (FLAGS_profile_inline_caches) {
+    xe_atomic_inc_32(&cache->miss_count);
+  }
+
+  int result = ResolveFunction(address, out_function);
+  if (result) {
+    return result;
+  }
+  // The cached target may have been promoted, its code modified or it may
+  // have been evicted to be freed; point the cache at the current version.
+  // Once full there's nothing left to claim, so don't keep trying.
+  if (!cache->Replace(address, *out_function) &&
+      !cache->is_megamorphic()) {
+    cache->Update(address, *out_function);
+  }
+  return 0;
 }
 
 int Runtime::LookupFunctionInfo(
@@ -233,6 +405,12 @@ int Runtime::LookupFunctionInfo(Module* module, uint64_t address,
       return 1;
     }
     symbol_info->set_status(SymbolInfo::STATUS_DECLARED);
+
+    // Most new declarations come from translating a caller, so there's a
+    // good chance this will be needed soon.
+    if (compile_queue_) {
+      compile_queue_->Enqueue(symbol_info, CompileQueue::PRIORITY_PREDICTED);
+    }
   }
 
   *out_symbol_info = symbol_info;
@@ -250,10 +428,22 @@ int Runtime::DemandFunction(
   if (symbol_status == SymbolInfo::STATUS_NEW) {
     // Symbol is undefined, so define now.
     Function* function = NULL;
-    int result = frontend_->DefineFunction(symbol_info, DEBUG_INFO_DEFAULT, &function);
-    if (result) {
-      symbol_info->set_status(SymbolInfo::STATUS_FAILED);
-      return result;
+    while (true) {
+      int result = frontend_->DefineFunction(
+          symbol_info, DEBUG_INFO_DEFAULT, &function);
+      if (result) {
+        symbol_info->set_status(SymbolInfo::STATUS_FAILED);
+        return result;
+      }
+      if (!FLAGS_invalidate_modified_code ||
+          WatchCode(symbol_info, function)) {
+        break;
+      }
+      // Written while it was being translated. Nothing has seen it yet, and
+      // without the watch nothing can, so it can go right away.
+      UnwatchCode(symbol_info);
+      delete function;
+      function = NULL;
     }
     symbol_info->set_function(function);
 
@@ -261,7 +451,12 @@ int Runtime::DemandFunction(
     debugger_->OnFunctionDefined(symbol_info, function);
 
     symbol_info->set_status(SymbolInfo::STATUS_DEFINED);
-    symbol_status = symbol_info->status();
+    if (FLAGS_invalidate_modified_code && PublishCodeWatch(symbol_info)) {
+      // Written after it was checked but before it was published, which
+      // the watch left to us.
+      InvalidateFunction(function);
+    }
+    symbol_status = SymbolInfo::STATUS_DEFINED;
   }
 
   if (symbol_status == SymbolInfo::STATUS_FAILED) {
@@ -274,6 +469,374 @@ int Runtime::DemandFunction(
   return 0;
 }
 
+void Runtime::RequestPromotion(Function* function) {
+  if (!tiering_enabled()) {
+    return;
+  }
+  if (function->MarkPromotionRequested()) {
+    compile_queue_->EnqueuePromotion(function->symbol_info());
+  }
+}
+
+int Runtime::PromoteFunction(FunctionInfo* symbol_info) {
+  // Held on to while it's being replaced. Whatever is on the symbol hasn't
+  // been freed, and reclaiming checks that under the same lock.
+  LockMutex(tier_lock_);
+  Function* old_function = symbol_info->function();
+  XEASSERTNOTNULL(old_function);
+  if (old_function->is_invalidated()) {
+    // Code changed since the request; it'll be retranslated on next use.
+    UnlockMutex(tier_lock_);
+    return 0;
+  }
+  old_function->Acquire();
+  UnlockMutex(tier_lock_);
+
+  Function* function = NULL;
+  int result = frontend_->DefineFunction(
+      symbol_info, DEBUG_INFO_DEFAULT, tier1_backend_, &function);
+  if (result) {
+    XELOGW("Unable to promote function %.8X", symbol_info->address());
+    old_function->Release();
+    return result;
+  }
+  // Already in the top tier; stop the new version from counting.
+  function->MarkPromotionRequested();
+  if (function->source_hash() != old_function->source_hash()) {
+    // The code changed since the old version was translated; the watch on
+    // it will invalidate that.
+    delete function;
+    old_function->Release();
+    return 0;
+  }
+  debugger_->OnFunctionDefined(symbol_info, function);
+
+  // Swap in the new version. Anyone already running (or holding on to) the
+  // old one keeps using it until they next resolve.
+  xe_memory_barrier();
+  symbol_info->set_function(function);
+  Entry* entry = entry_table_.Get(symbol_info->address());
+  if (entry) {
+    entry->function = function;
+  }
+  // The watch carries over, so it mustn't keep pointing at the old one.
+  LockMutex(code_watch_lock_);
+  CodeWatchMap::iterator it = code_watches_.find(symbol_info);
+  if (it != code_watches_.end()) {
+    CodeWatch& code_watch = code_watch_infos_[it->second];
+    if (code_watch.function == old_function) {
+      code_watch.function = function;
+    }
+  }
+  UnlockMutex(code_watch_lock_);
+  LockMutex(tier_lock_);
+  bool retired = old_function->MarkRetired();
+  old_function->UnlinkCallers();
+  if (retired) {
+    // Other threads may still be executing the old version and inline
+    // caches may still point at it, so it has to stay around until they're
+    // done.
+    RetireFunction(old_function);
+  }
+  UnlockMutex(tier_lock_);
+
+  // Invalidated while it was being replaced, which the new version has to
+  // follow.
+  xe_memory_barrier();
+  if (old_function->is_invalidated()) {
+    InvalidateFunction(function);
+  }
+  old_function->Release();
+  return 0;
+}
+
+size_t Runtime::InvalidateCode(uint64_t address, size_t size) {
+  if (!size) {
+    return 0;
+  }
+  std::vector<Entry*> entries =
+      entry_table_.Invalidate(address, address + size - 1);
+  size_t count = 0;
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    if (InvalidateFunction((*it)->function)) {
+      count++;
+    }
+  }
+  return count;
+}
+
+bool Runtime::InvalidateFunction(Function* function) {
+  if (!function || !function->MarkInvalidated()) {
+    return false;
+  }
+  FunctionInfo* symbol_info = function->symbol_info();
+  xe_memory_barrier();
+  if (symbol_info->function() == function) {
+    // Redefined from the current guest code on next resolve. The old
+    // version is left set so racing resolvers never see NULL.
+    UnwatchCode(symbol_info);
+    symbol_info->module()->UndefineFunction(symbol_info);
+  }
+  // Resolves would drop its entry anyway, but lookups by address shouldn't
+  // find it meanwhile.
+  Entry* entry = entry_table_.Get(function->address());
+  if (entry && entry->function == function) {
+    entry_table_.Remove(entry);
+  }
+
+  // Like promotion, other threads may still be running it.
+  LockMutex(tier_lock_);
+  function->UnlinkCallers();
+  if (function->MarkRetired()) {
+    RetireFunction(function);
+  }
+  UnlockMutex(tier_lock_);
+  xe_atomic_inc_32(&invalidated_function_count_);
+  return true;
+}
+
+void Runtime::UnlinkCallers(Function* function) {
+  LockMutex(tier_lock_);
+  function->UnlinkCallers();
+  UnlockMutex(tier_lock_);
+}
+
+size_t Runtime::retired_function_count() {
+  LockMutex(tier_lock_);
+  size_t count = retired_functions_.size();
+  UnlockMutex(tier_lock_);
+  return count;
+}
+
+void Runtime::RetireFunction(Function* function) {
+  // tier_lock_ must be held. Anything that looks the function up from here
+  // on won't find it (on the symbol or in the entry table) or will see it's
+  // retired; the epoch is for those that already did.
+  RetiredFunction retired = {
+    function, xe_atomic_inc_32(&retire_epoch_), false,
+  };
+  retired_functions_.push_back(retired);
+  // Each retirement gives those before it another chance, so only the
+  // latest few are ever kept.
+  ReclaimFunctions();
+}
+
+void Runtime::ReclaimFunctions() {
+  // tier_lock_ must be held.
+  uint32_t oldest_epoch = retire_epoch_;
+  LockMutex(thread_states_lock_);
+  for (auto it = thread_states_.begin(); it != thread_states_.end(); ++it) {
+    uint32_t epoch = (*it)->retire_epoch();
+    if (epoch && epoch < oldest_epoch) {
+      oldest_epoch = epoch;
+    }
+  }
+  UnlockMutex(thread_states_lock_);
+
+  std::vector<Function*> evicted_functions;
+  for (auto it = retired_functions_.begin();
+       it != retired_functions_.end();) {
+    Function* function = it->function;
+    if (it->epoch > oldest_epoch) {
+      // Someone may still have it from before it was retired.
+      ++it;
+    } else if (!it->evicted) {
+      // Invalidated versions are left on the symbol until it's redefined
+      // and can be picked up from there until then.
+      if (function->symbol_info()->function() != function) {
+        evicted_functions.push_back(function);
+      }
+      ++it;
+    } else if (!function->active_count()) {
+      delete function;
+      it = retired_functions_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (evicted_functions.empty()) {
+    return;
+  }
+
+  // Inline caches are the last place retired functions can be found, so
+  // drop them from every function that may still run. Anyone that found
+  // one there before this has to pass another epoch.
+  for (auto it = retired_functions_.begin();
+       it != retired_functions_.end(); ++it) {
+    it->function->EvictFromInlineCaches(evicted_functions);
+  }
+  ModuleList modules = GetModules();
+  for (auto it = modules.begin(); it != modules.end(); ++it) {
+    (*it)->ForEachFunction([&](FunctionInfo* symbol_info) {
+      Function* function = symbol_info->function();
+      if (function) {
+        function->EvictFromInlineCaches(evicted_functions);
+      }
+    });
+  }
+  uint32_t epoch = xe_atomic_inc_32(&retire_epoch_);
+  for (auto it = retired_functions_.begin();
+       it != retired_functions_.end(); ++it) {
+    if (std::find(evicted_functions.begin(), evicted_functions.end(),
+                  it->function) != evicted_functions.end()) {
+      it->epoch = epoch;
+      it->evicted = true;
+    }
+  }
+}
+
+uint64_t Runtime::HashGuestCode(uint64_t address, uint64_t end_address) {
+  end_address = MAX(address, end_address);
+  return TranslationCache::Hash(
+      memory_->Translate(address), (size_t)(end_address - address + 4));
+}
+
+bool Runtime::WatchCode(FunctionInfo* symbol_info, Function* function) {
+  // Watch first, then check the code is still what was translated: writes
+  // either show up in the check or fault once it's done.
+  uint64_t address = symbol_info->address();
+  uint64_t end_address = MAX(address, symbol_info->end_address());
+  uint32_t watch = memory_->AddWriteWatch(
+      address, (size_t)(end_address - address + 4), OnCodeWritten, this);
+  UnwatchCode(symbol_info);
+  if (watch) {
+    CodeWatch code_watch = { symbol_info, function, false, false };
+    LockMutex(code_watch_lock_);
+    code_watches_[symbol_info] = watch;
+    code_watch_infos_[watch] = code_watch;
+    UnlockMutex(code_watch_lock_);
+  }
+  return HashGuestCode(address, end_address) == function->source_hash();
+}
+
+void Runtime::UnwatchCode(FunctionInfo* symbol_info) {
+  LockMutex(code_watch_lock_);
+  CodeWatchMap::iterator it = code_watches_.find(symbol_info);
+  if (it == code_watches_.end()) {
+    UnlockMutex(code_watch_lock_);
+    return;
+  }
+  uint32_t watch = it->second;
+  code_watches_.erase(it);
+  code_watch_infos_.erase(watch);
+  UnlockMutex(code_watch_lock_);
+  memory_->RemoveWriteWatch(watch);
+}
+
+bool Runtime::PublishCodeWatch(FunctionInfo* symbol_info) {
+  // Returns true if the code was written while the watch was only recording
+  // that.
+  bool written = false;
+  LockMutex(code_watch_lock_);
+  CodeWatchMap::iterator it = code_watches_.find(symbol_info);
+  if (it != code_watches_.end()) {
+    CodeWatch& code_watch = code_watch_infos_[it->second];
+    code_watch.published = true;
+    written = code_watch.written;
+  }
+  UnlockMutex(code_watch_lock_);
+  return written;
+}
+
+void Runtime::OnCodeWritten(void* context, uint32_t watch, uint64_t address) {
+  // Called from Memory::DispatchWriteWatches, once per function whose code
+  // shares a page with the write.
+  Runtime* runtime = (Runtime*)context;
+  LockMutex(runtime->code_watch_lock_);
+  CodeWatchInfoMap::iterator it = runtime->code_watch_infos_.find(watch);
+  if (it == runtime->code_watch_infos_.end()) {
+    UnlockMutex(runtime->code_watch_lock_);
+    return;
+  }
+  if (!it->second.published) {
+    // The function may be thrown away at any point until it's published, so
+    // leave it to DemandFunction.
+    it->second.written = true;
+    UnlockMutex(runtime->code_watch_lock_);
+    return;
+  }
+  CodeWatch code_watch = it->second;
+  UnlockMutex(runtime->code_watch_lock_);
+  FunctionInfo* symbol_info = code_watch.symbol_info;
+  Function* function = code_watch.function;
+  if (function->is_retired() && !function->is_invalidated()) {
+    // Promoted since; the watch carries over to the new version.
+    function = symbol_info->function();
+  }
+  if (!function || function->is_invalidated()) {
+    return;
+  }
+
+  uint64_t start_address = symbol_info->address();
+  uint64_t end_address = MAX(start_address, symbol_info->end_address());
+  if (address < start_address || address > end_address) {
+    // Something else on the page was written, which is usually data. Watch
+    // again, then check nothing was written to the code itself while the
+    // page was unprotected. Code that was decommitted or protected since
+    // can't be checked, so that counts as written.
+    Memory* memory = runtime->memory_;
+    size_t page_size = memory->page_size();
+    bool watchable = true;
+    for (uint64_t page = start_address & ~(uint64_t)(page_size - 1);
+         page <= end_address && watchable; page += page_size) {
+      bool executable;
+      watchable = memory->IsWatchablePage(page, &executable);
+    }
+    if (watchable) {
+      memory->ResetWriteWatch(watch);
+      if (runtime->HashGuestCode(start_address, end_address) ==
+          function->source_hash()) {
+        return;
+      }
+    }
+  }
+  xe_atomic_inc_32(&runtime->code_write_count_);
+  runtime->InvalidateFunction(function);
+}
+
+void Runtime::DumpTierCounters() {
+  typedef struct {
+    Function* function;
+    bool      retired;
+  } CounterEntry;
+  std::vector<CounterEntry> entries;
+  LockMutex(tier_lock_);
+  for (auto it = retired_functions_.begin();
+       it != retired_functions_.end(); ++it) {
+    CounterEntry entry = { it->function, true };
+    entries.push_back(entry);
+  }
+  UnlockMutex(tier_lock_);
+  ModuleList modules = GetModules();
+  for (auto it = modules.begin(); it != modules.end(); ++it) {
+    (*it)->ForEachFunction([&](FunctionInfo* symbol_info) {
+      Function* function = symbol_info->function();
+      if (function && function->invocation_count()) {
+        CounterEntry entry = { function, false };
+        entries.push_back(entry);
+      }
+    });
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const CounterEntry& a, const CounterEntry& b) {
+    return a.function->invocation_count() > b.function->invocation_count();
+  });
+
+  XELOGI("Tier counters (invocation threshold %u, back-edge threshold %u):",
+         tier_invocation_threshold_, tier_backedge_threshold_);
+  XELOGI("  address   invocations   back-edges  tier");
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    Function* function = it->function;
+    XELOGI("  %.8X %12u %12u  %s %s",
+           (uint32_t)function->address(),
+           function->invocation_count(), function->backedge_count(),
+           !it->retired ? "base" :
+               function->is_invalidated() ? "invalidated" : "promoted",
+           function->symbol_info()->name() ?
+               function->symbol_info()->name() : "");
+  }
+}
+
 void Runtime::AddRegisterAccessCallbacks(
     const RegisterAccessCallbacks& callbacks) {
   RegisterAccessCallbacks* cbs = new RegisterAccessCallbacks();
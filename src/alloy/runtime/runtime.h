@@ -14,12 +14,15 @@
 #include <alloy/memory.h>
 #include <alloy/backend/backend.h>
 #include <alloy/frontend/frontend.h>
+#include <alloy/runtime/compile_queue.h>
 #include <alloy/runtime/debugger.h>
 #include <alloy/runtime/entry_table.h>
+#include <alloy/runtime/inline_cache.h>
 #include <alloy/runtime/module.h>
 #include <alloy/runtime/register_access.h>
 #include <alloy/runtime/symbol_info.h>
 #include <alloy/runtime/thread_state.h>
+#include <alloy/runtime/translation_cache.h>
 
 
 namespace alloy {
@@ -38,6 +41,26 @@ public:
   Debugger* debugger() const { return debugger_; }
   frontend::Frontend* frontend() const { return frontend_; }
   backend::Backend* backend() const { return backend_; }
+  CompileQueue* compile_queue() const { return compile_queue_; }
+  // Optional, owned by the caller and must outlive the runtime.
+  TranslationCache* translation_cache() const { return translation_cache_; }
+  void set_translation_cache(TranslationCache* cache) {
+    translation_cache_ = cache;
+  }
+
+  // Tiered execution: functions start in backend(), translated with the
+  // minimum of passes, and are retranslated for tier1_backend() with the
+  // full pipeline once hot.
+  backend::Backend* tier1_backend() const { return tier1_backend_; }
+  bool tiering_enabled() const { return tier1_backend_ != NULL; }
+  uint32_t tier_invocation_threshold() const {
+    return tier_invocation_threshold_;
+  }
+  uint32_t tier_backedge_threshold() const {
+    return tier_backedge_threshold_;
+  }
+  void RequestPromotion(Function* function);
+  void DumpTierCounters();
   RegisterAccessCallbacks* access_callbacks() const {
     return access_callbacks_;
   }
@@ -50,10 +73,56 @@ public:
 
   std::vector<Function*> FindFunctionsWithAddress(uint64_t address);
 
+  // Drops all translated functions overlapping [address, address + size) so
+  // they are retranslated from guest memory on next use. With
+  // --invalidate_modified_code guest writes to translated code are caught
+  // automatically; writes through other views must call this themselves.
+  // Returns the number of functions invalidated.
+  size_t InvalidateCode(uint64_t address, size_t size);
+  // Guest code writes are only queued when they fault. Backends call this
+  // before calls so invalidated functions aren't entered.
+  void CheckCodeWrites() {
+    if (memory_->has_pending_writes()) {
+      memory_->DispatchWriteWatches();
+    }
+  }
+  // Hash of the guest code in [address, end_address], as stored in
+  // Function::source_hash.
+  uint64_t HashGuestCode(uint64_t address, uint64_t end_address);
+  uint32_t code_write_count() const { return code_write_count_; }
+  uint32_t invalidated_function_count() const {
+    return invalidated_function_count_;
+  }
+
+  // Promoted and invalidated functions are retired and freed once no thread
+  // can still be running or holding on to them. Threads are tracked from
+  // creation to destruction and take part by publishing the retire epoch
+  // at points where they hold no functions apart from ones they're counted
+  // as calling (Function::Acquire); a function is freed once it's
+  // unreachable, not being called and every thread has published an epoch
+  // at least as new as the one it became unreachable in.
+  void AddThreadState(ThreadState* thread_state);
+  void RemoveThreadState(ThreadState* thread_state);
+  uint32_t retire_epoch() const { return retire_epoch_; }
+  void PublishRetireEpoch(ThreadState* thread_state) {
+    bool was_quiescent = !thread_state->retire_epoch();
+    thread_state->set_retire_epoch(retire_epoch_);
+    if (was_quiescent) {
+      // Reclaiming may have just looked and skipped the thread; it must
+      // see this before the thread goes looking for functions.
+      xe_memory_barrier();
+    }
+  }
+  // Reverts the call sites linked to a retired function.
+  void UnlinkCallers(Function* function);
+  size_t retired_function_count();
+
   int LookupFunctionInfo(uint64_t address, FunctionInfo** out_symbol_info);
   int LookupFunctionInfo(Module* module, uint64_t address,
                          FunctionInfo** out_symbol_info);
   int ResolveFunction(uint64_t address, Function** out_function);
+  int ResolveFunction(uint64_t address, InlineCache* cache,
+                      Function** out_function);
 
   void AddRegisterAccessCallbacks(
       const RegisterAccessCallbacks& callbacks);
@@ -61,7 +130,16 @@ public:
   //uint32_t CreateCallback(void (*callback)(void* data), void* data);
 
 private:
+  friend class CompileQueue;
   int DemandFunction(FunctionInfo* symbol_info, Function** out_function);
+  int PromoteFunction(FunctionInfo* symbol_info);
+  bool InvalidateFunction(Function* function);
+  void RetireFunction(Function* function);
+  void ReclaimFunctions();
+  bool WatchCode(FunctionInfo* symbol_info, Function* function);
+  void UnwatchCode(FunctionInfo* symbol_info);
+  bool PublishCodeWatch(FunctionInfo* symbol_info);
+  static void OnCodeWritten(void* context, uint32_t watch, uint64_t address);
 
 protected:
   Memory*             memory_;
@@ -70,6 +148,43 @@ protected:
 
   frontend::Frontend* frontend_;
   backend::Backend*   backend_;
+  CompileQueue*       compile_queue_;
+  TranslationCache*   translation_cache_;
+
+  backend::Backend*   tier1_backend_;
+  uint32_t            tier_invocation_threshold_;
+  uint32_t            tier_backedge_threshold_;
+  // Guards retired functions as well as the tiers.
+  Mutex*              tier_lock_;
+  // Each retired function and the retire epoch every thread has to pass
+  // before it goes to the next stage: first evicting it from inline caches,
+  // then freeing it.
+  typedef struct {
+    Function* function;
+    uint32_t  epoch;
+    bool      evicted;
+  } RetiredFunction;
+  std::vector<RetiredFunction> retired_functions_;
+  volatile uint32_t   retire_epoch_;
+  Mutex*              thread_states_lock_;
+  std::vector<ThreadState*> thread_states_;
+
+  // A write watch over the code of each defined function, and what each
+  // watch was made for. Until the function is published the watch only
+  // records that it was written, as the function may be thrown away.
+  Mutex*              code_watch_lock_;
+  typedef std::tr1::unordered_map<FunctionInfo*, uint32_t> CodeWatchMap;
+  CodeWatchMap        code_watches_;
+  typedef struct {
+    FunctionInfo* symbol_info;
+    Function*     function;
+    bool          published;
+    bool          written;
+  } CodeWatch;
+  typedef std::tr1::unordered_map<uint32_t, CodeWatch> CodeWatchInfoMap;
+  CodeWatchInfoMap    code_watch_infos_;
+  volatile uint32_t   code_write_count_;
+  volatile uint32_t   invalidated_function_count_;
 
   EntryTable          entry_table_;
   Mutex*              modules_lock_;
@@ -16,14 +16,15 @@ using namespace alloy::runtime;
 
 
 namespace {
-__declspec(thread) ThreadState* thread_state_ = NULL;
+XETHREADLOCAL ThreadState* thread_state_ = NULL;
 }
 
 
 ThreadState::ThreadState(Runtime* runtime, uint32_t thread_id) :
     runtime_(runtime), memory_(runtime->memory()),
     thread_id_(thread_id), name_(0),
-    backend_data_(0), raw_context_(0) {
+    backend_data_(0), raw_context_(0),
+    retire_epoch_(runtime->retire_epoch()) {
   if (thread_id_ == UINT_MAX) {
     // System thread. Assign the system thread ID with a high bit
     // set so people know what's up.
@@ -31,9 +32,11 @@ ThreadState::ThreadState(Runtime* runtime, uint32_t thread_id) :
     thread_id_ = 0x80000000 | system_thread_handle;
   }
   backend_data_ = runtime->backend()->AllocThreadData();
+  runtime->AddThreadState(this);
 }
 
 ThreadState::~ThreadState() {
+  runtime_->RemoveThreadState(this);
   if (backend_data_) {
     runtime_->backend()->FreeThreadData(backend_data_);
   }
@@ -34,6 +34,12 @@ public:
   void* backend_data() const { return backend_data_; }
   void* raw_context() const { return raw_context_; }
 
+  // The runtime's retire epoch as of the last time the thread held on to
+  // no functions other than ones it's counted as calling, or 0 while it
+  // holds on to none at all. See Runtime::PublishRetireEpoch.
+  uint32_t retire_epoch() const { return retire_epoch_; }
+  void set_retire_epoch(uint32_t value) { retire_epoch_ = value; }
+
   virtual volatile int* suspend_flag_address() const = 0;
   virtual int Suspend(uint32_t timeout_ms = UINT_MAX) = 0;
   virtual int Resume(bool force = false) = 0;
@@ -50,6 +56,7 @@ protected:
   char*     name_;
   void*     backend_data_;
   void*     raw_context_;
+  volatile uint32_t retire_epoch_;
 };
 
 
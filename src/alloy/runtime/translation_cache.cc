@@ -0,0 +1,33 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/runtime/translation_cache.h>
+
+using namespace alloy;
+using namespace alloy::runtime;
+
+
+uint64_t TranslationCache::Hash(
+    const void* data, size_t length, uint64_t seed) {
+  // FNV-1a-style mixing over 64-bit chunks, then any remaining bytes.
+  const uint64_t kPrime = 0x100000001B3ull;
+  uint64_t hash = 0xCBF29CE484222325ull ^ seed;
+  const uint8_t* p = (const uint8_t*)data;
+  size_t n = 0;
+  for (; n + 8 <= length; n += 8) {
+    uint64_t value;
+    memcpy(&value, p + n, sizeof(value));
+    hash = (hash ^ value) * kPrime;
+    hash ^= hash >> 29;
+  }
+  for (; n < length; n++) {
+    hash = (hash ^ p[n]) * kPrime;
+  }
+  return hash;
+}
@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_RUNTIME_TRANSLATION_CACHE_H_
+#define ALLOY_RUNTIME_TRANSLATION_CACHE_H_
+
+#include <alloy/core.h>
+
+
+namespace alloy {
+namespace runtime {
+
+
+// Persistent store of finalized backend functions.
+// The runtime only defines the interface; the host decides where entries
+// live (usually a memory-mapped file next to the game).
+// Entries are keyed by module and guest address and carry a hash of the
+// guest instructions they were translated from. The translator checks that
+// hash against guest memory before using an entry, so stale entries are
+// simply misses and are replaced on the next store.
+class TranslationCache {
+public:
+  // Bump when the serialized format changes.
+  static const uint32_t kFormatVersion = 2;
+  // Version of everything that decides what a translation looks like: HIR
+  // emission in the frontends, HIRBuilder, the compiler passes and the
+  // backends' code generation. Bump with any change to their output, as
+  // nothing else notices a pass or emitter behaving differently.
+  static const uint32_t kCompilerVersion = 1;
+
+  typedef struct {
+    // Module::content_hash() of the owning module.
+    uint64_t  module_hash;
+    // Backend::translation_cache_version() of the producing backend,
+    // combined with kCompilerVersion and the translator's pass pipeline.
+    uint64_t  backend_version;
+    uint64_t  address;
+  } Key;
+
+  typedef struct {
+    uint64_t        end_address;
+    // Hash() of the guest code from address to end_address, inclusive.
+    uint64_t        source_hash;
+    const uint8_t*  data;
+    size_t          length;
+  } Entry;
+
+public:
+  virtual ~TranslationCache() {}
+
+  // Returns true and fills out_entry if there's an entry for the key.
+  // Entry data remains valid for the lifetime of the cache.
+  virtual bool Lookup(const Key& key, Entry* out_entry) = 0;
+  // Adds or replaces the entry for the key. Data is copied.
+  virtual void Store(const Key& key, const Entry& entry) = 0;
+
+  static uint64_t Hash(const void* data, size_t length, uint64_t seed = 0);
+};
+
+
+}  // namespace runtime
+}  // namespace alloy
+
+
+#endif  // ALLOY_RUNTIME_TRANSLATION_CACHE_H_
@@ -0,0 +1,32 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_SEMAPHORE_H_
+#define ALLOY_SEMAPHORE_H_
+
+#include <xenia/common.h>
+
+
+namespace alloy {
+
+
+// Counting semaphore for threads that need to sleep until there's work.
+typedef struct Semaphore_t Semaphore;
+
+Semaphore* AllocSemaphore(uint32_t initial_count = 0);
+void FreeSemaphore(Semaphore* semaphore);
+
+int PostSemaphore(Semaphore* semaphore, uint32_t count = 1);
+int WaitSemaphore(Semaphore* semaphore);
+
+
+}  // namespace alloy
+
+
+#endif  // ALLOY_SEMAPHORE_H_
@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/semaphore.h>
+
+using namespace alloy;
+
+
+namespace alloy {
+  // OS X doesn't support unnamed POSIX semaphores, so build one.
+  struct Semaphore_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    uint32_t        count;
+  };
+}  // namespace alloy
+
+
+Semaphore* alloy::AllocSemaphore(uint32_t initial_count) {
+  Semaphore* semaphore = (Semaphore*)xe_calloc(sizeof(Semaphore));
+  if (pthread_mutex_init(&semaphore->lock, NULL)) {
+    xe_free(semaphore);
+    return NULL;
+  }
+  if (pthread_cond_init(&semaphore->cond, NULL)) {
+    pthread_mutex_destroy(&semaphore->lock);
+    xe_free(semaphore);
+    return NULL;
+  }
+  semaphore->count = initial_count;
+  return semaphore;
+}
+
+void alloy::FreeSemaphore(Semaphore* semaphore) {
+  pthread_cond_destroy(&semaphore->cond);
+  pthread_mutex_destroy(&semaphore->lock);
+  xe_free(semaphore);
+}
+
+int alloy::PostSemaphore(Semaphore* semaphore, uint32_t count) {
+  pthread_mutex_lock(&semaphore->lock);
+  semaphore->count += count;
+  pthread_mutex_unlock(&semaphore->lock);
+  if (count == 1) {
+    pthread_cond_signal(&semaphore->cond);
+  } else {
+    pthread_cond_broadcast(&semaphore->cond);
+  }
+  return 0;
+}
+
+int alloy::WaitSemaphore(Semaphore* semaphore) {
+  pthread_mutex_lock(&semaphore->lock);
+  while (!semaphore->count) {
+    pthread_cond_wait(&semaphore->cond, &semaphore->lock);
+  }
+  semaphore->count--;
+  pthread_mutex_unlock(&semaphore->lock);
+  return 0;
+}
@@ -0,0 +1,44 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <alloy/semaphore.h>
+
+using namespace alloy;
+
+
+namespace alloy {
+  struct Semaphore_t {
+    HANDLE value;
+  };
+}  // namespace alloy
+
+
+Semaphore* alloy::AllocSemaphore(uint32_t initial_count) {
+  HANDLE handle = CreateSemaphore(NULL, initial_count, LONG_MAX, NULL);
+  if (!handle) {
+    return NULL;
+  }
+  Semaphore* semaphore = (Semaphore*)xe_calloc(sizeof(Semaphore));
+  semaphore->value = handle;
+  return semaphore;
+}
+
+void alloy::FreeSemaphore(Semaphore* semaphore) {
+  CloseHandle(semaphore->value);
+  xe_free(semaphore);
+}
+
+int alloy::PostSemaphore(Semaphore* semaphore, uint32_t count) {
+  return ReleaseSemaphore(semaphore->value, count, NULL) ? 0 : 1;
+}
+
+int alloy::WaitSemaphore(Semaphore* semaphore) {
+  return WaitForSingleObject(semaphore->value, INFINITE) == WAIT_OBJECT_0 ?
+      0 : 1;
+}
@@ -30,7 +30,7 @@ DEFINE_string(trace_file, "",
 namespace {
 
 static Channel* shared_channel = NULL;
-__declspec(thread) Tracer* thread_tracer = NULL;
+XETHREADLOCAL Tracer* thread_tracer = NULL;
 
 void CleanupTracing() {
   if (shared_channel) {
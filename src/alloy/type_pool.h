@@ -58,6 +58,15 @@ public:
     UnlockMutex(lock_);
   }
 
+  // Visits all pooled values. Values currently allocated are skipped.
+  void ForEach(std::function<void (T*)> callback) {
+    LockMutex(lock_);
+    for (auto it = list_.begin(); it != list_.end(); ++it) {
+      callback(*it);
+    }
+    UnlockMutex(lock_);
+  }
+
 private:
   Mutex*  lock_;
   typedef std::vector<T*> TList;
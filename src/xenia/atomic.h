@@ -32,6 +32,10 @@
     TODOTODO
 #define xe_atomic_cas_32(oldValue, newValue, value) \
     OSAtomicCompareAndSwap32Barrier(oldValue, newValue, value)
+#define xe_atomic_cas_ptr(oldValue, newValue, value) \
+    OSAtomicCompareAndSwapPtrBarrier(oldValue, newValue, (void* volatile*)value)
+#define xe_memory_barrier() \
+    OSMemoryBarrier()
 
 typedef OSQueueHead xe_atomic_stack_t;
 #define xe_atomic_stack_init(stack) \
@@ -57,6 +61,11 @@ typedef OSQueueHead xe_atomic_stack_t;
     InterlockedExchange64((volatile LONGLONG*)value, newValue)
 #define xe_atomic_cas_32(oldValue, newValue, value) \
     (InterlockedCompareExchange((volatile LONG*)value, newValue, oldValue) == oldValue)
+#define xe_atomic_cas_ptr(oldValue, newValue, value) \
+    (InterlockedCompareExchangePointer( \
+        (PVOID volatile*)value, newValue, oldValue) == oldValue)
+#define xe_memory_barrier() \
+    MemoryBarrier()
 
 typedef SLIST_HEADER xe_atomic_stack_t;
 #define xe_atomic_stack_init(stack) \
@@ -87,6 +96,10 @@ XEFORCEINLINE void* xe_atomic_stack_dequeue(xe_atomic_stack_t* stack,
     TODOTODO
 #define xe_atomic_cas_32(oldValue, newValue, value) \
     __sync_bool_compare_and_swap(value, oldValue, newValue)
+#define xe_atomic_cas_ptr(oldValue, newValue, value) \
+    __sync_bool_compare_and_swap((void**)value, (void*)oldValue, (void*)newValue)
+#define xe_memory_barrier() \
+    __sync_synchronize()
 
 #else
 
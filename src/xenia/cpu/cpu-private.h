@@ -22,6 +22,8 @@ DECLARE_uint64(trace_thread_mask);
 
 DECLARE_string(load_module_map);
 
+DECLARE_string(translation_cache_path);
+
 DECLARE_string(dump_path);
 DECLARE_bool(dump_module_map);
 
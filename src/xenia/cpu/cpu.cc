@@ -31,6 +31,12 @@ DEFINE_string(load_module_map, "",
     "database.");
 
 
+// Caching:
+DEFINE_string(translation_cache_path, "",
+    "File translated functions are persisted to and loaded from across "
+    "runs. Empty to disable.");
+
+
 // Dumping:
 DEFINE_string(dump_path, "build/",
     "Directory that dump files are placed into.");
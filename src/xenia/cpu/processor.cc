@@ -14,8 +14,10 @@
 #include <alloy/runtime/debugger.h>
 #include <xenia/emulator.h>
 #include <xenia/export_resolver.h>
+#include <xenia/cpu/cpu-private.h>
 #include <xenia/cpu/xenon_memory.h>
 #include <xenia/cpu/xenon_runtime.h>
+#include <xenia/cpu/xenon_translation_cache.h>
 #include <xenia/cpu/xex_module.h>
 
 
@@ -54,7 +56,7 @@ namespace {
 
 Processor::Processor(Emulator* emulator) :
     emulator_(emulator), export_resolver_(emulator->export_resolver()),
-    runtime_(0), memory_(emulator->memory()),
+    runtime_(0), translation_cache_(0), memory_(emulator->memory()),
     interrupt_thread_lock_(NULL), interrupt_thread_state_(NULL),
     interrupt_thread_block_(0),
     DebugTarget(emulator->debug_server()) {
@@ -85,6 +87,8 @@ Processor::~Processor() {
   }
 
   delete runtime_;
+  // After the runtime, as it may still be translating until then.
+  delete translation_cache_;
 }
 
 int Processor::Setup() {
@@ -105,6 +109,16 @@ int Processor::Setup() {
     return result;
   }
 
+  if (FLAGS_translation_cache_path.size()) {
+    translation_cache_ = new XenonTranslationCache();
+    result = translation_cache_->Initialize(
+        FLAGS_translation_cache_path.c_str());
+    if (result) {
+      return result;
+    }
+    runtime_->set_translation_cache(translation_cache_);
+  }
+
   // Setup debugger events.
   auto debugger = runtime_->debugger();
   auto debug_server = emulator_->debug_server();
@@ -709,6 +723,32 @@ json_t* Processor::DumpFunction(uint64_t address, bool& succeeded) {
 
   delete fn;
 
+  // Inline cache stats come from the live function, if it's been defined.
+  Function* live_fn = info->function();
+  if (live_fn && live_fn->inline_cache_count()) {
+    json_t* caches_json = json_array();
+    for (size_t n = 0; n < live_fn->inline_cache_count(); n++) {
+      const InlineCache* cache = live_fn->inline_cache(n);
+      json_t* cache_json = json_object();
+      json_object_set_new(cache_json, "address",
+                          json_integer(cache->source_address));
+      json_object_set_new(cache_json, "hits",
+                          json_integer(cache->hit_count));
+      json_object_set_new(cache_json, "misses",
+                          json_integer(cache->miss_count));
+      json_t* targets_json = json_array();
+      for (size_t m = 0; m < InlineCache::kEntryCount; m++) {
+        if (cache->entries[m].address) {
+          json_array_append_new(targets_json,
+                                json_integer(cache->entries[m].address));
+        }
+      }
+      json_object_set_new(cache_json, "targets", targets_json);
+      json_array_append_new(caches_json, cache_json);
+    }
+    json_object_set_new(fn_json, "inlineCaches", caches_json);
+  }
+
   succeeded = true;
   return fn_json;
 }
@@ -22,6 +22,7 @@ XEDECLARECLASS1(xe, ExportResolver);
 XEDECLARECLASS2(xe, cpu, XenonMemory);
 XEDECLARECLASS2(xe, cpu, XenonRuntime);
 XEDECLARECLASS2(xe, cpu, XenonThreadState);
+XEDECLARECLASS2(xe, cpu, XenonTranslationCache);
 XEDECLARECLASS2(xe, cpu, XexModule);
 
 
@@ -74,6 +75,7 @@ private:
   ExportResolver*     export_resolver_;
 
   XenonRuntime*       runtime_;
+  XenonTranslationCache* translation_cache_;
   Memory*             memory_;
 
   xe_mutex_t*         interrupt_thread_lock_;
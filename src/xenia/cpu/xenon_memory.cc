@@ -21,23 +21,18 @@ using namespace xe::cpu;
 #include <xenia/xbox.h>
 
 #if !XE_PLATFORM_WIN32
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if !defined(MFD_CLOEXEC)
+// Older libc headers have the syscall number but not the flags.
+#define MFD_CLOEXEC             0x0001U
+#endif  // !MFD_CLOEXEC
 #endif  // WIN32
 
-#define MSPACES                 1
-#define USE_LOCKS               0
-#define USE_DL_PREFIX           1
-#define HAVE_MORECORE           0
-#define HAVE_MREMAP             0
-#define malloc_getpagesize      4096
-#define DEFAULT_GRANULARITY     64 * 1024
-#define DEFAULT_TRIM_THRESHOLD  MAX_SIZE_T
-#define MALLOC_ALIGNMENT        32
-#define MALLOC_INSPECT_ALL      1
-#if XE_DEBUG
-#define FOOTERS                 0
-#endif  // XE_DEBUG
-#include <third_party/dlmalloc/malloc.c.h>
+#include <map>
 
 
 DEFINE_bool(
@@ -49,6 +44,13 @@ DEFINE_uint64(
 DEFINE_bool(
     scribble_heap, false,
     "Scribble 0xCD into all allocated heap memory.");
+DEFINE_bool(
+    heap_thread_caches, true,
+    "Serve small heap allocations from per-thread caches.");
+DEFINE_bool(
+    huge_pages, false,
+    "Back the physical heap, 64k/16mb physical ranges and XEX range with "
+    "huge pages where the host supports it.");
 
 
 /**
@@ -66,6 +68,15 @@ DEFINE_bool(
  * we don't have to emulate a TLB. It'd be really cool to pass through page
  * sizes or use madvice to let the OS know what to expect.
  *
+ * The backing is a single 4gb object (a pagefile-backed section on Windows, a
+ * memfd on Linux) mapped once per range below, so the physical ranges alias
+ * each other without copies. Reserved pages are mapped inaccessible and made
+ * read/write on commit.
+ *
+ * With --huge_pages the ranges the guest itself maps with large pages (and
+ * the physical heap, which is what those alias) are hinted to the host as
+ * huge page candidates to cut down on TLB misses.
+ *
  * We create our own heap of committed memory that lives at
  * XENON_MEMORY_HEAP_LOW to XENON_MEMORY_HEAP_HIGH - all normal user allocations
  * come from there. Since the Xbox has no paging, we know that the size of this
@@ -89,6 +100,202 @@ DEFINE_bool(
 #define XENON_MEMORY_VIRTUAL_HEAP_HIGH    0x40000000
 
 
+namespace {
+
+// Guest ranges and where in the 4gb mapping each is viewed from.
+const struct {
+  uint64_t  virtual_address_start;
+  uint64_t  virtual_address_end;
+  uint64_t  target_address;
+} kViewInfo[] = {
+  0x00000000, 0x3FFFFFFF, 0x00000000, // (1024mb) - virtual 4k pages
+  0x40000000, 0x7FFFFFFF, 0x40000000, // (1024mb) - virtual 64k pages
+  0x80000000, 0x9FFFFFFF, 0x80000000, //  (512mb) - xex pages
+  0xA0000000, 0xBFFFFFFF, 0x00000000, //  (512mb) - physical 64k pages
+  0xC0000000, 0xDFFFFFFF, 0x00000000, //          - physical 16mb pages
+  0xE0000000, 0xFFFFFFFF, 0x00000000, //          - physical 4k pages
+};
+const uint64_t kMappingSize = 0x100000000ull;
+
+// Guest ranges hinted for huge pages with --huge_pages. The physical heap is
+// included as seen through the 4k view, as that's where the heap hands out
+// addresses from.
+const struct {
+  uint64_t  start;
+  uint64_t  end;
+} kHugePageRanges[] = {
+  0x00000000, 0x1FFFFFFF, // physical heap
+  0x80000000, 0x9FFFFFFF, // xex pages
+  0xA0000000, 0xBFFFFFFF, // physical 64k pages
+  0xC0000000, 0xDFFFFFFF, // physical 16mb pages
+};
+
+const size_t kPageSize = 4096;
+
+// Small heap allocations come from spans of this many pages carved into
+// blocks of one size class. Anything bigger, or more aligned than its class
+// allows, gets whole pages.
+const uint32_t kSpanPages = 16;
+const uint32_t kSizeClasses[] = {
+  32, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+};
+const uint32_t kSizeClassCount = XECOUNT(kSizeClasses);
+
+// Threads are spread over this many caches, so unless there are more guest
+// threads than this allocating at once they don't contend.
+const uint32_t kThreadCacheCount = 16;
+// Blocks moved between a cache and the heap at a time, and how many a cache
+// can hold per class before handing some back.
+const uint32_t kThreadCacheBatch = 16;
+const uint32_t kThreadCacheLimit = 64;
+
+XETHREADLOCAL uint32_t thread_cache_slot_ = 0;
+volatile uint32_t next_thread_cache_slot_ = 0;
+
+uint32_t GetThreadCacheSlot() {
+  if (!thread_cache_slot_) {
+    thread_cache_slot_ =
+        (xe_atomic_inc_32(&next_thread_cache_slot_) % kThreadCacheCount) + 1;
+  }
+  return thread_cache_slot_ - 1;
+}
+
+// Index of the smallest class that fits size and keeps its blocks aligned,
+// or -1 if it needs pages.
+int32_t GetSizeClass(size_t size, uint32_t alignment) {
+  for (uint32_t n = 0; n < kSizeClassCount; n++) {
+    if (kSizeClasses[n] >= size && kSizeClasses[n] % alignment == 0) {
+      return n;
+    }
+  }
+  return -1;
+}
+
+// Page bounds around [p, p + size), as VirtualAlloc/VirtualProtect round.
+void GetPageRange(void* p, size_t size, void** out_start, size_t* out_size) {
+  uintptr_t start = (uintptr_t)p & ~(kPageSize - 1);
+  uintptr_t end = XEROUNDUP((uintptr_t)p + size, kPageSize);
+  *out_start = (void*)start;
+  *out_size = end - start;
+}
+
+// Pages entirely within [p, p + size), which is all DecommitRange drops on
+// POSIX.
+void GetInnerPageRange(void* p, size_t size,
+                       void** out_start, size_t* out_size) {
+  uintptr_t start = XEROUNDUP((uintptr_t)p, kPageSize);
+  uintptr_t end = ((uintptr_t)p + size) & ~(kPageSize - 1);
+  *out_start = (void*)start;
+  *out_size = end > start ? end - start : 0;
+}
+
+// End of the view containing the guest address. Regions never span views,
+// as each is its own host mapping.
+uint64_t GetViewEnd(uint64_t address) {
+  for (size_t n = 0; n < XECOUNT(kViewInfo); n++) {
+    if (address <= kViewInfo[n].virtual_address_end) {
+      return kViewInfo[n].virtual_address_end + 1;
+    }
+  }
+  return kMappingSize;
+}
+
+#if XE_LIKE_POSIX
+
+// X_PAGE_* values match the Win32 PAGE_* ones, so they can be passed
+// straight through there. Here they need translating.
+int ToPosixProtect(uint32_t protect) {
+  if (protect & (X_PAGE_NOACCESS | X_PAGE_GUARD)) {
+    return PROT_NONE;
+  } else if (protect & (X_PAGE_READWRITE | X_PAGE_WRITECOPY)) {
+    return PROT_READ | PROT_WRITE;
+  } else if (protect & (X_PAGE_EXECUTE_READWRITE |
+                        X_PAGE_EXECUTE_WRITECOPY)) {
+    return PROT_READ | PROT_WRITE | PROT_EXEC;
+  } else if (protect & X_PAGE_EXECUTE_READ) {
+    return PROT_READ | PROT_EXEC;
+  } else if (protect & X_PAGE_EXECUTE) {
+    return PROT_EXEC;
+  } else if (protect & X_PAGE_READONLY) {
+    return PROT_READ;
+  }
+  return PROT_NONE;
+}
+#endif  // XE_LIKE_POSIX
+
+// Uncommitted pages are reserved but inaccessible; committing makes them
+// read/write. On POSIX this is just protection, as the kernel only backs
+// pages of the mapping once they're touched.
+bool CommitRange(void* p, size_t size) {
+#if XE_LIKE_WIN32
+  return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+  void* start;
+  size_t length;
+  GetPageRange(p, size, &start, &length);
+  return mprotect(start, length, PROT_READ | PROT_WRITE) == 0;
+#endif  // XE_LIKE_WIN32
+}
+
+// Drops the pages from this view. The contents of the mapping are kept, as
+// other views (or the heap around it) may still be using them.
+bool DecommitRange(void* p, size_t size) {
+#if XE_LIKE_WIN32
+  return VirtualFree(p, size, MEM_DECOMMIT) == TRUE;
+#else
+  // Only pages entirely within the range, so neighboring heap blocks that
+  // share a page stay accessible.
+  void* start;
+  size_t length;
+  GetInnerPageRange(p, size, &start, &length);
+  if (!length) {
+    return true;
+  }
+  madvise(start, length, MADV_DONTNEED);
+  return mprotect(start, length, PROT_NONE) == 0;
+#endif  // XE_LIKE_WIN32
+}
+
+bool ProtectRange(void* p, size_t size, uint32_t protect) {
+#if XE_LIKE_WIN32
+  DWORD old_protect;
+  return VirtualProtect(p, size, protect, &old_protect) == TRUE;
+#else
+  void* start;
+  size_t length;
+  GetPageRange(p, size, &start, &length);
+  return mprotect(start, length, ToPosixProtect(protect)) == 0;
+#endif  // XE_LIKE_WIN32
+}
+
+// Asks for huge pages to back the range, if the host can do that for views
+// of a shared mapping. Must be done before pages are first touched.
+bool AdviseHugePages(void* p, size_t size) {
+#if XE_PLATFORM_UNIX && defined(MADV_HUGEPAGE)
+  // memfd pages are shmem, which only gets transparent huge pages when
+  // shmem_enabled allows it; the madvise succeeds either way.
+  FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/shmem_enabled", "r");
+  if (file) {
+    char line[128] = { 0 };
+    fgets(line, sizeof(line), file);
+    fclose(file);
+    if (strstr(line, "[never]") || strstr(line, "[deny]")) {
+      XELOGW("Huge pages requested but shmem THP is disabled; set "
+             "/sys/kernel/mm/transparent_hugepage/shmem_enabled to advise.");
+      return false;
+    }
+  }
+  return madvise(p, size, MADV_HUGEPAGE) == 0;
+#else
+  // Windows only allows large pages on fully committed, non-aliased
+  // allocations, which the views here can't be.
+  return false;
+#endif  // XE_PLATFORM_UNIX
+}
+
+}  // namespace
+
+
 class xe::cpu::XenonMemoryHeap {
 public:
   XenonMemoryHeap(XenonMemory* memory, bool is_physical);
@@ -103,26 +310,78 @@ public:
 
   void Dump();
 
+private:
+  // page_info_ entries. Small spans mark every page with the class and the
+  // page's index in the span; large allocations mark their first page with
+  // the page count (including guard pages).
+  enum {
+    PAGE_LARGE  = 0x80000000,
+    PAGE_SMALL  = 0x40000000,
+    PAGE_VALUE  = 0x3FFFFFFF,
+  };
+  typedef struct {
+    uint8_t*  head;
+    uint32_t  count;
+  } FreeList;
+  typedef struct {
+    // Blocks handed back by thread caches (or freed without them).
+    FreeList  free_list;
+    // Unused part of the newest span.
+    uint8_t*  span_next;
+    uint8_t*  span_end;
+    uint32_t  span_count;
+  } SizeClass;
+  typedef struct {
+    Mutex*    lock;
+    FreeList  lists[kSizeClassCount];
+  } ThreadCache;
+
+  uint8_t* AllocSmall(uint32_t class_index);
+  void FreeSmall(uint8_t* p, uint32_t class_index);
+  uint8_t* TakeBlock(uint32_t class_index);
+  void RefillCache(FreeList& list, uint32_t class_index);
+  void FlushCache(FreeList& list, uint32_t class_index, uint32_t count);
+
+  uint8_t* AllocLarge(size_t size, uint32_t alignment);
+  bool AllocPages(uint32_t count, uint32_t alignment, uint32_t offset,
+                  uint32_t* out_page);
+  void FreePages(uint32_t page, uint32_t count);
+
+  void CommitPhysical(uint8_t* p, size_t size);
+  void DecommitPhysical(uint8_t* p, size_t size);
+
 private:
   static uint32_t next_heap_id_;
-  static void DumpHandler(
-      void* start, void* end, size_t used_bytes, void* context);
 
 private:
   XenonMemory*  memory_;
   uint32_t      heap_id_;
   bool          is_physical_;
-  Mutex*        lock_;
   size_t        size_;
   uint8_t*      ptr_;
-  mspace        space_;
+
+  // Guards everything below but the thread caches.
+  Mutex*        lock_;
+  // Free page runs, by first page.
+  std::map<uint32_t, uint32_t> free_runs_;
+  std::vector<uint32_t> page_info_;
+  SizeClass     classes_[kSizeClassCount];
+
+  ThreadCache   caches_[kThreadCacheCount];
 };
 uint32_t XenonMemoryHeap::next_heap_id_ = 1;
 
 
 XenonMemory::XenonMemory() :
-    mapping_(0), mapping_base_(0),
+#if XE_LIKE_WIN32
+    mapping_(0),
+#else
+    mapping_(-1),
+#endif  // XE_LIKE_WIN32
+    mapping_base_(0),
     Memory() {
+  xe_zero_struct(&views_, sizeof(views_));
+  regions_lock_ = AllocMutex(10000);
   virtual_heap_ = new XenonMemoryHeap(this, false);
   physical_heap_ = new XenonMemoryHeap(this, true);
 }
@@ -130,24 +389,32 @@ XenonMemory::XenonMemory() :
 XenonMemory::~XenonMemory() {
   if (mapping_base_) {
     // GPU writeback.
-    VirtualFree(
-        Translate(0xC0000000), 0x00100000,
-        MEM_DECOMMIT);
+    DecommitRegion(Translate(0xC0000000), 0x00100000);
   }
 
   delete physical_heap_;
   delete virtual_heap_;
 
   // Unmap all views and close mapping.
+#if XE_LIKE_WIN32
   if (mapping_) {
     UnmapViews();
     CloseHandle(mapping_);
     mapping_base_ = 0;
     mapping_ = 0;
+#else
+  if (mapping_ != -1) {
+    UnmapViews();
+    close(mapping_);
+    mapping_base_ = 0;
+    mapping_ = -1;
+#endif  // XE_LIKE_WIN32
 
     alloy::tracing::WriteEvent(EventType::MemoryDeinit({
     }));
   }
+
+  FreeMutex(regions_lock_);
 }
 
 int XenonMemory::Initialize() {
@@ -159,15 +426,37 @@ int XenonMemory::Initialize() {
 
   // Create main page file-backed mapping. This is all reserved but
   // uncommitted (so it shouldn't expand page file).
+#if XE_LIKE_WIN32
   mapping_ = CreateFileMapping(
       INVALID_HANDLE_VALUE,
       NULL,
       PAGE_READWRITE | SEC_RESERVE,
       1, 0, // entire 4gb space
       NULL);
-  if (!mapping_) {
+  bool has_mapping = mapping_ != NULL;
+#else
+  // An anonymous file sized to the whole space. It's sparse, so pages are
+  // only allocated as they're touched through one of the views.
+#if defined(__NR_memfd_create)
+  mapping_ = (int)syscall(__NR_memfd_create, "xenia_memory", MFD_CLOEXEC);
+#else
+  // shm_open descriptors are already close-on-exec.
+  char shm_name[64];
+  xesnprintfa(shm_name, XECOUNT(shm_name), "/xenia_memory_%d", getpid());
+  mapping_ = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (mapping_ != -1) {
+    shm_unlink(shm_name);
+  }
+#endif  // __NR_memfd_create
+  if (mapping_ != -1 && ftruncate(mapping_, kMappingSize)) {
+    close(mapping_);
+    mapping_ = -1;
+  }
+  bool has_mapping = mapping_ != -1;
+#endif  // XE_LIKE_WIN32
+  if (!has_mapping) {
     XELOGE("Unable to reserve the 4gb guest address space.");
-    XEASSERTNOTNULL(mapping_);
+    XEASSERTALWAYS();
     XEFAIL();
   }
 
@@ -188,6 +477,19 @@ int XenonMemory::Initialize() {
   }
   membase_ = mapping_base_;
 
+  if (FLAGS_huge_pages) {
+    for (size_t n = 0; n < XECOUNT(kHugePageRanges); n++) {
+      if (!AdviseHugePages(
+          Translate(kHugePageRanges[n].start),
+          kHugePageRanges[n].end - kHugePageRanges[n].start + 1)) {
+        XELOGW("Unable to use huge pages for %.8llX-%.8llX.",
+               (unsigned long long)kHugePageRanges[n].start,
+               (unsigned long long)kHugePageRanges[n].end);
+        break;
+      }
+    }
+  }
+
   alloy::tracing::WriteEvent(EventType::MemoryInit({
   }));
 
@@ -199,10 +501,7 @@ int XenonMemory::Initialize() {
 
   // GPU writeback.
   // 0xC... is physical, 0x7F... is virtual. We may need to overlay these.
-  VirtualAlloc(
-      Translate(0xC0000000),
-      0x00100000,
-      MEM_COMMIT, PAGE_READWRITE);
+  CommitRegion(Translate(0xC0000000), 0x00100000);
 
   return 0;
 
@@ -211,43 +510,86 @@ XECLEANUP:
 }
 
 int XenonMemory::MapViews(uint8_t* mapping_base) {
-  static struct {
-    uint64_t  virtual_address_start;
-    uint64_t  virtual_address_end;
-    uint64_t  target_address;
-  } map_info[] = {
-    0x00000000, 0x3FFFFFFF, 0x00000000, // (1024mb) - virtual 4k pages
-    0x40000000, 0x7FFFFFFF, 0x40000000, // (1024mb) - virtual 64k pages
-    0x80000000, 0x9FFFFFFF, 0x80000000, //  (512mb) - xex pages
-    0xA0000000, 0xBFFFFFFF, 0x00000000, //  (512mb) - physical 64k pages
-    0xC0000000, 0xDFFFFFFF, 0x00000000, //          - physical 16mb pages
-    0xE0000000, 0xFFFFFFFF, 0x00000000, //          - physical 4k pages
-  };
-  XEASSERT(XECOUNT(map_info) == XECOUNT(views_.all_views));
-  for (size_t n = 0; n < XECOUNT(map_info); n++) {
+  XEASSERT(XECOUNT(kViewInfo) == XECOUNT(views_.all_views));
+#if XE_LIKE_POSIX
+  // Reserve the whole range first: views are placed with MAP_FIXED, which
+  // would silently replace anything already mapped there.
+  void* reservation = mmap(
+      mapping_base, kMappingSize, PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reservation == MAP_FAILED) {
+    return 1;
+  } else if (reservation != mapping_base) {
+    // Only a hint; the kernel put it somewhere else.
+    munmap(reservation, kMappingSize);
+    return 1;
+  }
+#endif  // XE_LIKE_POSIX
+  for (size_t n = 0; n < XECOUNT(kViewInfo); n++) {
+    size_t view_size = kViewInfo[n].virtual_address_end -
+                       kViewInfo[n].virtual_address_start + 1;
+    uint8_t* view_base = mapping_base + kViewInfo[n].virtual_address_start;
+#if XE_LIKE_WIN32
     views_.all_views[n] = (uint8_t*)MapViewOfFileEx(
         mapping_,
         FILE_MAP_ALL_ACCESS,
-        0x00000000, (DWORD)map_info[n].target_address,
-        map_info[n].virtual_address_end - map_info[n].virtual_address_start + 1,
-        mapping_base + map_info[n].virtual_address_start);
+        0x00000000, (DWORD)kViewInfo[n].target_address,
+        view_size,
+        view_base);
+#else
+    // Views start out inaccessible (reserved) until committed.
+    void* view = mmap(
+        view_base, view_size, PROT_NONE,
+        MAP_SHARED | MAP_FIXED | MAP_NORESERVE,
+        mapping_, (off_t)kViewInfo[n].target_address);
+    views_.all_views[n] = view == MAP_FAILED ? NULL : (uint8_t*)view;
+#endif  // XE_LIKE_WIN32
     XEEXPECTNOTNULL(views_.all_views[n]);
   }
   return 0;
 
 XECLEANUP:
   UnmapViews();
+#if XE_LIKE_POSIX
+  // Drops whatever is left of the reservation.
+  munmap(mapping_base, kMappingSize);
+#endif  // XE_LIKE_POSIX
   return 1;
 }
 
 void XenonMemory::UnmapViews() {
   for (size_t n = 0; n < XECOUNT(views_.all_views); n++) {
     if (views_.all_views[n]) {
+#if XE_LIKE_WIN32
       UnmapViewOfFile(views_.all_views[n]);
+#else
+      munmap(views_.all_views[n],
+             kViewInfo[n].virtual_address_end -
+             kViewInfo[n].virtual_address_start + 1);
+#endif  // XE_LIKE_WIN32
+      views_.all_views[n] = NULL;
     }
   }
 }
 
+int XenonMemory::ReleaseRange(uint8_t* p, size_t size) {
+  if (!DecommitRegion(p, size)) {
+    return 1;
+  }
+#if XE_PLATFORM_UNIX && defined(FALLOC_FL_PUNCH_HOLE)
+  // Decommitting only unmaps pages from the view; punch them out of the
+  // mapping too so the memory is actually returned. Only done for ranges
+  // not also visible through the physical views, as those may overlap the
+  // physical heap.
+  uint64_t address = (uint64_t)(p - mapping_base_);
+  if (address >= XENON_MEMORY_PHYSICAL_HEAP_HIGH && address < 0xA0000000) {
+    fallocate(mapping_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              (off_t)address, (off_t)size);
+  }
+#endif  // XE_PLATFORM_UNIX
+  return 0;
+}
+
 uint64_t XenonMemory::HeapAlloc(
     uint64_t base_address, size_t size, uint32_t flags,
     uint32_t alignment) {
@@ -286,15 +628,14 @@ uint64_t XenonMemory::HeapAlloc(
     uint8_t* p = Translate(base_address);
     // TODO(benvanik): check if address range is in use with a query.
 
-    void* pv = VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE);
-    if (!pv) {
+    if (!CommitRegion(p, size)) {
       // Failed.
       XEASSERTALWAYS();
       return 0;
     }
 
     if (flags & MEMORY_FLAG_ZERO) {
-      xe_zero_struct(pv, size);
+      xe_zero_struct(p, size);
     }
 
     alloy::tracing::WriteEvent(EventType::MemoryHeapAlloc({
@@ -318,7 +659,7 @@ int XenonMemory::HeapFree(uint64_t address, size_t size) {
       0, address,
     }));
     uint8_t* p = Translate(address);
-    return VirtualFree(p, size, MEM_DECOMMIT) ? 0 : 1;
+    return ReleaseRange(p, size);
   }
 }
 
@@ -330,15 +671,11 @@ size_t XenonMemory::QuerySize(uint64_t base_address) {
              base_address < XENON_MEMORY_PHYSICAL_HEAP_HIGH) {
     return physical_heap_->QuerySize(base_address);
   } else {
-    // A placed address. Decommit.
-    uint8_t* p = Translate(base_address);
-    MEMORY_BASIC_INFORMATION mem_info;
-    if (VirtualQuery(p, &mem_info, sizeof(mem_info))) {
-      return mem_info.RegionSize;
-    } else {
-      // Error.
-      return 0;
-    }
+    // A placed address.
+    size_t region_size;
+    uint32_t protect;
+    QueryRegion(base_address, &region_size, &protect);
+    return region_size;
   }
 }
 
@@ -348,39 +685,182 @@ int XenonMemory::Protect(uint64_t address, size_t size, uint32_t access) {
   size_t heap_guard_size = FLAGS_heap_guard_pages * 4096;
   p += heap_guard_size;
 
-  DWORD new_protect = access;
+  uint32_t new_protect = access;
   new_protect = new_protect & (
       X_PAGE_NOACCESS | X_PAGE_READONLY | X_PAGE_READWRITE |
       X_PAGE_WRITECOPY | X_PAGE_GUARD | X_PAGE_NOCACHE |
       X_PAGE_WRITECOMBINE);
 
-  DWORD old_protect;
-  return VirtualProtect(p, size, new_protect, &old_protect) == TRUE ? 0 : 1;
+  return ProtectRegion(p, size, new_protect) ? 0 : 1;
 }
 
 uint32_t XenonMemory::QueryProtect(uint64_t address) {
-  uint8_t* p = Translate(address);
-  MEMORY_BASIC_INFORMATION info;
-  size_t info_size = VirtualQuery((void*)p, &info, sizeof(info));
-  if (!info_size) {
-    return 0;
+  size_t region_size;
+  uint32_t protect;
+  QueryRegion(address, &region_size, &protect);
+  return protect;
+}
+
+bool XenonMemory::IsWatchablePage(uint64_t address, bool* out_executable) {
+  // Host pages may be larger than guest ones, so all regions on it count.
+  *out_executable = false;
+  uint64_t end = address + page_size();
+  while (address < end) {
+    size_t region_size;
+    uint32_t protect;
+    QueryRegion(address, &region_size, &protect);
+    if (protect & (X_PAGE_NOACCESS | X_PAGE_GUARD)) {
+      return false;
+    } else if (protect & (X_PAGE_EXECUTE_READWRITE |
+                          X_PAGE_EXECUTE_WRITECOPY)) {
+      *out_executable = true;
+    } else if (!(protect & (X_PAGE_READWRITE | X_PAGE_WRITECOPY))) {
+      return false;
+    }
+    address += region_size;
   }
-  return info.Protect;
+  return true;
+}
+
+bool XenonMemory::CommitRegion(uint8_t* p, size_t size) {
+  void* start;
+  size_t length;
+  GetPageRange(p, size, &start, &length);
+  uint64_t address = (uint64_t)((uint8_t*)start - mapping_base_);
+  // Committing resets the protection, so watched pages have to know first.
+  DirtyWriteWatches(address, length);
+  if (!CommitRange(p, size)) {
+    return false;
+  }
+  UpdateRegions(address, address + length, X_PAGE_READWRITE);
+  return true;
+}
+
+bool XenonMemory::DecommitRegion(uint8_t* p, size_t size) {
+  void* start;
+  size_t length;
+#if XE_LIKE_WIN32
+  GetPageRange(p, size, &start, &length);
+#else
+  GetInnerPageRange(p, size, &start, &length);
+#endif  // XE_LIKE_WIN32
+  uint64_t address = (uint64_t)((uint8_t*)start - mapping_base_);
+  // The contents are dropped, which watchers have to see as a write.
+  DirtyWriteWatches(address, length);
+  if (!DecommitRange(p, size)) {
+    return false;
+  }
+  UpdateRegions(address, address + length, 0);
+  return true;
+}
+
+bool XenonMemory::ProtectRegion(uint8_t* p, size_t size, uint32_t protect) {
+  void* start;
+  size_t length;
+  GetPageRange(p, size, &start, &length);
+  uint64_t address = (uint64_t)((uint8_t*)start - mapping_base_);
+  DirtyWriteWatches(address, length);
+  if (!ProtectRange(p, size, protect)) {
+    return false;
+  }
+  UpdateRegions(address, address + length, protect);
+  return true;
+}
+
+void XenonMemory::UpdateRegions(
+    uint64_t start, uint64_t end, uint32_t protect) {
+  if (start >= end) {
+    return;
+  }
+  XEIGNORE(LockMutex(regions_lock_));
+
+  // Cut back the region overlapping the start, keeping any part of it past
+  // the end.
+  auto it = regions_.lower_bound(start);
+  if (it != regions_.begin()) {
+    auto prev = it;
+    --prev;
+    if (prev->second.end > start) {
+      Region tail = prev->second;
+      prev->second.end = start;
+      if (tail.end > end) {
+        regions_[end] = tail;
+      }
+    }
+  }
+  // Drop the regions starting within the range, keeping any part of the
+  // last one past the end.
+  while (it != regions_.end() && it->first < end) {
+    if (it->second.end > end) {
+      Region tail = it->second;
+      regions_.erase(it);
+      regions_[end] = tail;
+      break;
+    }
+    it = regions_.erase(it);
+  }
+
+  if (protect) {
+    // Merge with neighbors of the same protection in the same view.
+    Region region = { end, protect };
+    auto next = regions_.find(end);
+    if (next != regions_.end() && next->second.protect == protect &&
+        GetViewEnd(start) > end) {
+      region.end = next->second.end;
+      regions_.erase(next);
+    }
+    auto inserted = regions_.insert(std::make_pair(start, region)).first;
+    if (inserted != regions_.begin()) {
+      auto prev = inserted;
+      --prev;
+      if (prev->second.end == start && prev->second.protect == protect &&
+          GetViewEnd(prev->first) > start) {
+        prev->second.end = region.end;
+        regions_.erase(inserted);
+      }
+    }
+  }
+
+  XEIGNORE(UnlockMutex(regions_lock_));
+}
+
+void XenonMemory::QueryRegion(
+    uint64_t address, size_t* out_size, uint32_t* out_protect) {
+  uint64_t view_end = GetViewEnd(address);
+  XEIGNORE(LockMutex(regions_lock_));
+  auto it = regions_.upper_bound(address);
+  if (it != regions_.begin()) {
+    auto prev = it;
+    --prev;
+    if (prev->second.end > address) {
+      *out_size = (size_t)(prev->second.end - address);
+      *out_protect = prev->second.protect;
+      XEIGNORE(UnlockMutex(regions_lock_));
+      return;
+    }
+  }
+  // Uncommitted, up to the next committed region.
+  uint64_t end = it != regions_.end() ? MIN(it->first, view_end) : view_end;
+  XEIGNORE(UnlockMutex(regions_lock_));
+  *out_size = (size_t)(end - address);
+  *out_protect = X_PAGE_NOACCESS;
 }
 
 
 XenonMemoryHeap::XenonMemoryHeap(XenonMemory* memory, bool is_physical) :
-    memory_(memory), is_physical_(is_physical) {
+    memory_(memory), is_physical_(is_physical), size_(0), ptr_(0) {
   heap_id_ = next_heap_id_++;
   lock_ = AllocMutex(10000);
+  xe_zero_struct(classes_, sizeof(classes_));
+  xe_zero_struct(caches_, sizeof(caches_));
+  for (size_t n = 0; n < XECOUNT(caches_); n++) {
+    caches_[n].lock = AllocMutex(10000);
+  }
 }
 
 XenonMemoryHeap::~XenonMemoryHeap() {
-  if (lock_ && space_) {
-    LockMutex(lock_);
-    destroy_mspace(space_);
-    space_ = NULL;
-    UnlockMutex(lock_);
+  for (size_t n = 0; n < XECOUNT(caches_); n++) {
+    FreeMutex(caches_[n].lock);
   }
   if (lock_) {
     FreeMutex(lock_);
@@ -388,7 +868,7 @@ XenonMemoryHeap::~XenonMemoryHeap() {
   }
 
   if (ptr_) {
-    XEIGNORE(VirtualFree(ptr_, 0, MEM_RELEASE));
+    XEIGNORE(memory_->DecommitRegion(ptr_, size_));
 
     alloy::tracing::WriteEvent(EventType::MemoryHeapDeinit({
       heap_id_,
@@ -397,17 +877,17 @@ XenonMemoryHeap::~XenonMemoryHeap() {
 }
 
 int XenonMemoryHeap::Initialize(uint64_t low, uint64_t high) {
-  // Commit the memory where our heap will live and allocate it.
-  // TODO(benvanik): replace dlmalloc with an implementation that can commit
-  //     as it goes.
+  // Commit the memory where our heap will live. Pages are only backed by
+  // the host once touched, so this costs nothing up front.
   size_ = high - low;
   ptr_ = memory_->views_.v00000000 + low;
-  void* heap_result = VirtualAlloc(
-      ptr_, size_, MEM_COMMIT, PAGE_READWRITE);
-  if (!heap_result) {
+  if (!memory_->CommitRegion(ptr_, size_)) {
     return 1;
   }
-  space_ = create_mspace_with_base(ptr_, size_, 0);
+
+  uint32_t page_count = (uint32_t)(size_ / kPageSize);
+  page_info_.resize(page_count);
+  free_runs_[0] = page_count;
 
   alloy::tracing::WriteEvent(EventType::MemoryHeapInit({
     heap_id_, low, high, is_physical_,
@@ -418,56 +898,30 @@ int XenonMemoryHeap::Initialize(uint64_t low, uint64_t high) {
 
 uint64_t XenonMemoryHeap::Alloc(
     uint64_t base_address, size_t size, uint32_t flags, uint32_t alignment) {
-  XEIGNORE(LockMutex(lock_));
-  size_t alloc_size = size;
-  size_t heap_guard_size = FLAGS_heap_guard_pages * 4096;
-  if (heap_guard_size) {
-    alignment = (uint32_t)MAX(alignment, heap_guard_size);
-    alloc_size = (uint32_t)XEROUNDUP(size, heap_guard_size);
+  // Small allocations come from per-class spans, through a cache for the
+  // calling thread so guest threads don't serialize on the heap lock.
+  // Guard pages need every allocation on its own pages.
+  alignment = MAX(alignment, kSizeClasses[0]);
+  int32_t class_index = -1;
+  if (!FLAGS_heap_guard_pages) {
+    class_index = GetSizeClass(size, alignment);
   }
-  uint8_t* p = (uint8_t*)mspace_memalign(
-      space_,
-      alignment,
-      alloc_size + heap_guard_size * 2);
-  if (FLAGS_heap_guard_pages) {
-    size_t real_size = mspace_usable_size(p);
-    DWORD old_protect;
-    VirtualProtect(
-        p, heap_guard_size,
-        PAGE_NOACCESS, &old_protect);
-    p += heap_guard_size;
-    VirtualProtect(
-        p + alloc_size, heap_guard_size,
-        PAGE_NOACCESS, &old_protect);
+  uint8_t* p;
+  size_t alloc_size;
+  if (class_index != -1) {
+    p = AllocSmall(class_index);
+    alloc_size = kSizeClasses[class_index];
+  } else {
+    p = AllocLarge(size, alignment);
+    alloc_size = XEROUNDUP(MAX(size, (size_t)1), kPageSize);
   }
   if (FLAGS_log_heap) {
     Dump();
   }
-  XEIGNORE(UnlockMutex(lock_));
   if (!p) {
     return 0;
   }
 
-  if (is_physical_) {
-    // If physical, we need to commit the memory in the physical address ranges
-    // so that it can be accessed.
-    VirtualAlloc(
-        memory_->views_.vA0000000 + (p - memory_->views_.v00000000),
-        size,
-        MEM_COMMIT,
-        PAGE_READWRITE);
-    VirtualAlloc(
-        memory_->views_.vC0000000 + (p - memory_->views_.v00000000),
-        size,
-        MEM_COMMIT,
-        PAGE_READWRITE);
-    VirtualAlloc(
-        memory_->views_.vE0000000 + (p - memory_->views_.v00000000),
-        size,
-        MEM_COMMIT,
-        PAGE_READWRITE);
-  }
-
   if ((flags & X_MEM_NOZERO) &&
       FLAGS_scribble_heap) {
     // Trash the memory so that we can see bad read-before-write bugs easier.
@@ -489,52 +943,63 @@ uint64_t XenonMemoryHeap::Alloc(
 
 uint64_t XenonMemoryHeap::Free(uint64_t address, size_t size) {
   uint8_t* p = memory_->Translate(address);
-
-  // Heap allocated address.
-  size_t heap_guard_size = FLAGS_heap_guard_pages * 4096;
-  p -= heap_guard_size;
-  size_t real_size = mspace_usable_size(p);
-  real_size -= heap_guard_size * 2;
-  if (!real_size) {
+  if (p < ptr_ || p >= ptr_ + size_) {
     return 0;
   }
+  uint32_t page = (uint32_t)((p - ptr_) / kPageSize);
+
+  size_t real_size;
+  uint32_t info = page_info_[page];
+  if (info & PAGE_SMALL) {
+    // Pages of a span never change hands, so this is safe to read unlocked.
+    uint32_t class_index = (info & PAGE_VALUE) >> 8;
+    uint8_t* span = ptr_ + (page - (info & 0xFF)) * kPageSize;
+    real_size = kSizeClasses[class_index];
+    if ((p - span) % real_size) {
+      return 0;
+    }
+    if (FLAGS_scribble_heap) {
+      // Trash the memory so that we can see bad read-before-write bugs easier.
+      memset(p, 0xDC, real_size);
+    }
+    FreeSmall(p, class_index);
+  } else {
+    size_t heap_guard_pages = FLAGS_heap_guard_pages;
+    size_t heap_guard_size = heap_guard_pages * kPageSize;
+    if (page < heap_guard_pages) {
+      return 0;
+    }
+    page -= (uint32_t)heap_guard_pages;
+    p -= heap_guard_size;
 
-  if (FLAGS_scribble_heap) {
-    // Trash the memory so that we can see bad read-before-write bugs easier.
-    memset(p + heap_guard_size, 0xDC, size);
-  }
+    XEIGNORE(LockMutex(lock_));
+    info = page_info_[page];
+    if (!(info & PAGE_LARGE) || p != ptr_ + page * kPageSize) {
+      XEIGNORE(UnlockMutex(lock_));
+      return 0;
+    }
+    uint32_t page_count = info & PAGE_VALUE;
+    real_size = page_count * kPageSize - heap_guard_size * 2;
+    if (FLAGS_scribble_heap) {
+      memset(p + heap_guard_size, 0xDC, real_size);
+    }
+    if (heap_guard_size) {
+      memory_->ProtectRegion(p, heap_guard_size, X_PAGE_READWRITE);
+      memory_->ProtectRegion(
+          p + heap_guard_size + real_size, heap_guard_size, X_PAGE_READWRITE);
+    }
+    page_info_[page] = 0;
+    FreePages(page, page_count);
+    XEIGNORE(UnlockMutex(lock_));
 
-  XEIGNORE(LockMutex(lock_));
-  if (FLAGS_heap_guard_pages) {
-    DWORD old_protect;
-    VirtualProtect(
-        p, heap_guard_size,
-        PAGE_READWRITE, &old_protect);
-    VirtualProtect(
-        p + heap_guard_size + real_size, heap_guard_size,
-        PAGE_READWRITE, &old_protect);
-  }
-  mspace_free(space_, p);
+    if (is_physical_) {
+      // If physical, decommit from physical ranges too.
+      DecommitPhysical(p + heap_guard_size, real_size);
+    }
+  }
   if (FLAGS_log_heap) {
     Dump();
   }
-  XEIGNORE(UnlockMutex(lock_));
-
-  if (is_physical_) {
-    // If physical, decommit from physical ranges too.
-    VirtualFree(
-        memory_->views_.vA0000000 + (p - memory_->views_.v00000000),
-        size,
-        MEM_DECOMMIT);
-    VirtualFree(
-        memory_->views_.vC0000000 + (p - memory_->views_.v00000000),
-        size,
-        MEM_DECOMMIT);
-    VirtualFree(
-        memory_->views_.vE0000000 + (p - memory_->views_.v00000000),
-        size,
-        MEM_DECOMMIT);
-  }
 
   alloy::tracing::WriteEvent(EventType::MemoryHeapFree({
     heap_id_, address,
@@ -545,17 +1010,235 @@ uint64_t XenonMemoryHeap::Free(uint64_t address, size_t size) {
 
 size_t XenonMemoryHeap::QuerySize(uint64_t base_address) {
   uint8_t* p = memory_->Translate(base_address);
+  if (p < ptr_ || p >= ptr_ + size_) {
+    return 0;
+  }
+  uint32_t page = (uint32_t)((p - ptr_) / kPageSize);
+
+  uint32_t info = page_info_[page];
+  if (info & PAGE_SMALL) {
+    uint32_t class_index = (info & PAGE_VALUE) >> 8;
+    uint8_t* span = ptr_ + (page - (info & 0xFF)) * kPageSize;
+    size_t real_size = kSizeClasses[class_index];
+    return (p - span) % real_size ? 0 : real_size;
+  }
 
   // Heap allocated address.
-  size_t heap_guard_size = FLAGS_heap_guard_pages * 4096;
-  p -= heap_guard_size;
-  size_t real_size = mspace_usable_size(p);
-  real_size -= heap_guard_size * 2;
-  if (!real_size) {
+  size_t heap_guard_pages = FLAGS_heap_guard_pages;
+  if (page < heap_guard_pages) {
     return 0;
   }
+  page -= (uint32_t)heap_guard_pages;
+  XEIGNORE(LockMutex(lock_));
+  info = page_info_[page];
+  XEIGNORE(UnlockMutex(lock_));
+  if (!(info & PAGE_LARGE) ||
+      p != ptr_ + (page + heap_guard_pages) * kPageSize) {
+    return 0;
+  }
+  return (info & PAGE_VALUE) * kPageSize - heap_guard_pages * kPageSize * 2;
+}
+
+uint8_t* XenonMemoryHeap::AllocSmall(uint32_t class_index) {
+  if (!FLAGS_heap_thread_caches) {
+    XEIGNORE(LockMutex(lock_));
+    uint8_t* p = TakeBlock(class_index);
+    XEIGNORE(UnlockMutex(lock_));
+    return p;
+  }
+
+  ThreadCache& cache = caches_[GetThreadCacheSlot()];
+  XEIGNORE(LockMutex(cache.lock));
+  FreeList& list = cache.lists[class_index];
+  if (!list.head) {
+    RefillCache(list, class_index);
+  }
+  uint8_t* p = list.head;
+  if (p) {
+    list.head = *(uint8_t**)p;
+    list.count--;
+  }
+  XEIGNORE(UnlockMutex(cache.lock));
+  return p;
+}
+
+void XenonMemoryHeap::FreeSmall(uint8_t* p, uint32_t class_index) {
+  if (!FLAGS_heap_thread_caches) {
+    XEIGNORE(LockMutex(lock_));
+    FreeList& list = classes_[class_index].free_list;
+    *(uint8_t**)p = list.head;
+    list.head = p;
+    list.count++;
+    XEIGNORE(UnlockMutex(lock_));
+    return;
+  }
+
+  ThreadCache& cache = caches_[GetThreadCacheSlot()];
+  XEIGNORE(LockMutex(cache.lock));
+  FreeList& list = cache.lists[class_index];
+  *(uint8_t**)p = list.head;
+  list.head = p;
+  list.count++;
+  if (list.count > kThreadCacheLimit) {
+    FlushCache(list, class_index, kThreadCacheLimit / 2);
+  }
+  XEIGNORE(UnlockMutex(cache.lock));
+}
+
+uint8_t* XenonMemoryHeap::TakeBlock(uint32_t class_index) {
+  // Requires lock_.
+  SizeClass& size_class = classes_[class_index];
+  uint8_t* p = size_class.free_list.head;
+  if (p) {
+    size_class.free_list.head = *(uint8_t**)p;
+    size_class.free_list.count--;
+    return p;
+  }
+
+  uint32_t block_size = kSizeClasses[class_index];
+  if (size_class.span_next + block_size > size_class.span_end) {
+    // Spans stay with their class once carved, so the free path can find
+    // the class without a lock.
+    uint32_t page;
+    if (!AllocPages(kSpanPages, 1, 0, &page)) {
+      return NULL;
+    }
+    for (uint32_t n = 0; n < kSpanPages; n++) {
+      page_info_[page + n] = PAGE_SMALL | (class_index << 8) | n;
+    }
+    size_class.span_next = ptr_ + page * kPageSize;
+    size_class.span_end = size_class.span_next + kSpanPages * kPageSize;
+    size_class.span_count++;
+    if (is_physical_) {
+      CommitPhysical(size_class.span_next, kSpanPages * kPageSize);
+    }
+  }
+  p = size_class.span_next;
+  size_class.span_next += block_size;
+  return p;
+}
+
+void XenonMemoryHeap::RefillCache(FreeList& list, uint32_t class_index) {
+  XEIGNORE(LockMutex(lock_));
+  for (uint32_t n = 0; n < kThreadCacheBatch; n++) {
+    uint8_t* p = TakeBlock(class_index);
+    if (!p) {
+      break;
+    }
+    *(uint8_t**)p = list.head;
+    list.head = p;
+    list.count++;
+  }
+  XEIGNORE(UnlockMutex(lock_));
+}
+
+void XenonMemoryHeap::FlushCache(
+    FreeList& list, uint32_t class_index, uint32_t count) {
+  // Detach the blocks first so the heap lock is only held for the splice.
+  uint8_t* head = list.head;
+  uint8_t* tail = head;
+  for (uint32_t n = 1; n < count; n++) {
+    tail = *(uint8_t**)tail;
+  }
+  list.head = *(uint8_t**)tail;
+  list.count -= count;
 
-  return real_size;
+  XEIGNORE(LockMutex(lock_));
+  FreeList& central = classes_[class_index].free_list;
+  *(uint8_t**)tail = central.head;
+  central.head = head;
+  central.count += count;
+  XEIGNORE(UnlockMutex(lock_));
+}
+
+uint8_t* XenonMemoryHeap::AllocLarge(size_t size, uint32_t alignment) {
+  size_t heap_guard_pages = FLAGS_heap_guard_pages;
+  size_t heap_guard_size = heap_guard_pages * kPageSize;
+  size_t alloc_size = XEROUNDUP(MAX(size, (size_t)1), kPageSize);
+  uint32_t page_count =
+      (uint32_t)((alloc_size + heap_guard_size * 2) / kPageSize);
+  uint32_t page_alignment =
+      (uint32_t)(MAX((size_t)alignment, kPageSize) / kPageSize);
+
+  XEIGNORE(LockMutex(lock_));
+  uint32_t page;
+  if (!AllocPages(page_count, page_alignment, (uint32_t)heap_guard_pages,
+                  &page)) {
+    XEIGNORE(UnlockMutex(lock_));
+    return NULL;
+  }
+  page_info_[page] = PAGE_LARGE | page_count;
+  XEIGNORE(UnlockMutex(lock_));
+
+  uint8_t* p = ptr_ + page * kPageSize;
+  if (heap_guard_size) {
+    memory_->ProtectRegion(p, heap_guard_size, X_PAGE_NOACCESS);
+    p += heap_guard_size;
+    memory_->ProtectRegion(p + alloc_size, heap_guard_size, X_PAGE_NOACCESS);
+  }
+
+  if (is_physical_) {
+    // If physical, we need to commit the memory in the physical address ranges
+    // so that it can be accessed.
+    CommitPhysical(p, alloc_size);
+  }
+  return p;
+}
+
+bool XenonMemoryHeap::AllocPages(
+    uint32_t count, uint32_t alignment, uint32_t offset, uint32_t* out_page) {
+  // Requires lock_. First fit from the bottom of the heap, with page
+  // (start + offset) aligned.
+  for (auto it = free_runs_.begin(); it != free_runs_.end(); ++it) {
+    uint32_t run_start = it->first;
+    uint32_t run_end = run_start + it->second;
+    uint32_t start = XEROUNDUP(run_start + offset, alignment) - offset;
+    if (start + count > run_end) {
+      continue;
+    }
+    free_runs_.erase(it);
+    if (start > run_start) {
+      free_runs_[run_start] = start - run_start;
+    }
+    if (start + count < run_end) {
+      free_runs_[start + count] = run_end - (start + count);
+    }
+    *out_page = start;
+    return true;
+  }
+  return false;
+}
+
+void XenonMemoryHeap::FreePages(uint32_t page, uint32_t count) {
+  // Requires lock_. Merge with the runs on either side.
+  auto next = free_runs_.lower_bound(page);
+  if (next != free_runs_.end() && page + count == next->first) {
+    count += next->second;
+    next = free_runs_.erase(next);
+  }
+  if (next != free_runs_.begin()) {
+    auto prev = next;
+    --prev;
+    if (prev->first + prev->second == page) {
+      prev->second += count;
+      return;
+    }
+  }
+  free_runs_[page] = count;
+}
+
+void XenonMemoryHeap::CommitPhysical(uint8_t* p, size_t size) {
+  size_t offset = p - memory_->views_.v00000000;
+  memory_->CommitRegion(memory_->views_.vA0000000 + offset, size);
+  memory_->CommitRegion(memory_->views_.vC0000000 + offset, size);
+  memory_->CommitRegion(memory_->views_.vE0000000 + offset, size);
+}
+
+void XenonMemoryHeap::DecommitPhysical(uint8_t* p, size_t size) {
+  size_t offset = p - memory_->views_.v00000000;
+  memory_->DecommitRegion(memory_->views_.vA0000000 + offset, size);
+  memory_->DecommitRegion(memory_->views_.vC0000000 + offset, size);
+  memory_->DecommitRegion(memory_->views_.vE0000000 + offset, size);
 }
 
 void XenonMemoryHeap::Dump() {
@@ -564,36 +1247,40 @@ void XenonMemoryHeap::Dump() {
   if (FLAGS_heap_guard_pages) {
     XELOGI("  (heap guard pages enabled, stats will be wrong)");
   }
-  struct mallinfo info = mspace_mallinfo(space_);
-  XELOGI("    arena: %lld", info.arena);
-  XELOGI("  ordblks: %lld", info.ordblks);
-  XELOGI("    hblks: %lld", info.hblks);
-  XELOGI("   hblkhd: %lld", info.hblkhd);
-  XELOGI("  usmblks: %lld", info.usmblks);
-  XELOGI(" uordblks: %lld", info.uordblks);
-  XELOGI(" fordblks: %lld", info.fordblks);
-  XELOGI(" keepcost: %lld", info.keepcost);
-  mspace_inspect_all(space_, DumpHandler, this);
-}
-
-void XenonMemoryHeap::DumpHandler(
-  void* start, void* end, size_t used_bytes, void* context) {
-  XenonMemoryHeap* heap = (XenonMemoryHeap*)context;
-  XenonMemory* memory = heap->memory_;
-  size_t heap_guard_size = FLAGS_heap_guard_pages * 4096;
-  uint64_t start_addr = (uint64_t)start + heap_guard_size;
-  uint64_t end_addr = (uint64_t)end - heap_guard_size;
-  uint32_t guest_start =
-      (uint32_t)(start_addr - (uintptr_t)memory->mapping_base_);
-  uint32_t guest_end =
-      (uint32_t)(end_addr - (uintptr_t)memory->mapping_base_);
-  if (int32_t(end_addr - start_addr) > 0) {
-    XELOGI(" - %.8X-%.8X (%10db) %.16llX-%.16llX - %9db used",
-           guest_start, guest_end, (guest_end - guest_start),
-           start_addr, end_addr,
-           used_bytes);
-  } else {
-    XELOGI(" -                                 %.16llX-%.16llX - %9db used",
-           start, end, used_bytes);
+  if (FLAGS_heap_thread_caches) {
+    XELOGI("  (blocks held in thread caches are counted as used)");
   }
+  XEIGNORE(LockMutex(lock_));
+  uint32_t free_pages = 0;
+  for (auto it = free_runs_.begin(); it != free_runs_.end(); ++it) {
+    free_pages += it->second;
+  }
+  XELOGI("  free: %u pages in %u runs",
+         free_pages, (uint32_t)free_runs_.size());
+  for (uint32_t n = 0; n < kSizeClassCount; n++) {
+    const SizeClass& size_class = classes_[n];
+    if (!size_class.span_count) {
+      continue;
+    }
+    XELOGI("  %5ub: %4u spans, %6u free blocks",
+           kSizeClasses[n], size_class.span_count,
+           size_class.free_list.count +
+           (uint32_t)((size_class.span_end - size_class.span_next) /
+                      kSizeClasses[n]));
+  }
+  size_t heap_guard_size = FLAGS_heap_guard_pages * kPageSize;
+  uint64_t heap_address = (uint64_t)(ptr_ - memory_->mapping_base_);
+  for (uint32_t page = 0; page < page_info_.size(); page++) {
+    uint32_t info = page_info_[page];
+    if (!(info & PAGE_LARGE)) {
+      continue;
+    }
+    uint32_t guest_start =
+        (uint32_t)(heap_address + page * kPageSize + heap_guard_size);
+    uint32_t guest_end = (uint32_t)(heap_address +
+        (page + (info & PAGE_VALUE)) * kPageSize - heap_guard_size);
+    XELOGI(" - %.8X-%.8X (%10db)",
+           guest_start, guest_end, (guest_end - guest_start));
+  }
+  XEIGNORE(UnlockMutex(lock_));
 }
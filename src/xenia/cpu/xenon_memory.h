@@ -10,6 +10,8 @@
 #ifndef XENIA_CPU_XENON_MEMORY_H_
 #define XENIA_CPU_XENON_MEMORY_H_
 
+#include <map>
+
 #include <alloy/memory.h>
 
 #include <xenia/core.h>
@@ -38,12 +40,33 @@ public:
   virtual int Protect(uint64_t address, size_t size, uint32_t access);
   virtual uint32_t QueryProtect(uint64_t address);
 
+  virtual bool IsWatchablePage(uint64_t address, bool* out_executable);
+
 private:
   int MapViews(uint8_t* mapping_base);
   void UnmapViews();
+  int ReleaseRange(uint8_t* p, size_t size);
+
+  // Commit/decommit/protect through one of the views, keeping regions_ in
+  // sync with what the host was asked to do. Write watches on the range see
+  // it as written.
+  bool CommitRegion(uint8_t* p, size_t size);
+  bool DecommitRegion(uint8_t* p, size_t size);
+  bool ProtectRegion(uint8_t* p, size_t size, uint32_t protect);
+  // Records [start, end) as having the given protection, or as uncommitted
+  // when it's 0.
+  void UpdateRegions(uint64_t start, uint64_t end, uint32_t protect);
+  // The bytes from address to the end of its region and the region's
+  // X_PAGE_* protection.
+  void QueryRegion(uint64_t address, size_t* out_size, uint32_t* out_protect);
 
 private:
+#if XE_LIKE_WIN32
   HANDLE    mapping_;
+#else
+  // memfd (or shm) descriptor backing all views.
+  int       mapping_;
+#endif  // XE_LIKE_WIN32
   uint8_t*  mapping_base_;
   union {
     struct {
@@ -60,6 +83,16 @@ private:
   XenonMemoryHeap* virtual_heap_;
   XenonMemoryHeap* physical_heap_;
 
+  // Committed guest ranges by start address. Neighboring regions always
+  // differ in protection, so a region is what VirtualQuery would report.
+  // Anything not covered is reserved but uncommitted.
+  typedef struct {
+    uint64_t  end;
+    uint32_t  protect;
+  } Region;
+  alloy::Mutex* regions_lock_;
+  std::map<uint64_t, Region> regions_;
+
   friend class XenonMemoryHeap;
 };
 
@@ -0,0 +1,297 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <xenia/cpu/xenon_translation_cache.h>
+
+#include <algorithm>
+
+
+using namespace alloy::runtime;
+using namespace xe;
+using namespace xe::cpu;
+
+
+namespace {
+
+// 'XTC0' when read as bytes on a little-endian host.
+const uint32_t kFileMagic = 0x30435458;
+
+typedef struct {
+  uint32_t  magic;
+  uint32_t  format_version;
+  uint32_t  record_count;
+  uint32_t  reserved;
+} FileHeader;
+
+// Followed by length bytes of data, padded to 8b.
+typedef struct {
+  uint64_t  module_hash;
+  uint64_t  backend_version;
+  uint64_t  address;
+  uint64_t  end_address;
+  uint64_t  source_hash;
+  uint64_t  checksum;
+  uint32_t  length;
+  uint32_t  reserved;
+} FileRecord;
+
+uint64_t HashKey(const TranslationCache::Key& key) {
+  return TranslationCache::Hash(&key, sizeof(key));
+}
+
+bool KeysEqual(const TranslationCache::Key& a,
+               const TranslationCache::Key& b) {
+  return a.module_hash == b.module_hash &&
+         a.backend_version == b.backend_version &&
+         a.address == b.address;
+}
+
+}  // namespace
+
+
+XenonTranslationCache::XenonTranslationCache() :
+    path_(NULL), mmap_(NULL), is_dirty_(false),
+    hit_count_(0), miss_count_(0), store_count_(0) {
+  lock_ = xe_mutex_alloc(10000);
+}
+
+XenonTranslationCache::~XenonTranslationCache() {
+  XELOGI("Translation cache: %u hits, %u misses, %u stores",
+         hit_count_, miss_count_, store_count_);
+  if (is_dirty_) {
+    WriteFile();
+  }
+  for (auto it = records_.begin(); it != records_.end(); ++it) {
+    FreeRecord(it->second);
+  }
+  records_.clear();
+  for (auto it = replaced_records_.begin();
+       it != replaced_records_.end(); ++it) {
+    FreeRecord(*it);
+  }
+  replaced_records_.clear();
+  if (mmap_) {
+    xe_mmap_release(mmap_);
+  }
+  xe_free(path_);
+  xe_mutex_free(lock_);
+}
+
+int XenonTranslationCache::Initialize(const char* path) {
+  path_ = xestrdupa(path);
+  if (LoadFile()) {
+    // Missing or unusable - we'll write a new one on shutdown.
+    XELOGI("Translation cache %s not loaded, starting empty", path_);
+  } else {
+    XELOGI("Translation cache %s: %u entries",
+           path_, (uint32_t)records_.size());
+  }
+  return 0;
+}
+
+int XenonTranslationCache::LoadFile() {
+#if XE_WCHAR
+  xechar_t file_path[XE_MAX_PATH];
+  XEIGNORE(xestrwiden(file_path, XECOUNT(file_path), path_));
+#else
+  const xechar_t* file_path = path_;
+#endif
+  mmap_ = xe_mmap_open(kXEFileModeRead, file_path, 0, 0);
+  if (!mmap_) {
+    return 1;
+  }
+  const uint8_t* p = xe_mmap_get_addr(mmap_);
+  size_t length = xe_mmap_get_length(mmap_);
+
+  FileHeader header;
+  if (length < sizeof(header)) {
+    return 1;
+  }
+  xe_copy_struct(&header, p, sizeof(header));
+  if (header.magic != kFileMagic ||
+      header.format_version != kFormatVersion) {
+    XELOGW("Translation cache %s is from an incompatible build", path_);
+    is_dirty_ = true;
+    return 1;
+  }
+
+  // Only the record headers are touched here; data is checked on use.
+  size_t offset = sizeof(header);
+  for (uint32_t n = 0; n < header.record_count; n++) {
+    FileRecord file_record;
+    if (offset + sizeof(file_record) > length) {
+      break;
+    }
+    xe_copy_struct(&file_record, p + offset, sizeof(file_record));
+    offset += sizeof(file_record);
+    if (offset + file_record.length > length) {
+      break;
+    }
+
+    Record* record = (Record*)xe_calloc(sizeof(Record));
+    record->key.module_hash = file_record.module_hash;
+    record->key.backend_version = file_record.backend_version;
+    record->key.address = file_record.address;
+    record->entry.end_address = file_record.end_address;
+    record->entry.source_hash = file_record.source_hash;
+    record->entry.data = p + offset;
+    record->entry.length = file_record.length;
+    record->checksum = file_record.checksum;
+    record->is_validated = false;
+    record->is_owned = false;
+    offset += XEALIGN(file_record.length, 8);
+
+    uint64_t key_hash = HashKey(record->key);
+    auto it = records_.find(key_hash);
+    if (it != records_.end()) {
+      FreeRecord(it->second);
+    }
+    records_[key_hash] = record;
+  }
+  return 0;
+}
+
+int XenonTranslationCache::WriteFile() {
+  // Write to a temp file and swap it in, so a crash halfway through doesn't
+  // leave a corrupt cache behind. The old file is still mapped while we do
+  // this, as unchanged entries are copied straight out of it.
+  char temp_path[XE_MAX_PATH];
+  xesnprintfa(temp_path, XECOUNT(temp_path), "%s.tmp", path_);
+  FILE* file = fopen(temp_path, "wb");
+  if (!file) {
+    XELOGE("Unable to write translation cache %s", temp_path);
+    return 1;
+  }
+
+  std::vector<Record*> records;
+  for (auto it = records_.begin(); it != records_.end(); ++it) {
+    Record* record = it->second;
+    if (live_versions_.size() &&
+        std::find(live_versions_.begin(), live_versions_.end(),
+                  record->key.backend_version) == live_versions_.end()) {
+      continue;
+    }
+    records.push_back(record);
+  }
+
+  FileHeader header;
+  header.magic = kFileMagic;
+  header.format_version = kFormatVersion;
+  header.record_count = (uint32_t)records.size();
+  header.reserved = 0;
+  fwrite(&header, sizeof(header), 1, file);
+
+  const uint8_t padding[8] = { 0 };
+  for (auto it = records.begin(); it != records.end(); ++it) {
+    Record* record = *it;
+    FileRecord file_record;
+    file_record.module_hash = record->key.module_hash;
+    file_record.backend_version = record->key.backend_version;
+    file_record.address = record->key.address;
+    file_record.end_address = record->entry.end_address;
+    file_record.source_hash = record->entry.source_hash;
+    file_record.checksum = record->checksum;
+    file_record.length = (uint32_t)record->entry.length;
+    file_record.reserved = 0;
+    fwrite(&file_record, sizeof(file_record), 1, file);
+    fwrite(record->entry.data, 1, record->entry.length, file);
+    size_t pad = XEALIGN(record->entry.length, 8) - record->entry.length;
+    if (pad) {
+      fwrite(padding, 1, pad, file);
+    }
+  }
+  fclose(file);
+
+  // Release everything pointing into the old mapping before replacing it.
+  for (auto it = records_.begin(); it != records_.end(); ++it) {
+    FreeRecord(it->second);
+  }
+  records_.clear();
+  if (mmap_) {
+    xe_mmap_release(mmap_);
+    mmap_ = NULL;
+  }
+  remove(path_);
+  if (rename(temp_path, path_)) {
+    XELOGE("Unable to replace translation cache %s", path_);
+    return 1;
+  }
+  is_dirty_ = false;
+  return 0;
+}
+
+void XenonTranslationCache::FreeRecord(Record* record) {
+  if (record->is_owned) {
+    xe_free((void*)record->entry.data);
+  }
+  xe_free(record);
+}
+
+bool XenonTranslationCache::Lookup(const Key& key, Entry* out_entry) {
+  xe_mutex_lock(lock_);
+  if (std::find(live_versions_.begin(), live_versions_.end(),
+                key.backend_version) == live_versions_.end()) {
+    live_versions_.push_back(key.backend_version);
+  }
+
+  uint64_t key_hash = HashKey(key);
+  auto it = records_.find(key_hash);
+  if (it == records_.end() || !KeysEqual(it->second->key, key)) {
+    miss_count_++;
+    xe_mutex_unlock(lock_);
+    return false;
+  }
+
+  Record* record = it->second;
+  if (!record->is_validated) {
+    if (Hash(record->entry.data, record->entry.length) != record->checksum) {
+      XELOGW("Translation cache entry %.8X corrupt, dropping",
+             (uint32_t)key.address);
+      FreeRecord(record);
+      records_.erase(it);
+      is_dirty_ = true;
+      miss_count_++;
+      xe_mutex_unlock(lock_);
+      return false;
+    }
+    record->is_validated = true;
+  }
+
+  *out_entry = record->entry;
+  hit_count_++;
+  xe_mutex_unlock(lock_);
+  return true;
+}
+
+void XenonTranslationCache::Store(const Key& key, const Entry& entry) {
+  Record* record = (Record*)xe_calloc(sizeof(Record));
+  record->key = key;
+  record->entry = entry;
+  uint8_t* data = (uint8_t*)xe_malloc(entry.length);
+  xe_copy_struct(data, entry.data, entry.length);
+  record->entry.data = data;
+  record->checksum = Hash(data, entry.length);
+  record->is_validated = true;
+  record->is_owned = true;
+
+  xe_mutex_lock(lock_);
+  if (std::find(live_versions_.begin(), live_versions_.end(),
+                key.backend_version) == live_versions_.end()) {
+    live_versions_.push_back(key.backend_version);
+  }
+  uint64_t key_hash = HashKey(key);
+  auto it = records_.find(key_hash);
+  if (it != records_.end()) {
+    replaced_records_.push_back(it->second);
+  }
+  records_[key_hash] = record;
+  is_dirty_ = true;
+  store_count_++;
+  xe_mutex_unlock(lock_);
+}
@@ -0,0 +1,76 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef XENIA_CPU_XENON_TRANSLATION_CACHE_H_
+#define XENIA_CPU_XENON_TRANSLATION_CACHE_H_
+
+#include <alloy/runtime/translation_cache.h>
+
+#include <xenia/core.h>
+
+
+namespace xe {
+namespace cpu {
+
+
+// File backed translation cache.
+// The existing file is memory mapped and indexed on startup; entry data is
+// only checksummed the first time it's looked up. New entries are kept in
+// memory and the file is rewritten when the cache is destroyed.
+class XenonTranslationCache : public alloy::runtime::TranslationCache {
+public:
+  XenonTranslationCache();
+  virtual ~XenonTranslationCache();
+
+  int Initialize(const char* path);
+
+  virtual bool Lookup(const Key& key, Entry* out_entry);
+  virtual void Store(const Key& key, const Entry& entry);
+
+private:
+  typedef struct {
+    Key       key;
+    Entry     entry;
+    uint64_t  checksum;
+    bool      is_validated;
+    // Entry data is ours (not in the mapped file) and must be freed.
+    bool      is_owned;
+  } Record;
+  typedef std::tr1::unordered_map<uint64_t, Record*> RecordMap;
+
+  int LoadFile();
+  int WriteFile();
+  void FreeRecord(Record* record);
+
+private:
+  char*         path_;
+  xe_mmap_ref   mmap_;
+
+  xe_mutex_t*   lock_;
+  RecordMap     records_;
+  // Records replaced by Store. Their data may still be in use by whoever
+  // looked them up (possibly on another compile thread), and entry data is
+  // promised to live as long as the cache, so they're only freed with it.
+  std::vector<Record*> replaced_records_;
+  // Backend versions used this session. Records from any other version
+  // are dropped when the file is rewritten.
+  std::vector<uint64_t> live_versions_;
+  bool          is_dirty_;
+
+  uint32_t      hit_count_;
+  uint32_t      miss_count_;
+  uint32_t      store_count_;
+};
+
+
+}  // namespace cpu
+}  // namespace xe
+
+
+#endif  // XENIA_CPU_XENON_TRANSLATION_CACHE_H_
@@ -14,6 +14,8 @@
 #include <xenia/cpu/xenon_runtime.h>
 #include <xenia/export_resolver.h>
 
+#include <algorithm>
+
 using namespace alloy;
 using namespace alloy::runtime;
 using namespace xe::cpu;
@@ -29,7 +31,7 @@ void UndefinedImport(PPCContext* ppc_state, void* arg0, void* arg1) {
 XexModule::XexModule(
     XenonRuntime* runtime) :
     runtime_(runtime),
-    name_(0), path_(0), xex_(0),
+    name_(0), path_(0), xex_(0), content_hash_(0),
     base_address_(0), low_address_(0), high_address_(0),
     Module(runtime) {
 }
@@ -46,6 +48,15 @@ int XexModule::Load(const char* name, const char* path, xe_xex2_ref xex) {
   xex_ = xe_xex2_retain(xex);
   const xe_xex2_header_t* header = xe_xex2_get_header(xex);
 
+  // The signed digests change whenever the image does.
+  const xe_xex2_loader_info_t* loader_info = &header->loader_info;
+  content_hash_ = xe_hash64(
+      loader_info->header_digest, sizeof(loader_info->header_digest));
+  content_hash_ = xe_hash64(
+      loader_info->section_digest, sizeof(loader_info->section_digest),
+      content_hash_);
+  content_hash_ ^= header->exe_address;
+
   // Scan and find the low/high addresses.
   // All code sections are continuous, so this should be easy.
   low_address_ = UINT_MAX;
@@ -209,6 +220,68 @@ bool XexModule::ContainsAddress(uint64_t address) {
   return address >= low_address_ && address < high_address_;
 }
 
+size_t XexModule::DeclareAllFunctions() {
+  const xe_xex2_header_t* header = xe_xex2_get_header(xex_);
+  const uint8_t* membase = memory_->membase();
+  std::vector<uint64_t> addresses;
+
+  addresses.push_back(header->exe_entry_point);
+
+  // Export table, if this is a library. Ordinal offsets are relative to
+  // the image base (stored >> 16).
+  if (header->loader_info.export_table) {
+    const uint8_t* p = membase + header->loader_info.export_table;
+    uint32_t image_base = XEGETUINT32BE(p + 0x20) << 16;
+    uint32_t count = XEGETUINT32BE(p + 0x24);
+    for (uint32_t n = 0; n < count; n++) {
+      uint32_t offset = XEGETUINT32BE(p + 0x2C + n * 4);
+      if (offset) {
+        addresses.push_back(image_base + offset);
+      }
+    }
+  }
+
+  // Targets of every bl in the code sections.
+  for (size_t n = 0, i = 0; n < header->section_count; n++) {
+    const xe_xex2_section_t* section = &header->sections[n];
+    const size_t start_address =
+        header->exe_address + (i * xe_xex2_section_length);
+    const size_t end_address =
+        start_address + (section->info.page_count * xe_xex2_section_length);
+    if (section->info.type == XEX_SECTION_CODE) {
+      for (uint64_t address = start_address; address < end_address;
+           address += 4) {
+        uint32_t code = XEGETUINT32BE(membase + address);
+        // Opcode 18 (b) with LK=1 and AA=0.
+        if ((code >> 26) == 18 && (code & 3) == 1) {
+          int32_t li = (int32_t)(code & 0x03FFFFFC);
+          if (li & 0x02000000) {
+            li |= 0xFC000000;
+          }
+          addresses.push_back(address + li);
+        }
+      }
+    }
+    i += section->info.page_count;
+  }
+
+  std::sort(addresses.begin(), addresses.end());
+  addresses.erase(std::unique(addresses.begin(), addresses.end()),
+                  addresses.end());
+  size_t count = 0;
+  for (auto it = addresses.begin(); it != addresses.end(); ++it) {
+    uint64_t address = *it;
+    if (!ContainsAddress(address)) {
+      continue;
+    }
+    FunctionInfo* symbol_info;
+    if (!runtime_->LookupFunctionInfo(this, address, &symbol_info)) {
+      count++;
+    }
+  }
+  return count;
+}
+
 int XexModule::FindSaveRest() {
   // Special stack save/restore functions.
   // http://research.microsoft.com/en-us/um/redmond/projects/invisible/src/crt/md/ppc/xxx.s.htm
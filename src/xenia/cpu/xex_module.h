@@ -31,9 +31,16 @@ public:
   int Load(const char* name, const char* path, xe_xex2_ref xex);
 
   virtual const char* name() const { return name_; }
+  virtual uint64_t content_hash() const { return content_hash_; }
 
   virtual bool ContainsAddress(uint64_t address);
 
+  // Declares every function that can be found statically: the entry point,
+  // exports and all direct call targets. Normal execution discovers
+  // functions lazily; this is for precompiling whole modules.
+  // Returns the number of functions found.
+  size_t DeclareAllFunctions();
+
 private:
   int SetupImports(xe_xex2_ref xex);
   int SetupLibraryImports(const xe_xex2_import_library_t* library);
@@ -44,6 +51,7 @@ private:
   char*       name_;
   char*       path_;
   xe_xex2_ref xex_;
+  uint64_t    content_hash_;
 
   uint64_t    base_address_;
   uint64_t    low_address_;
@@ -262,7 +262,9 @@ SHIM_CALL NtReadFile_shim(
         byte_offset = -1;
       }
 
-      // Read now.
+      // Read now. The host writes the buffer with a system call, which
+      // fails on pages write-protected to watch them.
+      state->memory()->DirtyWriteWatches(buffer, buffer_length);
       size_t bytes_read = 0;
       result = file->Read(
           SHIM_MEM_ADDR(buffer), buffer_length, byte_offset,
@@ -108,6 +108,14 @@ using std::tr1::shared_ptr;
 #define XECACHEALIGN
 #define XECACHEALIGN64
 #endif  // MSVC
+
+#if XE_COMPILER_MSVC
+// http://msdn.microsoft.com/en-us/library/9w1sdazb.aspx
+#define XETHREADLOCAL           __declspec(thread)
+#elif XE_COMPILER_GNUC
+// http://gcc.gnu.org/onlinedocs/gcc/Thread-Local.html
+#define XETHREADLOCAL           __thread
+#endif  // MSVC
 typedef XECACHEALIGN volatile void xe_aligned_void_t;
 
 #if XE_COMPILER_MSVC
@@ -16,6 +16,8 @@
 
 #include <gflags/gflags.h>
 
+#include <benchmarks.h>
+
 using namespace alloy;
 using namespace alloy::backend;
 using namespace alloy::runtime;
@@ -23,7 +25,45 @@ using namespace xe;
 using namespace xe::cpu;
 
 
+DEFINE_string(benchmark, "",
+    "Runs the named benchmark instead of the sample "
+    "[call_context, code_invalidation, entry_table, guest_heap, "
+    "hir_layout, ivm, memory_sweep, pre_lowering].");
+
+
+int RunBenchmark(const std::string& name) {
+  xe_pal_options_t pal_options;
+  xe_zero_struct(&pal_options, sizeof(pal_options));
+  if (xe_pal_init(pal_options)) {
+    return 1;
+  }
+
+  if (name == "call_context") {
+    return RunCallContextBenchmark();
+  } else if (name == "code_invalidation") {
+    return RunCodeInvalidationBenchmark();
+  } else if (name == "entry_table") {
+    return RunEntryTableBenchmark();
+  } else if (name == "guest_heap") {
+    return RunGuestHeapBenchmark();
+  } else if (name == "hir_layout") {
+    return RunHIRLayoutBenchmark();
+  } else if (name == "ivm") {
+    return RunIVMBenchmark();
+  } else if (name == "memory_sweep") {
+    return RunMemorySweepBenchmark();
+  } else if (name == "pre_lowering") {
+    return RunPreLoweringBenchmark();
+  }
+  printf("Unknown benchmark: %s\n", name.c_str());
+  return 1;
+}
+
 int alloy_sandbox(int argc, xechar_t** argv) {
+  if (FLAGS_benchmark.size()) {
+    return RunBenchmark(FLAGS_benchmark);
+  }
+
   XenonMemory* memory = new XenonMemory();
 
   ExportResolver* export_resolver = new ExportResolver();
@@ -0,0 +1,104 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/backend/ivm/ivm_backend.h>
+#include <xenia/cpu/xenon_memory.h>
+
+using namespace alloy;
+using namespace xe;
+using namespace xe::cpu;
+
+
+namespace {
+
+typedef struct {
+  BenchmarkThreadFn   fn;
+  void*               context;
+  uint32_t            seed;
+  volatile uint32_t*  start_flag;
+  Semaphore*          done;
+  double              elapsed;
+  uint32_t            failures;
+} BenchmarkThreadState;
+
+void BenchmarkThread(void* param) {
+  BenchmarkThreadState* state = (BenchmarkThreadState*)param;
+  while (!*state->start_flag) {
+    // Spin so all threads start hammering at the same time.
+  }
+  double start = xe_pal_now();
+  state->failures = state->fn(state->context, state->seed);
+  state->elapsed = xe_pal_now() - start;
+  // Threads are detached on POSIX, so they can't be joined.
+  PostSemaphore(state->done);
+}
+
+}  // namespace
+
+
+void RunBenchmarkThreads(
+    const char* name, uint32_t thread_count,
+    BenchmarkThreadFn fn, void* context,
+    double* out_avg_elapsed, uint32_t* out_failures) {
+  volatile uint32_t start_flag = 0;
+  Semaphore* done = AllocSemaphore();
+  BenchmarkThreadState states[8];
+  xe_thread_ref threads[8];
+  XEASSERT(thread_count <= XECOUNT(threads));
+  for (uint32_t n = 0; n < thread_count; n++) {
+    states[n].fn = fn;
+    states[n].context = context;
+    states[n].seed = n * 7919 + 1;
+    states[n].start_flag = &start_flag;
+    states[n].done = done;
+    states[n].elapsed = 0;
+    states[n].failures = 0;
+    threads[n] = xe_thread_create(name, BenchmarkThread, &states[n]);
+    xe_thread_start(threads[n]);
+  }
+  start_flag = 1;
+
+  double total_elapsed = 0;
+  uint32_t total_failures = 0;
+  for (uint32_t n = 0; n < thread_count; n++) {
+    WaitSemaphore(done);
+  }
+  for (uint32_t n = 0; n < thread_count; n++) {
+    xe_thread_release(threads[n]);
+    total_elapsed += states[n].elapsed;
+    total_failures += states[n].failures;
+  }
+  FreeSemaphore(done);
+
+  *out_avg_elapsed = total_elapsed / thread_count;
+  *out_failures = total_failures;
+}
+
+XenonRuntime* CreateIVMRuntime() {
+  // The runtime initializes the memory it is given.
+  XenonMemory* memory = new XenonMemory();
+  ExportResolver* export_resolver = new ExportResolver();
+  XenonRuntime* runtime = new XenonRuntime(memory, export_resolver);
+  if (runtime->Initialize(new alloy::backend::ivm::IVMBackend(runtime))) {
+    printf("  failed to initialize runtime\n");
+    DestroyIVMRuntime(runtime);
+    return NULL;
+  }
+  return runtime;
+}
+
+void DestroyIVMRuntime(XenonRuntime* runtime) {
+  alloy::Memory* memory = runtime->memory();
+  ExportResolver* export_resolver = runtime->export_resolver();
+  delete runtime;
+  delete export_resolver;
+  delete memory;
+}
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#ifndef ALLOY_SANDBOX_BENCHMARKS_H_
+#define ALLOY_SANDBOX_BENCHMARKS_H_
+
+#include <xenia/xenia.h>
+#include <alloy/alloy.h>
+
+#include <xenia/cpu/xenon_runtime.h>
+
+
+// Microbenchmarks runnable with --benchmark=<name>.
+// Each returns 0 on success and prints its results to stdout.
+
+int RunCallContextBenchmark();
+int RunCodeInvalidationBenchmark();
+int RunEntryTableBenchmark();
+int RunGuestHeapBenchmark();
+int RunHIRLayoutBenchmark();
+int RunIVMBenchmark();
+int RunMemorySweepBenchmark();
+int RunPreLoweringBenchmark();
+
+
+// Shared by the benchmarks above.
+
+// Cheap LCG, so access patterns aren't sequential but are the same on every
+// run. Next returns the top 24 bits; the low bits of an LCG repeat quickly.
+class BenchmarkRandom {
+public:
+  BenchmarkRandom(uint32_t seed) : x_(seed) {}
+
+  uint32_t Next() {
+    x_ = x_ * 1664525 + 1013904223;
+    return x_ >> 8;
+  }
+
+private:
+  uint32_t x_;
+};
+
+// Restores a flag when it goes out of scope, so benchmarks can flip it
+// between configurations without leaking the change.
+template <typename T>
+class ScopedFlag {
+public:
+  ScopedFlag(T& flag) : flag_(flag), old_value_(flag) {}
+  ~ScopedFlag() { flag_ = old_value_; }
+
+private:
+  T& flag_;
+  T old_value_;
+};
+
+// Body of a benchmark thread. Runs once all threads have started, seeded
+// differently on each thread, and returns the number of failures.
+typedef uint32_t (*BenchmarkThreadFn)(void* context, uint32_t seed);
+
+// Runs fn on thread_count threads at once, returning the average time each
+// thread spent in it (in seconds) and the total number of failures.
+void RunBenchmarkThreads(
+    const char* name, uint32_t thread_count,
+    BenchmarkThreadFn fn, void* context,
+    double* out_avg_elapsed, uint32_t* out_failures);
+
+// A runtime using the IVM backend on a fresh XenonMemory, or NULL if it
+// couldn't be initialized. Free with DestroyIVMRuntime.
+xe::cpu::XenonRuntime* CreateIVMRuntime();
+void DestroyIVMRuntime(xe::cpu::XenonRuntime* runtime);
+
+
+#endif  // ALLOY_SANDBOX_BENCHMARKS_H_
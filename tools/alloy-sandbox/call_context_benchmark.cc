@@ -0,0 +1,185 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/frontend/ppc/ppc_context.h>
+#include <alloy/runtime/raw_module.h>
+#include <xenia/core/pal.h>
+#include <xenia/cpu/xenon_runtime.h>
+#include <xenia/cpu/xenon_thread_state.h>
+
+using namespace alloy;
+using namespace alloy::frontend::ppc;
+using namespace alloy::runtime;
+using namespace xe;
+using namespace xe::cpu;
+
+
+namespace {
+
+const uint64_t kCodeAddress = 0x82000000;
+const uint32_t kIterations = 64 * 1024;
+
+// Callers that keep guest registers in flight around calls to a callee
+// that reads or writes them, hand-assembled. The context passes must not
+// carry anything across the call.
+typedef struct {
+  const char* name;
+  const uint32_t* code;
+  size_t code_count;
+  void (*setup)(PPCContext* ctx);
+  bool (*check)(PPCContext* ctx);
+} Snippet;
+
+// caller: mflr r12
+//         li r3, 1
+//         bl callee
+//         addi r3, r3, 1
+//         mtlr r12
+//         blr
+// callee: li r3, 10
+//         blr
+const uint32_t load_after_call_code[] = {
+  0x7D8802A6, 0x38600001, 0x48000011, 0x38630001, 0x7D8803A6, 0x4E800020,
+  0x3860000A, 0x4E800020,
+};
+void load_after_call_setup(PPCContext* ctx) {
+  ctx->r[3] = 0;
+}
+bool load_after_call_check(PPCContext* ctx) {
+  return ctx->r[3] == 11;
+}
+
+// caller: mflr r12
+//         li r3, 5
+//         bl callee
+//         li r3, 0
+//         mtlr r12
+//         blr
+// callee: mr r4, r3
+//         blr
+const uint32_t store_before_call_code[] = {
+  0x7D8802A6, 0x38600005, 0x48000011, 0x38600000, 0x7D8803A6, 0x4E800020,
+  0x7C641B78, 0x4E800020,
+};
+void store_before_call_setup(PPCContext* ctx) {
+  ctx->r[3] = 0;
+  ctx->r[4] = 0;
+}
+bool store_before_call_check(PPCContext* ctx) {
+  return ctx->r[3] == 0 && ctx->r[4] == 5;
+}
+
+// li r3, 7
+// cmpwi r4, 0
+// beqlr
+// li r3, 9
+// blr
+const uint32_t store_before_return_code[] = {
+  0x38600007, 0x2C040000, 0x4D820020, 0x38600009, 0x4E800020,
+};
+void store_before_return_setup(PPCContext* ctx) {
+  ctx->r[3] = 0;
+  ctx->r[4] = 0;
+}
+bool store_before_return_check(PPCContext* ctx) {
+  return ctx->r[3] == 7;
+}
+
+// caller: mflr r12
+//         li r5, 0
+//         li r6, 3
+//         mtctr r6
+// loop:   bl callee
+//         add r5, r5, r3
+//         bdnz loop
+//         mtlr r12
+//         blr
+// callee: addi r3, r3, 1
+//         blr
+const uint32_t loop_around_call_code[] = {
+  0x7D8802A6, 0x38A00000, 0x38C00003, 0x7CC903A6, 0x48000015, 0x7CA51A14,
+  0x4200FFF8, 0x7D8803A6, 0x4E800020, 0x38630001, 0x4E800020,
+};
+void loop_around_call_setup(PPCContext* ctx) {
+  ctx->r[3] = 0;
+}
+bool loop_around_call_check(PPCContext* ctx) {
+  return ctx->r[3] == 3 && ctx->r[5] == 1 + 2 + 3;
+}
+
+#define SNIPPET(name) \
+    { #name, name##_code, XECOUNT(name##_code), \
+      name##_setup, name##_check }
+const Snippet snippets[] = {
+  SNIPPET(load_after_call),
+  SNIPPET(loop_around_call),
+  SNIPPET(store_before_call),
+  SNIPPET(store_before_return),
+};
+
+}  // namespace
+
+
+int RunCallContextBenchmark() {
+  printf("Call context benchmark: %u calls per snippet\n", kIterations);
+
+  XenonRuntime* runtime = CreateIVMRuntime();
+  if (!runtime) {
+    return 1;
+  }
+  XenonThreadState* thread_state = new XenonThreadState(
+      runtime, 100, 64 * 1024, 0);
+  PPCContext* ctx = thread_state->context();
+
+  int result = 0;
+  for (size_t n = 0; n < XECOUNT(snippets); n++) {
+    const Snippet& snippet = snippets[n];
+    uint64_t address = kCodeAddress + n * 0x1000;
+    uint32_t code[32];
+    XEASSERT(snippet.code_count <= XECOUNT(code));
+    for (size_t m = 0; m < snippet.code_count; m++) {
+      code[m] = XESWAP32BE(snippet.code[m]);
+    }
+    RawModule* module = new RawModule(runtime);
+    module->LoadData(address, (const uint8_t*)code,
+                     snippet.code_count * sizeof(uint32_t), snippet.name);
+    runtime->AddModule(module);
+
+    Function* fn;
+    if (runtime->ResolveFunction(address, &fn)) {
+      printf("  %-20s failed to compile\n", snippet.name);
+      result = 1;
+      continue;
+    }
+
+    uint32_t failures = 0;
+    double start = xe_pal_now();
+    for (uint32_t m = 0; m < kIterations; m++) {
+      ctx->lr = 0xBEBEBEBE;
+      snippet.setup(ctx);
+      fn->Call(thread_state, ctx->lr);
+      if (!snippet.check(ctx)) {
+        failures++;
+      }
+    }
+    double elapsed = xe_pal_now() - start;
+    printf("  %-20s %8.2f ns/call%s\n", snippet.name,
+           elapsed * 1000000000.0 / kIterations,
+           failures ? " (WRONG RESULT!)" : "");
+    if (failures) {
+      result = 1;
+    }
+  }
+
+  delete thread_state;
+  DestroyIVMRuntime(runtime);
+  return result;
+}
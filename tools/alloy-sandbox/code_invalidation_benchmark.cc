@@ -0,0 +1,157 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/frontend/ppc/ppc_context.h>
+#include <alloy/runtime/raw_module.h>
+#include <xenia/core/pal.h>
+#include <xenia/cpu/xenon_runtime.h>
+#include <xenia/cpu/xenon_thread_state.h>
+
+#include <gflags/gflags.h>
+
+using namespace alloy;
+using namespace alloy::frontend::ppc;
+using namespace alloy::runtime;
+using namespace xe;
+using namespace xe::cpu;
+
+
+DECLARE_bool(invalidate_modified_code);
+
+
+namespace {
+
+const uint64_t kCodeAddress = 0x82000000;
+const uint32_t kPatchCount = 4 * 1024;
+// Retired functions wait out a couple of epochs before they're freed.
+const size_t kMaxRetiredFunctions = 8;
+
+// caller: mflr r12
+//         bl callee
+//         mtlr r12
+//         blr
+// callee: li r3, 1
+//         blr
+// The callee is patched to load other values, and the caller must pick up
+// the retranslated callee without being retranslated itself.
+const uint32_t code[] = {
+  0x7D8802A6, 0x4800000D, 0x7D8803A6, 0x4E800020,
+  0x38600001, 0x4E800020,
+};
+const size_t kCalleeOffset = 4 * sizeof(uint32_t);
+// Past the code but on the same page, standing in for data.
+const size_t kDataOffset = 0x800;
+
+uint32_t LoadImmediate(uint32_t value) {
+  // li r3, value
+  return 0x38600000 | (value & 0xFFFF);
+}
+
+}  // namespace
+
+
+int RunCodeInvalidationBenchmark() {
+  printf("Code invalidation benchmark: %u patches\n", kPatchCount);
+
+  ScopedFlag<bool> saved_invalidate(FLAGS_invalidate_modified_code);
+  FLAGS_invalidate_modified_code = true;
+
+  XenonRuntime* runtime = CreateIVMRuntime();
+  if (!runtime) {
+    return 1;
+  }
+
+  uint32_t image[kDataOffset / sizeof(uint32_t) + 1];
+  xe_zero_struct(image, sizeof(image));
+  for (size_t n = 0; n < XECOUNT(code); n++) {
+    image[n] = XESWAP32BE(code[n]);
+  }
+  RawModule* module = new RawModule(runtime);
+  module->LoadData(kCodeAddress, (const uint8_t*)image, sizeof(image),
+                   "code_invalidation");
+  runtime->AddModule(module);
+
+  Function* fn;
+  if (runtime->ResolveFunction(kCodeAddress, &fn)) {
+    printf("  failed to compile\n");
+    DestroyIVMRuntime(runtime);
+    return 1;
+  }
+
+  XenonThreadState* thread_state = new XenonThreadState(
+      runtime, 100, 64 * 1024, 0);
+  PPCContext* ctx = thread_state->context();
+  Memory* memory = runtime->memory();
+  uint8_t* callee = memory->Translate(kCodeAddress + kCalleeOffset);
+  uint8_t* data = memory->Translate(kCodeAddress + kDataOffset);
+
+  int result = 0;
+  ctx->lr = 0xBEBEBEBE;
+  fn->Call(thread_state, ctx->lr);
+  if (ctx->r[3] != 1) {
+    printf("  initial call returned %u, expected 1 (WRONG RESULT!)\n",
+           (uint32_t)ctx->r[3]);
+    result = 1;
+  }
+
+  // Writes to data sharing the page must not retranslate anything.
+  uint32_t write_count = runtime->code_write_count();
+  double start = xe_pal_now();
+  for (uint32_t n = 0; n < kPatchCount; n++) {
+    XESETUINT32BE(data, n);
+    ctx->lr = 0xBEBEBEBE;
+    fn->Call(thread_state, ctx->lr);
+  }
+  double data_elapsed = xe_pal_now() - start;
+  uint32_t data_invalidations = runtime->code_write_count() - write_count;
+  printf("  data writes: %8.2f us/write+call, %u invalidations%s\n",
+         data_elapsed * 1000000.0 / kPatchCount, data_invalidations,
+         data_invalidations ? " (WRONG RESULT!)" : "");
+  if (data_invalidations || ctx->r[3] != 1) {
+    result = 1;
+  }
+
+  // Each patch must be seen by the next call through the caller.
+  uint32_t failures = 0;
+  write_count = runtime->code_write_count();
+  start = xe_pal_now();
+  for (uint32_t n = 0; n < kPatchCount; n++) {
+    uint32_t value = 2 + (n & 0xFF);
+    XESETUINT32BE(callee, LoadImmediate(value));
+    ctx->lr = 0xBEBEBEBE;
+    fn->Call(thread_state, ctx->lr);
+    if (ctx->r[3] != value) {
+      failures++;
+    }
+  }
+  double code_elapsed = xe_pal_now() - start;
+  uint32_t code_invalidations = runtime->code_write_count() - write_count;
+  printf("  code writes: %8.2f us/write+call, %u invalidations, "
+         "%u stale results%s\n",
+         code_elapsed * 1000000.0 / kPatchCount, code_invalidations,
+         failures, failures ? " (WRONG RESULT!)" : "");
+  if (failures) {
+    result = 1;
+  }
+
+  // Each patch retires a version of the callee, which must be freed once
+  // the thread is done with it rather than kept until shutdown.
+  size_t retired_count = runtime->retired_function_count();
+  printf("  %u retired functions kept%s\n", (uint32_t)retired_count,
+         retired_count > kMaxRetiredFunctions ? " (LEAKED!)" : "");
+  if (retired_count > kMaxRetiredFunctions) {
+    result = 1;
+  }
+
+  delete thread_state;
+  DestroyIVMRuntime(runtime);
+  return result;
+}
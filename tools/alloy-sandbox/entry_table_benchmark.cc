@@ -0,0 +1,84 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/runtime/entry_table.h>
+#include <xenia/core/pal.h>
+#include <xenia/core/thread.h>
+
+using namespace alloy;
+using namespace alloy::runtime;
+
+
+namespace {
+
+const uint64_t kBaseAddress = 0x82000000;
+const uint32_t kEntryCount = 64 * 1024;
+const uint32_t kLookupsPerThread = 8 * 1024 * 1024;
+
+uint32_t LookupThread(void* context, uint32_t seed) {
+  EntryTable* table = (EntryTable*)context;
+  BenchmarkRandom random(seed);
+  uint32_t misses = 0;
+  for (uint32_t n = 0; n < kLookupsPerThread; n++) {
+    uint64_t address = kBaseAddress + (random.Next() % kEntryCount) * 16;
+    Entry* entry;
+    if (table->GetOrCreate(address, &entry) != Entry::STATUS_READY) {
+      misses++;
+    }
+  }
+  return misses;
+}
+
+int RunLookups(EntryTable* table, uint32_t thread_count) {
+  double avg_elapsed;
+  uint32_t total_misses;
+  RunBenchmarkThreads("EntryTable Lookup", thread_count, LookupThread, table,
+                      &avg_elapsed, &total_misses);
+
+  double ns_per_lookup = avg_elapsed * 1000000000.0 / kLookupsPerThread;
+  double mlookups_per_sec =
+      (thread_count * (double)kLookupsPerThread) / avg_elapsed / 1000000.0;
+  printf("  %u thread(s): %8.2f ns/lookup, %8.2f Mlookups/s aggregate%s\n",
+         thread_count, ns_per_lookup, mlookups_per_sec,
+         total_misses ? " (MISSES!)" : "");
+  return total_misses ? 1 : 0;
+}
+
+}  // namespace
+
+
+int RunEntryTableBenchmark() {
+  printf("EntryTable lookup benchmark: %u entries, %u lookups/thread\n",
+         kEntryCount, kLookupsPerThread);
+
+  EntryTable* table = new EntryTable();
+
+  // Populate with fake ready entries. The function pointer is never touched.
+  for (uint32_t n = 0; n < kEntryCount; n++) {
+    Entry* entry;
+    uint64_t address = kBaseAddress + n * 16;
+    if (table->GetOrCreate(address, &entry) == Entry::STATUS_NEW) {
+      entry->function = (Function*)table;
+      entry->end_address = address + 12;
+      xe_memory_barrier();
+      entry->status = Entry::STATUS_READY;
+    }
+  }
+
+  int result = 0;
+  uint32_t thread_counts[] = { 1, 4, 8 };
+  for (size_t n = 0; n < XECOUNT(thread_counts); n++) {
+    result |= RunLookups(table, thread_counts[n]);
+  }
+
+  delete table;
+  return result;
+}
@@ -0,0 +1,112 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <xenia/core/pal.h>
+#include <xenia/core/thread.h>
+#include <xenia/cpu/xenon_memory.h>
+
+#include <gflags/gflags.h>
+
+using namespace alloy;
+using namespace xe::cpu;
+
+
+DECLARE_bool(heap_thread_caches);
+
+
+namespace {
+
+const uint32_t kOpsPerThread = 1024 * 1024;
+// Allocations each thread keeps live; a slot is freed if in use, otherwise
+// filled, so the heap sees an even mix of both.
+const uint32_t kLiveSlots = 256;
+
+uint32_t HeapThread(void* context, uint32_t seed) {
+  XenonMemory* memory = (XenonMemory*)context;
+  uint64_t slots[kLiveSlots] = { 0 };
+
+  // Mostly small allocations, like guest objects and strings, with the
+  // occasional buffer.
+  BenchmarkRandom random(seed);
+  uint32_t failures = 0;
+  for (uint32_t n = 0; n < kOpsPerThread; n++) {
+    uint32_t x = random.Next();
+    uint64_t& slot = slots[x % kLiveSlots];
+    if (slot) {
+      memory->HeapFree(slot, 0);
+      slot = 0;
+      continue;
+    }
+    uint32_t kind = (x >> 8) % 100;
+    uint32_t y = random.Next();
+    size_t size;
+    if (kind < 85) {
+      size = 16 + y % 496;
+    } else if (kind < 95) {
+      size = 512 + y % 1536;
+    } else {
+      size = 4096 + y % (60 * 1024);
+    }
+    slot = memory->HeapAlloc(0, size, 0);
+    if (!slot) {
+      failures++;
+    }
+  }
+
+  for (uint32_t n = 0; n < kLiveSlots; n++) {
+    if (slots[n]) {
+      memory->HeapFree(slots[n], 0);
+    }
+  }
+  return failures;
+}
+
+int RunThreads(bool thread_caches, uint32_t thread_count) {
+  FLAGS_heap_thread_caches = thread_caches;
+  XenonMemory* memory = new XenonMemory();
+  if (memory->Initialize()) {
+    delete memory;
+    return 1;
+  }
+
+  double avg_elapsed;
+  uint32_t total_failures;
+  RunBenchmarkThreads("Guest Heap", thread_count, HeapThread, memory,
+                      &avg_elapsed, &total_failures);
+  delete memory;
+
+  double ns_per_op = avg_elapsed * 1000000000.0 / kOpsPerThread;
+  double mops_per_sec =
+      (thread_count * (double)kOpsPerThread) / avg_elapsed / 1000000.0;
+  printf("  %-8s %u thread(s): %8.2f ns/op, %8.2f Mops/s aggregate%s\n",
+         thread_caches ? "cached" : "locked", thread_count,
+         ns_per_op, mops_per_sec, total_failures ? " (FAILURES!)" : "");
+  return total_failures ? 1 : 0;
+}
+
+}  // namespace
+
+
+int RunGuestHeapBenchmark() {
+  printf("Guest heap benchmark: %u alloc/free ops/thread, %u live/thread\n",
+         kOpsPerThread, kLiveSlots);
+
+  // Without thread caches every small allocation takes the heap lock, as
+  // all allocations used to.
+  ScopedFlag<bool> saved_thread_caches(FLAGS_heap_thread_caches);
+  int result = 0;
+  uint32_t thread_counts[] = { 1, 2, 4, 8 };
+  for (size_t n = 0; n < XECOUNT(thread_counts); n++) {
+    result |= RunThreads(false, thread_counts[n]);
+    result |= RunThreads(true, thread_counts[n]);
+  }
+  return result;
+}
@@ -0,0 +1,201 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/compiler/compiler.h>
+#include <alloy/frontend/frontend.h>
+#include <alloy/runtime/raw_module.h>
+#include <xenia/core/pal.h>
+#include <xenia/cpu/xenon_runtime.h>
+
+#include <gflags/gflags.h>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::runtime;
+using namespace xe;
+using namespace xe::cpu;
+
+
+DECLARE_bool(compact_hir);
+
+
+namespace {
+
+const uint64_t kCodeAddress = 0x82000000;
+const uint32_t kFunctionSpacing = 0x8000;
+const uint32_t kFunctionSizes[] = { 16, 64, 256, 1024, 4096 };
+const uint32_t kFunctionsPerSize = 8;
+const uint32_t kFunctionCount = XECOUNT(kFunctionSizes) * kFunctionsPerSize;
+const uint32_t kRounds = 4;
+
+class CorpusGenerator {
+public:
+  CorpusGenerator(uint32_t seed) : random_(seed) {}
+
+  // Fills code with roughly length instructions of straight-line integer
+  // code, loads/stores, compare-and-skip diamonds and small bdnz loops,
+  // ending in blr. Control flow is always structured so every function
+  // scans cleanly. Returns the instruction count.
+  uint32_t Generate(uint32_t length, uint32_t* code) {
+    uint32_t count = 0;
+    while (count < length) {
+      uint32_t kind = Next() % 20;
+      if (kind < 14) {
+        code[count++] = RandomOp();
+      } else if (kind < 17) {
+        // cmpw cr0, rA, rB ; bge +skip ; ...
+        uint32_t skip = 1 + Next() % 6;
+        code[count++] = 0x7C000000 | (Reg() << 16) | (Reg() << 11);
+        code[count++] = 0x40800000 | ((skip + 1) * 4);
+        for (uint32_t n = 0; n < skip; n++) {
+          code[count++] = RandomOp();
+        }
+      } else {
+        // loop: ... ; bdnz loop
+        uint32_t body = 2 + Next() % 8;
+        for (uint32_t n = 0; n < body; n++) {
+          code[count++] = RandomOp();
+        }
+        code[count++] = 0x42000000 | ((0 - body * 4) & 0xFFFC);
+      }
+    }
+    code[count++] = 0x4E800020;
+    return count;
+  }
+
+private:
+  uint32_t Next() {
+    return random_.Next();
+  }
+  // r3-r12, so nothing touches the stack pointer or r0 (which means 0 as
+  // a base register).
+  uint32_t Reg() {
+    return 3 + Next() % 10;
+  }
+  uint32_t RandomOp() {
+    uint32_t d = Reg();
+    uint32_t a = Reg();
+    uint32_t b = Reg();
+    switch (Next() % 8) {
+    default:
+    case 0: return 0x7C000214 | (d << 21) | (a << 16) | (b << 11);  // add
+    case 1: return 0x7C000050 | (d << 21) | (a << 16) | (b << 11);  // subf
+    case 2: return 0x7C000278 | (d << 21) | (a << 16) | (b << 11);  // xor
+    case 3: return 0x7C000038 | (d << 21) | (a << 16) | (b << 11);  // and
+    case 4: return 0x7C000378 | (d << 21) | (a << 16) | (b << 11);  // or
+    case 5: return 0x38000000 | (d << 21) | (a << 16) |             // addi
+                   (Next() & 0xFFFF);
+    case 6: return 0x80000000 | (d << 21) | (a << 16) |             // lwz
+                   ((Next() % 64) * 4);
+    case 7: return 0x90000000 | (d << 21) | (a << 16) |             // stw
+                   ((Next() % 64) * 4);
+    }
+  }
+
+  BenchmarkRandom random_;
+};
+
+int CompileCorpus(bool compact, const uint8_t* corpus, size_t corpus_length,
+                  Compiler::PassTimingList& timings) {
+  // Pass lists are built when the translator is created, so each mode gets
+  // fresh runtimes.
+  FLAGS_compact_hir = compact;
+
+  int result = 0;
+  for (uint32_t round = 0; round < kRounds && !result; round++) {
+    XenonRuntime* runtime = CreateIVMRuntime();
+    if (!runtime) {
+      result = 1;
+      break;
+    }
+
+    RawModule* module = new RawModule(runtime);
+    module->LoadData(kCodeAddress, corpus, corpus_length, "corpus");
+    runtime->AddModule(module);
+
+    for (uint32_t n = 0; n < kFunctionCount; n++) {
+      Function* fn;
+      if (runtime->ResolveFunction(kCodeAddress + n * kFunctionSpacing,
+                                   &fn)) {
+        printf("  function %u failed to compile\n", n);
+        result = 1;
+        break;
+      }
+    }
+
+    runtime->frontend()->GetTimings(timings);
+    DestroyIVMRuntime(runtime);
+  }
+  return result;
+}
+
+const Compiler::PassTiming* FindTiming(
+    const Compiler::PassTimingList& timings, const char* name) {
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    if (!xestrcmpa(it->name, name)) {
+      return &(*it);
+    }
+  }
+  return NULL;
+}
+
+}  // namespace
+
+
+int RunHIRLayoutBenchmark() {
+  printf("HIR layout benchmark: %u functions of %u-%u instructions, "
+         "%u rounds\n",
+         kFunctionCount, kFunctionSizes[0],
+         kFunctionSizes[XECOUNT(kFunctionSizes) - 1], kRounds);
+
+  size_t corpus_length = kFunctionCount * kFunctionSpacing;
+  uint32_t* corpus = (uint32_t*)xe_calloc(corpus_length);
+  CorpusGenerator generator(0x1234);
+  for (uint32_t n = 0; n < kFunctionCount; n++) {
+    uint32_t* code = corpus + n * kFunctionSpacing / sizeof(uint32_t);
+    uint32_t count = generator.Generate(
+        kFunctionSizes[n / kFunctionsPerSize], code);
+    XEASSERT(count * sizeof(uint32_t) < kFunctionSpacing);
+    for (uint32_t m = 0; m < count; m++) {
+      code[m] = XESWAP32BE(code[m]);
+    }
+  }
+
+  ScopedFlag<bool> saved_compact(FLAGS_compact_hir);
+  Compiler::PassTimingList scattered_timings;
+  Compiler::PassTimingList compact_timings;
+  int result = CompileCorpus(false, (uint8_t*)corpus, corpus_length,
+                             scattered_timings);
+  result |= CompileCorpus(true, (uint8_t*)corpus, corpus_length,
+                          compact_timings);
+  xe_free(corpus);
+
+  // Everything the compacted pipeline ran, including Compaction itself.
+  printf("  %-24s %12s %12s %8s\n",
+         "pass", "scattered ms", "compact ms", "speedup");
+  uint64_t scattered_total = 0;
+  uint64_t compact_total = 0;
+  for (auto it = compact_timings.begin(); it != compact_timings.end();
+       ++it) {
+    const Compiler::PassTiming* scattered =
+        FindTiming(scattered_timings, it->name);
+    uint64_t scattered_ns = scattered ? scattered->total_ns : 0;
+    scattered_total += scattered_ns;
+    compact_total += it->total_ns;
+    printf("  %-24s %12.2f %12.2f %7.2fx\n",
+           it->name, scattered_ns / 1000000.0, it->total_ns / 1000000.0,
+           it->total_ns ? (double)scattered_ns / it->total_ns : 0.0);
+  }
+  printf("  %-24s %12.2f %12.2f %7.2fx\n",
+         "total", scattered_total / 1000000.0, compact_total / 1000000.0,
+         compact_total ? (double)scattered_total / compact_total : 0.0);
+  return result;
+}
@@ -0,0 +1,224 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/frontend/ppc/ppc_context.h>
+#include <alloy/runtime/raw_module.h>
+#include <xenia/core/pal.h>
+#include <xenia/cpu/xenon_runtime.h>
+#include <xenia/cpu/xenon_thread_state.h>
+
+#include <gflags/gflags.h>
+
+using namespace alloy;
+using namespace alloy::frontend::ppc;
+using namespace alloy::runtime;
+using namespace xe;
+using namespace xe::cpu;
+
+
+DECLARE_bool(ivm_superinstructions);
+
+
+namespace {
+
+const uint64_t kCodeAddress = 0x82000000;
+const uint32_t kIterations = 4 * 1024 * 1024;
+
+// Small loops in the style of test/codegen, hand-assembled.
+// Each runs its body ctr times via bdnz and then checks its outputs the way
+// a REGISTER_OUT annotation would.
+typedef struct {
+  const char* name;
+  const uint32_t* code;
+  size_t code_count;
+  // Guest instructions executed per iteration, including the bdnz.
+  uint32_t body_count;
+  void (*setup)(PPCContext* ctx, uint64_t scratch_address);
+  bool (*check)(PPCContext* ctx, uint8_t* scratch);
+} Snippet;
+
+// loop: add r11, r5, r25
+//       addi r5, r5, 1
+//       bdnz loop
+//       blr
+const uint32_t add_code[] = {
+  0x7D65CA14, 0x38A50001, 0x4200FFF8, 0x4E800020,
+};
+void add_setup(PPCContext* ctx, uint64_t scratch_address) {
+  ctx->r[5] = 0;
+  ctx->r[25] = 0x0000FFFF;
+}
+bool add_check(PPCContext* ctx, uint8_t* scratch) {
+  return ctx->r[5] == kIterations &&
+         ctx->r[11] == kIterations - 1 + 0x0000FFFF;
+}
+
+// loop: cmpw r3, r4
+//       bge skip
+//       addi r3, r3, 1
+// skip: bdnz loop
+//       blr
+const uint32_t compare_branch_code[] = {
+  0x7C032000, 0x40800008, 0x38630001, 0x4200FFF4, 0x4E800020,
+};
+void compare_branch_setup(PPCContext* ctx, uint64_t scratch_address) {
+  ctx->r[3] = 0;
+  ctx->r[4] = kIterations / 2;
+}
+bool compare_branch_check(PPCContext* ctx, uint8_t* scratch) {
+  return ctx->r[3] == kIterations / 2;
+}
+
+// loop: xor r8, r8, r6
+//       and r9, r8, r7
+//       or r10, r9, r6
+//       addi r6, r6, 3
+//       bdnz loop
+//       blr
+const uint32_t logical_code[] = {
+  0x7D083278, 0x7D093838, 0x7D2A3378, 0x38C60003, 0x4200FFF0, 0x4E800020,
+};
+void logical_setup(PPCContext* ctx, uint64_t scratch_address) {
+  ctx->r[6] = 1;
+  ctx->r[7] = 0x00FF00FF;
+  ctx->r[8] = 0;
+}
+bool logical_check(PPCContext* ctx, uint8_t* scratch) {
+  uint64_t r6 = 1, r7 = 0x00FF00FF, r8 = 0, r9 = 0, r10 = 0;
+  for (uint32_t n = 0; n < kIterations; n++) {
+    r8 ^= r6;
+    r9 = r8 & r7;
+    r10 = r9 | r6;
+    r6 += 3;
+  }
+  return ctx->r[8] == r8 && ctx->r[9] == r9 && ctx->r[10] == r10;
+}
+
+// loop: lwz r6, 0(r7)
+//       addi r6, r6, 1
+//       stw r6, 0(r7)
+//       bdnz loop
+//       blr
+const uint32_t memory_code[] = {
+  0x80C70000, 0x38C60001, 0x90C70000, 0x4200FFF4, 0x4E800020,
+};
+void memory_setup(PPCContext* ctx, uint64_t scratch_address) {
+  ctx->r[7] = scratch_address;
+}
+bool memory_check(PPCContext* ctx, uint8_t* scratch) {
+  return XEGETUINT32BE(scratch) == kIterations;
+}
+
+#define SNIPPET(name, body_count) \
+    { #name, name##_code, XECOUNT(name##_code), body_count, \
+      name##_setup, name##_check }
+const Snippet snippets[] = {
+  SNIPPET(add, 3),
+  SNIPPET(compare_branch, 4),
+  SNIPPET(logical, 5),
+  SNIPPET(memory, 4),
+};
+
+int RunSnippets(bool use_superinstructions, double* out_elapsed) {
+  // Functions are fused when they are compiled, so each mode gets a fresh
+  // runtime.
+  FLAGS_ivm_superinstructions = use_superinstructions;
+
+  XenonRuntime* runtime = CreateIVMRuntime();
+  if (!runtime) {
+    for (size_t n = 0; n < XECOUNT(snippets); n++) {
+      out_elapsed[n] = 0;
+    }
+    return 1;
+  }
+
+  XenonThreadState* thread_state = new XenonThreadState(
+      runtime, 100, 64 * 1024, 0);
+  Memory* memory = runtime->memory();
+  uint64_t scratch_address = memory->HeapAlloc(0, 16, MEMORY_FLAG_ZERO);
+  uint8_t* scratch = memory->Translate(scratch_address);
+
+  int result = 0;
+  for (size_t n = 0; n < XECOUNT(snippets); n++) {
+    const Snippet& snippet = snippets[n];
+    uint64_t address = kCodeAddress + n * 0x1000;
+    uint32_t code[16];
+    XEASSERT(snippet.code_count <= XECOUNT(code));
+    for (size_t m = 0; m < snippet.code_count; m++) {
+      code[m] = XESWAP32BE(snippet.code[m]);
+    }
+    RawModule* module = new RawModule(runtime);
+    module->LoadData(address, (const uint8_t*)code,
+                     snippet.code_count * sizeof(uint32_t), snippet.name);
+    runtime->AddModule(module);
+
+    Function* fn;
+    if (runtime->ResolveFunction(address, &fn)) {
+      printf("  %-16s failed to compile\n", snippet.name);
+      out_elapsed[n] = 0;
+      result = 1;
+      continue;
+    }
+
+    PPCContext* ctx = thread_state->context();
+    ctx->lr = 0xBEBEBEBE;
+    ctx->ctr = kIterations;
+    XESETUINT32BE(scratch, 0);
+    snippet.setup(ctx, scratch_address);
+
+    double start = xe_pal_now();
+    fn->Call(thread_state, ctx->lr);
+    double elapsed = xe_pal_now() - start;
+    out_elapsed[n] = elapsed;
+
+    bool passed = snippet.check(ctx, scratch);
+    printf("  %-16s %8.2f ns/iteration, %8.2f ns/guest instruction%s\n",
+           snippet.name,
+           elapsed * 1000000000.0 / kIterations,
+           elapsed * 1000000000.0 / kIterations / snippet.body_count,
+           passed ? "" : " (WRONG RESULT!)");
+    if (!passed) {
+      result = 1;
+    }
+  }
+
+  delete thread_state;
+  DestroyIVMRuntime(runtime);
+  return result;
+}
+
+}  // namespace
+
+
+int RunIVMBenchmark() {
+  printf("IVM interpreter benchmark: %u iterations per snippet\n",
+         kIterations);
+
+  ScopedFlag<bool> saved_superinstructions(FLAGS_ivm_superinstructions);
+  double plain_elapsed[XECOUNT(snippets)];
+  double fused_elapsed[XECOUNT(snippets)];
+
+  printf("Without superinstructions:\n");
+  int result = RunSnippets(false, plain_elapsed);
+  printf("With superinstructions:\n");
+  result |= RunSnippets(true, fused_elapsed);
+
+  printf("Speedup:\n");
+  for (size_t n = 0; n < XECOUNT(snippets); n++) {
+    // Snippets that failed to compile in either mode have no timing.
+    if (!plain_elapsed[n] || !fused_elapsed[n]) {
+      continue;
+    }
+    printf("  %-16s %8.2fx\n", snippets[n].name,
+           plain_elapsed[n] / fused_elapsed[n]);
+  }
+  return result;
+}
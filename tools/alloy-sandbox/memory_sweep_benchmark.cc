@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <xenia/cpu/xenon_memory.h>
+
+#include <gflags/gflags.h>
+
+#if XE_PLATFORM_UNIX && defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAS_PERF_EVENTS 1
+#endif  // __linux__
+
+using namespace alloy;
+using namespace xe::cpu;
+
+
+DECLARE_bool(huge_pages);
+
+
+namespace {
+
+const size_t kWorkingSetSize = 256 * 1024 * 1024;
+const uint32_t kAccessCount = 32 * 1024 * 1024;
+
+// Counts data TLB misses on the current thread, where the host lets us.
+class TLBMissCounter {
+public:
+  TLBMissCounter() : fd_(-1) {
+#if HAS_PERF_EVENTS
+    perf_event_attr attr;
+    xe_zero_struct(&attr, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif  // HAS_PERF_EVENTS
+  }
+  ~TLBMissCounter() {
+#if HAS_PERF_EVENTS
+    if (fd_ != -1) {
+      close(fd_);
+    }
+#endif  // HAS_PERF_EVENTS
+  }
+
+  bool is_available() const { return fd_ != -1; }
+
+  void Start() {
+#if HAS_PERF_EVENTS
+    if (fd_ != -1) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif  // HAS_PERF_EVENTS
+  }
+
+  uint64_t Stop() {
+    uint64_t count = 0;
+#if HAS_PERF_EVENTS
+    if (fd_ != -1) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+#endif  // HAS_PERF_EVENTS
+    return count;
+  }
+
+private:
+  int fd_;
+};
+
+// kB of shared memory mapped with huge pages, to check the hint took.
+uint64_t QueryHugePageKB() {
+  uint64_t total = 0;
+#if XE_PLATFORM_UNIX
+  FILE* file = fopen("/proc/self/smaps_rollup", "r");
+  if (!file) {
+    return 0;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long long kb;
+    if (sscanf(line, "ShmemPmdMapped: %llu kB", &kb) == 1 ||
+        sscanf(line, "FilePmdMapped: %llu kB", &kb) == 1) {
+      total += kb;
+    }
+  }
+  fclose(file);
+#endif  // XE_PLATFORM_UNIX
+  return total;
+}
+
+typedef struct {
+  const char* name;
+  bool        huge_pages;
+  double      touch_elapsed;
+  double      sweep_elapsed;
+  uint64_t    tlb_misses;
+  uint64_t    huge_page_kb;
+} Configuration;
+
+int RunConfiguration(Configuration& config) {
+  // Huge pages are hinted when the views are created.
+  FLAGS_huge_pages = config.huge_pages;
+  XenonMemory* memory = new XenonMemory();
+  if (memory->Initialize()) {
+    delete memory;
+    return 1;
+  }
+
+  uint64_t address = memory->HeapAlloc(
+      0, kWorkingSetSize, MEMORY_FLAG_PHYSICAL, 2 * 1024 * 1024);
+  if (!address) {
+    printf("  unable to allocate the working set\n");
+    delete memory;
+    return 1;
+  }
+  uint8_t* base = memory->Translate(address);
+
+  // Touch every page so the sweep doesn't pay for first-touch faults. Any
+  // pages the heap's clear already faulted in make this cheaper.
+  double start = xe_pal_now();
+  for (size_t offset = 0; offset < kWorkingSetSize; offset += 4096) {
+    base[offset]++;
+  }
+  config.touch_elapsed = xe_pal_now() - start;
+  config.huge_page_kb = QueryHugePageKB();
+
+  // Random cache-line reads over the whole set, the way guest code walking
+  // big structures goes through membase + address.
+  TLBMissCounter counter;
+  BenchmarkRandom random(0x1234);
+  uint32_t sum = 0;
+  counter.Start();
+  start = xe_pal_now();
+  for (uint32_t n = 0; n < kAccessCount; n++) {
+    size_t offset = ((size_t)random.Next() * 64) % kWorkingSetSize;
+    sum += *(uint32_t*)(base + offset);
+  }
+  config.sweep_elapsed = xe_pal_now() - start;
+  config.tlb_misses = counter.Stop();
+  if (!counter.is_available()) {
+    config.tlb_misses = (uint64_t)-1;
+  }
+  if (sum == 0xFFFFFFFF) {
+    // Keeps the loads from being optimized away.
+    printf("  ...\n");
+  }
+
+  memory->HeapFree(address, kWorkingSetSize);
+  delete memory;
+  return 0;
+}
+
+}  // namespace
+
+
+int RunMemorySweepBenchmark() {
+  printf("Memory sweep benchmark: %u random reads over %u MB of physical "
+         "heap\n", kAccessCount, (uint32_t)(kWorkingSetSize / (1024 * 1024)));
+
+  ScopedFlag<bool> saved_huge_pages(FLAGS_huge_pages);
+  Configuration configs[] = {
+    { "4k pages",   false },
+    { "huge pages", true  },
+  };
+  int result = 0;
+  for (size_t n = 0; n < XECOUNT(configs) && !result; n++) {
+    result = RunConfiguration(configs[n]);
+  }
+
+  // TLB misses are only counted where perf events are available; the
+  // huge page column shows how much of the set the host actually backed.
+  printf("  %-12s %10s %10s %14s %12s\n",
+         "config", "touch ms", "ns/read", "dTLB misses", "huge MB");
+  for (size_t n = 0; n < XECOUNT(configs); n++) {
+    const Configuration& config = configs[n];
+    char misses[32];
+    if (config.tlb_misses == (uint64_t)-1) {
+      snprintf(misses, XECOUNT(misses), "n/a");
+    } else {
+      snprintf(misses, XECOUNT(misses), "%llu",
+               (unsigned long long)config.tlb_misses);
+    }
+    printf("  %-12s %10.2f %10.2f %14s %12llu\n",
+           config.name,
+           config.touch_elapsed * 1000.0,
+           config.sweep_elapsed * 1000000000.0 / kAccessCount,
+           misses,
+           (unsigned long long)(config.huge_page_kb / 1024));
+  }
+  if (configs[0].tlb_misses != (uint64_t)-1 && configs[1].tlb_misses) {
+    printf("  dTLB miss reduction: %.2fx\n",
+           (double)configs[0].tlb_misses / configs[1].tlb_misses);
+  }
+  return result;
+}
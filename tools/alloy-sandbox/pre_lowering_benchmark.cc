@@ -0,0 +1,285 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <benchmarks.h>
+
+#include <alloy/backend/machine_info.h>
+#include <alloy/compiler/compiler.h>
+#include <alloy/compiler/compiler_passes.h>
+#include <alloy/hir/hir_builder.h>
+
+#include <unordered_map>
+
+using namespace alloy;
+using namespace alloy::backend;
+using namespace alloy::compiler;
+using namespace alloy::hir;
+
+
+namespace {
+
+const uint32_t kFunctionCount = 64;
+const uint32_t kFunctionLength = 256;
+const uint32_t kLoadLatency = 4;
+
+// Registers available to the allocator; matches the x64 backend.
+const uint32_t kGPRCount = 5;
+const uint32_t kXMMCount = 10;
+
+class BlockGenerator {
+public:
+  BlockGenerator(uint32_t seed) : random_(seed) {}
+
+  // Emits a single block shaped like translated guest code: registers
+  // loaded from the context, a guest memory load or two, ALU work and
+  // stores back to the context.
+  void Generate(HIRBuilder* builder, uint32_t length) {
+    Value* pool[16];
+    size_t pool_size = 0;
+    for (uint32_t n = 0; n < length; n++) {
+      uint32_t kind = Next() % 20;
+      Value* value = NULL;
+      if (kind < 5 || pool_size < 2) {
+        value = builder->LoadContext(RegOffset(), INT32_TYPE);
+      } else if (kind < 8) {
+        Value* address = builder->LoadContext(RegOffset(), INT64_TYPE);
+        value = builder->Load(address, INT32_TYPE);
+      } else if (kind < 18) {
+        Value* a = pool[Next() % pool_size];
+        Value* b = pool[Next() % pool_size];
+        if (kind == 8) {
+          a = builder->LoadConstant((int32_t)(Next() & 0xFF));
+        }
+        switch (Next() % 6) {
+        default:
+        case 0: value = builder->Add(a, b); break;
+        case 1: value = builder->Sub(a, b); break;
+        case 2: value = builder->Xor(a, b); break;
+        case 3: value = builder->And(a, b); break;
+        case 4: value = builder->Or(a, b); break;
+        case 5: value = builder->Mul(a, b); break;
+        }
+      } else {
+        Value* a = pool[Next() % pool_size];
+        Value* b = pool[Next() % pool_size];
+        if (kind == 18) {
+          builder->StoreContext(RegOffset(), a);
+        } else {
+          builder->StoreContext(
+              RegOffset(),
+              builder->CompareSLT(builder->LoadConstant((int32_t)4), b));
+        }
+      }
+      if (value) {
+        // Most values are short lived; keep a small window of them.
+        if (pool_size < XECOUNT(pool)) {
+          pool[pool_size++] = value;
+        } else {
+          pool[Next() % pool_size] = value;
+        }
+      }
+    }
+    for (size_t n = 0; n < pool_size; n++) {
+      builder->StoreContext(n * 8, pool[n]);
+    }
+    builder->Return();
+  }
+
+private:
+  uint32_t Next() {
+    return random_.Next();
+  }
+  size_t RegOffset() {
+    return (Next() % 32) * 8;
+  }
+
+  BenchmarkRandom random_;
+};
+
+typedef struct {
+  const char* name;
+  bool        canonicalize;
+  bool        schedule;
+  uint64_t    instr_count;
+  uint64_t    mov_count;
+  uint64_t    cycles;
+  uint64_t    compile_ns;
+} Configuration;
+
+bool IsTwoAddress(Instr* i) {
+  switch (i->opcode->num) {
+  case OPCODE_ADD:
+  case OPCODE_SUB:
+  case OPCODE_MUL:
+  case OPCODE_AND:
+  case OPCODE_OR:
+  case OPCODE_XOR:
+    return true;
+  default:
+    return false;
+  }
+}
+
+uint32_t GetLatency(Instr* i) {
+  switch (i->opcode->num) {
+  case OPCODE_LOAD:
+  case OPCODE_LOAD_CONTEXT:
+  case OPCODE_LOAD_LOCAL:
+    return kLoadLatency;
+  case OPCODE_MUL:
+    return 3;
+  default:
+    return 1;
+  }
+}
+
+// Estimates what the x64 lowering would emit for the allocated HIR and
+// runs it through a simple in-order, single-issue pipeline model.
+void Measure(HIRBuilder* builder, Configuration& config) {
+  std::unordered_map<Value*, uint64_t> ready_at;
+  uint64_t cycle = 0;
+  auto block = builder->first_block();
+  while (block) {
+    auto i = block->instr_head;
+    while (i) {
+      if (i->opcode->flags & OPCODE_FLAG_IGNORE) {
+        i = i->next;
+        continue;
+      }
+      config.instr_count++;
+
+      // Copies needed to get src1 into dest's register first, or to
+      // materialize a constant the encoding can't take as src1.
+      uint32_t signature = i->opcode->signature;
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V &&
+          GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        Value* src1 = i->src1.value;
+        if (src1->IsConstant() ||
+            (IsTwoAddress(i) && i->dest &&
+             (i->dest->reg.set != src1->reg.set ||
+              i->dest->reg.index != src1->reg.index))) {
+          config.mov_count++;
+          config.instr_count++;
+          cycle++;
+        }
+      }
+
+      uint64_t issue = cycle + 1;
+      Value* srcs[3] = { NULL, NULL, NULL };
+      if (GET_OPCODE_SIG_TYPE_SRC1(signature) == OPCODE_SIG_TYPE_V) {
+        srcs[0] = i->src1.value;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC2(signature) == OPCODE_SIG_TYPE_V) {
+        srcs[1] = i->src2.value;
+      }
+      if (GET_OPCODE_SIG_TYPE_SRC3(signature) == OPCODE_SIG_TYPE_V) {
+        srcs[2] = i->src3.value;
+      }
+      for (size_t n = 0; n < XECOUNT(srcs); n++) {
+        auto it = srcs[n] ? ready_at.find(srcs[n]) : ready_at.end();
+        if (it != ready_at.end()) {
+          issue = std::max(issue, it->second);
+        }
+      }
+      cycle = issue;
+      if (i->dest) {
+        ready_at[i->dest] = issue + GetLatency(i);
+      }
+      i = i->next;
+    }
+    block = block->next;
+  }
+  config.cycles += cycle;
+}
+
+int RunConfiguration(const MachineInfo* machine_info, Configuration& config) {
+  Compiler* compiler = new Compiler(NULL);
+  if (config.canonicalize) {
+    compiler->AddPass(new passes::X86CanonicalizationPass());
+  }
+  if (config.schedule) {
+    compiler->AddPass(new passes::InstructionSchedulingPass(machine_info));
+  }
+  compiler->AddPass(new passes::RegisterAllocationPass(machine_info));
+
+  int result = 0;
+  HIRBuilder* builder = new HIRBuilder();
+  for (uint32_t n = 0; n < kFunctionCount && !result; n++) {
+    builder->Reset();
+    BlockGenerator generator(0x5678 + n);
+    generator.Generate(builder, kFunctionLength);
+    result = compiler->Compile(builder);
+    if (!result) {
+      Measure(builder, config);
+    }
+  }
+  delete builder;
+
+  Compiler::PassTimingList timings;
+  compiler->GetPassTimings(timings);
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    config.compile_ns += it->total_ns;
+  }
+  delete compiler;
+  return result;
+}
+
+}  // namespace
+
+
+int RunPreLoweringBenchmark() {
+  printf("Pre-lowering benchmark: %u blocks of %u operations, "
+         "%u GPRs, load latency %u\n",
+         kFunctionCount, kFunctionLength, kGPRCount, kLoadLatency);
+
+  MachineInfo machine_info;
+  xe_zero_struct(&machine_info, sizeof(machine_info));
+  machine_info.register_sets[0] = {
+    0,
+    "gpr",
+    MachineInfo::RegisterSet::INT_TYPES,
+    kGPRCount,
+  };
+  machine_info.register_sets[1] = {
+    1,
+    "xmm",
+    MachineInfo::RegisterSet::FLOAT_TYPES |
+    MachineInfo::RegisterSet::VEC_TYPES,
+    kXMMCount,
+  };
+  machine_info.two_address_ops = true;
+  machine_info.load_latency = kLoadLatency;
+
+  Configuration configs[] = {
+    { "none",         false, false },
+    { "canonicalize", true,  false },
+    { "schedule",     false, true  },
+    { "both",         true,  true  },
+  };
+  int result = 0;
+  for (size_t n = 0; n < XECOUNT(configs) && !result; n++) {
+    result = RunConfiguration(&machine_info, configs[n]);
+  }
+
+  // Instruction counts include the movs and spill code; cycles are from
+  // the pipeline model, so only relative numbers mean anything.
+  printf("  %-14s %10s %8s %10s %8s %10s\n",
+         "config", "instrs", "movs", "cycles", "speedup", "compile ms");
+  for (size_t n = 0; n < XECOUNT(configs); n++) {
+    const Configuration& config = configs[n];
+    printf("  %-14s %10llu %8llu %10llu %7.2fx %10.2f\n",
+           config.name,
+           (unsigned long long)config.instr_count,
+           (unsigned long long)config.mov_count,
+           (unsigned long long)config.cycles,
+           config.cycles ? (double)configs[0].cycles / config.cycles : 0.0,
+           config.compile_ns / 1000000.0);
+  }
+  return result;
+}
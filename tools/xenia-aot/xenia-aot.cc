@@ -0,0 +1,190 @@
+/**
+ ******************************************************************************
+ * Xenia : Xbox 360 Emulator Research Project                                 *
+ ******************************************************************************
+ * Copyright 2014 Ben Vanik. All rights reserved.                             *
+ * Released under the BSD license - see LICENSE in the root for more details. *
+ ******************************************************************************
+ */
+
+#include <xenia/xenia.h>
+#include <alloy/alloy.h>
+
+#include <alloy/runtime/compile_queue.h>
+#include <xenia/cpu/xenon_runtime.h>
+#include <xenia/cpu/xex_module.h>
+#include <xenia/kernel/util/xex2.h>
+
+#include <gflags/gflags.h>
+
+#include <algorithm>
+#include <thread>
+
+using namespace alloy;
+using namespace alloy::compiler;
+using namespace alloy::runtime;
+using namespace xe;
+using namespace xe::cpu;
+
+
+DEFINE_string(target, "",
+    "Specifies the target .xex to precompile.");
+DEFINE_int32(threads, 0,
+    "Number of compiler threads, or 0 for one per core.");
+
+DECLARE_int32(runtime_compile_threads);
+DECLARE_string(runtime_backend);
+DECLARE_string(translation_cache_path);
+
+
+namespace {
+
+void PrintTimings(frontend::Frontend* frontend, double elapsed) {
+  Compiler::PassTimingList timings;
+  frontend->GetTimings(timings);
+
+  uint64_t total_ns = 0;
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    total_ns += it->total_ns;
+  }
+  printf("\n%-28s %10s %10s %12s %12s %12s %7s\n",
+         "Stage", "Runs", "Changed", "Instr delta",
+         "Total (ms)", "Avg (us)", "%");
+  for (auto it = timings.begin(); it != timings.end(); ++it) {
+    printf("%-28s %10u %10u %12lld %12.2f %12.2f %6.2f%%\n",
+           it->name, it->run_count, it->changed_count,
+           (long long)it->instr_delta,
+           it->total_ns / 1000000.0,
+           it->run_count ? it->total_ns / 1000.0 / it->run_count : 0.0,
+           total_ns ? 100.0 * it->total_ns / total_ns : 0.0);
+  }
+  // Summed across threads, so may exceed the wall time.
+  printf("%-28s %34s %12.2f\n", "Total (all threads)", "",
+         total_ns / 1000000.0);
+  printf("%-28s %34s %12.2f\n", "Wall time", "", elapsed * 1000.0);
+}
+
+}  // namespace
+
+
+int xenia_aot(int argc, xechar_t** argv) {
+  int result_code = 1;
+
+  Emulator* emulator = NULL;
+  XenonRuntime* runtime = NULL;
+  xe_mmap_ref mmap = NULL;
+  xe_xex2_ref xex = NULL;
+  XexModule* module = NULL;
+  XexModule* xex_module = NULL;
+  X_STATUS result;
+
+  // Grab path from the flag or unnamed argument.
+  if (!FLAGS_target.size() && argc < 2) {
+    google::ShowUsageWithFlags("xenia-aot");
+    XEFATAL("Pass a .xex file to precompile.");
+    return 1;
+  }
+  const xechar_t* path = NULL;
+  xechar_t buffer[XE_MAX_PATH];
+  if (FLAGS_target.size()) {
+    XEIGNORE(xestrwiden(buffer, XECOUNT(buffer), FLAGS_target.c_str()));
+    path = buffer;
+  } else {
+    path = argv[1];
+  }
+
+  xechar_t abs_path[XE_MAX_PATH];
+  xe_path_get_absolute(path, abs_path, XECOUNT(abs_path));
+  char abs_path_a[XE_MAX_PATH];
+#if XE_WCHAR
+  XEIGNORE(xestrnarrow(abs_path_a, XECOUNT(abs_path_a), abs_path));
+#else
+  XEIGNORE(xestrcpya(abs_path_a, XECOUNT(abs_path_a), abs_path));
+#endif
+  const char* file_name = xestrrchra(abs_path_a, (char)XE_PATH_SEPARATOR);
+  file_name = file_name ? file_name + 1 : abs_path_a;
+
+  xe_pal_options_t pal_options;
+  xe_zero_struct(&pal_options, sizeof(pal_options));
+  XEEXPECTZERO(xe_pal_init(pal_options));
+
+  // Default the cache to live next to the module.
+  if (!FLAGS_translation_cache_path.size()) {
+    FLAGS_translation_cache_path = std::string(abs_path_a) + ".xtc";
+  }
+  FLAGS_runtime_compile_threads = FLAGS_threads ?
+      FLAGS_threads : std::max(1u, std::thread::hardware_concurrency());
+  // Only IVM output can be cached, and "any" would pick x64 first.
+  if (FLAGS_runtime_backend == "any") {
+    FLAGS_runtime_backend = "ivm";
+  }
+
+  emulator = new Emulator(XT(""));
+  XEEXPECTNOTNULL(emulator);
+  result = emulator->Setup();
+  if (XFAILED(result)) {
+    XELOGE("Failed to setup emulator: %.8X", result);
+    XEFAIL();
+  }
+  runtime = emulator->processor()->runtime();
+  if (!runtime->backend()->translation_cache_version()) {
+    XELOGE("Backend %s can't be cached; use --runtime_backend=ivm",
+           FLAGS_runtime_backend.c_str());
+    XEFAIL();
+  }
+
+  // Load the module without launching it. Imports are resolved against the
+  // HLE kernel exactly as they would be at runtime, so the code hashes match.
+  mmap = xe_mmap_open(kXEFileModeRead, abs_path, 0, 0);
+  if (!mmap) {
+    XELOGE("Unable to open %s", abs_path_a);
+    XEFAIL();
+  }
+  xe_xex2_options_t xex_options;
+  xe_zero_struct(&xex_options, sizeof(xex_options));
+  xex = xe_xex2_load(emulator->memory(),
+                     xe_mmap_get_addr(mmap), xe_mmap_get_length(mmap),
+                     xex_options);
+  XEEXPECTNOTNULL(xex);
+  module = new XexModule(runtime);
+  XEEXPECTZERO(module->Load(file_name, abs_path_a, xex));
+  XEEXPECTZERO(runtime->AddModule(module));
+  // Owned by the runtime now.
+  xex_module = module;
+  module = NULL;
+
+  {
+    printf("Precompiling %s with %d threads into %s\n",
+           file_name, FLAGS_runtime_compile_threads,
+           FLAGS_translation_cache_path.c_str());
+
+    // Everything declared gets queued; callees found while translating are
+    // queued as they are discovered.
+    double start = xe_pal_now();
+    size_t function_count = xex_module->DeclareAllFunctions();
+    CompileQueue* compile_queue = runtime->compile_queue();
+    compile_queue->WaitForIdle();
+    double elapsed = xe_pal_now() - start;
+
+    printf("%u functions found statically, %u compiled, %u failed, "
+           "%u skipped in %.2fs\n",
+           (uint32_t)function_count,
+           compile_queue->compiled_count(), compile_queue->failed_count(),
+           compile_queue->skipped_count(), elapsed);
+    PrintTimings(runtime->frontend(), elapsed);
+  }
+
+  result_code = 0;
+XECLEANUP:
+  delete module;
+  if (xex) {
+    xe_xex2_release(xex);
+  }
+  // Writes out the translation cache.
+  delete emulator;
+  if (mmap) {
+    xe_mmap_release(mmap);
+  }
+  return result_code;
+}
+XE_MAIN_THUNK(xenia_aot, "xenia-aot some.xex");